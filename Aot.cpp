@@ -0,0 +1,107 @@
+#include "Aot.h"
+
+#include <vector>
+
+//* Function-local: generated translation units register from static initializers,
+//* in whatever order the linker put them
+static std::vector<const AotProgram *> &registry()
+{
+    static std::vector<const AotProgram *> programs;
+    return programs;
+}
+
+bool Aot::add(const AotProgram *program)
+{
+    registry().push_back(program);
+    return true;
+}
+
+const AotProgram *Aot::find(const uint8_t *rom, size_t size, QuirkProfile quirks)
+{
+    for (const AotProgram *program : registry()) {
+        if (program->quirks == quirks && program->romSize == size && !memcmp(program->rom, rom, size)) {
+            return program;
+        }
+    }
+    return nullptr;
+}
+
+size_t Aot::count()
+{
+    return registry().size();
+}
+
+const AotProgram *Aot::program(size_t index)
+{
+    return index < registry().size() ? registry()[index] : nullptr;
+}
+
+bool Aot::matches(const Chip8 &chip8, const AotProgram &program)
+{
+    if (chip8.quirks != program.quirks) {
+        return false;
+    }
+
+    //* Only the code has to be there: data in the ROM's range may have been written since
+    for (unsigned addr = START_LOCATION; addr < START_LOCATION + program.romSize; addr++) {
+        if (program.covers(addr) && chip8.mem[addr] != program.rom[addr - START_LOCATION]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void Aot::run(Chip8 &chip8, unsigned cycles)
+{
+    const AotProgram &program = *chip8.program;
+
+    while (cycles > 0) {
+        if (chip8.aotStatus == Chip8::AOT_READY && program.translated(chip8.pc)) {
+            AotCpu cpu;
+            memcpy(cpu.V, chip8.V, sizeof(cpu.V));
+            memcpy(cpu.stack, chip8.stack, sizeof(cpu.stack));
+            cpu.I = chip8.I;
+            cpu.pc = chip8.pc;
+            cpu.sp = chip8.sp;
+            cpu.delayTimer = chip8.delayTimer;
+            cpu.soundTimer = chip8.soundTimer;
+            cpu.drew = false;
+            cpu.modified = false;
+            cpu.dirtyRows = 0;
+            cpu.mem = chip8.mem;
+            cpu.gfx = chip8.gfx;
+            cpu.key = chip8.key;
+            cpu.chip8 = &chip8;
+
+            unsigned left = program.run(cpu, cycles);
+
+            memcpy(chip8.V, cpu.V, sizeof(cpu.V));
+            memcpy(chip8.stack, cpu.stack, sizeof(cpu.stack));
+            chip8.I = cpu.I;
+            chip8.pc = cpu.pc;
+            chip8.sp = cpu.sp;
+            chip8.delayTimer = cpu.delayTimer;
+            chip8.soundTimer = cpu.soundTimer;
+            chip8.dirtyRows |= cpu.dirtyRows;
+            chip8.updateScreen |= cpu.drew;
+            chip8.instructionCount += cycles - left;
+            cycles = left;
+            continue;
+        }
+
+        //* Outside the translated code (or after a write over it): one instruction at a time
+        chip8.emulateCycle();
+        cycles--;
+    }
+}
+
+uint8_t Aot::random(Chip8 *chip8)
+{
+    return chip8->rng.byte();
+}
+
+bool Aot::store(Chip8 *chip8, uint16_t addr, uint8_t value)
+{
+    chip8->writeMem(addr, value);
+    return chip8->aotStatus != Chip8::AOT_READY;
+}
@@ -0,0 +1,111 @@
+#ifndef _AOT_H
+#define _AOT_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+#include "Chip8.h"
+
+//* Runtime of ROMs translated ahead of time by chip8c. A translation unit emitted by
+//* chip8c holds one function per basic block of the code reachable from
+//* START_LOCATION, a dispatcher over them, and an AotProgram describing the ROM
+//* image it came from. Chip8::attachProgram() makes runFrame use it for as long as
+//* the translated bytes in RAM are the ones of the image. Indirect jumps to code the
+//* analysis didn't reach, Fx0A and invalid opcodes go back to the interpreter, and
+//* a write over translated code drops the translation until the next load().
+
+//* The machine as translated code sees it, copied in and out around each run. Generated
+//* code works on it in place: at 10 instructions a frame, a register-allocated copy
+//* cost more to set up than it saved.
+struct AotCpu {
+    uint8_t     V[16];
+    uint16_t    stack[16];
+    uint16_t    I;
+    uint16_t    pc;
+    uint8_t     sp;
+    uint8_t     delayTimer;
+    uint8_t     soundTimer;
+    bool        drew;           // CLS or DRW ran, the frontend has something to show
+    bool        modified;       // A store hit translated code, leave now
+    uint32_t    dirtyRows;
+    const uint8_t *mem;         // Writes go through Aot::store
+    uint64_t    *gfx;
+    const uint8_t *key;
+    Chip8       *chip8;         // For the few instructions that call out
+};
+
+//* Run translated code from cpu.pc for at most `cycles` instructions. Returns the
+//* cycles left: 0, or more when pc leaves the translated code or cpu.modified is set.
+typedef unsigned (*AotRunFn)(AotCpu &cpu, unsigned cycles);
+
+struct AotProgram {
+    const char      *name;
+    QuirkProfile    quirks;         // Profile the code was specialized for
+    const uint8_t   *rom;           // Image translated, loaded at START_LOCATION
+    size_t          romSize;
+    const uint64_t  *covered;       // 4096-bit map of the bytes read as code
+    const uint64_t  *entries;       // 4096-bit map of the translated instruction addresses
+    unsigned        blocks;         // Basic blocks emitted
+    AotRunFn        run;
+
+    bool covers(uint16_t addr) const { return (covered[(addr & 0xFFF) >> 6] >> (addr & 63)) & 1; }
+    bool translated(uint16_t pc) const { return pc <= 0xFFF && ((entries[pc >> 6] >> (pc & 63)) & 1); }
+};
+
+class Aot {
+public:
+    //* Programs register themselves from their translation unit's static initializer
+    static bool add(const AotProgram *program);
+    //* The registered program translated from exactly this ROM image, or nullptr
+    static const AotProgram *find(const uint8_t *rom, size_t size, QuirkProfile quirks);
+    static size_t count();
+    static const AotProgram *program(size_t index);
+
+    //* Whether chip8's RAM still holds the translated bytes, true also means the profile matches
+    static bool matches(const Chip8 &chip8, const AotProgram &program);
+
+    //* Run exactly `cycles` instructions, same accounting as Chip8::runFrame
+    static void run(Chip8 &chip8, unsigned cycles);
+
+    //* Out-of-line helpers of the generated code
+    static uint8_t random(Chip8 *chip8);
+    //* Write one byte through the interpreter's caches, true if it was translated code
+    static bool store(Chip8 *chip8, uint16_t addr, uint8_t value);
+
+    //* Dxyn, the same row arithmetic as the interpreter
+    template <bool CLIP>
+    static void draw(AotCpu &cpu, uint8_t vx, uint8_t vy, unsigned n)
+    {
+        unsigned x = vx % SCREEN_WIDTH;
+        unsigned y = CLIP ? vy % SCREEN_HEIGHT : vy;
+        unsigned lines = CLIP && y + n > SCREEN_HEIGHT ? SCREEN_HEIGHT - y : n;
+        uint64_t collision = 0;
+
+        for (unsigned line = 0; line < lines; line++) {
+            uint64_t row = (uint64_t)cpu.mem[(cpu.I + line) & 0xFFF] << 56;
+            unsigned index = (y + line) % SCREEN_HEIGHT;
+
+            if (CLIP) {
+                row >>= x;
+            } else {
+                row = (row >> x) | (row << ((SCREEN_WIDTH - x) % SCREEN_WIDTH));
+            }
+            collision |= cpu.gfx[index] & row;
+            cpu.gfx[index] ^= row;
+            cpu.dirtyRows |= 1u << index;
+        }
+
+        cpu.V[0xF] = collision != 0;
+        cpu.drew = true;
+    }
+
+    static void clear(AotCpu &cpu)
+    {
+        memset(cpu.gfx, 0, SCREEN_HEIGHT * sizeof(uint64_t));
+        cpu.dirtyRows = ~0u;
+        cpu.drew = true;
+    }
+};
+
+#endif // _AOT_H
@@ -0,0 +1,112 @@
+#include "Audio.h"
+
+#include <cstring>
+
+bool AudioGate::push(bool on)
+{
+    uint64_t h = head.load(std::memory_order_relaxed);
+
+    if (h - tail.load(std::memory_order_acquire) >= CAPACITY) {
+        overflows.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    gates[h % CAPACITY] = on;
+    head.store(h + 1, std::memory_order_release);
+    return true;
+}
+
+bool AudioGate::pop(bool &on)
+{
+    uint64_t t = tail.load(std::memory_order_relaxed);
+
+    if (head.load(std::memory_order_acquire) == t) {
+        return false;
+    }
+
+    on = gates[t % CAPACITY];
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+}
+
+size_t AudioGate::skip(size_t keep)
+{
+    uint64_t t = tail.load(std::memory_order_relaxed);
+    uint64_t queued = head.load(std::memory_order_acquire) - t;
+
+    if (queued <= keep) {
+        return 0;
+    }
+
+    tail.store(t + queued - keep, std::memory_order_release);
+    return queued - keep;
+}
+
+Buzzer::Buzzer(AudioGate &gate, unsigned rate, unsigned hz, unsigned prefill, unsigned maxQueued,
+    unsigned frequency, int16_t amplitude)
+    : gate(gate), rate(rate), hz(hz), prefill(prefill), maxQueued(maxQueued > prefill ? maxQueued : prefill + 1),
+      amplitude(amplitude)
+{
+    //* Phase is a 32-bit fraction of a period, the top bit picks the half
+    step = (uint32_t)(((uint64_t)frequency << 32) / rate);
+}
+
+void Buzzer::render(int16_t *out, size_t count)
+{
+    size_t done = 0;
+    uint64_t sounding = 0;
+
+    while (done < count) {
+        if (!left) {
+            if (!playing && gate.available() < prefill) {
+                //* Still buffering: silence, the emulated timeline hasn't started here
+                memset(out + done, 0, (count - done) * sizeof(int16_t));
+                break;
+            }
+            playing = true;
+
+            size_t dropped = gate.skip(maxQueued);
+            if (dropped) {
+                frame += dropped;
+                skipped.fetch_add(dropped, std::memory_order_relaxed);
+            }
+
+            bool next;
+            if (!gate.pop(next)) {
+                underruns.fetch_add(1, std::memory_order_relaxed);
+                playing = false;
+                memset(out + done, 0, (count - done) * sizeof(int16_t));
+                break;
+            }
+
+            on = next;
+            left = frameSamples(frame++);
+        }
+
+        size_t run = count - done < left ? count - done : left;
+
+        if (on) {
+            for (size_t i = 0; i < run; i++) {
+                out[done + i] = (phase & 0x80000000u) ? amplitude : -amplitude;
+                phase += step;
+            }
+            sounding += run;
+        } else {
+            //* The phase keeps running so a gate edge never restarts the wave mid-period
+            memset(out + done, 0, run * sizeof(int16_t));
+            phase += step * (uint32_t)run;
+        }
+
+        done += run;
+        left -= run;
+    }
+
+    samples.fetch_add(done, std::memory_order_relaxed);
+    onSamples.fetch_add(sounding, std::memory_order_relaxed);
+}
+
+void NullAudioSink::frameDone(bool on)
+{
+    gate.push(on);
+    buzzer.render(buffer, buzzer.frameSamples(frame++));
+}
@@ -0,0 +1,106 @@
+#ifndef _AUDIO_H
+#define _AUDIO_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+#define AUDIO_RATE 48000
+
+//* Buzzer gates from the emulation thread to the audio side, one per emulated
+//* frame: a lock-free single-producer single-consumer ring. This is the only
+//* parameter the two sides share, the audio callback never touches the Chip8.
+class AudioGate {
+private:
+    static const unsigned CAPACITY = 64;    // Frames, about a second of emulated time
+
+    uint8_t gates[CAPACITY];
+
+    alignas(64) std::atomic<uint64_t> head{0};      // Written by the emulation thread
+    std::atomic<uint64_t> overflows{0};
+    alignas(64) std::atomic<uint64_t> tail{0};      // Written by the audio side
+
+public:
+    //* Emulation side, once per emulated frame. A full ring (audio far behind, e.g.
+    //* turbo) drops the frame and counts it.
+    bool push(bool on);
+
+    //* Audio side
+    bool pop(bool &on);
+    size_t available() const
+    {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_relaxed);
+    }
+    //* Throw away all but `keep` frames, returns how many went
+    size_t skip(size_t keep);
+
+    uint64_t framesOverflowed() const { return overflows.load(std::memory_order_relaxed); }
+};
+
+//* Square-wave synthesis of the gates. Frame n covers samples [n * rate / hz,
+//* (n + 1) * rate / hz) of the output whatever the emulation speed, so every gate
+//* edge lands on the sample the 60Hz timer puts it on.
+//* render() takes no locks and allocates nothing: it runs in the audio callback.
+class Buzzer {
+private:
+    AudioGate &gate;
+    unsigned rate;
+    unsigned hz;
+    unsigned prefill;
+    unsigned maxQueued;
+    int16_t amplitude;
+    uint32_t phase = 0;
+    uint32_t step;
+
+    uint64_t frame = 0;         // Emulated frames started
+    unsigned left = 0;          // Samples left in the current frame
+    bool on = false;
+    bool playing = false;       // Buffered enough to start, cleared by an underrun
+
+    std::atomic<uint64_t> underruns{0};
+    std::atomic<uint64_t> skipped{0};
+    std::atomic<uint64_t> samples{0};
+    std::atomic<uint64_t> onSamples{0};
+
+public:
+    //* prefill: frames to buffer before starting (and again after an underrun), the
+    //* jitter allowance between the emulation thread and the audio device.
+    //* Beyond maxQueued frames queued the oldest are skipped so latency stays bounded.
+    explicit Buzzer(AudioGate &gate, unsigned rate = AUDIO_RATE, unsigned hz = 60, unsigned prefill = 2,
+        unsigned maxQueued = 8, unsigned frequency = 440, int16_t amplitude = 4000);
+
+    //* Fill `count` mono samples
+    void render(int16_t *out, size_t count);
+
+    //* Samples frame n spans
+    unsigned frameSamples(uint64_t n) const { return (n + 1) * rate / hz - n * rate / hz; }
+    unsigned sampleRate() const { return rate; }
+
+    //* The audio side ran out of gates and played silence
+    uint64_t underrunCount() const { return underruns.load(std::memory_order_relaxed); }
+    //* Frames thrown away to catch up with the emulation
+    uint64_t skippedFrames() const { return skipped.load(std::memory_order_relaxed); }
+    uint64_t samplesRendered() const { return samples.load(std::memory_order_relaxed); }
+    uint64_t samplesOn() const { return onSamples.load(std::memory_order_relaxed); }
+};
+
+//* Audio output for headless runs: renders each emulated frame's samples as soon
+//* as its gate is pushed and throws them away, so the counters stay meaningful
+//* without a sound device
+class NullAudioSink {
+private:
+    AudioGate gate;
+    Buzzer buzzer;
+    int16_t buffer[AUDIO_RATE / 50];
+    uint64_t frame = 0;
+
+public:
+    NullAudioSink() : buzzer(gate, AUDIO_RATE, 60, 0) {}
+
+    //* One emulated frame with the buzzer on or off
+    void frameDone(bool on);
+
+    const Buzzer &output() const { return buzzer; }
+};
+
+#endif // _AUDIO_H
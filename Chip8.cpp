@@ -1,9 +1,228 @@
 #include "Chip8.h"
+#include "Aot.h"
+#include "Debugger.h"
+#include "Jit.h"
+#include "Profile.h"
+#include "SaveState.h"
+#include "StateHash.h"
+#include "Trace.h"
 
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
-#include <ctime>
+
+Chip8::Chip8()
+{
+    reset();
+}
+
+Chip8::~Chip8() = default;
+
+bool Chip8::setBackend(Backend backend)
+{
+    if (backend == BACKEND_JIT) {
+        if (!Jit::available()) {
+            return false;
+        }
+
+        std::unique_ptr<Jit> engine(new Jit(*this));
+        if (!engine->ready()) {
+            return false;
+        }
+        jit = std::move(engine);
+    } else {
+        jit.reset();
+    }
+
+    this->backend = backend;
+    return true;
+}
+
+bool Chip8::jitAvailable()
+{
+    return Jit::available();
+}
+
+//* Eight pixels of a row to eight bytes of 0 or 1, leftmost pixel first in memory
+//* (on a little-endian host, like everything else that is written out as is)
+struct PixelBytes {
+    uint64_t bytes[256];
+
+    constexpr PixelBytes() : bytes()
+    {
+        for (unsigned bits = 0; bits < 256; bits++) {
+            for (unsigned x = 0; x < 8; x++) {
+                bytes[bits] |= (uint64_t)((bits >> (7 - x)) & 1) << (8 * x);
+            }
+        }
+    }
+};
+static constexpr PixelBytes pixelBytes;
+
+void Chip8::frameBytes(uint8_t out[SCREEN_WIDTH * SCREEN_HEIGHT]) const
+{
+    for (unsigned y = 0; y < SCREEN_HEIGHT; y++) {
+        uint64_t row = gfx[y];
+
+        for (unsigned b = 0; b < SCREEN_WIDTH / 8; b++) {
+            uint64_t bytes = pixelBytes.bytes[(row >> (56 - 8 * b)) & 0xFF];
+            memcpy(&out[y * SCREEN_WIDTH + b * 8], &bytes, sizeof(bytes));
+        }
+    }
+}
+
+bool Chip8::stateEquals(const Chip8 &other) const
+{
+    return !memcmp(mem, other.mem, sizeof(mem))
+        && !memcmp(V, other.V, sizeof(V))
+        && I == other.I
+        && pc == other.pc
+        && sp == other.sp
+        && !memcmp(stack, other.stack, sizeof(stack))
+        && delayTimer == other.delayTimer
+        && soundTimer == other.soundTimer
+        && !memcmp(gfx, other.gfx, sizeof(gfx))
+        && rng == other.rng
+        && keyWait.held == other.keyWait.held
+        && keyWait.state == other.keyWait.state
+        && keyWait.key == other.keyWait.key;
+}
+
+void Chip8::reset()
+{
+    if (profiler) {
+        //* Whatever was called before the reset will never return
+        profiler->suspend(pc, instructionCount);
+    }
+
+    memset(mem, 0, sizeof(mem));
+    memcpy(mem, sprites, sizeof(sprites));
+    memset(V, 0, sizeof(V));
+    memset(stack, 0, sizeof(stack));
+    memset(gfx, 0, sizeof(gfx));
+    dirtyRows = ~0u;
+    memset(key, 0, sizeof(key));
+    keyWait = KeyWait();
+
+    I = 0;
+    pc = START_LOCATION;
+    sp = 0;
+    delayTimer = 0;
+    soundTimer = 0;
+    memset(decoded, 0, sizeof(decoded));
+    if (jit) {
+        jit->flush();
+    }
+
+    updateScreen = false;
+    fileSize = 0;
+    instructionCount = 0;
+    idleSkipped = 0;
+    aotStatus = AOT_UNCHECKED;
+    if (hashing) {
+        rehash();
+    }
+    if (profiler) {
+        profiler->resume(pc, 0);
+    }
+}
+
+void Chip8::getRegisters(Registers &registers) const
+{
+    memcpy(registers.V, V, sizeof(V));
+    memcpy(registers.stack, stack, sizeof(stack));
+    registers.I = I;
+    registers.pc = pc;
+    registers.keys = keyMask();
+    registers.sp = sp;
+    registers.delayTimer = delayTimer;
+    registers.soundTimer = soundTimer;
+    memset(registers.reserved, 0, sizeof(registers.reserved));
+}
+
+void Chip8::saveState(SaveState &state) const
+{
+    state.magic = SAVE_STATE_MAGIC;
+    state.version = SAVE_STATE_VERSION;
+    state.size = sizeof(SaveState);
+
+    memcpy(state.gfx, gfx, sizeof(gfx));
+    rng.getState(state.rng);
+    memcpy(state.stack, stack, sizeof(stack));
+    state.I = I;
+    state.pc = pc;
+    memcpy(state.mem, mem, sizeof(mem));
+    memcpy(state.V, V, sizeof(V));
+    memcpy(state.key, key, sizeof(key));
+    state.sp = sp;
+    state.delayTimer = delayTimer;
+    state.soundTimer = soundTimer;
+    state.keyWaitHeld = keyWait.held;
+    state.keyWaitState = keyWait.state;
+    state.keyWaitKey = keyWait.key;
+    memset(state.reserved, 0, sizeof(state.reserved));
+}
+
+bool Chip8::loadState(const SaveState &state)
+{
+    if (!saveStateValid(state)) {
+        return false;
+    }
+
+    //* Only the rows and the RAM words that differ move the hash and the caches: the
+    //* states a search restores are mostly the same RAM
+    for (unsigned row = 0; row < SCREEN_HEIGHT; row++) {
+        if (hashing && gfx[row] != state.gfx[row]) {
+            contentHash ^= rowKey(row, gfx[row]) ^ rowKey(row, state.gfx[row]);
+        }
+    }
+    for (unsigned word = 0; word < sizeof(mem); word += 8) {
+        uint64_t current, next;
+        memcpy(&current, &mem[word], 8);
+        memcpy(&next, &state.mem[word], 8);
+        if (current == next) {
+            continue;
+        }
+        for (unsigned addr = word; addr < word + 8; addr++) {
+            if (mem[addr] != state.mem[addr]) {
+                if (hashing) {
+                    contentHash ^= memoryKey(addr, mem[addr]) ^ memoryKey(addr, state.mem[addr]);
+                }
+                //* An opcode at addr - 1 also covers this byte
+                decoded[addr].op = OP_DECODE;
+                decoded[(addr - 1) & 0xFFF].op = OP_DECODE;
+            }
+        }
+    }
+
+    memcpy(gfx, state.gfx, sizeof(gfx));
+    rng.setState(state.rng);
+    memcpy(stack, state.stack, sizeof(stack));
+    I = state.I;
+    if (profiler) {
+        profiler->suspend(pc, instructionCount);
+        profiler->resume(state.pc, instructionCount);
+    }
+    pc = state.pc;
+    memcpy(mem, state.mem, sizeof(mem));
+    memcpy(V, state.V, sizeof(V));
+    memcpy(key, state.key, sizeof(key));
+    sp = state.sp;
+    delayTimer = state.delayTimer;
+    soundTimer = state.soundTimer;
+    keyWait.held = state.keyWaitHeld;
+    keyWait.state = state.keyWaitState;
+    keyWait.key = state.keyWaitKey;
+
+    if (jit) {
+        jit->flush();
+    }
+    aotStatus = AOT_UNCHECKED;
+    dirtyRows = ~0u;
+    updateScreen = true;
+
+    return true;
+}
 
 bool Chip8::load(const char *path)
 {
@@ -17,419 +236,1020 @@ bool Chip8::load(const char *path)
     printf("\nLoad: %s\n", path);
 
     fseek(rom, 0, SEEK_END);
-    fileSize = ftell(rom);
+    long size = ftell(rom);
     rewind(rom);
 
-    printf("File size: %.2lfKiB\n\n", (float)fileSize / 1024);
+    //* Anything past MAX_ROM_SIZE would be written beyond the end of mem
+    if (size < 0 || size > MAX_ROM_SIZE) {
+        fprintf(stderr, "ROM does not fit in memory (%ld bytes)\n", size);
+        fclose(rom);
+        return false;
+    }
 
-    fread(&mem[0x200], fileSize, sizeof(uint8_t), rom);
+    printf("File size: %.2lfKiB\n\n", (float)size / 1024);
+
+    uint8_t data[MAX_ROM_SIZE];
+    size_t read = fread(data, sizeof(uint8_t), size, rom);
     fclose(rom);
 
-    return true;
+    return read == (size_t)size && load(data, size);
 }
 
-void Chip8::emulateCycle()
+bool Chip8::load(const uint8_t *rom, size_t size)
 {
-    uint16_t opcode = (mem[pc] << 8) | mem[pc + 1]; // Instruction is 2 bytes each
+    if (size > MAX_ROM_SIZE || findVariantOpcode(rom, size)) {
+        return false;
+    }
+
+    memcpy(&mem[START_LOCATION], rom, size);
+    fileSize = size;
+
+    for (size_t i = 0; i <= size; i++) {
+        invalidate(START_LOCATION + i);
+    }
+    aotStatus = AOT_UNCHECKED;
+    if (hashing) {
+        rehash();
+    }
+
+    return true;
+}
 
-    //! Temporary
-    // if (pc >= fileSize) {
-    //     exit(0);
-    // }
-    x   = (opcode & 0x0F00) >> 8;   // Shift 8 bit
-    y   = (opcode & 0x00F0) >> 4;   // Shift 4 bit
-    kk  =  opcode & 0x00FF;
-    nnn =  opcode & 0x0FFF;
+Instruction Chip8::decodeOpcode(uint16_t opcode)
+{
+    Instruction in;
 
-    srand(time(0));
+    in.x   = (opcode & 0x0F00) >> 8;    // Shift 8 bit
+    in.y   = (opcode & 0x00F0) >> 4;    // Shift 4 bit
+    in.n   =  opcode & 0x000F;
+    in.kk  =  opcode & 0x00FF;
+    in.nnn =  opcode & 0x0FFF;
+    in.op  = OP_INVALID;
 
     switch (opcode & 0xF000) {
-        //* 00E-
         case 0x0000:
-            switch(opcode) {
-                case 0x00E0:
-                    //* Clear the display.
-                    memset(gfx, 0, 64 * 32);
-                    updateScreen = true;
-                    pc += 2;
-                    printf("CLS\n");
-                    break;
-                case 0x00EE:
-                    //* Return from a subroutine.
-                    // The interpreter sets the program counter to the address at the top of the stack,
-                    // then subtracts 1 from the stack pointer.
-                    pc = stack[--sp];
-                    pc += 2;
-                    printf("RET\n");
-                    break;
-                //* 0nnn
-                default:
-                    //* Jump to a machine code routine at nnn.
-                    //! Ignored by modern interpreter
-                    printf("SYS \t 0x%.4X (ignored)\n", nnn);
-                    // exit(0);
-                    pc += 2;
-                    break;
+            switch (opcode) {
+                case 0x00E0: in.op = OP_CLS; break;
+                case 0x00EE: in.op = OP_RET; break;
+                default:     in.op = OP_SYS; break;
             }
             break;
-        //* 1nnn
-        case 0x1000:
-            //* Jump to location nnn.
-            //  The interpreter sets the program counter to nnn.
-            pc = nnn;
-            printf("JP \t 0x%X\n", nnn);
-            break;
-        //* 2nnn
-        case 0x2000:
-            //* Call subroutine at nnn.
-            //  The interpreter increments the stack pointer,
-            //  then puts the current PC on the top of the stack.
-            //  The PC is then set to nnn.
-            stack[sp++] = pc;
-            pc = nnn;
-            printf("CALL \t 0x%.4X\n", nnn);
-            break;
-        //* 3xkk
-        case 0x3000:
-            //* Skip next instruction if Vx = kk.
-            //  The interpreter compares register Vx to kk,
-            //  and if they are equal, increments the program counter by 2.
-            if (V[x] == kk) {
-                pc += 2;
+        case 0x1000: in.op = OP_JP; break;
+        case 0x2000: in.op = OP_CALL; break;
+        case 0x3000: in.op = OP_SE_VX_KK; break;
+        case 0x4000: in.op = OP_SNE_VX_KK; break;
+        case 0x5000: in.op = OP_SE_VX_VY; break;
+        case 0x6000: in.op = OP_LD_VX_KK; break;
+        case 0x7000: in.op = OP_ADD_VX_KK; break;
+        case 0x8000:
+            switch (in.n) {
+                case 0x0: in.op = OP_LD_VX_VY; break;
+                case 0x1: in.op = OP_OR; break;
+                case 0x2: in.op = OP_AND; break;
+                case 0x3: in.op = OP_XOR; break;
+                case 0x4: in.op = OP_ADD_VX_VY; break;
+                case 0x5: in.op = OP_SUB; break;
+                case 0x6: in.op = OP_SHR; break;
+                case 0x7: in.op = OP_SUBN; break;
+                case 0xE: in.op = OP_SHL; break;
             }
-            pc += 2;
-            printf("SE \t V%d, 0x%X\n", x, kk);
             break;
-        //* 4xkk
-        case 0x4000:
-            //* Skip next instruction if Vx != kk.
-            //  The interpreter compares register Vx to kk,
-            //  and if they are not equal, increments the program counter by 2.
-            if (V[x] != kk) {
-                pc += 2;
+        case 0x9000: in.op = OP_SNE_VX_VY; break;
+        case 0xA000: in.op = OP_LD_I; break;
+        case 0xB000: in.op = OP_JP_V0; break;
+        case 0xC000: in.op = OP_RND; break;
+        case 0xD000: in.op = OP_DRW; break;
+        case 0xE000:
+            switch (in.kk) {
+                case 0x9E: in.op = OP_SKP; break;
+                case 0xA1: in.op = OP_SKNP; break;
             }
-            pc += 2;
-            printf("SNE \t V%d, 0x%X\n", x, kk);
             break;
-        //* 5xy0
-        case 0x5000:
-            //* Skip next instruction if Vx = Vy.
-            //  The interpreter compares register Vx to register Vy,
-            //  and if they are equal, increments the program counter by 2.
-            if (V[x] == V[y]) {
-                pc += 2;
+        case 0xF000:
+            switch (in.kk) {
+                case 0x07: in.op = OP_LD_VX_DT; break;
+                case 0x0A: in.op = OP_LD_VX_K; break;
+                case 0x15: in.op = OP_LD_DT_VX; break;
+                case 0x18: in.op = OP_LD_ST_VX; break;
+                case 0x1E: in.op = OP_ADD_I_VX; break;
+                case 0x29: in.op = OP_LD_F_VX; break;
+                case 0x33: in.op = OP_LD_B_VX; break;
+                case 0x55: in.op = OP_LD_I_VX; break;
+                case 0x65: in.op = OP_LD_VX_I; break;
             }
-            pc += 2;
-            printf("SE \t V%d, V%d\n", x, y);
-            break;
-        //* 6xkk
-        case 0x6000:
-            //* Set Vx = kk.
-            //  The interpreter puts the value kk into register Vx.
-            V[x] = kk;
-            pc += 2;
-            printf("LD \t V%d, 0x%X\n", x, kk);
-            break;
-        //* 7xkk
-        case 0x7000:
-            //* Set Vx = Vx + kk.
-            //  Adds the value kk to the value of register Vx, then stores the result in Vx. 
-            V[x] += kk;
-            pc += 2;
-            printf("ADD \t V%d, 0x%X\n", x, kk);
             break;
-        //* 8xy-
-        case 0x8000:
-            switch (opcode & 0x000F) {
-                case 0:
-                    //* Set Vx = Vy.
-                    //  Stores the value of register Vy in register Vx.
-                    V[x] = V[y];
-                    pc += 2;
-                    printf("LD \t V%d, V%d\n", x, y);
-                    break;
-                case 1:
-                    //* Set Vx = Vx OR Vy.
-                    //  Performs a bitwise OR on the values of Vx and Vy,
-                    //  then stores the result in Vx.
-                    V[x] |= V[y];
-                    pc += 2;
-                    printf("OR \t V%d, V%d\n", x, y);
-                    break;
-                case 2:
-                    //* Set Vx = Vx AND Vy.
-                    //  Performs a bitwise AND on the values of Vx and Vy, then stores the result in Vx.
-                    V[x] &= V[y];
-                    pc += 2;
-                    printf("AND \t V%d, V%d\n", x, y);
-                    break;
-                case 3:
-                    //* Set Vx = Vx XOR Vy.
-                    //  Performs a bitwise exclusive OR on the values of Vx and Vy, then stores the result in Vx.
-                    V[x] ^= V[y];
-                    pc += 2;
-                    printf("XOR \t V%d, V%d\n", x, y);
-                    break;
-                case 4:
-                    //* Set Vx = Vx + Vy, set VF = carry.
-                    //  The values of Vx and Vy are added together.
-                    //  If the result is greater than 8 bits (i.e., > 255,) VF is set to 1, otherwise 0.
-                    //  Only the lowest 8 bits of the result are kept, and stored in Vx.
-                    V[x] += V[y];
-                    V[0xF] = V[y] > (0xFF - V[x]);
-                    pc += 2;
-                    printf("ADD \t V%d, V%d\n", x, y);
-                    break;
-                case 5:
-                    //* Set Vx = Vx - Vy, set VF = NOT borrow.
-                    //  If Vx > Vy, then VF is set to 1, otherwise 0.
-                    //  Then Vy is subtracted from Vx, and the results stored in Vx.
-                    V[0xF] = V[x] > V[y];
-                    V[x] -= V[y];
-                    pc += 2;
-                    printf("SUB \t V%d, V%d\n", x, y);
-                    break;
-                case 6:
-                    //* Set Vx = Vx SHR 1.
-                    //  If the least-significant bit of Vx is 1,
-                    //  then VF is set to 1, otherwise 0. Then Vx is divided by 2.
-                    V[0xF] = V[x] & 0x0001;
-                    V[x] >>= 1;
-                    pc += 2;
-                    printf("SHR \t V%d {, V%d}\n", x, y);
-                    break;
-                case 7:
-                    //* Set Vx = Vy - Vx, set VF = NOT borrow.
-                    //  If Vy > Vx, then VF is set to 1, otherwise 0.
-                    //  Then Vx is subtracted from Vy, and the results stored in Vx.
-                    V[0xF] = V[y] > V[x];
-                    V[x] = V[y] - V[x];
-                    pc += 2;
-                    printf("SUBN \t V%d, V%d\n", x, y);
-                    break;
-                case 0xE:
-                    //* Set Vx = Vx SHL 1.
-                    //  If the most-significant bit of Vx is 1, then VF is set to 1, otherwise to 0.
-                    //  Then Vx is multiplied by 2.
-                    V[0xF] = V[x] >> 7;
-                    V[x] <<= 1;
-                    pc += 2;
-                    printf("SHL \t V%d {, V%d}\n", x, y);
-                    break;
+    }
+
+    return in;
+}
+
+void Chip8::setKeys(uint16_t mask)
+{
+    for (int i = 0; i < 16; i++) {
+        key[i] = (mask >> i) & 1;
+    }
+}
+
+uint16_t Chip8::keyMask() const
+{
+    uint16_t mask = 0;
+
+    for (int i = 0; i < 16; i++) {
+        if (key[i]) {
+            mask |= 1 << i;
+        }
+    }
+    return mask;
+}
+
+bool KeyWait::step(uint16_t down)
+{
+    switch (state) {
+        case KEY_WAIT_NONE:
+            held = down;
+            state = KEY_WAIT_PRESS;
+            return false;
+        case KEY_WAIT_PRESS: {
+            held &= down;
+            uint16_t pressed = down & ~held;
+            if (pressed) {
+                key = __builtin_ctz(pressed);
+                state = KEY_WAIT_RELEASE;
             }
-            break;
-        case 0x9000:
-            //* Skip next instruction if Vx != Vy.
-            //  The values of Vx and Vy are compared, and if they are not equal,
-            //  the program counter is increased by 2.
-            if (V[x] != V[y]) {
-                pc += 2;
+            return false;
+        }
+        default:
+            if ((down >> key) & 1) {
+                return false;
             }
-            pc += 2;
-            printf("SNE \t V%d, V%d\n", x, y);
-            break;
-        case 0xA000:
-            //* Set I = nnn.
-            //  The value of register I is set to nnn.
-            I = nnn;
-            pc += 2;
-            printf("LD \t I, 0x%.4X\n", nnn);
-            break;
-        case 0xB000:
-            //* Jump to location nnn + V0.
-            //  The program counter is set to nnn plus the value of V0.
-            pc = nnn + V[0];
-            printf("JP \t V0, 0x%.4X\n", nnn);
-            break;
-        case 0xC000:
-            //* Set Vx = random byte AND kk.
-            //  The interpreter generates a random number from 0 to 255, which is then ANDed with the value kk.
-            //  The results are stored in Vx.
-            V[x] = (rand() % 255) & kk;
-            pc += 2;
-            printf("RND \t V%d, 0x%X\n", x, kk);
-            break;
-        case 0xD000:
-        {
-            //* Display n-byte sprite starting at memory location I at (Vx, Vy), set VF = collision.
-            //  The interpreter reads n bytes from memory, starting at the address stored in I.
-            //  These bytes are then displayed as sprites on screen at coordinates (Vx, Vy).
-            //  Sprites are XORed onto the existing screen.
-            //  If this causes any pixels to be erased, VF is set to 1, otherwise it is set to 0.
-            //  If the sprite is positioned so part of it is outside the coordinates of the display,
-            //  it wraps around to the opposite side of the screen.
-            unsigned short x = V[(opcode & 0x0F00) >> 8];
-            unsigned short y = V[(opcode & 0x00F0) >> 4];
-            unsigned short height = opcode & 0x000F;
-            unsigned short pixel;
+            state = KEY_WAIT_NONE;
+            return true;
+    }
+}
 
-            V[0xF] = 0;
-            for (int yline = 0; yline < height; yline++)
-            {
-                pixel = mem[I + yline];
-                for(int xline = 0; xline < 8; xline++)
-                {
-                    if((pixel & (0x80 >> xline)) != 0)
-                    {
-                        if(gfx[(x + xline + ((y + yline) * 64))] == 1)
-                        {
-                            V[0xF] = 1;
-                        }
-                        gfx[x + xline + ((y + yline) * 64)] ^= 1;
-                    }
-                }
-            }
+void Chip8::seedRandom(uint64_t seed, unsigned stream)
+{
+    rng.seed(seed);
+    for (unsigned i = 0; i < stream; i++) {
+        rng.jump();
+    }
+}
 
-            updateScreen = true;
-            pc += 2;
-            printf("DRW \t V%d, V%d, 0x%X\n", x, y, opcode & 0x000F);
-            break;
+uint16_t Chip8::fetch(uint16_t addr) const
+{
+    return (mem[addr & 0xFFF] << 8) | mem[(addr + 1) & 0xFFF]; // Instruction is 2 bytes each
+}
+
+void Chip8::invalidate(uint16_t addr)
+{
+    //* An opcode at addr - 1 also covers this byte
+    decoded[addr & 0xFFF].op = OP_DECODE;
+    decoded[(addr - 1) & 0xFFF].op = OP_DECODE;
+
+    if (jit) {
+        jit->invalidate(addr);
+    }
+    if (aotStatus == AOT_READY && program->covers(addr)) {
+        aotStatus = AOT_OFF;
+    }
+}
+
+void Chip8::writeMem(uint16_t addr, uint8_t value)
+{
+    //* Write barrier (compiled out unless CHIP8_DEBUG)
+    if constexpr (DEBUG_ENABLED) {
+        if (debugger) {
+            debugger->stored(pc, addr, mem[addr & 0xFFF], value);
         }
-        //* Ex--
-        case 0xE000:
-            switch (opcode & 0x00FF) {
-                case 0x9E:
-                    //* Skip next instruction if key with the value of Vx is pressed.
-                    //  Checks the keyboard, and if the key corresponding to the value of
-                    //  Vx is currently in the down position, PC is increased by 2.
-                    if (key[V[x]]) {
-                        pc += 2;
-                    }
-                    pc += 2;
-                    printf("SKP \t V%d\n", x);
-                    break;
-                case 0xA1:
-                    //* Skip next instruction if key with the value of Vx is not pressed.
-                    //  Checks the keyboard, and if the key corresponding to the value of
-                    //  Vx is currently in the up position, PC is increased by 2.
-                    if (!key[V[x]]) {
-                        pc += 2;
-                    }
-                    pc += 2;
-                    printf("SKNP \t V%d\n", x);
-                    break;
+    }
+    if (hashing) {
+        contentHash ^= memoryKey(addr, mem[addr & 0xFFF]) ^ memoryKey(addr, value);
+    }
+    mem[addr & 0xFFF] = value;
+    invalidate(addr);
+}
+
+void Chip8::attachTrace(TraceRing *ring)
+{
+    traceRing = TRACE_ENABLED ? ring : nullptr;
+}
+
+void Chip8::attachProfiler(Profiler *attached)
+{
+    if (profiler) {
+        profiler->suspend(pc, instructionCount);
+    }
+
+    profiler = PROFILE_ENABLED ? attached : nullptr;
+    if (profiler) {
+        profiler->resume(pc, instructionCount);
+    }
+}
+
+void Chip8::attachDebugger(Debugger *attached)
+{
+    debugger = DEBUG_ENABLED ? attached : nullptr;
+}
+
+bool Chip8::debugging() const
+{
+    return DEBUG_ENABLED && debugger && debugger->armed();
+}
+
+void Chip8::setStateHashing(bool enabled)
+{
+    hashing = enabled;
+    if (hashing) {
+        rehash();
+    }
+}
+
+void Chip8::rehash()
+{
+    contentHash = 0;
+    for (unsigned addr = 0; addr < sizeof(mem); addr++) {
+        contentHash ^= memoryKey(addr, mem[addr]);
+    }
+    for (unsigned row = 0; row < SCREEN_HEIGHT; row++) {
+        contentHash ^= rowKey(row, gfx[row]);
+    }
+}
+
+uint64_t Chip8::stateHash() const
+{
+    //* A few words, cheaper to hash whole than to track through every register write
+    uint64_t words[13];
+    uint64_t generator[4];
+
+    memcpy(&words[0], V, sizeof(V));
+    memcpy(&words[2], stack, sizeof(stack));
+    words[6] = (uint64_t)I | (uint64_t)pc << 16 | (uint64_t)sp << 32 | (uint64_t)delayTimer << 40
+        | (uint64_t)soundTimer << 48 | (uint64_t)keyWait.state << 56;
+    words[7] = (uint64_t)keyWait.held | (uint64_t)keyWait.key << 16;
+    rng.getState(generator);
+    memcpy(&words[8], generator, sizeof(generator));
+    words[12] = contentHash;
+
+    uint64_t hash = 0;
+    for (uint64_t word : words) {
+        hash = hashMix(hash ^ word) + 0x9E3779B97F4A7C15ull;
+    }
+    return hash;
+}
+
+void Chip8::attachCoverage(uint64_t *bitmap)
+{
+    coverage = bitmap;
+    memset(decoded, 0, sizeof(decoded));
+}
+
+void Chip8::traceStep(uint16_t at, uint16_t opcode)
+{
+    TraceRecord record;
+
+    //* The decoder rebuilds the stack from CALL/RET, give it a snapshot to start from
+    if (traceRing->needsResync()) {
+        for (int half = 0; half < 2; half++) {
+            record.pc = half * 8;
+            record.type = TRACE_STACK;
+            record.sp = sp;
+            memcpy(record.V, &stack[half * 8], sizeof(record.V));
+            traceRing->push(record);
+        }
+    }
+
+    record.pc = at;
+    record.opcode = opcode;
+    record.I = I;
+    record.sp = sp;
+    record.type = TRACE_STEP;
+    memcpy(record.V, V, sizeof(V));
+    traceRing->push(record);
+}
+
+void Chip8::idleSnapshot(IdleSnapshot &snapshot) const
+{
+    //* Compared with memcmp, padding included
+    memset(&snapshot, 0, sizeof(snapshot));
+    memcpy(snapshot.V, V, sizeof(V));
+    memcpy(snapshot.stack, stack, sizeof(stack));
+    snapshot.I = I;
+    snapshot.sp = sp;
+    snapshot.delayTimer = delayTimer;
+    snapshot.soundTimer = soundTimer;
+    snapshot.keyWaitState = keyWait.state;
+    snapshot.keyWaitKey = keyWait.key;
+    snapshot.keyWaitHeld = keyWait.held;
+}
+
+unsigned Chip8::skipIdle(IdleProbe &probe, uint16_t target, uint64_t effects, unsigned cycles)
+{
+    uint64_t period = instructionCount - probe.count;
+    bool repeat = target == probe.target && effects == probe.effects && period <= IDLE_MAX_PERIOD;
+    unsigned skipped = 0;
+
+    if (!repeat || period > cycles) {
+        repeat = false;
+    } else if (probe.cooldown) {
+        //* A loop that does change something (a counter): check it less and less often
+        probe.cooldown--;
+        repeat = false;
+    } else {
+        //* Keys and timers don't change inside one execute(), so the same state at the
+        //* same jump means the same iteration again, and again
+        IdleSnapshot now;
+        idleSnapshot(now);
+        if (!probe.valid) {
+            probe.snapshot = now;
+        } else if (!memcmp(&now, &probe.snapshot, sizeof(now))) {
+            skipped = cycles - cycles % period;
+            instructionCount += skipped;
+            idleSkipped += skipped;
+        } else {
+            probe.misses = probe.misses < IDLE_MAX_COOLDOWN ? probe.misses * 2 + 1 : probe.misses;
+            probe.cooldown = probe.misses;
+            probe.snapshot = now;
+        }
+    }
+
+    if (target != probe.target) {
+        probe.misses = 0;
+        probe.cooldown = 0;
+    }
+    probe.target = target;
+    probe.count = instructionCount;
+    probe.effects = effects;
+    probe.valid = repeat;
+
+    return skipped;
+}
+
+void Chip8::emulateCycle()
+{
+    execute(1);
+}
+
+void Chip8::attachProgram(const AotProgram *attached)
+{
+    program = attached;
+    aotStatus = AOT_UNCHECKED;
+}
+
+bool Chip8::aotReady()
+{
+    if (aotStatus == AOT_UNCHECKED) {
+        aotStatus = Aot::matches(*this, *program) ? AOT_READY : AOT_OFF;
+    }
+    return aotStatus == AOT_READY;
+}
+
+void Chip8::runFrame(unsigned cycles)
+{
+    //* Translated code doesn't trace, profile, debug or hash, those runs stay in the interpreter
+    const bool instrumented = traceRing || profiler || debugging() || hashing;
+
+    if (program && !instrumented && aotReady()) {
+        Aot::run(*this, cycles);
+    } else if (jit && !instrumented && quirks == QUIRKS_LEGACY) {
+        jit->run(*this, cycles);
+    } else {
+        execute(cycles);
+    }
+
+    endFrame();
+}
+
+void Chip8::endFrame()
+{
+    soundGate = soundTimer > 0;
+    tickTimers();
+}
+
+void Chip8::tickTimers()
+{
+    if (delayTimer > 0) {
+        delayTimer--;
+    }
+    if (soundTimer > 0) {
+        soundTimer--;
+    }
+}
+
+void Chip8::execute(unsigned cycles)
+{
+    //* The checked instantiations only exist in CHIP8_DEBUG builds
+    if constexpr (DEBUG_ENABLED) {
+        if (debugging()) {
+            switch (quirks) {
+                case QUIRKS_CHIP8:  run<QUIRKS_CHIP8, true>(cycles); break;
+                case QUIRKS_SCHIP:  run<QUIRKS_SCHIP, true>(cycles); break;
+                case QUIRKS_XOCHIP: run<QUIRKS_XOCHIP, true>(cycles); break;
+                default:            run<QUIRKS_LEGACY, true>(cycles); break;
             }
-            break;
-        case 0xF000:
-            switch (opcode & 0x00FF) {
-                case 0x07:
-                    //* Set Vx = delay timer value.
-                    V[x] = delayTimer;
-                    pc += 2;
-                    printf("LD \t V%d, DT\n", x);
-                    break;
-                case 0x0A:
-                {
-                    //* Wait for a key press, store the value of the key in Vx.
-                    //  All execution stops until a key is pressed,
-                    //  then the value of that key is stored in Vx.
-                    bool key_pressed = false;
-
-                    //* Wait for all key to be released
-                    for (int i = 0; i < 16; i++) {
-                        //* Key still pressed
-                        if (!key[i]) {
-                            V[x] = i;
-                            key_pressed = true;
-                        }
-                    }
-                    
-                    //* If no key pressed, try again
-                    if (!key_pressed) {
-                        return;
-                    }
-
-                    pc += 2;
-                    printf("LD \t V%d, K\n", x);
-                    break;
-                }
-                case 0x15:
-                    //* Set delay timer = Vx.
-                    //  DT is set equal to the value of Vx.
-                    delayTimer = V[x];
-                    pc += 2;
-                    printf("LD \t DT, V%d\n", x);
-                    break;
-                case 0x18:
-                    //* Set sound timer = Vx.
-                    //  ST is set equal to the value of Vx.
-                    soundTimer = V[x];
-                    pc += 2;
-                    printf("LD \t ST, V%d\n", x);
-                    break;
-                case 0x1E:
-                    //* Set I = I + Vx.
-                    //  The values of I and Vx are added, and the results are stored in I.
-                    if(I + V[x] > 0xFFF)
-                        V[0xF] = 1;
-                    else
-                        V[0xF] = 0;
-                    I += V[x];
-                    pc += 2;
-                    printf("ADD \t I, V%d\n", x);
-                    break;
-                case 0x29:
-                    //* Set I = location of sprite for digit Vx.
-                    //  The value of I is set to the location for
-                    //  the hexadecimal sprite corresponding to the value of Vx.
-                    I = V[x] * 0x5;
-                    pc += 2;
-                    printf("LD \t F, V%d\n", x);
-                    break;
-                case 0x33:
-                    //* Store BCD representation of Vx in memory locations I, I+1, and I+2.
-                    //  The interpreter takes the decimal value of Vx,
-                    //  and places the hundreds digit in memory at location in I,
-                    //  the tens digit at location I+1, and the ones digit at location I+2.
-                    mem[I]      = (V[x] / 100) % 10;
-                    mem[I + 1]  = (V[x] / 10) % 10;
-                    mem[I + 2]  = (V[x] / 1) % 10;
-                    pc += 2;
-                    printf("LD \t B, V%d\n", x);
-                    break;
-                case 0x55:
-                    //* Store registers V0 through Vx in memory starting at location I.
-                    //  The interpreter copies the values of
-                    //  registers V0 through Vx into memory, starting at the address in I.
-                    for (size_t i = 0; i <= x; i++) {
-                        mem[I + i] = V[i];
-                    }
-                    pc += 2;
-                    printf("LD \t [I], V%d\n", x);
-                    break;
-                case 0x65:
-                    //* Read registers V0 through Vx from memory starting at location I.
-                    //  The interpreter reads values from memory starting at location I into registers V0 through Vx.
-                    for (size_t i = 0; i <= x; i++) {
-                        V[i] = mem[I + i];
-                    }
-                    pc += 2;
-                    printf("LD \t V%d, [I]\n", x);
-                    break;
+            return;
+        }
+    }
+
+    switch (quirks) {
+        case QUIRKS_CHIP8:  run<QUIRKS_CHIP8, false>(cycles); break;
+        case QUIRKS_SCHIP:  run<QUIRKS_SCHIP, false>(cycles); break;
+        case QUIRKS_XOCHIP: run<QUIRKS_XOCHIP, false>(cycles); break;
+        default:            run<QUIRKS_LEGACY, false>(cycles); break;
+    }
+}
+
+template <QuirkProfile PROFILE, bool DEBUG>
+void Chip8::run(unsigned cycles)
+{
+    constexpr Quirks QUIRKS = QUIRK_TABLE[PROFILE];
+
+    //* Threaded dispatch: every handler jumps straight to the handler of the next
+    //* instruction through the pre-decoded cache, indexed by OpKind
+    static void *const handlers[OP_COUNT] = {
+        &&op_decode,
+        &&op_cls, &&op_ret, &&op_sys, &&op_jp, &&op_call,
+        &&op_se_vx_kk, &&op_sne_vx_kk, &&op_se_vx_vy, &&op_ld_vx_kk, &&op_add_vx_kk,
+        &&op_ld_vx_vy, &&op_or, &&op_and, &&op_xor, &&op_add_vx_vy,
+        &&op_sub, &&op_shr, &&op_subn, &&op_shl, &&op_sne_vx_vy,
+        &&op_ld_i, &&op_jp_v0, &&op_rnd, &&op_drw, &&op_skp, &&op_sknp,
+        &&op_ld_vx_dt, &&op_ld_vx_k, &&op_ld_dt_vx, &&op_ld_st_vx, &&op_add_i_vx,
+        &&op_ld_f_vx, &&op_ld_b_vx, &&op_ld_i_vx, &&op_ld_vx_i,
+        &&op_invalid,
+    };
+
+    const Instruction *in;
+    //* Local copies: byte stores to V would otherwise force a reload of the member.
+    //* Jumps are counted without a branch, into a per-thread scratch table when no
+    //* profiler is attached: the test costs more than the two increments it guards.
+    static thread_local ProfileFlow scratch[PROFILE_ENABLED ? 4096 : 1];
+    Profiler *const prof = profiler;
+    ProfileFlow *const flow = prof ? prof->flows() : scratch;
+
+    //* Traced, profiled and debugged runs account for every instruction, they never skip
+    const bool detectIdle = idleSkip && !traceRing && !prof && !DEBUG;
+    //* Breakpoints, one bit test per instruction
+    const uint64_t *const stops = DEBUG ? debugger->stopBits() : nullptr;
+    uint16_t debugPc = 0;
+    IdleProbe idle;
+    uint64_t effects = 0;       // Anything an idle loop can't do: write RAM, draw, draw a random number
+    uint16_t tracePc = 0;
+    uint16_t traceOpcode = 0;
+
+#define DISPATCH()                              \
+    do {                                        \
+        if (cycles == 0) {                      \
+            return;                             \
+        }                                       \
+        if constexpr (DEBUG) {                  \
+            debugPc = pc;                       \
+            if ((stops[(pc & 0xFFF) >> 6] >> (pc & 63)) & 1 \
+                && debugger->breakAt(*this, pc)) {          \
+                return;                         \
+            }                                   \
+        }                                       \
+        cycles--;                               \
+        instructionCount++;                     \
+        in = &decoded[pc & 0xFFF];              \
+        if constexpr (TRACE_ENABLED) {          \
+            tracePc = pc;                       \
+            traceOpcode = fetch(pc);            \
+        }                                       \
+        goto *handlers[in->op];                 \
+    } while (0)
+
+    //* Completed instruction: trace it (compiled out unless CHIP8_TRACE), report its
+    //* writes to an armed debugger, then go on
+#define NEXT()                                  \
+    do {                                        \
+        if constexpr (TRACE_ENABLED) {          \
+            if (traceRing) {                    \
+                traceStep(tracePc, traceOpcode);\
+            }                                   \
+        }                                       \
+        if constexpr (DEBUG) {                  \
+            if (debugger->stepped(*this, debugPc, *in, PROFILE)) { \
+                return;                         \
+            }                                   \
+        }                                       \
+        DISPATCH();                             \
+    } while (0)
+
+    //* Control leaves the straight line: the only thing the profiler counts per
+    //* instruction (compiled out unless CHIP8_PROFILE)
+#define PROFILE_TRANSFER(from, to)              \
+    do {                                        \
+        if constexpr (PROFILE_ENABLED) {        \
+            flow[(from) & 0xFFF].departures++;  \
+            flow[(to) & 0xFFF].arrivals++;      \
+        }                                       \
+    } while (0)
+
+    DISPATCH();
+
+op_decode:
+    //* First visit of this address (or its bytes were overwritten): decode and retry
+    decoded[pc & 0xFFF] = decodeOpcode(fetch(pc));
+    if (coverage) {
+        coverage[(pc & 0xFFF) >> 6] |= 1ull << (pc & 63);
+    }
+    goto *handlers[in->op];
+
+    //* 00E0
+op_cls:
+    //* Clear the display.
+    effects++;
+    if (hashing) {
+        for (unsigned row = 0; row < SCREEN_HEIGHT; row++) {
+            contentHash ^= rowKey(row, gfx[row]);
+        }
+    }
+    memset(gfx, 0, sizeof(gfx));
+    dirtyRows = ~0u;
+    updateScreen = true;
+    pc += 2;
+    NEXT();
+
+    //* 00EE
+op_ret:
+    //* Return from a subroutine.
+    // The interpreter sets the program counter to the address at the top of the stack,
+    // then subtracts 1 from the stack pointer.
+    if constexpr (PROFILE_ENABLED) {
+        if (prof) {
+            prof->ret(pc, stack[(sp - 1) & 0xF] + 2, instructionCount);
+        }
+    }
+    //  An empty stack wraps around to its last entry rather than read past it.
+    pc = stack[--sp & 0xF];
+    pc += 2;
+    NEXT();
+
+    //* 0nnn
+op_sys:
+    //* Jump to a machine code routine at nnn.
+    //! Ignored by modern interpreter
+    pc += 2;
+    NEXT();
+
+    //* 1nnn
+op_jp:
+    //* Jump to location nnn.
+    //  The interpreter sets the program counter to nnn.
+    //  A jump back may close an idle loop.
+    if (in->nnn <= pc && detectIdle) {
+        cycles -= skipIdle(idle, in->nnn, effects, cycles);
+    }
+    PROFILE_TRANSFER(pc, in->nnn);
+    pc = in->nnn;
+    NEXT();
+
+    //* 2nnn
+op_call:
+    //* Call subroutine at nnn.
+    //  The interpreter increments the stack pointer,
+    //  then puts the current PC on the top of the stack.
+    //  The PC is then set to nnn.
+    if constexpr (PROFILE_ENABLED) {
+        if (prof) {
+            prof->call(pc, in->nnn, instructionCount);
+        }
+    }
+    //  Past 16 levels the stack wraps around, overwriting its oldest entries.
+    stack[sp++ & 0xF] = pc;
+    pc = in->nnn;
+    NEXT();
+
+    //* 3xkk
+op_se_vx_kk:
+    //* Skip next instruction if Vx = kk.
+    //  The interpreter compares register Vx to kk,
+    //  and if they are equal, increments the program counter by 2.
+    if (V[in->x] == in->kk) {
+        PROFILE_TRANSFER(pc, pc + 4);
+        pc += 2;
+    }
+    pc += 2;
+    NEXT();
+
+    //* 4xkk
+op_sne_vx_kk:
+    //* Skip next instruction if Vx != kk.
+    //  The interpreter compares register Vx to kk,
+    //  and if they are not equal, increments the program counter by 2.
+    if (V[in->x] != in->kk) {
+        PROFILE_TRANSFER(pc, pc + 4);
+        pc += 2;
+    }
+    pc += 2;
+    NEXT();
+
+    //* 5xy0
+op_se_vx_vy:
+    //* Skip next instruction if Vx = Vy.
+    //  The interpreter compares register Vx to register Vy,
+    //  and if they are equal, increments the program counter by 2.
+    if (V[in->x] == V[in->y]) {
+        PROFILE_TRANSFER(pc, pc + 4);
+        pc += 2;
+    }
+    pc += 2;
+    NEXT();
+
+    //* 6xkk
+op_ld_vx_kk:
+    //* Set Vx = kk.
+    //  The interpreter puts the value kk into register Vx.
+    V[in->x] = in->kk;
+    pc += 2;
+    NEXT();
+
+    //* 7xkk
+op_add_vx_kk:
+    //* Set Vx = Vx + kk.
+    //  Adds the value kk to the value of register Vx, then stores the result in Vx.
+    V[in->x] += in->kk;
+    pc += 2;
+    NEXT();
+
+    //* 8xy0
+op_ld_vx_vy:
+    //* Set Vx = Vy.
+    //  Stores the value of register Vy in register Vx.
+    V[in->x] = V[in->y];
+    pc += 2;
+    NEXT();
+
+    //* 8xy1
+op_or:
+    //* Set Vx = Vx OR Vy.
+    //  Performs a bitwise OR on the values of Vx and Vy,
+    //  then stores the result in Vx.
+    V[in->x] |= V[in->y];
+    if constexpr (QUIRKS.vfReset) {
+        V[0xF] = 0;
+    }
+    pc += 2;
+    NEXT();
+
+    //* 8xy2
+op_and:
+    //* Set Vx = Vx AND Vy.
+    //  Performs a bitwise AND on the values of Vx and Vy, then stores the result in Vx.
+    V[in->x] &= V[in->y];
+    if constexpr (QUIRKS.vfReset) {
+        V[0xF] = 0;
+    }
+    pc += 2;
+    NEXT();
+
+    //* 8xy3
+op_xor:
+    //* Set Vx = Vx XOR Vy.
+    //  Performs a bitwise exclusive OR on the values of Vx and Vy, then stores the result in Vx.
+    V[in->x] ^= V[in->y];
+    if constexpr (QUIRKS.vfReset) {
+        V[0xF] = 0;
+    }
+    pc += 2;
+    NEXT();
+
+    //* 8xy4
+op_add_vx_vy:
+    //* Set Vx = Vx + Vy, set VF = carry.
+    //  The values of Vx and Vy are added together.
+    //  If the result is greater than 8 bits (i.e., > 255,) VF is set to 1, otherwise 0.
+    //  Only the lowest 8 bits of the result are kept, and stored in Vx.
+    if constexpr (QUIRKS.flagsLast) {
+        uint8_t flag = V[in->y] > (0xFF - V[in->x]);
+        V[in->x] += V[in->y];
+        V[0xF] = flag;
+    } else {
+        V[in->x] += V[in->y];
+        V[0xF] = V[in->y] > (0xFF - V[in->x]);
+    }
+    pc += 2;
+    NEXT();
+
+    //* 8xy5
+op_sub:
+    //* Set Vx = Vx - Vy, set VF = NOT borrow.
+    //  If Vx > Vy, then VF is set to 1, otherwise 0.
+    //  Then Vy is subtracted from Vx, and the results stored in Vx.
+    if constexpr (QUIRKS.flagsLast) {
+        uint8_t flag = V[in->x] >= V[in->y];
+        V[in->x] -= V[in->y];
+        V[0xF] = flag;
+    } else {
+        V[0xF] = V[in->x] > V[in->y];
+        V[in->x] -= V[in->y];
+    }
+    pc += 2;
+    NEXT();
+
+    //* 8xy6
+op_shr:
+    //* Set Vx = Vx SHR 1.
+    //  If the least-significant bit of Vx is 1,
+    //  then VF is set to 1, otherwise 0. Then Vx is divided by 2.
+    if constexpr (QUIRKS.shiftVy) {
+        uint8_t flag = V[in->y] & 0x01;
+        V[in->x] = V[in->y] >> 1;
+        V[0xF] = flag;
+    } else {
+        V[0xF] = V[in->x] & 0x0001;
+        V[in->x] >>= 1;
+    }
+    pc += 2;
+    NEXT();
+
+    //* 8xy7
+op_subn:
+    //* Set Vx = Vy - Vx, set VF = NOT borrow.
+    //  If Vy > Vx, then VF is set to 1, otherwise 0.
+    //  Then Vx is subtracted from Vy, and the results stored in Vx.
+    if constexpr (QUIRKS.flagsLast) {
+        uint8_t flag = V[in->y] >= V[in->x];
+        V[in->x] = V[in->y] - V[in->x];
+        V[0xF] = flag;
+    } else {
+        V[0xF] = V[in->y] > V[in->x];
+        V[in->x] = V[in->y] - V[in->x];
+    }
+    pc += 2;
+    NEXT();
+
+    //* 8xyE
+op_shl:
+    //* Set Vx = Vx SHL 1.
+    //  If the most-significant bit of Vx is 1, then VF is set to 1, otherwise to 0.
+    //  Then Vx is multiplied by 2.
+    if constexpr (QUIRKS.shiftVy) {
+        uint8_t flag = V[in->y] >> 7;
+        V[in->x] = V[in->y] << 1;
+        V[0xF] = flag;
+    } else {
+        V[0xF] = V[in->x] >> 7;
+        V[in->x] <<= 1;
+    }
+    pc += 2;
+    NEXT();
+
+    //* 9xy0
+op_sne_vx_vy:
+    //* Skip next instruction if Vx != Vy.
+    //  The values of Vx and Vy are compared, and if they are not equal,
+    //  the program counter is increased by 2.
+    if (V[in->x] != V[in->y]) {
+        PROFILE_TRANSFER(pc, pc + 4);
+        pc += 2;
+    }
+    pc += 2;
+    NEXT();
+
+    //* Annn
+op_ld_i:
+    //* Set I = nnn.
+    //  The value of register I is set to nnn.
+    I = in->nnn;
+    pc += 2;
+    NEXT();
+
+    //* Bnnn
+op_jp_v0:
+    //* Jump to location nnn + V0.
+    //  The program counter is set to nnn plus the value of V0.
+    //  (SUPER-CHIP: Bxnn, jump to location xnn + Vx.)
+    {
+        uint16_t target = in->nnn + V[QUIRKS.jumpVx ? in->x : 0];
+        PROFILE_TRANSFER(pc, target);
+        pc = target;
+    }
+    NEXT();
+
+    //* Cxkk
+op_rnd:
+    //* Set Vx = random byte AND kk.
+    //  The interpreter generates a random number from 0 to 255, which is then ANDed with the value kk.
+    //  The results are stored in Vx.
+    effects++;
+    V[in->x] = rng.byte() & in->kk;
+    pc += 2;
+    NEXT();
+
+    //* Dxyn
+op_drw:
+{
+    //* Display n-byte sprite starting at memory location I at (Vx, Vy), set VF = collision.
+    //  The interpreter reads n bytes from memory, starting at the address stored in I.
+    //  These bytes are then displayed as sprites on screen at coordinates (Vx, Vy).
+    //  Sprites are XORed onto the existing screen.
+    //  If this causes any pixels to be erased, VF is set to 1, otherwise it is set to 0.
+    //  If the sprite is positioned so part of it is outside the coordinates of the display,
+    //  it wraps around to the opposite side of the screen.
+    //  Each sprite row lands in the top byte of a word and is rotated into place,
+    //  so the wrap on the x axis comes for free.
+    uint64_t drawStart = 0;
+    if constexpr (PROFILE_ENABLED) {
+        if (prof && prof->timeDraw()) {
+            drawStart = profileClock();
+        }
+    }
+
+    //  With clipping quirks the position still wraps, but the sprite stops at the edges:
+    //  a plain shift drops what the rotate would carry over.
+    effects++;
+    unsigned x = V[in->x] % SCREEN_WIDTH;
+    unsigned y = QUIRKS.clipSprites ? V[in->y] % SCREEN_HEIGHT : V[in->y];
+    unsigned lines = QUIRKS.clipSprites && y + in->n > SCREEN_HEIGHT ? SCREEN_HEIGHT - y : in->n;
+    uint64_t collision = 0;
+
+    for (unsigned line = 0; line < lines; line++)
+    {
+        uint64_t row = (uint64_t)mem[(I + line) & 0xFFF] << 56;
+        unsigned index = (y + line) % SCREEN_HEIGHT;
+        uint64_t &target = gfx[index];
+
+        if constexpr (QUIRKS.clipSprites) {
+            row >>= x;
+        } else {
+            row = (row >> x) | (row << ((SCREEN_WIDTH - x) % SCREEN_WIDTH));
+        }
+        collision |= target & row;
+        if (hashing) {
+            contentHash ^= rowKey(index, target) ^ rowKey(index, target ^ row);
+        }
+        target ^= row;
+        dirtyRows |= 1u << index;
+    }
+
+    V[0xF] = collision != 0;
+    updateScreen = true;
+    pc += 2;
+    if constexpr (PROFILE_ENABLED) {
+        if (drawStart) {
+            prof->drawTimed(profileClock() - drawStart);
+        }
+    }
+    NEXT();
+}
+
+    //* Ex9E
+op_skp:
+    //* Skip next instruction if key with the value of Vx is pressed.
+    //  Checks the keyboard, and if the key corresponding to the value of
+    //  Vx is currently in the down position, PC is increased by 2.
+    if (key[V[in->x] & 0xF]) {
+        PROFILE_TRANSFER(pc, pc + 4);
+        pc += 2;
+    }
+    pc += 2;
+    NEXT();
+
+    //* ExA1
+op_sknp:
+    //* Skip next instruction if key with the value of Vx is not pressed.
+    //  Checks the keyboard, and if the key corresponding to the value of
+    //  Vx is currently in the up position, PC is increased by 2.
+    if (!key[V[in->x] & 0xF]) {
+        PROFILE_TRANSFER(pc, pc + 4);
+        pc += 2;
+    }
+    pc += 2;
+    NEXT();
+
+    //* Fx07
+op_ld_vx_dt:
+    //* Set Vx = delay timer value.
+    V[in->x] = delayTimer;
+    if constexpr (PROFILE_ENABLED) {
+        if (prof && delayTimer) {
+            prof->timerPolls++;
+        }
+    }
+    pc += 2;
+    NEXT();
+
+    //* Fx0A
+op_ld_vx_k:
+    //* Wait for a key press, store the value of the key in Vx.
+    //  All execution stops until a key is pressed,
+    //  then the value of that key is stored in Vx.
+    //  Like on the COSMAC VIP, the key counts once it is released again.
+{
+    KeyWait before = keyWait;
+
+    if (!keyWait.step(keyMask())) {
+        if constexpr (PROFILE_ENABLED) {
+            if (prof) {
+                prof->keyWait(pc);
             }
-            break;
-        default:
-            printf("Invalid\n");
-            break;
+        }
+        //* The keypad stays as it is until the next execute(): once a wait step
+        //* changes nothing, the rest of the budget is spent here
+        if (detectIdle && before.state == keyWait.state && before.key == keyWait.key && before.held == keyWait.held) {
+            instructionCount += cycles;
+            idleSkipped += cycles;
+            cycles = 0;
+        }
+        DISPATCH();
+    }
+}
+
+    V[in->x] = keyWait.key;
+    pc += 2;
+    NEXT();
+
+    //* Fx15
+op_ld_dt_vx:
+    //* Set delay timer = Vx.
+    //  DT is set equal to the value of Vx.
+    delayTimer = V[in->x];
+    pc += 2;
+    NEXT();
+
+    //* Fx18
+op_ld_st_vx:
+    //* Set sound timer = Vx.
+    //  ST is set equal to the value of Vx.
+    soundTimer = V[in->x];
+    pc += 2;
+    NEXT();
+
+    //* Fx1E
+op_add_i_vx:
+    //* Set I = I + Vx.
+    //  The values of I and Vx are added, and the results are stored in I.
+    if constexpr (QUIRKS.indexFlag) {
+        if(I + V[in->x] > 0xFFF)
+            V[0xF] = 1;
+        else
+            V[0xF] = 0;
     }
+    I += V[in->x];
+    pc += 2;
+    NEXT();
+
+    //* Fx29
+op_ld_f_vx:
+    //* Set I = location of sprite for digit Vx.
+    //  The value of I is set to the location for
+    //  the hexadecimal sprite corresponding to the value of Vx.
+    I = V[in->x] * 0x5;
+    pc += 2;
+    NEXT();
+
+    //* Fx33
+op_ld_b_vx:
+{
+    //* Store BCD representation of Vx in memory locations I, I+1, and I+2.
+    //  The interpreter takes the decimal value of Vx,
+    //  and places the hundreds digit in memory at location in I,
+    //  the tens digit at location I+1, and the ones digit at location I+2.
+    uint8_t value = V[in->x];
+    effects++;
+    writeMem(I,     (value / 100) % 10);
+    writeMem(I + 1, (value / 10) % 10);
+    writeMem(I + 2, (value / 1) % 10);
+    pc += 2;
+    NEXT();
+}
 
-    printf("Opcode: 0x%.4X\n", opcode);
-    printf("Stack : ");
-    for (auto addr : stack) {
-        printf("0x%.4X ", addr);
+    //* Fx55
+op_ld_i_vx:
+    //* Store registers V0 through Vx in memory starting at location I.
+    //  The interpreter copies the values of
+    //  registers V0 through Vx into memory, starting at the address in I.
+    effects++;
+    for (size_t i = 0; i <= in->x; i++) {
+        writeMem(I + i, V[i]);
     }
-    putchar('\n');
+    if constexpr (QUIRKS.loadStoreI) {
+        I += in->x + 1;
+    }
+    pc += 2;
+    NEXT();
 
-    printf("V : ");
-    for (auto v : V) {
-        printf("%d ", v);
+    //* Fx65
+op_ld_vx_i:
+{
+    //* Read registers V0 through Vx from memory starting at location I.
+    //  The interpreter reads values from memory starting at location I into registers V0 through Vx.
+    uint8_t last = in->x;
+    for (size_t i = 0; i <= last; i++) {
+        V[i] = mem[(I + i) & 0xFFF];
+    }
+    if constexpr (QUIRKS.loadStoreI) {
+        I += last + 1;
     }
-    putchar('\n');
-    printf("I : 0x%.4X\n", I);
+    pc += 2;
+    NEXT();
+}
+
+op_invalid:
+    PROFILE_TRANSFER(pc, pc);
+    NEXT();
 
-    // printf("GFX :\n");
-    // for (auto pixel : gfx) {
-    //     printf("%d ", pixel);
-    // }
-    putchar('\n');
+#undef PROFILE_TRANSFER
+#undef NEXT
+#undef DISPATCH
 }
@@ -3,11 +3,91 @@
 
 #include <cstdint>
 #include <cstddef>
-#include "SDL2/SDL.h"
+#include <memory>
+
+#include "Quirks.h"
+#include "Random.h"
 
 #define START_LOCATION 0x200
+#define MEM_SIZE 4096
+#define MAX_ROM_SIZE (MEM_SIZE - START_LOCATION)
+#define SCREEN_WIDTH 64
+#define SCREEN_HEIGHT 32
+
+//* Handler of a pre-decoded instruction
+enum OpKind : uint8_t {
+    OP_DECODE = 0,      // Not decoded yet, or invalidated by a write
+    OP_CLS, OP_RET, OP_SYS, OP_JP, OP_CALL,
+    OP_SE_VX_KK, OP_SNE_VX_KK, OP_SE_VX_VY, OP_LD_VX_KK, OP_ADD_VX_KK,
+    OP_LD_VX_VY, OP_OR, OP_AND, OP_XOR, OP_ADD_VX_VY,
+    OP_SUB, OP_SHR, OP_SUBN, OP_SHL, OP_SNE_VX_VY,
+    OP_LD_I, OP_JP_V0, OP_RND, OP_DRW, OP_SKP, OP_SKNP,
+    OP_LD_VX_DT, OP_LD_VX_K, OP_LD_DT_VX, OP_LD_ST_VX, OP_ADD_I_VX,
+    OP_LD_F_VX, OP_LD_B_VX, OP_LD_I_VX, OP_LD_VX_I,
+    OP_INVALID,
+    OP_COUNT
+};
+
+//* Instruction with its operands already split out of the opcode
+struct Instruction {
+    uint8_t     op;     // OpKind
+    uint8_t     x;
+    uint8_t     y;
+    uint8_t     n;
+    uint8_t     kk;
+    uint16_t    nnn;
+};
+
+enum KeyWaitState : uint8_t {
+    KEY_WAIT_NONE = 0,      // Not inside Fx0A
+    KEY_WAIT_PRESS,         // Waiting for a key to go down
+    KEY_WAIT_RELEASE        // A key went down, waiting for it to come back up
+};
+
+//* Fx0A: wait for a key to go down, then for that same key to come back up.
+//* Keys already held when the wait starts only count once released and pressed again.
+struct KeyWait {
+    uint16_t    held = 0;   // Down when the wait started and not released since
+    uint8_t     state = KEY_WAIT_NONE;
+    uint8_t     key = 0;    // The key pressed, in KEY_WAIT_RELEASE
+
+    //* One execution of Fx0A with `down` held, true once a key went down and up again
+    bool step(uint16_t down);
+};
+
+//* Execution engine used by runFrame
+enum Backend {
+    BACKEND_INTERPRETER,
+    BACKEND_JIT
+};
+
+//* The CPU as tools see it: everything but RAM and the screen. Fixed-width fields
+//* only, it is also shared with other processes (Server.h).
+struct Registers {
+    uint8_t     V[16];
+    uint16_t    stack[16];
+    uint16_t    I;
+    uint16_t    pc;
+    uint16_t    keys;           // keyMask()
+    uint8_t     sp;
+    uint8_t     delayTimer;
+    uint8_t     soundTimer;
+    uint8_t     reserved[3];
+};
+
+class Jit;
+class Aot;
+struct AotProgram;
+class TraceRing;
+class Profiler;
+class Debugger;
+struct SaveState;
 
 class Chip8 {
+    friend class Jit;
+    friend class Aot;
+    friend class Debugger;
+
 private:
     uint8_t     mem[4096];      // 4 KB of RAM
     uint8_t     V[16];         // 16 general purpose 8-bit registers
@@ -45,21 +125,232 @@ private:
         0xF0, 0x80, 0xF0, 0x80, 0x80    // F
     };
 
-    //* For debugging purpose
-    uint8_t x;
-    uint8_t y;
-    uint8_t kk;
-    uint16_t nnn;
+    //* Decoded instruction cache, keyed by address
+    Instruction decoded[4096];
+
+    Backend backend = BACKEND_INTERPRETER;
+    std::unique_ptr<Jit> jit;
+    QuirkProfile quirks = QUIRKS_LEGACY;
+
+    //* ROM translated ahead of time (Aot.h), checked against RAM on the first frame
+    //* after a load, and dropped by a write over its code
+    enum AotStatus : uint8_t {
+        AOT_UNCHECKED,
+        AOT_READY,
+        AOT_OFF
+    };
+    const AotProgram *program = nullptr;
+    AotStatus aotStatus = AOT_UNCHECKED;
+    bool aotReady();
+
+    //* Interpreter for the current quirk profile
+    void execute(unsigned cycles);
+    //* One instantiation per profile, every quirk resolved at compile time. DEBUG
+    //* ones test breakpoints and report writes, for an armed debugger only.
+    template <QuirkProfile PROFILE, bool DEBUG>
+    void run(unsigned cycles);
+    //* After a frame's instructions: latch the buzzer, tick the timers
+    void endFrame();
+    //* Drop the cached decodes that overlap addr
+    void invalidate(uint16_t addr);
+    void writeMem(uint16_t addr, uint8_t value);
+    uint16_t fetch(uint16_t addr) const;
+
+    TraceRing *traceRing = nullptr;
+    void traceStep(uint16_t at, uint16_t opcode);
+
+    Profiler *profiler = nullptr;
+
+    Debugger *debugger = nullptr;
+    //* The debugger needs the checked interpreter (Debugger.h)
+    bool debugging() const;
+
+    //* Zobrist-style hash of RAM and the screen (StateHash.h), moved by every write
+    //* while hashing is on
+    bool hashing = false;
+    uint64_t contentHash = 0;
+    void rehash();
+
+    //* Addresses executed, marked when they are decoded
+    uint64_t *coverage = nullptr;
+
+    //* Idle loops: everything a loop iteration could change outside RAM and screen
+    struct IdleSnapshot {
+        uint8_t     V[16];
+        uint16_t    stack[16];
+        uint16_t    I;
+        uint8_t     sp;
+        uint8_t     delayTimer;
+        uint8_t     soundTimer;
+        uint8_t     keyWaitState;
+        uint8_t     keyWaitKey;
+        uint16_t    keyWaitHeld;
+    };
+    //* The last backward jump of the running execute()
+    struct IdleProbe {
+        uint16_t    target = 0xFFFF;
+        uint64_t    count = 0;          // instructionCount at that jump
+        uint64_t    effects = 0;        // Writes, draws and RND done before it
+        bool        valid = false;      // snapshot was taken at that jump
+        uint8_t     misses = 0;         // Iterations that changed the state, backing off
+        uint8_t     cooldown = 0;       // Arrivals left before the next check
+        IdleSnapshot snapshot;
+    };
+    static const unsigned IDLE_MAX_PERIOD = 32;
+    static const unsigned IDLE_MAX_COOLDOWN = 63;
+
+    bool idleSkip = true;
+    void idleSnapshot(IdleSnapshot &snapshot) const;
+    //* At a backward jump to target: if the machine is exactly where it was at the
+    //* previous one, every further iteration of the loop is the same, skip as many
+    //* whole ones as fit in cycles, the rest of the current frame and no further.
+    //* Returns the instructions skipped.
+    unsigned skipIdle(IdleProbe &probe, uint16_t target, uint64_t effects, unsigned cycles);
+
+    //* Graphics buffer: one 64-bit word per row, bit 63 is x = 0
+    uint64_t gfx[SCREEN_HEIGHT];
+    //* Rows changed since the frontend last took them, bit n = row n
+    uint32_t dirtyRows = 0;
+
+    //* Source of Cxkk, kept across reset() so a seed chosen before load() holds
+    Random rng;
+
+    KeyWait keyWait;
+
+    bool soundGate = false;
 public:
-    uint8_t gfx[64 * 32];       // Graphics buffer
     bool updateScreen = false;  // Indicator for update the screen
     uint8_t key[16];            //* Keymap
 
+    //* The keypad as a bitmask, bit n = key n down
+    void setKeys(uint16_t mask);
+    uint16_t keyMask() const;
+
     //* For debugging purpose
     size_t fileSize;
 
+    //* Number of instructions executed since the last reset
+    uint64_t instructionCount = 0;
+    //* Of those, instructions of idle loops accounted for without running them
+    uint64_t idleSkipped = 0;
+
+    Chip8();
+    ~Chip8();
+
+    //* Power-on state: clear RAM, registers and screen, install the font sprites
+    void reset();
+
     bool load(const char *path);
+    //* Copy an in-memory ROM image to START_LOCATION, no file I/O involved. False (and
+    //* nothing copied) if it doesn't fit, or runs SUPER-CHIP/XO-CHIP opcodes (findVariantOpcode).
+    bool load(const uint8_t *rom, size_t size);
+
     void emulateCycle();
+    //* Run a fixed number of instructions, one emulated frame, then tick the timers once
+    void runFrame(unsigned cycles);
+    //* Count both timers down by one, the 60Hz tick
+    void tickTimers();
+    //* The buzzer over the last runFrame: ST was non-zero once the frame's instructions ran
+    bool soundOn() const { return soundGate; }
+
+    //* Fast-forward idle loops (spins on DT or the keypad, Fx0A) to the end of the
+    //* frame: the instruction count and the machine state come out exactly as if
+    //* each instruction had run. The skip never crosses a frame boundary, the next
+    //* runFrame re-detects the loop after a couple of iterations, since timers tick
+    //* and keys change between frames. On by default, interpreter only, off while
+    //* traced or profiled.
+    void setIdleSkip(bool enabled) { idleSkip = enabled; }
+
+    //* Select the interpreter or the JIT, false if the JIT isn't available on this host
+    bool setBackend(Backend backend);
+    Backend getBackend() const { return backend; }
+    static bool jitAvailable();
+
+    //* Opcode behavior the ROM expects. Not reset by reset(). The JIT only knows
+    //* QUIRKS_LEGACY, any other profile runs on the interpreter.
+    void setQuirks(QuirkProfile profile)
+    {
+        quirks = profile;
+        aotStatus = AOT_UNCHECKED;
+    }
+    QuirkProfile getQuirks() const { return quirks; }
+
+    //* Run the code chip8c translated ahead of time whenever RAM holds the ROM it was
+    //* translated from, with the same profile. Takes precedence over the JIT, not over
+    //* traces and profiles. nullptr detaches.
+    void attachProgram(const AotProgram *program);
+    const AotProgram *attachedProgram() const { return program; }
+    //* Whether the next frame runs translated code: attached, matching RAM and not dropped
+    bool programActive() const { return program && aotStatus != AOT_OFF; }
+
+    //* Stream a binary record of every executed instruction into ring (needs a CHIP8_TRACE build,
+    //* a no-op otherwise). Traced runs always use the interpreter. nullptr detaches.
+    void attachTrace(TraceRing *ring);
+
+    //* Count every executed instruction into profiler (needs a CHIP8_PROFILE build, a
+    //* no-op otherwise). Profiled runs always use the interpreter. nullptr detaches.
+    void attachProfiler(Profiler *profiler);
+
+    //* Stop at the breakpoints and watchpoints of debugger (needs a CHIP8_DEBUG build, a
+    //* no-op otherwise). Only while it has any armed, runs use the interpreter. nullptr detaches.
+    void attachDebugger(Debugger *debugger);
+
+    //* Keep stateHash() up to date: every store and every drawn row moves it, nothing
+    //* rehashes the 4 KB of RAM. Off by default, runs use the interpreter while on.
+    void setStateHashing(bool enabled);
+    //* RAM, screen, registers, stack, timers, generator and Fx0A wait: states that
+    //* stateEquals() hash the same. Only valid with hashing on.
+    uint64_t stateHash() const;
+
+    //* Set bit n of bitmap (4096 bits) for every address n executed from now on.
+    //* Costs nothing per instruction: marks happen in the decoder, the decode cache
+    //* is flushed here so every address decodes once more. nullptr detaches.
+    void attachCoverage(uint64_t *bitmap);
+
+    //* Read-only view of the 4 KB of RAM
+    const uint8_t *memory() const { return mem; }
+
+    //* Packed screen rows, SCREEN_HEIGHT words, the most significant bit is the leftmost pixel
+    const uint64_t *frameRows() const { return gfx; }
+    bool pixel(unsigned x, unsigned y) const
+    {
+        return (gfx[y % SCREEN_HEIGHT] >> (63 - x % SCREEN_WIDTH)) & 1;
+    }
+    //* Rows drawn or cleared since the last call, then starts over
+    uint32_t takeDirtyRows()
+    {
+        uint32_t rows = dirtyRows;
+        dirtyRows = 0;
+        return rows;
+    }
+    //* Unpack the screen into the old one-byte-per-pixel layout (0 or 1, row major)
+    void frameBytes(uint8_t out[SCREEN_WIDTH * SCREEN_HEIGHT]) const;
+
+    //* Sitting on a jump to itself, the usual way a CHIP-8 program ends
+    bool halted() const
+    {
+        return (mem[pc & 0xFFF] << 8 | mem[(pc + 1) & 0xFFF]) == (0x1000 | pc);
+    }
+
+    //* Registers, stack, timers and keypad, without the 4 KB of RAM a saveState() copies
+    void getRegisters(Registers &registers) const;
+
+    //* Snapshot everything that defines the machine: RAM, registers, stack, timers, screen, keys
+    void saveState(SaveState &state) const;
+    //* Resume from a snapshot, false (and nothing changed) if it is from another format version
+    //* or out of range (saveStateValid)
+    bool loadState(const SaveState &state);
+
+    //* Compare the whole machine state: RAM, registers, stack, timers, screen, generator and Fx0A wait
+    bool stateEquals(const Chip8 &other) const;
+
+    //* Seed the Cxkk generator. Instances running in parallel from one seed should
+    //* take different streams, each one 2^128 draws away from the previous.
+    void seedRandom(uint64_t seed, unsigned stream = 0);
+    const Random &getRandom() const { return rng; }
+    void setRandom(const Random &random) { rng = random; }
+
+    static Instruction decodeOpcode(uint16_t opcode);
 };
 
 #endif // _CHIP_8_H
@@ -0,0 +1,287 @@
+#include "Chip8Env.h"
+#include "Chip8.h"
+
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct Chip8Env {
+    std::unique_ptr<Chip8[]> machines;
+    std::vector<uint8_t> rom;
+    std::vector<uint32_t> episodeFrame;     // Frames into the current episode
+    uint32_t count;
+    Chip8EnvConfig config;
+    uint64_t instructionsBefore = 0;        // Of the machines' episodes before their last reset
+
+    //* The threads beyond the caller's, woken once per step with the step's arguments
+    std::vector<std::thread> workers;
+    std::mutex lock;
+    std::condition_variable wake;
+    std::condition_variable finished;
+    uint64_t generation = 0;
+    unsigned running = 0;
+    bool stopping = false;
+    const uint16_t *actions = nullptr;
+    uint32_t frames = 0;
+    uint8_t *observations = nullptr;
+    uint32_t format = CHIP8_OBS_NONE;
+    uint8_t *flags = nullptr;
+    std::vector<uint64_t> workerInstructions;   // Before reset, per worker slice
+
+    void resetMachine(uint32_t index);
+    void observe(uint32_t index, uint8_t *out, uint32_t format) const;
+    //* Environments [begin, end) of the current step, done by worker `slice`
+    void stepSlice(unsigned slice, uint32_t begin, uint32_t end);
+    void workerLoop(unsigned slice);
+    uint32_t sliceBegin(unsigned slice) const { return (uint64_t)count * slice / (workers.size() + 1); }
+};
+
+void Chip8Env::resetMachine(uint32_t index)
+{
+    Chip8 &chip8 = machines[index];
+
+    //* The generator carries on: every episode draws new numbers
+    chip8.reset();
+    chip8.load(rom.data(), rom.size());
+    episodeFrame[index] = 0;
+}
+
+void Chip8Env::observe(uint32_t index, uint8_t *out, uint32_t format) const
+{
+    const Chip8 &chip8 = machines[index];
+
+    if (format == CHIP8_OBS_BYTES) {
+        chip8.frameBytes(out);
+    } else if (format == CHIP8_OBS_BITS) {
+        const uint64_t *rows = chip8.frameRows();
+        for (unsigned y = 0; y < SCREEN_HEIGHT; y++) {
+            uint64_t row = __builtin_bswap64(rows[y]);
+            memcpy(&out[y * 8], &row, sizeof(row));
+        }
+    }
+}
+
+void Chip8Env::stepSlice(unsigned slice, uint32_t begin, uint32_t end)
+{
+    size_t observationSize = chip8_env_observation_size(format);
+    uint64_t lost = 0;
+
+    for (uint32_t n = begin; n < end; n++) {
+        Chip8 &chip8 = machines[n];
+        uint8_t flag = 0;
+
+        chip8.setKeys(actions ? actions[n] : 0);
+        for (uint32_t frame = 0; frame < frames; frame++) {
+            chip8.runFrame(config.cyclesPerFrame);
+            episodeFrame[n]++;
+
+            if (chip8.halted()) {
+                flag |= CHIP8_ENV_TERMINATED;
+            }
+            if (config.episodeFrames && episodeFrame[n] >= config.episodeFrames) {
+                flag |= CHIP8_ENV_TRUNCATED;
+            }
+            if (flag) {
+                break;
+            }
+        }
+
+        if (flag && config.autoReset) {
+            lost += chip8.instructionCount;
+            resetMachine(n);
+            flag |= CHIP8_ENV_RESET;
+        }
+        if (observations) {
+            observe(n, observations + n * observationSize, format);
+        }
+        if (flags) {
+            flags[n] = flag;
+        }
+    }
+
+    workerInstructions[slice] += lost;
+}
+
+void Chip8Env::workerLoop(unsigned slice)
+{
+    uint64_t seen = 0;
+
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            wake.wait(guard, [&] { return stopping || generation != seen; });
+            if (stopping) {
+                return;
+            }
+            seen = generation;
+        }
+
+        stepSlice(slice, sliceBegin(slice), sliceBegin(slice + 1));
+
+        std::lock_guard<std::mutex> guard(lock);
+        if (--running == 0) {
+            finished.notify_one();
+        }
+    }
+}
+
+uint32_t chip8_env_abi_version(void)
+{
+    return CHIP8_ENV_ABI_VERSION;
+}
+
+void chip8_env_default_config(Chip8EnvConfig *config)
+{
+    memset(config, 0, sizeof(*config));
+    config->size = sizeof(*config);
+    config->cyclesPerFrame = 10;
+    config->episodeFrames = 0;
+    config->quirks = QUIRKS_LEGACY;
+    config->threads = 1;
+    config->autoReset = 1;
+    config->seed = 0;
+}
+
+Chip8Env *chip8_env_create(const uint8_t *rom, size_t romSize, uint32_t count, const Chip8EnvConfig *config)
+{
+    Chip8EnvConfig settings;
+    chip8_env_default_config(&settings);
+    //* An older caller's smaller struct leaves the newer fields at their defaults
+    if (config) {
+        size_t size = config->size < sizeof(settings) ? config->size : sizeof(settings);
+        memcpy(&settings, config, size);
+        settings.size = sizeof(settings);
+    }
+
+    if (!rom || romSize > MAX_ROM_SIZE || findVariantOpcode(rom, romSize) || count == 0 || settings.cyclesPerFrame == 0
+        || settings.quirks >= QUIRK_PROFILE_COUNT || settings.threads == 0) {
+        return nullptr;
+    }
+
+    std::unique_ptr<Chip8Env> env(new Chip8Env());
+    env->count = count;
+    env->config = settings;
+    env->rom.assign(rom, rom + romSize);
+    env->episodeFrame.assign(count, 0);
+    env->machines.reset(new Chip8[count]);
+
+    Random stream(settings.seed ? settings.seed : RANDOM_DEFAULT_SEED);
+    for (uint32_t n = 0; n < count; n++) {
+        env->machines[n].setRandom(stream);
+        env->machines[n].setQuirks((QuirkProfile)settings.quirks);
+        env->resetMachine(n);
+        stream.jump();
+    }
+
+    unsigned threads = settings.threads < count ? settings.threads : count;
+    env->workerInstructions.assign(threads, 0);
+    for (unsigned slice = 1; slice < threads; slice++) {
+        env->workers.emplace_back(&Chip8Env::workerLoop, env.get(), slice);
+    }
+
+    return env.release();
+}
+
+void chip8_env_destroy(Chip8Env *env)
+{
+    if (!env) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(env->lock);
+        env->stopping = true;
+        env->wake.notify_all();
+    }
+    for (auto &worker : env->workers) {
+        worker.join();
+    }
+    delete env;
+}
+
+uint32_t chip8_env_count(const Chip8Env *env)
+{
+    return env->count;
+}
+
+size_t chip8_env_observation_size(uint32_t format)
+{
+    switch (format) {
+        case CHIP8_OBS_BYTES: return SCREEN_WIDTH * SCREEN_HEIGHT;
+        case CHIP8_OBS_BITS: return SCREEN_WIDTH * SCREEN_HEIGHT / 8;
+        default: return 0;
+    }
+}
+
+int chip8_env_reset(Chip8Env *env, int32_t index, void *observations, uint32_t format)
+{
+    if (index < -1 || (index >= 0 && (uint32_t)index >= env->count) || format > CHIP8_OBS_BITS
+        || (format != CHIP8_OBS_NONE && !observations)) {
+        return CHIP8_ENV_BAD_ARGUMENT;
+    }
+
+    uint32_t begin = index < 0 ? 0 : index;
+    uint32_t end = index < 0 ? env->count : index + 1;
+    size_t observationSize = chip8_env_observation_size(format);
+
+    for (uint32_t n = begin; n < end; n++) {
+        env->instructionsBefore += env->machines[n].instructionCount;
+        env->resetMachine(n);
+        if (format != CHIP8_OBS_NONE) {
+            env->observe(n, (uint8_t *)observations + (n - begin) * observationSize, format);
+        }
+    }
+    return CHIP8_ENV_OK;
+}
+
+int chip8_env_step(Chip8Env *env, const uint16_t *actions, uint32_t frames, void *observations, uint32_t format,
+    uint8_t *flags)
+{
+    if (format > CHIP8_OBS_BITS || (format != CHIP8_OBS_NONE && !observations)) {
+        return CHIP8_ENV_BAD_ARGUMENT;
+    }
+
+    env->actions = actions;
+    env->frames = frames;
+    env->observations = format != CHIP8_OBS_NONE ? (uint8_t *)observations : nullptr;
+    env->format = format;
+    env->flags = flags;
+
+    if (env->workers.empty()) {
+        env->stepSlice(0, 0, env->count);
+        return CHIP8_ENV_OK;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(env->lock);
+        env->running = env->workers.size();
+        env->generation++;
+        env->wake.notify_all();
+    }
+
+    env->stepSlice(0, 0, env->sliceBegin(1));
+
+    std::unique_lock<std::mutex> guard(env->lock);
+    env->finished.wait(guard, [env] { return env->running == 0; });
+    return CHIP8_ENV_OK;
+}
+
+const uint8_t *chip8_env_memory(const Chip8Env *env, uint32_t index)
+{
+    return index < env->count ? env->machines[index].memory() : nullptr;
+}
+
+uint64_t chip8_env_instructions(const Chip8Env *env)
+{
+    uint64_t total = env->instructionsBefore;
+    for (uint64_t lost : env->workerInstructions) {
+        total += lost;
+    }
+    for (uint32_t n = 0; n < env->count; n++) {
+        total += env->machines[n].instructionCount;
+    }
+    return total;
+}
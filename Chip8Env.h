@@ -0,0 +1,94 @@
+#ifndef _CHIP8_ENV_H
+#define _CHIP8_ENV_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+//* C ABI of libchip8.so, built around batches: one call steps every environment
+//* of a set by K frames, so a foreign-function caller (ctypes, cffi) pays one
+//* crossing per batch instead of one per frame. Nothing allocates after
+//* chip8_env_create(): observations and flags go into caller-provided buffers.
+//*
+//* The ABI only grows: new functions get new names, and Chip8EnvConfig is read
+//* up to its `size` field, so a caller built against an older header keeps working.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(__GNUC__)
+#define CHIP8_API __attribute__((visibility("default")))
+#else
+#define CHIP8_API
+#endif
+
+#define CHIP8_ENV_ABI_VERSION 1
+
+typedef struct Chip8Env Chip8Env;
+
+//* Observation layouts, per environment, environments back to back
+enum Chip8Observation {
+    CHIP8_OBS_NONE = 0,         // Nothing written, observations may be NULL
+    CHIP8_OBS_BYTES = 1,        // 64x32 uint8, 0 or 1, row major (2048 bytes)
+    CHIP8_OBS_BITS = 2,         // 32 rows of 8 bytes, leftmost pixel in the top bit of the first (256 bytes)
+};
+
+//* Per-environment flags written by chip8_env_step
+enum Chip8EnvFlag {
+    CHIP8_ENV_TERMINATED = 1,   // The program halted (a jump to itself)
+    CHIP8_ENV_TRUNCATED = 2,    // The episode reached episodeFrames
+    CHIP8_ENV_RESET = 4,        // Reset after that: its observation is the first of the next episode
+};
+
+enum Chip8EnvStatus {
+    CHIP8_ENV_OK = 0,
+    CHIP8_ENV_BAD_ARGUMENT = -1,
+};
+
+typedef struct Chip8EnvConfig {
+    uint32_t    size;               // sizeof(Chip8EnvConfig) of the caller's header
+    uint32_t    cyclesPerFrame;     // Instructions per 60Hz frame (default 10)
+    uint32_t    episodeFrames;      // Truncate episodes after that many frames, 0 = never (default)
+    uint32_t    quirks;             // QuirkProfile: 0 legacy (default), 1 chip8, 2 schip-quirks, 3 xochip-quirks
+    uint32_t    threads;            // Threads stepping the set, calling thread included (default 1)
+    uint32_t    autoReset;          // Reset ended episodes within the step (default 1)
+    uint64_t    seed;               // Cxkk seed, environment n draws from stream n (0 = the default seed)
+} Chip8EnvConfig;
+
+CHIP8_API uint32_t chip8_env_abi_version(void);
+
+//* The defaults above, size filled in
+CHIP8_API void chip8_env_default_config(Chip8EnvConfig *config);
+
+//* `count` environments running the ROM, NULL if the ROM doesn't fit, runs SUPER-CHIP
+//* or XO-CHIP opcodes, or an argument is out of range. config may be NULL for the defaults.
+CHIP8_API Chip8Env *chip8_env_create(const uint8_t *rom, size_t romSize, uint32_t count,
+    const Chip8EnvConfig *config);
+CHIP8_API void chip8_env_destroy(Chip8Env *env);
+
+CHIP8_API uint32_t chip8_env_count(const Chip8Env *env);
+//* Bytes of one environment's observation in that format, 0 for an unknown one
+CHIP8_API size_t chip8_env_observation_size(uint32_t format);
+
+//* Start a new episode on environment `index`, or on all of them with index -1,
+//* and write the observation(s): one slot for one environment, count slots for all
+CHIP8_API int chip8_env_reset(Chip8Env *env, int32_t index, void *observations, uint32_t format);
+
+//* Run every environment `frames` frames with its keypad held as actions[n]
+//* (bit k = key k down; NULL = no keys), then write the observations and flags[n]
+//* (NULL = not wanted). An environment whose episode ends stops there, and with
+//* autoReset starts the next one.
+CHIP8_API int chip8_env_step(Chip8Env *env, const uint16_t *actions, uint32_t frames,
+    void *observations, uint32_t format, uint8_t *flags);
+
+//* Environment `index`'s 4 KB of RAM, to read scores and lives from. Valid until
+//* the next step or reset; NULL for an index out of range.
+CHIP8_API const uint8_t *chip8_env_memory(const Chip8Env *env, uint32_t index);
+//* Instructions run over all environments since creation
+CHIP8_API uint64_t chip8_env_instructions(const Chip8Env *env);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _CHIP8_ENV_H
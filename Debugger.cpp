@@ -0,0 +1,178 @@
+#include "Debugger.h"
+
+#include <algorithm>
+#include <cstring>
+
+void Debugger::setBreakpoint(uint16_t addr, bool set)
+{
+    if (breakpoint(addr) != set) {
+        breakCount += set ? 1 : -1;
+        assign(breaks, addr, set);
+        assign(stops, addr, set || (overCall && (returnPc & 0xFFF) == (addr & 0xFFF)));
+    }
+}
+
+void Debugger::setWatch(uint16_t addr, bool set)
+{
+    if (watching(addr) != set) {
+        watchCount += set ? 1 : -1;
+        assign(watches, addr, set);
+    }
+}
+
+void Debugger::watchRegister(DebugRegister reg, bool set)
+{
+    watchedRegisters = set ? watchedRegisters | 1u << reg : watchedRegisters & ~(1u << reg);
+}
+
+void Debugger::clear()
+{
+    memset(breaks, 0, sizeof(breaks));
+    memset(stops, 0, sizeof(stops));
+    memset(watches, 0, sizeof(watches));
+    watchedRegisters = 0;
+    breakCount = 0;
+    watchCount = 0;
+    overCall = false;
+}
+
+uint32_t Debugger::writes(const Instruction &in, QuirkProfile quirks)
+{
+    const Quirks &q = QUIRK_TABLE[quirks < QUIRK_PROFILE_COUNT ? quirks : QUIRKS_LEGACY];
+    const uint32_t vx = 1u << in.x;
+    const uint32_t vf = 1u << DEBUG_REG_VF;
+    const uint32_t i = 1u << DEBUG_REG_I;
+
+    switch (in.op) {
+        case OP_LD_VX_KK:
+        case OP_ADD_VX_KK:
+        case OP_LD_VX_VY:
+        case OP_RND:
+        case OP_LD_VX_DT:
+        case OP_LD_VX_K:
+            return vx;
+        case OP_OR:
+        case OP_AND:
+        case OP_XOR:
+            return q.vfReset ? vx | vf : vx;
+        case OP_ADD_VX_VY:
+        case OP_SUB:
+        case OP_SHR:
+        case OP_SUBN:
+        case OP_SHL:
+            return vx | vf;
+        case OP_DRW:
+            return vf;
+        case OP_LD_I:
+        case OP_LD_F_VX:
+            return i;
+        case OP_ADD_I_VX:
+            return q.indexFlag ? i | vf : i;
+        case OP_LD_DT_VX:
+            return 1u << DEBUG_REG_DT;
+        case OP_LD_ST_VX:
+            return 1u << DEBUG_REG_ST;
+        case OP_LD_I_VX:
+            return q.loadStoreI ? i : 0;
+        case OP_LD_VX_I:
+            return ((2u << in.x) - 1) | (q.loadStoreI ? i : 0);
+        default:
+            return 0;
+    }
+}
+
+void Debugger::registerWritten(const Chip8 &chip8, uint16_t at, uint32_t written)
+{
+    if (hit.reason != DEBUG_NONE) {
+        return;
+    }
+
+    //* Lowest register first: V0-VF, I, DT, ST
+    unsigned reg = __builtin_ctz(written);
+    hit.reason = DEBUG_WATCH_REGISTER;
+    hit.at = at;
+    hit.addr = reg;
+    hit.before = 0;
+    if (reg <= DEBUG_REG_VF) {
+        hit.after = chip8.V[reg];
+    } else if (reg == DEBUG_REG_I) {
+        hit.after = chip8.I;
+    } else if (reg == DEBUG_REG_DT) {
+        hit.after = chip8.delayTimer;
+    } else {
+        hit.after = chip8.soundTimer;
+    }
+}
+
+bool Debugger::breakAt(const Chip8 &chip8, uint16_t pc)
+{
+    if (overCall && (pc & 0xFFF) == (returnPc & 0xFFF) && chip8.sp == returnSp) {
+        hit.reason = DEBUG_STEP;
+        return true;
+    }
+    if (!breakpoint(pc) || (resuming && pc == resumePc)) {
+        return false;
+    }
+    hit.reason = DEBUG_BREAKPOINT;
+    return true;
+}
+
+DebugStop Debugger::run(Chip8 &chip8, uint64_t instructions, uint64_t toFrame)
+{
+    hit = DebugStop();
+    resuming = true;
+    resumePc = chip8.pc;
+
+    while (instructions && frame < toFrame) {
+        //* Whole frames with nothing to check run on the frame's usual engine
+        if (frameCycles == 0 && instructions >= cycles && !(DEBUG_ENABLED && chip8.debugger == this && armed())) {
+            chip8.runFrame(cycles);
+            instructions -= cycles;
+            frame++;
+            continue;
+        }
+
+        //* Anything else runs on the interpreter: a step, the rest of a frame, or a
+        //* frame that can stop halfway
+        unsigned budget = (unsigned)std::min<uint64_t>(cycles - frameCycles, instructions);
+        uint64_t before = chip8.instructionCount;
+        chip8.execute(budget);
+        unsigned done = (unsigned)(chip8.instructionCount - before);
+
+        frameCycles += done;
+        instructions -= done;
+        if (frameCycles >= cycles) {
+            chip8.endFrame();
+            frame++;
+            frameCycles = 0;
+        }
+        if (hit.reason != DEBUG_NONE) {
+            break;
+        }
+    }
+
+    if (overCall) {
+        overCall = false;
+        assign(stops, returnPc, breakpoint(returnPc));
+    }
+    if (hit.reason == DEBUG_NONE) {
+        hit.reason = instructions ? DEBUG_FRAME : DEBUG_STEP;
+    }
+    hit.pc = chip8.pc;
+    return hit;
+}
+
+DebugStop Debugger::stepOver(Chip8 &chip8, uint64_t maxFrames)
+{
+    if (Chip8::decodeOpcode(chip8.fetch(chip8.pc)).op != OP_CALL) {
+        return step(chip8);
+    }
+
+    //* Back at the next instruction with the call's frame popped. Without a CHIP8_DEBUG
+    //* build there is nothing to stop there, it runs out the frames instead.
+    overCall = true;
+    returnPc = chip8.pc + 2;
+    returnSp = chip8.sp;
+    assign(stops, returnPc, true);
+    return run(chip8, UINT64_MAX, maxFrames > UINT64_MAX - frame ? UINT64_MAX : frame + maxFrames);
+}
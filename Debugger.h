@@ -0,0 +1,151 @@
+#ifndef _DEBUGGER_H
+#define _DEBUGGER_H
+
+#include "Chip8.h"
+
+#include <cstdint>
+#include <cstddef>
+
+//* Debugging is a compile-time policy like tracing and profiling: built without
+//* -DCHIP8_DEBUG the interpreter has no breakpoint test and stores have no write
+//* barrier, attachDebugger() attaches nothing. Debugger::run() still steps and runs
+//* to frames on such a build, it just never stops anywhere else.
+#ifdef CHIP8_DEBUG
+constexpr bool DEBUG_ENABLED = true;
+#else
+constexpr bool DEBUG_ENABLED = false;
+#endif
+
+//* Watchable registers: V0-VF, then I and the two timers
+enum DebugRegister : uint8_t {
+    DEBUG_REG_V0 = 0,
+    DEBUG_REG_VF = 15,
+    DEBUG_REG_I,
+    DEBUG_REG_DT,
+    DEBUG_REG_ST,
+    DEBUG_REG_COUNT
+};
+
+enum DebugStopReason : uint8_t {
+    DEBUG_NONE = 0,
+    DEBUG_STEP,             // Ran the instructions asked for, or stepped over a call
+    DEBUG_FRAME,            // Reached the frame asked for
+    DEBUG_BREAKPOINT,       // About to run a breakpoint address
+    DEBUG_WATCH_MEMORY,     // An instruction stored to a watched address
+    DEBUG_WATCH_REGISTER    // An instruction wrote a watched register
+};
+
+//* Why and where Debugger::run() gave control back
+struct DebugStop {
+    DebugStopReason reason = DEBUG_NONE;
+    uint16_t    pc = 0;         // Next instruction to run
+    uint16_t    at = 0;         // Watches: the instruction that wrote
+    uint16_t    addr = 0;       // Watched address, or DebugRegister
+    uint16_t    before = 0;     // Memory watches: the byte before the store
+    uint16_t    after = 0;      // The value written
+};
+
+//* Breakpoints, watchpoints and the frame position of one Chip8. The interpreter
+//* tests every instruction address against a 4096-bit map, one bit test, and only
+//* while something is armed: with nothing armed an attached debugger leaves
+//* runFrame on its usual engine (JIT, translated code, idle skipping included).
+//* Stores and register writes are reported through a write barrier, the first
+//* hit of an instruction stops after it completes.
+class Debugger {
+private:
+    uint64_t    breaks[MEM_SIZE / 64] = {};
+    uint64_t    stops[MEM_SIZE / 64] = {};     // breaks plus the step-over stop, what run() tests
+    uint64_t    watches[MEM_SIZE / 64] = {};
+    uint32_t    watchedRegisters = 0;          // Bit n = DebugRegister n
+    unsigned    breakCount = 0;
+    unsigned    watchCount = 0;
+
+    //* Step over: stop when pc comes back to returnPc at this stack depth
+    bool        overCall = false;
+    uint16_t    returnPc = 0;
+    uint8_t     returnSp = 0;
+
+    //* The instruction execution resumes from doesn't hit its own breakpoint
+    bool        resuming = false;
+    uint16_t    resumePc = 0;
+
+    DebugStop   hit;
+    unsigned    cycles;
+
+    static bool test(const uint64_t *bits, uint16_t addr)
+    {
+        return (bits[(addr & 0xFFF) >> 6] >> (addr & 63)) & 1;
+    }
+    static void assign(uint64_t *bits, uint16_t addr, bool set)
+    {
+        uint64_t bit = 1ull << (addr & 63);
+        bits[(addr & 0xFFF) >> 6] = set ? bits[(addr & 0xFFF) >> 6] | bit : bits[(addr & 0xFFF) >> 6] & ~bit;
+    }
+
+    void registerWritten(const Chip8 &chip8, uint16_t at, uint32_t written);
+
+public:
+    //* Frames completed since construction, and instructions already run of the next one
+    uint64_t    frame = 0;
+    unsigned    frameCycles = 0;
+
+    explicit Debugger(unsigned cyclesPerFrame = 10) : cycles(cyclesPerFrame) {}
+
+    unsigned cyclesPerFrame() const { return cycles; }
+
+    void setBreakpoint(uint16_t addr, bool set);
+    bool breakpoint(uint16_t addr) const { return test(breaks, addr); }
+    void setWatch(uint16_t addr, bool set);
+    bool watching(uint16_t addr) const { return test(watches, addr); }
+    void watchRegister(DebugRegister reg, bool set);
+    bool watchingRegister(DebugRegister reg) const { return (watchedRegisters >> reg) & 1; }
+    //* Drop every breakpoint and watchpoint
+    void clear();
+
+    //* Anything that needs the checked interpreter
+    bool armed() const { return breakCount || watchCount || watchedRegisters || overCall; }
+
+    //* Run at most `instructions` instructions, and no further than the end of frame
+    //* `toFrame - 1`, ending frames (timers) as runFrame would. Stops early at a
+    //* breakpoint or watchpoint hit when attached to chip8 on a CHIP8_DEBUG build.
+    DebugStop run(Chip8 &chip8, uint64_t instructions, uint64_t toFrame = UINT64_MAX);
+    DebugStop step(Chip8 &chip8, uint64_t instructions = 1) { return run(chip8, instructions); }
+    //* Step, running a 2nnn to its return, for at most maxFrames frames
+    DebugStop stepOver(Chip8 &chip8, uint64_t maxFrames);
+    DebugStop runToFrame(Chip8 &chip8, uint64_t toFrame) { return run(chip8, UINT64_MAX, toFrame); }
+
+    //* Registers an instruction writes, bit n = DebugRegister n
+    static uint32_t writes(const Instruction &in, QuirkProfile quirks);
+
+    //* Interpreter hooks, CHIP8_DEBUG builds only
+
+    //* The map to test before every instruction
+    const uint64_t *stopBits() const { return stops; }
+    //* pc has its bit set: whether to stop before running it
+    bool breakAt(const Chip8 &chip8, uint16_t pc);
+    //* Write barrier of RAM, every store of an attached Chip8
+    void stored(uint16_t at, uint16_t addr, uint8_t before, uint8_t after)
+    {
+        if (test(watches, addr) && hit.reason == DEBUG_NONE) {
+            hit.reason = DEBUG_WATCH_MEMORY;
+            hit.at = at;
+            hit.addr = addr & 0xFFF;
+            hit.before = before;
+            hit.after = after;
+        }
+    }
+    //* Write barrier of the registers, after every instruction: whether to stop now
+    bool stepped(const Chip8 &chip8, uint16_t at, const Instruction &in, QuirkProfile quirks)
+    {
+        resuming = false;
+        if (watchedRegisters) {
+            uint32_t written = writes(in, quirks) & watchedRegisters;
+            if (written) {
+                registerWritten(chip8, at, written);
+            }
+        }
+        return hit.reason != DEBUG_NONE;
+    }
+};
+
+#endif // _DEBUGGER_H
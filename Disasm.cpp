@@ -0,0 +1,48 @@
+#include "Disasm.h"
+#include "Chip8.h"
+
+#include <cstdio>
+
+int disassemble(uint16_t opcode, char *buffer, size_t size)
+{
+    Instruction in = Chip8::decodeOpcode(opcode);
+
+    switch (in.op) {
+        case OP_CLS:        return snprintf(buffer, size, "CLS");
+        case OP_RET:        return snprintf(buffer, size, "RET");
+        case OP_SYS:        return snprintf(buffer, size, "SYS \t 0x%.4X (ignored)", in.nnn);
+        case OP_JP:         return snprintf(buffer, size, "JP \t 0x%X", in.nnn);
+        case OP_CALL:       return snprintf(buffer, size, "CALL \t 0x%.4X", in.nnn);
+        case OP_SE_VX_KK:   return snprintf(buffer, size, "SE \t V%d, 0x%X", in.x, in.kk);
+        case OP_SNE_VX_KK:  return snprintf(buffer, size, "SNE \t V%d, 0x%X", in.x, in.kk);
+        case OP_SE_VX_VY:   return snprintf(buffer, size, "SE \t V%d, V%d", in.x, in.y);
+        case OP_LD_VX_KK:   return snprintf(buffer, size, "LD \t V%d, 0x%X", in.x, in.kk);
+        case OP_ADD_VX_KK:  return snprintf(buffer, size, "ADD \t V%d, 0x%X", in.x, in.kk);
+        case OP_LD_VX_VY:   return snprintf(buffer, size, "LD \t V%d, V%d", in.x, in.y);
+        case OP_OR:         return snprintf(buffer, size, "OR \t V%d, V%d", in.x, in.y);
+        case OP_AND:        return snprintf(buffer, size, "AND \t V%d, V%d", in.x, in.y);
+        case OP_XOR:        return snprintf(buffer, size, "XOR \t V%d, V%d", in.x, in.y);
+        case OP_ADD_VX_VY:  return snprintf(buffer, size, "ADD \t V%d, V%d", in.x, in.y);
+        case OP_SUB:        return snprintf(buffer, size, "SUB \t V%d, V%d", in.x, in.y);
+        case OP_SHR:        return snprintf(buffer, size, "SHR \t V%d {, V%d}", in.x, in.y);
+        case OP_SUBN:       return snprintf(buffer, size, "SUBN \t V%d, V%d", in.x, in.y);
+        case OP_SHL:        return snprintf(buffer, size, "SHL \t V%d {, V%d}", in.x, in.y);
+        case OP_SNE_VX_VY:  return snprintf(buffer, size, "SNE \t V%d, V%d", in.x, in.y);
+        case OP_LD_I:       return snprintf(buffer, size, "LD \t I, 0x%.4X", in.nnn);
+        case OP_JP_V0:      return snprintf(buffer, size, "JP \t V0, 0x%.4X", in.nnn);
+        case OP_RND:        return snprintf(buffer, size, "RND \t V%d, 0x%X", in.x, in.kk);
+        case OP_DRW:        return snprintf(buffer, size, "DRW \t V%d, V%d, 0x%X", in.x, in.y, in.n);
+        case OP_SKP:        return snprintf(buffer, size, "SKP \t V%d", in.x);
+        case OP_SKNP:       return snprintf(buffer, size, "SKNP \t V%d", in.x);
+        case OP_LD_VX_DT:   return snprintf(buffer, size, "LD \t V%d, DT", in.x);
+        case OP_LD_VX_K:    return snprintf(buffer, size, "LD \t V%d, K", in.x);
+        case OP_LD_DT_VX:   return snprintf(buffer, size, "LD \t DT, V%d", in.x);
+        case OP_LD_ST_VX:   return snprintf(buffer, size, "LD \t ST, V%d", in.x);
+        case OP_ADD_I_VX:   return snprintf(buffer, size, "ADD \t I, V%d", in.x);
+        case OP_LD_F_VX:    return snprintf(buffer, size, "LD \t F, V%d", in.x);
+        case OP_LD_B_VX:    return snprintf(buffer, size, "LD \t B, V%d", in.x);
+        case OP_LD_I_VX:    return snprintf(buffer, size, "LD \t [I], V%d", in.x);
+        case OP_LD_VX_I:    return snprintf(buffer, size, "LD \t V%d, [I]", in.x);
+        default:            return snprintf(buffer, size, "Invalid");
+    }
+}
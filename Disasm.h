@@ -0,0 +1,11 @@
+#ifndef _DISASM_H
+#define _DISASM_H
+
+#include <cstdint>
+#include <cstddef>
+
+//* Write the mnemonic of one opcode into buffer, same text the interpreter used to print.
+//* Returns the length like snprintf.
+int disassemble(uint16_t opcode, char *buffer, size_t size);
+
+#endif // _DISASM_H
@@ -0,0 +1,83 @@
+#include "Display.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define DISPLAY_SIMD 1
+#include <immintrin.h>
+#else
+#define DISPLAY_SIMD 0
+#endif
+
+typedef void (*RowKernel)(uint64_t row, uint32_t *out, uint32_t on, uint32_t off);
+
+static void expandScalar(uint64_t row, uint32_t *out, uint32_t on, uint32_t off)
+{
+    for (int x = 0; x < 64; x++) {
+        out[x] = (row >> (63 - x)) & 1 ? on : off;
+    }
+}
+
+#if DISPLAY_SIMD
+//* 4 pixels per step: broadcast a nibble, test one bit per lane, select the color
+__attribute__((target("sse2")))
+static void expandSse2(uint64_t row, uint32_t *out, uint32_t on, uint32_t off)
+{
+    const __m128i bits = _mm_setr_epi32(8, 4, 2, 1);
+    const __m128i offColor = _mm_set1_epi32(off);
+    const __m128i diff = _mm_set1_epi32(on ^ off);
+
+    for (int x = 0; x < 64; x += 4) {
+        __m128i nibble = _mm_set1_epi32((row >> (60 - x)) & 0xF);
+        __m128i mask = _mm_cmpeq_epi32(_mm_and_si128(nibble, bits), bits);
+        _mm_storeu_si128((__m128i *)(out + x), _mm_xor_si128(offColor, _mm_and_si128(mask, diff)));
+    }
+}
+
+//* 8 pixels per step, one sprite byte at a time
+__attribute__((target("avx2")))
+static void expandAvx2(uint64_t row, uint32_t *out, uint32_t on, uint32_t off)
+{
+    const __m256i bits = _mm256_setr_epi32(128, 64, 32, 16, 8, 4, 2, 1);
+    const __m256i offColor = _mm256_set1_epi32(off);
+    const __m256i diff = _mm256_set1_epi32(on ^ off);
+
+    for (int x = 0; x < 64; x += 8) {
+        __m256i byte = _mm256_set1_epi32((row >> (56 - x)) & 0xFF);
+        __m256i mask = _mm256_cmpeq_epi32(_mm256_and_si256(byte, bits), bits);
+        _mm256_storeu_si256((__m256i *)(out + x), _mm256_xor_si256(offColor, _mm256_and_si256(mask, diff)));
+    }
+}
+#endif
+
+static RowKernel selectKernel(const char **name)
+{
+#if DISPLAY_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        *name = "avx2";
+        return expandAvx2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        *name = "sse2";
+        return expandSse2;
+    }
+#endif
+    *name = "scalar";
+    return expandScalar;
+}
+
+static const char *kernelName;
+static const RowKernel kernel = selectKernel(&kernelName);
+
+void expandRows(const uint64_t *rows, unsigned count, void *pixels, int pitch, uint32_t on, uint32_t off)
+{
+    uint8_t *line = (uint8_t *)pixels;
+
+    for (unsigned y = 0; y < count; y++, line += pitch) {
+        kernel(rows[y], (uint32_t *)line, on, off);
+    }
+}
+
+const char *expandKernel()
+{
+    return kernelName;
+}
@@ -0,0 +1,26 @@
+#ifndef _DISPLAY_H
+#define _DISPLAY_H
+
+#include <cstdint>
+#include <cstddef>
+
+//* Colors of the expanded screen, ARGB8888
+#define PIXEL_ON    0xFFFFFFFF
+#define PIXEL_OFF   0xFF000000
+
+//* Expand `count` packed screen rows to 32-bit pixels, 64 per row.
+//* Rows are written `pitch` bytes apart, straight into texture memory.
+//* Picks an AVX2 or SSE2 kernel at runtime where the host has one.
+void expandRows(const uint64_t *rows, unsigned count, void *pixels, int pitch,
+                uint32_t on = PIXEL_ON, uint32_t off = PIXEL_OFF);
+
+//* Name of the kernel expandRows() ended up with: "avx2", "sse2" or "scalar"
+const char *expandKernel();
+
+//* Presentation counters, reset by the caller whenever it reports them
+struct DisplayStats {
+    uint64_t presents = 0;
+    uint64_t bytesUploaded = 0;
+};
+
+#endif // _DISPLAY_H
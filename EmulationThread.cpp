@@ -0,0 +1,96 @@
+#include "EmulationThread.h"
+#include "Audio.h"
+#include "Chip8.h"
+#include "Input.h"
+#include "Recorder.h"
+#include "Scheduler.h"
+#include "TripleBuffer.h"
+
+#include <cstring>
+
+EmulationThread::EmulationThread(Chip8 &chip8, FrameScheduler &scheduler, TripleBuffer &frames, KeyInput &input,
+    unsigned frameSkip)
+    : chip8(chip8), scheduler(scheduler), frames(frames), input(input), frameSkip(frameSkip ? frameSkip : 1)
+{
+    turboRequested = scheduler.turbo();
+}
+
+EmulationThread::~EmulationThread()
+{
+    stop();
+}
+
+void EmulationThread::start()
+{
+    if (!running.exchange(true)) {
+        thread = std::thread(&EmulationThread::loop, this);
+    }
+}
+
+void EmulationThread::stop()
+{
+    if (running.exchange(false)) {
+        thread.join();
+    }
+}
+
+void EmulationThread::loop()
+{
+    SchedulerStats lastSecond;
+    uint64_t index = 0;
+    uint64_t inputTime = 0;
+    unsigned skipped = 0;
+
+    while (running.load(std::memory_order_relaxed)) {
+        bool turbo = turboRequested.load(std::memory_order_relaxed);
+        if (turbo != scheduler.turbo()) {
+            scheduler.setTurbo(turbo);
+        }
+
+        uint64_t eventTime;
+        chip8.setKeys(input.sample(eventTime));
+        //* Frames skipped in turbo don't reach the screen, the next published one shows the input
+        if (eventTime && !inputTime) {
+            inputTime = eventTime;
+        }
+
+        scheduler.emulate(chip8);
+        index++;
+        if (audio) {
+            audio->push(chip8.soundOn());
+        }
+        if (recorder) {
+            recorder->capture(chip8.frameRows(), chip8.keyMask());
+        }
+
+        SchedulerStats timing = scheduler.stats();
+        if (timing.wallSeconds >= 1.0) {
+            lastSecond = timing;
+            scheduler.resetStats();
+        }
+
+        if (!scheduler.turbo() || ++skipped >= frameSkip) {
+            skipped = 0;
+
+            Frame &frame = frames.writeFrame();
+            memcpy(frame.rows, chip8.frameRows(), sizeof(frame.rows));
+            frame.dirty = chip8.takeDirtyRows();
+            frame.index = index;
+            frame.inputTime = inputTime;
+            frame.turbo = scheduler.turbo();
+            frame.timing = lastSecond;
+            frames.publish();
+            inputTime = 0;
+
+            if (published) {
+                published();
+            }
+        }
+
+        if (earlyInput.load(std::memory_order_relaxed)) {
+            scheduler.waitNextFrame([this] { return input.pending(); });
+        } else {
+            scheduler.waitNextFrame();
+        }
+    }
+}
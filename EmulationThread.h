@@ -0,0 +1,64 @@
+#ifndef _EMULATION_THREAD_H
+#define _EMULATION_THREAD_H
+
+#include <atomic>
+#include <functional>
+#include <thread>
+
+class Chip8;
+class FrameScheduler;
+class TripleBuffer;
+class KeyInput;
+class AudioGate;
+class FrameRecorder;
+
+//* Runs a Chip8 on its own thread, paced by a FrameScheduler alone. Every frame
+//* samples the keypad from KeyInput, emulates, and hands the finished screen to
+//* the TripleBuffer. It never waits for whoever consumes the frames.
+class EmulationThread {
+private:
+    Chip8 &chip8;
+    FrameScheduler &scheduler;
+    TripleBuffer &frames;
+    KeyInput &input;
+    unsigned frameSkip;
+
+    std::thread thread;
+    std::atomic<bool> running{false};
+    std::atomic<bool> turboRequested{false};
+    std::atomic<bool> earlyInput{true};
+    std::function<void()> published;
+    AudioGate *audio = nullptr;
+    FrameRecorder *recorder = nullptr;
+
+    void loop();
+
+public:
+    //* In turbo only every frameSkip-th frame is published
+    EmulationThread(Chip8 &chip8, FrameScheduler &scheduler, TripleBuffer &frames, KeyInput &input,
+        unsigned frameSkip = 16);
+    ~EmulationThread();
+
+    //* Called on the emulation thread after every published frame, e.g. to wake a
+    //* renderer that sleeps until there is something to show. Set before start().
+    void onPublish(std::function<void()> callback) { published = callback; }
+
+    //* Push the buzzer state of every emulated frame, skipped ones included. Set before start().
+    void setAudio(AudioGate *gate) { audio = gate; }
+
+    //* Capture the screen and keypad of every emulated frame, skipped ones included. Set before start().
+    void setRecorder(FrameRecorder *frames) { recorder = frames; }
+
+    void start();
+    //* Finishes the frame in progress and joins the thread
+    void stop();
+
+    //* A key event starts the next frame early instead of waiting for its deadline
+    //* (on by default). Off, frames keep a fixed cadence and input waits up to a frame.
+    void setEarlyInput(bool enabled) { earlyInput.store(enabled, std::memory_order_relaxed); }
+
+    void setTurbo(bool enabled) { turboRequested.store(enabled, std::memory_order_relaxed); }
+    bool turbo() const { return turboRequested.load(std::memory_order_relaxed); }
+};
+
+#endif // _EMULATION_THREAD_H
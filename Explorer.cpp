@@ -0,0 +1,221 @@
+#include "Explorer.h"
+#include "Chip8.h"
+#include "Rewind.h"
+#include "SaveState.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+//* Inputs tried from every state: no key, then each key held alone
+static const unsigned INPUTS = 17;
+
+VisitedTable::VisitedTable(size_t entries)
+{
+    size_t capacity = 16;
+    while (capacity < entries * 2) {
+        capacity <<= 1;
+    }
+
+    slots.reset(new std::atomic<uint64_t>[capacity]);
+    for (size_t i = 0; i < capacity; i++) {
+        slots[i].store(0, std::memory_order_relaxed);
+    }
+    mask = capacity - 1;
+    limit = entries;
+}
+
+VisitedTable::Insert VisitedTable::insert(uint64_t hash)
+{
+    hash = hash ? hash : 1;
+
+    //* The hash is the whole entry: nothing else is published with it, relaxed is enough
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        uint64_t seen = slots[i].load(std::memory_order_relaxed);
+        if (seen == hash) {
+            return INSERT_SEEN;
+        }
+        if (seen != 0) {
+            continue;
+        }
+        //* Racing inserts may overshoot the limit by a few, the capacity leaves room
+        if (count.load(std::memory_order_relaxed) >= limit) {
+            return INSERT_FULL;
+        }
+        if (slots[i].compare_exchange_strong(seen, hash, std::memory_order_relaxed)) {
+            count.fetch_add(1, std::memory_order_relaxed);
+            return INSERT_NEW;
+        }
+        //* Another worker took the slot first, maybe with this very hash
+        if (seen == hash) {
+            return INSERT_SEEN;
+        }
+    }
+}
+
+//* States of one level, as deltas from the root state packed back to back
+struct ExploreLevel {
+    std::vector<uint8_t> bytes;
+    std::vector<uint32_t> offsets;      // Where each state's delta starts in bytes
+
+    size_t size() const { return offsets.size(); }
+    size_t memoryBytes() const { return bytes.size() + offsets.size() * sizeof(uint32_t); }
+
+    void get(const SaveState &root, size_t index, SaveState &state) const
+    {
+        size_t end = index + 1 < offsets.size() ? offsets[index + 1] : bytes.size();
+        state = root;
+        applyStateDelta(bytes.data() + offsets[index], bytes.data() + end, state);
+    }
+
+    void push(const SaveState &root, const SaveState &state)
+    {
+        offsets.push_back((uint32_t)bytes.size());
+        encodeStateDelta(root, state, bytes);
+    }
+};
+
+//* One per pool thread, reused for every level
+struct ExploreWorker {
+    Chip8 chip8;
+    SaveState parent;
+    SaveState child;
+    ExploreLevel next;
+    uint64_t coverage[64] = {};
+    uint64_t generated = 0;
+    uint64_t distinct = 0;
+    uint64_t failedRestores = 0;
+    bool full = false;
+};
+
+static void boot(Chip8 &chip8, const uint8_t *rom, size_t size, const ExploreConfig &config)
+{
+    chip8.seedRandom(config.seed);
+    chip8.setQuirks(config.quirks);
+    chip8.reset();
+    chip8.load(rom, size);
+}
+
+static void expand(ExploreWorker &worker, const SaveState &root, const ExploreLevel &level, size_t begin,
+    size_t end, const ExploreConfig &config, VisitedTable &visited)
+{
+    Chip8 &chip8 = worker.chip8;
+
+    for (size_t index = begin; index < end; index++) {
+        level.get(root, index, worker.parent);
+
+        for (unsigned input = 0; input < INPUTS; input++) {
+            //* Siblings share nearly all of RAM: the restore only touches what differs.
+            //* A failed one leaves the previous sibling in place, none of its children count.
+            if (!chip8.loadState(worker.parent)) {
+                worker.failedRestores++;
+                break;
+            }
+            chip8.setKeys(input ? 1u << (input - 1) : 0);
+            chip8.runFrame(config.cyclesPerFrame);
+            worker.generated++;
+
+            switch (visited.insert(chip8.stateHash())) {
+                case VisitedTable::INSERT_NEW:
+                    chip8.saveState(worker.child);
+                    worker.next.push(root, worker.child);
+                    worker.distinct++;
+                    break;
+                case VisitedTable::INSERT_FULL:
+                    worker.full = true;
+                    break;
+                case VisitedTable::INSERT_SEEN:
+                    break;
+            }
+        }
+    }
+}
+
+bool explore(const uint8_t *rom, size_t size, const ExploreConfig &config, ThreadPool &pool,
+    ExploreReport &report)
+{
+    report = ExploreReport();
+    if (size > MAX_ROM_SIZE || findVariantOpcode(rom, size) || config.cyclesPerFrame == 0 || config.maxStates == 0) {
+        return false;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    Chip8 first;
+    SaveState root;
+    boot(first, rom, size, config);
+    first.setStateHashing(true);
+    first.saveState(root);
+
+    VisitedTable visited(config.maxStates);
+    visited.insert(first.stateHash());
+    report.distinct = 1;
+
+    std::vector<std::unique_ptr<ExploreWorker>> workers;
+    for (size_t i = 0; i < pool.size(); i++) {
+        workers.emplace_back(new ExploreWorker());
+        ExploreWorker &worker = *workers.back();
+        boot(worker.chip8, rom, size, config);
+        worker.chip8.setStateHashing(true);
+        worker.chip8.attachCoverage(worker.coverage);
+    }
+
+    //* The root level: one state, no delta
+    std::vector<ExploreLevel> levels(1);
+    levels[0].offsets.push_back(0);
+    report.peakFrontierBytes = levels[0].memoryBytes();
+
+    bool full = false;
+    while (report.depth < config.depth && !full && report.failedRestores == 0) {
+        size_t parents = 0;
+        for (auto &level : levels) {
+            parents += level.size();
+        }
+        if (parents == 0) {
+            break;
+        }
+
+        //* Enough tasks for the pool to balance, few enough that a task isn't all overhead
+        size_t chunk = std::min<size_t>(256, std::max<size_t>(1, parents / (pool.size() * 8)));
+        for (auto &level : levels) {
+            for (size_t begin = 0; begin < level.size(); begin += chunk) {
+                size_t end = std::min(level.size(), begin + chunk);
+                pool.submit([&workers, &root, &level, begin, end, &config, &visited] {
+                    expand(*workers[ThreadPool::workerIndex()], root, level, begin, end, config, visited);
+                });
+            }
+        }
+        pool.wait();
+
+        //* The children become the next level, the parents are dropped
+        size_t levelBytes = 0;
+        levels.clear();
+        for (auto &worker : workers) {
+            levelBytes += worker->next.memoryBytes();
+            report.deltaBytes += worker->next.memoryBytes();
+            levels.push_back(std::move(worker->next));
+            worker->next = ExploreLevel();
+            full = full || worker->full;
+            report.failedRestores += worker->failedRestores;
+        }
+        report.peakFrontierBytes = std::max(report.peakFrontierBytes, levelBytes);
+        report.depth++;
+    }
+
+    for (auto &worker : workers) {
+        report.generated += worker->generated;
+        report.distinct += worker->distinct;
+        for (int i = 0; i < 64; i++) {
+            report.coverage[i] |= worker->coverage[i];
+        }
+    }
+    for (int i = 0; i < 64; i++) {
+        report.covered += __builtin_popcountll(report.coverage[i]);
+    }
+    report.truncated = full;
+    report.tableBytes = visited.memoryBytes();
+    report.tableBytesPerState = visited.bytesPerEntry();
+    report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return report.failedRestores == 0;
+}
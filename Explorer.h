@@ -0,0 +1,81 @@
+#ifndef _EXPLORER_H
+#define _EXPLORER_H
+
+#include "Quirks.h"
+#include "Random.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+
+class ThreadPool;
+
+//* Set of 64-bit state hashes shared by every worker without a lock: open addressing
+//* with linear probing, one compare-and-swap per claimed slot. Fixed capacity, 0
+//* marks an empty slot (a hash of 0 is stored as 1).
+class VisitedTable {
+private:
+    std::unique_ptr<std::atomic<uint64_t>[]> slots;
+    size_t mask;
+    size_t limit;                       // Entries allowed, well under the capacity
+    std::atomic<size_t> count{0};
+
+public:
+    //* Room for `entries` hashes at a load factor of at most 1/2
+    explicit VisitedTable(size_t entries);
+
+    enum Insert {
+        INSERT_NEW,
+        INSERT_SEEN,
+        INSERT_FULL                     // New, but the table is at its limit: not stored
+    };
+    Insert insert(uint64_t hash);
+
+    size_t size() const { return count.load(std::memory_order_relaxed); }
+    size_t capacity() const { return mask + 1; }
+    size_t memoryBytes() const { return capacity() * sizeof(uint64_t); }
+    //* What an entry costs once the table is as full as it gets
+    double bytesPerEntry() const { return (double)memoryBytes() / limit; }
+};
+
+struct ExploreConfig {
+    unsigned depth = 600;           // Frames deep, one input per frame (10 s of game time)
+    unsigned cyclesPerFrame = 10;
+    size_t maxStates = 1 << 18;     // Distinct states to keep, the search stops there
+    QuirkProfile quirks = QUIRKS_LEGACY;
+    uint64_t seed = RANDOM_DEFAULT_SEED;
+};
+
+struct ExploreReport {
+    uint64_t generated = 0;         // Child states run: parents x inputs
+    uint64_t distinct = 0;          // New to the table, the root included
+    unsigned depth = 0;             // Levels completed
+    bool truncated = false;         // Stopped at maxStates
+    uint64_t failedRestores = 0;    // States that didn't restore, the search stops at their level
+    size_t peakFrontierBytes = 0;   // Largest level held at once, as deltas from the root
+    uint64_t deltaBytes = 0;        // Every state kept, as a delta from the root
+    size_t tableBytes = 0;
+    double tableBytesPerState = 0;  // VisitedTable::bytesPerEntry()
+    double seconds = 0;
+    uint64_t coverage[64] = {};     // Addresses executed, bit n = address n
+    unsigned covered = 0;           // Bits set in coverage
+
+    double statesPerSecond() const { return seconds > 0 ? generated / seconds : 0; }
+    //* Children that turned out to be a state seen before
+    double duplicateRatio() const { return generated ? 1 - (double)(distinct - 1) / generated : 0; }
+    //* A table entry plus the state's delta while its level is held
+    double bytesPerState() const { return distinct ? tableBytesPerState + (double)deltaBytes / distinct : 0; }
+};
+
+//* Breadth-first search over keypad input: from the state after loading rom, every
+//* state of a level is run one frame with each of the 17 inputs (no key, or one of
+//* the 16 keys held) and the children never seen before make the next level. States
+//* are told apart by Chip8::stateHash(), kept up to date by the writes themselves.
+//* Levels are stored as deltas from the root state and spread over the pool.
+//* False on a bad config or ROM, or when a state of the search fails to restore (counted
+//* in report.failedRestores): its children would have run from another machine.
+bool explore(const uint8_t *rom, size_t size, const ExploreConfig &config, ThreadPool &pool,
+    ExploreReport &report);
+
+#endif // _EXPLORER_H
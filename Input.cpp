@@ -0,0 +1,137 @@
+#include "Input.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+uint64_t inputClock()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void KeyInput::post(const KeyEvent &event)
+{
+    uint16_t bit = 1 << (event.key & 0xF);
+
+    if (event.down) {
+        down.fetch_or(bit, std::memory_order_relaxed);
+        pressed.fetch_or(bit, std::memory_order_relaxed);
+    } else {
+        down.fetch_and(~bit, std::memory_order_relaxed);
+    }
+
+    //* After the mask: a sample in between sees the key without its time and the
+    //* latency is charged to the next frame, too long rather than too short
+    uint64_t none = 0;
+    pendingTime.compare_exchange_strong(none, event.time ? event.time : 1, std::memory_order_release);
+}
+
+uint16_t KeyInput::sample(uint64_t &eventTime)
+{
+    eventTime = pendingTime.exchange(0, std::memory_order_acquire);
+    return down.load(std::memory_order_relaxed) | pressed.exchange(0, std::memory_order_relaxed);
+}
+
+KeyMap::KeyMap()
+{
+    static const char layout[17] = "x123qweasdzc4rfv";
+
+    for (int i = 0; i < 16; i++) {
+        codes[i] = layout[i];
+    }
+}
+
+int KeyMap::lookup(int32_t code) const
+{
+    for (int i = 0; i < 16; i++) {
+        if (codes[i] == code) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool KeyMap::load(const char *path, int32_t (*resolve)(const char *name))
+{
+    FILE *file = fopen(path, "r");
+
+    if (!file) {
+        fprintf(stderr, "Fail to load the key map: %s\n", path);
+        return false;
+    }
+
+    char line[256];
+    int number = 0;
+    bool ok = true;
+
+    while (fgets(line, sizeof(line), file)) {
+        number++;
+
+        char *comment = strchr(line, '#');
+        if (comment) {
+            *comment = '\0';
+        }
+
+        unsigned key;
+        char name[128];
+        int fields = sscanf(line, " %x %127[^\r\n]", &key, name);
+        if (fields <= 0) {
+            continue;
+        }
+
+        //* Names like "Left Shift" have spaces, only the trailing ones go
+        size_t length = fields == 2 ? strlen(name) : 0;
+        while (length && name[length - 1] == ' ') {
+            name[--length] = '\0';
+        }
+
+        int32_t code = length ? resolve(name) : 0;
+        if (key > 0xF || !code) {
+            fprintf(stderr, "%s:%d: expected <key 0-F> <key name>\n", path, number);
+            ok = false;
+            continue;
+        }
+
+        bind(key, code);
+    }
+
+    fclose(file);
+    return ok;
+}
+
+void LatencyHistogram::add(double seconds)
+{
+    unsigned bucket = seconds > 0 ? (unsigned)(seconds / BUCKET_SECONDS) : 0;
+
+    buckets[bucket < BUCKETS ? bucket : BUCKETS]++;
+    count++;
+    if (seconds > max) {
+        max = seconds;
+    }
+}
+
+void LatencyHistogram::reset()
+{
+    memset(buckets, 0, sizeof(buckets));
+    count = 0;
+    max = 0;
+}
+
+double LatencyHistogram::percentile(double p) const
+{
+    if (!count) {
+        return 0;
+    }
+
+    uint64_t rank = (uint64_t)(p * count);
+    uint64_t seen = 0;
+
+    for (unsigned i = 0; i < BUCKETS; i++) {
+        seen += buckets[i];
+        if (seen > rank) {
+            return (i + 1) * BUCKET_SECONDS;
+        }
+    }
+    return max;
+}
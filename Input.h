@@ -0,0 +1,83 @@
+#ifndef _INPUT_H
+#define _INPUT_H
+
+#include <atomic>
+#include <cstdint>
+
+//* Nanoseconds on the steady clock, the time base of key events and latencies
+uint64_t inputClock();
+
+//* One key going down or up, stamped when the frontend received it
+struct KeyEvent {
+    uint64_t    time;
+    uint8_t     key;        // Chip8 key, 0x0-0xF
+    bool        down;
+};
+
+//* The keypad between the input side and the emulation thread: a 16-bit mask the
+//* frontend updates as events arrive and the emulation thread samples once a frame.
+//* Lock-free, neither side waits.
+class KeyInput {
+private:
+    alignas(64) std::atomic<uint16_t> down{0};
+    //* Keys that went down since the last sample, so a tap shorter than a frame is still seen
+    std::atomic<uint16_t> pressed{0};
+    //* Time of the oldest event not sampled yet, 0 = none
+    std::atomic<uint64_t> pendingTime{0};
+
+public:
+    //* Input side
+    void post(const KeyEvent &event);
+
+    //* Emulation side: the keys to show the core this frame. eventTime is the time of
+    //* the oldest event since the last sample, 0 if there was none.
+    uint16_t sample(uint64_t &eventTime);
+
+    uint16_t keys() const { return down.load(std::memory_order_relaxed); }
+    //* An event arrived since the last sample
+    bool pending() const { return pendingTime.load(std::memory_order_relaxed) != 0; }
+};
+
+//* Host key code (SDL_Keycode in the frontend) of each of the 16 Chip8 keys
+class KeyMap {
+private:
+    int32_t codes[16];
+
+public:
+    //* 1234/QWER/ASDF/ZXCV over the 123C/456D/789E/A0BF keypad
+    KeyMap();
+
+    //* The Chip8 key bound to a host key, -1 if none
+    int lookup(int32_t code) const;
+    void bind(unsigned key, int32_t code) { codes[key & 0xF] = code; }
+    int32_t code(unsigned key) const { return codes[key & 0xF]; }
+
+    //* Lines of `<hex key> <host key name>`, `#` starts a comment. Names are turned
+    //* into codes by `resolve`, which returns 0 for names it doesn't know.
+    //* Keys the file doesn't mention keep their binding. False on any error.
+    bool load(const char *path, int32_t (*resolve)(const char *name));
+};
+
+//* Latencies in 0.1 ms buckets up to 100 ms, anything slower in the last one
+class LatencyHistogram {
+private:
+    static const unsigned BUCKETS = 1000;
+    static constexpr double BUCKET_SECONDS = 1e-4;
+
+    uint32_t buckets[BUCKETS + 1];
+    uint64_t count;
+    double max;
+
+public:
+    LatencyHistogram() { reset(); }
+
+    void add(double seconds);
+    void reset();
+
+    uint64_t samples() const { return count; }
+    double maximum() const { return max; }
+    //* Upper edge of the bucket holding the p-th fraction (0.99 = p99), 0 without samples
+    double percentile(double p) const;
+};
+
+#endif // _INPUT_H
@@ -0,0 +1,649 @@
+#include "Jit.h"
+#include "Chip8.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) && defined(__linux__)
+#define JIT_SUPPORTED 1
+#include <sys/mman.h>
+#else
+#define JIT_SUPPORTED 0
+#endif
+
+#define CODE_BUFFER_SIZE (1 << 20)
+#define MAX_BLOCK_BYTES 8192
+
+//* Interpreter fallback for one instruction, pc already points at it
+static void stepHelper(Chip8 *chip8)
+{
+    chip8->emulateCycle();
+}
+
+//* Minimal x86-64 encoder. Inside generated code rbx holds the Chip8 pointer,
+//* r12d the remaining cycle budget and r13d the natively executed instruction
+//* count; eax/ecx/edx are scratch.
+class Emitter {
+private:
+    uint8_t *out;
+
+public:
+    enum Reg { EAX = 0, ECX = 1, EDX = 2 };
+
+    explicit Emitter(uint8_t *buffer) : out(buffer) {}
+
+    uint8_t *position() const { return out; }
+
+    void byte(uint8_t value) { *out++ = value; }
+
+    void imm16(uint16_t value)
+    {
+        memcpy(out, &value, 2);
+        out += 2;
+    }
+
+    void imm32(uint32_t value)
+    {
+        memcpy(out, &value, 4);
+        out += 4;
+    }
+
+    void imm64(uint64_t value)
+    {
+        memcpy(out, &value, 8);
+        out += 8;
+    }
+
+    //* ModRM for [rbx + disp32] with the given register field
+    void rbxDisp(int reg, int32_t disp)
+    {
+        byte(0x80 | (reg << 3) | 3);
+        imm32(disp);
+    }
+
+    //* Patch a rel32 at `at` so it lands on `target`
+    static void patchRel32(uint8_t *at, const uint8_t *target)
+    {
+        int32_t rel = (int32_t)(target - (at + 4));
+        memcpy(at, &rel, 4);
+    }
+
+    //* uint64_t enter(Chip8 *chip8 = rdi, uint32_t budget = esi, const void *body = rdx)
+    void trampoline()
+    {
+        byte(0x53);                                 // push rbx
+        byte(0x41); byte(0x54);                     // push r12
+        byte(0x41); byte(0x55);                     // push r13
+        byte(0x48); byte(0x89); byte(0xFB);         // mov rbx, rdi
+        byte(0x41); byte(0x89); byte(0xF4);         // mov r12d, esi
+        byte(0x45); byte(0x31); byte(0xED);         // xor r13d, r13d
+        byte(0xFF); byte(0xE2);                     // jmp rdx
+    }
+
+    void epilogue()
+    {
+        byte(0x44); byte(0x89); byte(0xE0);         // mov eax, r12d
+        byte(0x49); byte(0xC1); byte(0xE5); byte(32); // shl r13, 32
+        byte(0x4C); byte(0x09); byte(0xE8);         // or rax, r13
+        byte(0x41); byte(0x5D);                     // pop r13
+        byte(0x41); byte(0x5C);                     // pop r12
+        byte(0x5B);                                 // pop rbx
+        byte(0xC3);                                 // ret
+    }
+
+    //* Jump to blocks[pc].body if it is translated and fits the budget, else to `exit`
+    void dispatch(int32_t offPc, const void *table, const uint8_t *exit)
+    {
+        loadWord(EAX, offPc);
+        byte(0x3D); imm32(0xFFE);                   // cmp eax, 0xFFE
+        byte(0x0F); byte(0x87); jumpTo(exit);       // ja exit
+        byte(0xC1); byte(0xE0); byte(4);            // shl eax, 4
+        byte(0x48); byte(0xBA);                     // mov rdx, imm64
+        imm64((uint64_t)(uintptr_t)table);
+        byte(0x48); byte(0x01); byte(0xD0);         // add rax, rdx
+        byte(0x48); byte(0x8B); byte(0x08);         // mov rcx, [rax]
+        byte(0x48); byte(0x85); byte(0xC9);         // test rcx, rcx
+        byte(0x0F); byte(0x84); jumpTo(exit);       // jz exit
+        byte(0x0F); byte(0xB7); byte(0x50); byte(8); // movzx edx, word [rax + 8]
+        byte(0x41); byte(0x39); byte(0xD4);         // cmp r12d, edx
+        byte(0x0F); byte(0x82); jumpTo(exit);       // jb exit
+        byte(0xFF); byte(0xE1);                     // jmp rcx
+    }
+
+    //* Block header: charge the whole block to the budget, count the native part.
+    //* Returns where the native count goes so it can be patched once known.
+    uint8_t *blockHeader(uint32_t length)
+    {
+        byte(0x41); byte(0x81); byte(0xEC); imm32(length); // sub r12d, imm32
+        byte(0x41); byte(0x81); byte(0xC5);         // add r13d, imm32
+        uint8_t *native = out;
+        imm32(0);
+        return native;
+    }
+
+    void jmp(const uint8_t *target)                 // jmp rel32
+    {
+        byte(0xE9); jumpTo(target);
+    }
+
+    void jumpTo(const uint8_t *target)
+    {
+        patchRel32(out, target);
+        out += 4;
+    }
+
+    void loadByte(Reg reg, int32_t disp)            // movzx reg, byte [rbx + disp]
+    {
+        byte(0x0F); byte(0xB6); rbxDisp(reg, disp);
+    }
+
+    void loadWord(Reg reg, int32_t disp)            // movzx reg, word [rbx + disp]
+    {
+        byte(0x0F); byte(0xB7); rbxDisp(reg, disp);
+    }
+
+    void storeByte(int32_t disp, Reg reg)           // mov byte [rbx + disp], reg8
+    {
+        byte(0x88); rbxDisp(reg, disp);
+    }
+
+    void storeWord(int32_t disp, Reg reg)           // mov word [rbx + disp], reg16
+    {
+        byte(0x66); byte(0x89); rbxDisp(reg, disp);
+    }
+
+    void storeByteImm(int32_t disp, uint8_t value)  // mov byte [rbx + disp], imm8
+    {
+        byte(0xC6); rbxDisp(0, disp); byte(value);
+    }
+
+    void storeWordImm(int32_t disp, uint16_t value) // mov word [rbx + disp], imm16
+    {
+        byte(0x66); byte(0xC7); rbxDisp(0, disp); imm16(value);
+    }
+
+    void addByteImm(int32_t disp, uint8_t value)    // add byte [rbx + disp], imm8
+    {
+        byte(0x80); rbxDisp(0, disp); byte(value);
+    }
+
+    void cmpByteImm(int32_t disp, uint8_t value)    // cmp byte [rbx + disp], imm8
+    {
+        byte(0x80); rbxDisp(7, disp); byte(value);
+    }
+
+    void cmpRegByte(Reg reg, int32_t disp)          // cmp reg8, byte [rbx + disp]
+    {
+        byte(0x3A); rbxDisp(reg, disp);
+    }
+
+    //* reg8 op reg8, opcode is the r/m8, r8 form (add 00, or 08, and 20, sub 28, xor 30, cmp 38)
+    void alu8(uint8_t opcode, Reg dst, Reg src)
+    {
+        byte(opcode); byte(0xC0 | (src << 3) | dst);
+    }
+
+    //* reg32 op reg32, same opcode table + 1
+    void alu32(uint8_t opcode, Reg dst, Reg src)
+    {
+        byte(opcode + 1); byte(0xC0 | (src << 3) | dst);
+    }
+
+    void movImm32(Reg reg, uint32_t value)          // mov reg, imm32
+    {
+        byte(0xB8 + reg); imm32(value);
+    }
+
+    void cmpEaxImm32(uint32_t value)                // cmp eax, imm32
+    {
+        byte(0x3D); imm32(value);
+    }
+
+    void setAbove(Reg reg)                          // seta reg8
+    {
+        byte(0x0F); byte(0x97); byte(0xC0 | reg);
+    }
+
+    void andAlImm(uint8_t value)                    // and al, imm8
+    {
+        byte(0x24); byte(value);
+    }
+
+    void shrAl(uint8_t count)                       // shr al, count
+    {
+        byte(0xC0); byte(0xE8); byte(count);
+    }
+
+    void shlAl1()                                   // shl al, 1
+    {
+        byte(0xD0); byte(0xE0);
+    }
+
+    void leaEaxTimes5()                             // lea eax, [rax + rax * 4]
+    {
+        byte(0x8D); byte(0x04); byte(0x80);
+    }
+
+    //* rsp stays 16-byte aligned inside blocks: return address plus three pushes
+    void callHelper(void (*fn)(Chip8 *))
+    {
+        byte(0x48); byte(0x89); byte(0xDF);         // mov rdi, rbx
+        byte(0x48); byte(0xB8);                     // mov rax, imm64
+        imm64((uint64_t)(uintptr_t)fn);
+        byte(0xFF); byte(0xD0);                     // call rax
+    }
+
+    //* Leave the block for a known pc. Until linked the budget check always passes and
+    //* the jump goes through the dispatch stub; patching puts the target's length and body in.
+    //* Returns the link site (the compare immediate).
+    uint8_t *exitTo(int32_t offPc, uint16_t target, const uint8_t *leave, const uint8_t *dispatch)
+    {
+        storeWordImm(offPc, target);
+        byte(0x41); byte(0x81); byte(0xFC);         // cmp r12d, imm32
+        uint8_t *site = out;
+        imm32(0);
+        byte(0x0F); byte(0x82); jumpTo(leave);      // jb leave
+        jmp(dispatch);
+        return site;
+    }
+
+    //* Conditional jump on the flags of the preceding compare, jcc 0x84 (je) or 0x85 (jne).
+    //* Returns the rel32 to patch once the target is emitted.
+    uint8_t *jumpIf(uint8_t jcc)
+    {
+        byte(0x0F); byte(jcc);
+        uint8_t *rel = out;
+        imm32(0);
+        return rel;
+    }
+};
+
+bool Jit::available()
+{
+    return JIT_SUPPORTED;
+}
+
+Jit::Jit(Chip8 &chip8)
+{
+    memset(blocks, 0, sizeof(blocks));
+    memset(heat, 0, sizeof(heat));
+    memset(covered, 0, sizeof(covered));
+
+    const uint8_t *base = (const uint8_t *)&chip8;
+    offV     = (const uint8_t *)&chip8.V[0] - base;
+    offI     = (const uint8_t *)&chip8.I - base;
+    offPc    = (const uint8_t *)&chip8.pc - base;
+    offDelay = (const uint8_t *)&chip8.delayTimer - base;
+    offSound = (const uint8_t *)&chip8.soundTimer - base;
+
+#if JIT_SUPPORTED
+    //* W^X: the buffer is never writable and executable at once, translate() flips it
+    //* to RW while it emits a block and links it, and back to RX before anything runs
+    void *buffer = mmap(NULL, CODE_BUFFER_SIZE, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buffer != MAP_FAILED) {
+        code = (uint8_t *)buffer;
+        codeSize = CODE_BUFFER_SIZE;
+        emitStubs();
+        if (!setWritable(false)) {
+            release();
+        }
+    }
+#endif
+}
+
+bool Jit::setWritable(bool writable)
+{
+#if JIT_SUPPORTED
+    int prot = writable ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC;
+    return mprotect(code, codeSize, prot) == 0;
+#else
+    (void)writable;
+    return false;
+#endif
+}
+
+void Jit::release()
+{
+#if JIT_SUPPORTED
+    munmap(code, codeSize);
+#endif
+    code = nullptr;
+    codeSize = 0;
+    flush();
+}
+
+void Jit::emitStubs()
+{
+    Emitter e(code);
+
+    enter = (EnterFn)(void *)e.position();
+    e.trampoline();
+
+    leave = e.position();
+    e.epilogue();
+
+    dispatch = e.position();
+    e.dispatch(offPc, blocks, leave);
+
+    stubsSize = e.position() - code;
+    codeUsed = stubsSize;
+}
+
+Jit::~Jit()
+{
+    if (code) {
+        release();
+    }
+}
+
+void Jit::patchLink(uint8_t *site, const Block &target)
+{
+    uint32_t length = target.length;
+    memcpy(site, &length, 4);
+    //* cmp imm32 (4), jb rel32 (6), then the jmp opcode
+    Emitter::patchRel32(site + 4 + 6 + 1, target.body);
+}
+
+void Jit::emitExit(Emitter &e, uint16_t start, uint16_t target)
+{
+    uint8_t *site = e.exitTo(offPc, target, leave, dispatch);
+
+    if (target > 0xFFE) {
+        return;
+    }
+
+    //* A loop back to the block being translated is patched once its length is known
+    if (target != start && blocks[target].body) {
+        patchLink(site, blocks[target]);
+    } else {
+        links.push_back({ target, site });
+    }
+}
+
+void Jit::flush()
+{
+    links.clear();
+    memset(blocks, 0, sizeof(blocks));
+    memset(heat, 0, sizeof(heat));
+    memset(covered, 0, sizeof(covered));
+    codeUsed = stubsSize;
+    flushPending = false;
+    flushes++;
+}
+
+bool Jit::translate(Chip8 &chip8, uint16_t start)
+{
+    if (codeUsed + MAX_BLOCK_BYTES > codeSize) {
+        flush();
+    }
+
+    if (!setWritable(true)) {
+        return false;
+    }
+
+    Emitter e(code + codeUsed);
+    uint16_t addr = start;
+    uint16_t length = 0;
+    uint16_t helperCalls = 0;
+    bool ended = false;
+    bool terminated = false;    // Exits already emitted
+    bool leaveAfter = false;
+
+    auto V = [this](int reg) { return offV + reg; };
+
+    //* The block length is only known at the end, scan it first
+    while (!ended && length < MAX_BLOCK_LENGTH && addr + 1 <= 0xFFF) {
+        Instruction in = Chip8::decodeOpcode((chip8.mem[addr] << 8) | chip8.mem[addr + 1]);
+        switch (in.op) {
+            case OP_JP: case OP_CALL: case OP_RET: case OP_JP_V0:
+            case OP_SE_VX_KK: case OP_SNE_VX_KK: case OP_SE_VX_VY: case OP_SNE_VX_VY:
+            case OP_SKP: case OP_SKNP: case OP_LD_VX_K:
+            case OP_LD_B_VX: case OP_LD_I_VX: case OP_INVALID:
+                ended = true;
+                break;
+        }
+        length++;
+        addr += 2;
+    }
+
+    uint8_t *nativeCount = e.blockHeader(length);
+    uint16_t end = addr;
+
+    addr = start;
+    length = 0;
+    ended = false;
+
+    while (addr < end) {
+        Instruction in = Chip8::decodeOpcode((chip8.mem[addr] << 8) | chip8.mem[addr + 1]);
+        uint16_t next = addr + 2;
+
+        switch (in.op) {
+            case OP_SYS:
+                break;
+            case OP_LD_VX_KK:
+                e.storeByteImm(V(in.x), in.kk);
+                break;
+            case OP_ADD_VX_KK:
+                e.addByteImm(V(in.x), in.kk);
+                break;
+            case OP_LD_VX_VY:
+                e.loadByte(Emitter::EAX, V(in.y));
+                e.storeByte(V(in.x), Emitter::EAX);
+                break;
+            case OP_OR:
+            case OP_AND:
+            case OP_XOR: {
+                static const uint8_t ops[] = { 0x08, 0x20, 0x30 };
+                e.loadByte(Emitter::EAX, V(in.x));
+                e.loadByte(Emitter::ECX, V(in.y));
+                e.alu8(ops[in.op - OP_OR], Emitter::EAX, Emitter::ECX);
+                e.storeByte(V(in.x), Emitter::EAX);
+                break;
+            }
+            case OP_ADD_VX_VY:
+                //* V[x] += V[y]; V[F] = V[y] > (0xFF - V[x]), operands re-read like the interpreter
+                e.loadByte(Emitter::EAX, V(in.x));
+                e.loadByte(Emitter::ECX, V(in.y));
+                e.alu8(0x00, Emitter::EAX, Emitter::ECX);
+                e.storeByte(V(in.x), Emitter::EAX);
+                e.loadByte(Emitter::EAX, V(in.x));
+                e.movImm32(Emitter::EDX, 0xFF);
+                e.alu32(0x28, Emitter::EDX, Emitter::EAX);
+                e.loadByte(Emitter::ECX, V(in.y));
+                e.alu32(0x38, Emitter::ECX, Emitter::EDX);
+                e.setAbove(Emitter::EAX);
+                e.storeByte(V(0xF), Emitter::EAX);
+                break;
+            case OP_SUB:
+            case OP_SUBN: {
+                //* VF = a > b; V[x] = a - b, with (a, b) = (Vx, Vy) or (Vy, Vx)
+                int a = in.op == OP_SUB ? in.x : in.y;
+                int b = in.op == OP_SUB ? in.y : in.x;
+                e.loadByte(Emitter::EAX, V(a));
+                e.loadByte(Emitter::ECX, V(b));
+                e.alu8(0x38, Emitter::EAX, Emitter::ECX);
+                e.setAbove(Emitter::EDX);
+                e.storeByte(V(0xF), Emitter::EDX);
+                e.loadByte(Emitter::EAX, V(a));
+                e.loadByte(Emitter::ECX, V(b));
+                e.alu8(0x28, Emitter::EAX, Emitter::ECX);
+                e.storeByte(V(in.x), Emitter::EAX);
+                break;
+            }
+            case OP_SHR:
+                e.loadByte(Emitter::EAX, V(in.x));
+                e.andAlImm(0x01);
+                e.storeByte(V(0xF), Emitter::EAX);
+                e.loadByte(Emitter::EAX, V(in.x));
+                e.shrAl(1);
+                e.storeByte(V(in.x), Emitter::EAX);
+                break;
+            case OP_SHL:
+                e.loadByte(Emitter::EAX, V(in.x));
+                e.shrAl(7);
+                e.storeByte(V(0xF), Emitter::EAX);
+                e.loadByte(Emitter::EAX, V(in.x));
+                e.shlAl1();
+                e.storeByte(V(in.x), Emitter::EAX);
+                break;
+            case OP_LD_I:
+                e.storeWordImm(offI, in.nnn);
+                break;
+            case OP_LD_VX_DT:
+                e.loadByte(Emitter::EAX, offDelay);
+                e.storeByte(V(in.x), Emitter::EAX);
+                break;
+            case OP_LD_DT_VX:
+                e.loadByte(Emitter::EAX, V(in.x));
+                e.storeByte(offDelay, Emitter::EAX);
+                break;
+            case OP_LD_ST_VX:
+                e.loadByte(Emitter::EAX, V(in.x));
+                e.storeByte(offSound, Emitter::EAX);
+                break;
+            case OP_ADD_I_VX:
+                //* VF = I + Vx > 0xFFF; I += Vx (re-read, x may be F)
+                e.loadWord(Emitter::EAX, offI);
+                e.loadByte(Emitter::ECX, V(in.x));
+                e.alu32(0x00, Emitter::EAX, Emitter::ECX);
+                e.cmpEaxImm32(0xFFF);
+                e.setAbove(Emitter::EDX);
+                e.storeByte(V(0xF), Emitter::EDX);
+                e.loadWord(Emitter::EAX, offI);
+                e.loadByte(Emitter::ECX, V(in.x));
+                e.alu32(0x00, Emitter::EAX, Emitter::ECX);
+                e.storeWord(offI, Emitter::EAX);
+                break;
+            case OP_LD_F_VX:
+                e.loadByte(Emitter::EAX, V(in.x));
+                e.leaEaxTimes5();
+                e.storeWord(offI, Emitter::EAX);
+                break;
+            case OP_JP:
+                emitExit(e, start, in.nnn);
+                ended = true;
+                terminated = true;
+                break;
+            case OP_SE_VX_KK:
+            case OP_SNE_VX_KK:
+            case OP_SE_VX_VY:
+            case OP_SNE_VX_VY: {
+                if (in.op == OP_SE_VX_KK || in.op == OP_SNE_VX_KK) {
+                    e.cmpByteImm(V(in.x), in.kk);
+                } else {
+                    e.loadByte(Emitter::EAX, V(in.x));
+                    e.cmpRegByte(Emitter::EAX, V(in.y));
+                }
+
+                bool skipIfEqual = in.op == OP_SE_VX_KK || in.op == OP_SE_VX_VY;
+                uint8_t *taken = e.jumpIf(skipIfEqual ? 0x84 : 0x85);
+                emitExit(e, start, addr + 2);
+                Emitter::patchRel32(taken, e.position());
+                emitExit(e, start, addr + 4);
+                ended = true;
+                terminated = true;
+                break;
+            }
+            default:
+                //* Interpreter fallback: CLS, RET, CALL, Bnnn, RND, DRW, keys, Fx0A, stores, invalid
+                e.storeWordImm(offPc, addr);
+                e.callHelper(stepHelper);
+                helperCalls++;
+
+                switch (in.op) {
+                    case OP_CLS:
+                    case OP_RND:
+                    case OP_DRW:
+                    case OP_LD_VX_I:
+                        break;
+                    case OP_LD_B_VX:
+                    case OP_LD_I_VX:
+                        //* A store may have hit translated code, let run() flush before going on
+                        ended = true;
+                        leaveAfter = true;
+                        break;
+                    case OP_CALL:
+                        emitExit(e, start, in.nnn);
+                        ended = true;
+                        terminated = true;
+                        break;
+                    default:
+                        //* Control flow and key waits end the block
+                        ended = true;
+                        break;
+                }
+                break;
+        }
+
+        covered[addr] = 1;
+        covered[addr + 1] = 1;
+        length++;
+        addr = next;
+    }
+
+    if (!ended) {
+        //* Ran into the length limit or the end of memory, continue at the next address
+        emitExit(e, start, addr);
+    } else if (!terminated) {
+        e.jmp(leaveAfter ? leave : dispatch);
+    }
+
+    uint32_t native = length - helperCalls;
+    memcpy(nativeCount, &native, 4);
+
+    Block &block = blocks[start];
+    block.body = code + codeUsed;
+    block.length = length;
+
+    //* Link the exits that were waiting for this block
+    for (size_t i = 0; i < links.size();) {
+        if (links[i].target == start) {
+            patchLink(links[i].site, block);
+            links[i] = links.back();
+            links.pop_back();
+        } else {
+            i++;
+        }
+    }
+
+    codeUsed += e.position() - (code + codeUsed);
+    translated++;
+
+    //* Code that cannot be made executable again is dropped, run() then interprets
+    if (!setWritable(false)) {
+        release();
+        return false;
+    }
+
+    return true;
+}
+
+void Jit::run(Chip8 &chip8, unsigned cycles)
+{
+    while (cycles > 0) {
+        if (flushPending) {
+            flush();
+        }
+
+        uint16_t pc = chip8.pc;
+
+        //* Only plain 12-bit addresses get translated, wrapped ones stay in the interpreter
+        if (code && pc <= 0xFFE) {
+            Block &block = blocks[pc];
+
+            if (!block.body && ++heat[pc] >= HOT_THRESHOLD) {
+                translate(chip8, pc);
+            }
+
+            if (block.body && block.length <= cycles) {
+                uint64_t result = enter(&chip8, cycles, block.body);
+                chip8.instructionCount += result >> 32;
+                cycles = (uint32_t)result;
+                continue;
+            }
+        }
+
+        chip8.emulateCycle();
+        cycles--;
+    }
+}
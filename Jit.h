@@ -0,0 +1,107 @@
+#ifndef _JIT_H
+#define _JIT_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+class Chip8;
+
+//* x86-64 dynamic recompiler for hot basic blocks.
+//* A block runs from its entry address up to the first jump, call, return, skip,
+//* Fx0A or memory store. ALU, register and timer moves are emitted natively,
+//* everything else (DRW, RND, keys, stack, stores) calls back into the interpreter
+//* for exactly one instruction, so both backends share the same semantics.
+//* Blocks chain into each other through a native dispatch stub while the cycle
+//* budget lasts, and only return to run() for cold code or after a memory store.
+class Jit {
+private:
+    //* Enter generated code at `body` with a cycle budget.
+    //* Returns the unused budget in the low 32 bits and the natively executed instructions above.
+    typedef uint64_t (*EnterFn)(Chip8 *chip8, uint32_t budget, const void *body);
+
+    //* Layout is read by the dispatch stub: body at +0, length at +8
+    struct Block {
+        const uint8_t   *body;
+        uint16_t        length;     // Instructions in the block
+        uint16_t        pad[3];
+    };
+    static_assert(sizeof(Block) == 16, "the dispatch stub indexes blocks by pc * 16");
+
+    //* Static exit (jump, skip, call, fall through) waiting for its target to be translated
+    struct Link {
+        uint16_t        target;
+        uint8_t         *site;      // Budget compare immediate, the jump to the target follows
+    };
+
+    Block       blocks[4096];       // Translated blocks by entry address
+    uint8_t     heat[4096];         // Entries seen so far, translate once hot
+    uint8_t     covered[4096];      // Bytes read by a translated block
+
+    uint8_t     *code = nullptr;    // Code buffer, RX except inside translate()
+    size_t      codeSize = 0;
+    size_t      codeUsed = 0;
+
+    EnterFn     enter = nullptr;        // Shared trampoline at the start of the buffer
+    uint8_t     *dispatch = nullptr;    // Look up blocks[pc] and jump, or leave
+    uint8_t     *leave = nullptr;       // Return to run()
+    size_t      stubsSize = 0;
+
+    std::vector<Link> links;
+
+    bool        flushPending = false;
+
+    //* Byte offsets of the Chip8 fields used by the emitted code
+    int32_t     offV;
+    int32_t     offI;
+    int32_t     offPc;
+    int32_t     offDelay;
+    int32_t     offSound;
+
+    uint64_t    translated = 0;
+    uint64_t    flushes = 0;
+
+    void emitStubs();
+    //* Switch the whole buffer between RW and RX
+    bool setWritable(bool writable);
+    //* Unmap the buffer, leaving every block to the interpreter
+    void release();
+    //* Point a static exit straight at the target block
+    void patchLink(uint8_t *site, const Block &target);
+    void emitExit(class Emitter &e, uint16_t start, uint16_t target);
+    bool translate(Chip8 &chip8, uint16_t start);
+
+public:
+    static const uint8_t HOT_THRESHOLD = 4;
+    static const unsigned MAX_BLOCK_LENGTH = 64;
+
+    explicit Jit(Chip8 &chip8);
+    ~Jit();
+
+    Jit(const Jit &) = delete;
+    Jit &operator=(const Jit &) = delete;
+
+    //* Whether the host can run generated code
+    static bool available();
+    bool ready() const { return code != nullptr; }
+
+    //* Run exactly `cycles` instructions, same accounting as Chip8::runFrame
+    void run(Chip8 &chip8, unsigned cycles);
+
+    //* Drop every translated block
+    void flush();
+
+    //* Called for every memory write; translated code over addr is dropped
+    void invalidate(uint16_t addr)
+    {
+        addr &= 0xFFF;
+        if (covered[addr]) {
+            flushPending = true;
+        }
+    }
+
+    uint64_t blocksTranslated() const { return translated; }
+    uint64_t flushCount() const { return flushes; }
+};
+
+#endif // _JIT_H
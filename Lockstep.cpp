@@ -0,0 +1,642 @@
+#include "Lockstep.h"
+#include "SaveState.h"
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define LOCKSTEP_SIMD 1
+#include <immintrin.h>
+#else
+#define LOCKSTEP_SIMD 0
+#endif
+
+LockstepEngine::LockstepEngine(unsigned lanes)
+    : lanes(lanes), width((lanes + BLOCK - 1) / BLOCK * BLOCK)
+{
+    V.resize(16 * width);
+    I.resize(width);
+    pc.resize(width);
+    sp.resize(width);
+    stack.resize(16 * width);
+    delayTimer.resize(width);
+    soundTimer.resize(width);
+    keys.resize(2 * width);
+    mem.resize(width * MEM_STRIDE);
+    gfx.resize(width * SCREEN_HEIGHT);
+    rng.resize(width);
+    keyWait.resize(width);
+
+#if LOCKSTEP_SIMD
+    __builtin_cpu_init();
+    simd = __builtin_cpu_supports("avx2");
+#else
+    simd = false;
+#endif
+
+    reset();
+}
+
+void LockstepEngine::reset()
+{
+    //* Power-on RAM (font included) comes from the reference machine itself
+    std::unique_ptr<Chip8> blank(new Chip8());
+    SaveState state;
+    blank->saveState(state);
+
+    for (unsigned lane = 0; lane < width; lane++) {
+        memcpy(ram(lane), state.mem, MEM_SIZE);
+    }
+
+    std::fill(V.begin(), V.end(), 0);
+    std::fill(I.begin(), I.end(), 0);
+    std::fill(pc.begin(), pc.end(), START_LOCATION);
+    std::fill(sp.begin(), sp.end(), 0);
+    std::fill(stack.begin(), stack.end(), 0);
+    std::fill(delayTimer.begin(), delayTimer.end(), 0);
+    std::fill(soundTimer.begin(), soundTimer.end(), 0);
+    std::fill(keys.begin(), keys.end(), 0);
+    std::fill(gfx.begin(), gfx.end(), 0);
+    std::fill(keyWait.begin(), keyWait.end(), KeyWait());
+
+    memset(decoded, 0, sizeof(decoded));
+    memset(diverged, 0, sizeof(diverged));
+    instructionCount = 0;
+}
+
+bool LockstepEngine::load(const uint8_t *rom, size_t size)
+{
+    if (size > MAX_ROM_SIZE) {
+        return false;
+    }
+
+    for (unsigned lane = 0; lane < width; lane++) {
+        memcpy(ram(lane) + START_LOCATION, rom, size);
+    }
+    memset(decoded, 0, sizeof(decoded));
+
+    return true;
+}
+
+void LockstepEngine::setKeys(unsigned lane, const uint8_t key[16])
+{
+    uint16_t mask = 0;
+
+    for (int i = 0; i < 16; i++) {
+        if (key[i]) {
+            mask |= 1 << i;
+        }
+    }
+    keys[lane] = mask & 0xFF;
+    keys[width + lane] = mask >> 8;
+}
+
+void LockstepEngine::saveState(unsigned lane, SaveState &state) const
+{
+    state.magic = SAVE_STATE_MAGIC;
+    state.version = SAVE_STATE_VERSION;
+    state.size = sizeof(SaveState);
+
+    memcpy(state.gfx, &gfx[lane * SCREEN_HEIGHT], sizeof(state.gfx));
+    rng[lane].getState(state.rng);
+    for (int i = 0; i < 16; i++) {
+        state.stack[i] = stack[i * width + lane];
+        state.V[i] = V[i * width + lane];
+        state.key[i] = (keys[(i >> 3) * width + lane] >> (i & 7)) & 1;
+    }
+    state.I = I[lane];
+    state.pc = pc[lane];
+    memcpy(state.mem, ram(lane), MEM_SIZE);
+    state.sp = sp[lane];
+    state.delayTimer = delayTimer[lane];
+    state.soundTimer = soundTimer[lane];
+    state.keyWaitHeld = keyWait[lane].held;
+    state.keyWaitState = keyWait[lane].state;
+    state.keyWaitKey = keyWait[lane].key;
+    memset(state.reserved, 0, sizeof(state.reserved));
+}
+
+void LockstepEngine::seedRandom(uint64_t seed)
+{
+    Random stream(seed);
+
+    for (unsigned lane = 0; lane < width; lane++) {
+        rng[lane] = stream;
+        stream.jump();
+    }
+}
+
+uint16_t LockstepEngine::fetch(unsigned lane) const
+{
+    const uint8_t *m = ram(lane);
+    return (m[pc[lane] & 0xFFF] << 8) | m[(pc[lane] + 1) & 0xFFF];
+}
+
+void LockstepEngine::runFrame(unsigned cycles)
+{
+    for (unsigned cycle = 0; cycle < cycles; cycle++) {
+        step();
+    }
+
+    //* Same tick as Chip8::tickTimers, the compiler vectorizes these
+    for (unsigned lane = 0; lane < width; lane++) {
+        delayTimer[lane] -= delayTimer[lane] > 0;
+        soundTimer[lane] -= soundTimer[lane] > 0;
+    }
+
+    instructionCount += (uint64_t)cycles * lanes;
+}
+
+void LockstepEngine::step()
+{
+    if (simd) {
+        for (unsigned base = 0; base < width; base += BLOCK) {
+            stepBlock(base);
+        }
+        return;
+    }
+
+    for (unsigned lane = 0; lane < width; lane++) {
+        stepLane(lane, Chip8::decodeOpcode(fetch(lane)));
+    }
+}
+
+//* Dxyn on one lane, kept out of stepLane so whole groups can loop over it
+void LockstepEngine::drawLane(unsigned lane, const Instruction &in)
+{
+    const uint8_t *m = ram(lane);
+    uint64_t *screen = &gfx[lane * SCREEN_HEIGHT];
+    unsigned x = V[in.x * width + lane] % SCREEN_WIDTH;
+    unsigned y = V[in.y * width + lane];
+    uint16_t index = I[lane];
+    uint64_t collision = 0;
+
+    for (unsigned line = 0; line < in.n; line++) {
+        uint64_t row = (uint64_t)m[(index + line) & 0xFFF] << 56;
+        uint64_t &target = screen[(y + line) % SCREEN_HEIGHT];
+
+        row = (row >> x) | (row << ((SCREEN_WIDTH - x) % SCREEN_WIDTH));
+        collision |= target & row;
+        target ^= row;
+    }
+
+    V[0xF * width + lane] = collision != 0;
+    pc[lane] += 2;
+}
+
+//* One instruction on one lane. Mirrors Chip8::execute handler by handler, quirks
+//* included: the conformance check compares the two.
+void LockstepEngine::stepLane(unsigned lane, const Instruction &in)
+{
+    uint8_t *m = ram(lane);
+    auto v = [&](unsigned r) -> uint8_t & { return V[r * width + lane]; };
+    uint8_t &vx = v(in.x);
+    uint8_t &vy = v(in.y);
+    uint8_t &vf = v(0xF);
+    uint16_t &PC = pc[lane];
+    uint16_t down = keys[lane] | keys[width + lane] << 8;
+
+    //* Every store goes through here: lanes may now disagree on that byte
+    auto write = [&](uint16_t addr, uint8_t value) {
+        m[addr & 0xFFF] = value;
+        diverged[addr & 0xFFF] = 1;
+    };
+
+    switch (in.op) {
+        case OP_CLS:
+            memset(&gfx[lane * SCREEN_HEIGHT], 0, SCREEN_HEIGHT * sizeof(uint64_t));
+            PC += 2;
+            break;
+        case OP_RET:
+            PC = stack[(--sp[lane] & 0xF) * width + lane];
+            PC += 2;
+            break;
+        case OP_SYS:
+            PC += 2;
+            break;
+        case OP_JP:
+            PC = in.nnn;
+            break;
+        case OP_CALL:
+            stack[(sp[lane]++ & 0xF) * width + lane] = PC;
+            PC = in.nnn;
+            break;
+        case OP_SE_VX_KK:
+            PC += vx == in.kk ? 4 : 2;
+            break;
+        case OP_SNE_VX_KK:
+            PC += vx != in.kk ? 4 : 2;
+            break;
+        case OP_SE_VX_VY:
+            PC += vx == vy ? 4 : 2;
+            break;
+        case OP_LD_VX_KK:
+            vx = in.kk;
+            PC += 2;
+            break;
+        case OP_ADD_VX_KK:
+            vx += in.kk;
+            PC += 2;
+            break;
+        case OP_LD_VX_VY:
+            vx = vy;
+            PC += 2;
+            break;
+        case OP_OR:
+            vx |= vy;
+            PC += 2;
+            break;
+        case OP_AND:
+            vx &= vy;
+            PC += 2;
+            break;
+        case OP_XOR:
+            vx ^= vy;
+            PC += 2;
+            break;
+        case OP_ADD_VX_VY:
+            vx += vy;
+            vf = vy > (0xFF - vx);
+            PC += 2;
+            break;
+        case OP_SUB:
+            vf = vx > vy;
+            vx -= vy;
+            PC += 2;
+            break;
+        case OP_SHR:
+            vf = vx & 0x0001;
+            vx >>= 1;
+            PC += 2;
+            break;
+        case OP_SUBN:
+            vf = vy > vx;
+            vx = vy - vx;
+            PC += 2;
+            break;
+        case OP_SHL:
+            vf = vx >> 7;
+            vx <<= 1;
+            PC += 2;
+            break;
+        case OP_SNE_VX_VY:
+            PC += vx != vy ? 4 : 2;
+            break;
+        case OP_LD_I:
+            I[lane] = in.nnn;
+            PC += 2;
+            break;
+        case OP_JP_V0:
+            PC = in.nnn + v(0);
+            break;
+        case OP_RND:
+            vx = rng[lane].byte() & in.kk;
+            PC += 2;
+            break;
+        case OP_DRW:
+            drawLane(lane, in);
+            break;
+        case OP_SKP:
+            PC += (down >> (vx & 0xF)) & 1 ? 4 : 2;
+            break;
+        case OP_SKNP:
+            PC += (down >> (vx & 0xF)) & 1 ? 2 : 4;
+            break;
+        case OP_LD_VX_DT:
+            vx = delayTimer[lane];
+            PC += 2;
+            break;
+        case OP_LD_VX_K:
+            if (keyWait[lane].step(down)) {
+                vx = keyWait[lane].key;
+                PC += 2;
+            }
+            break;
+        case OP_LD_DT_VX:
+            delayTimer[lane] = vx;
+            PC += 2;
+            break;
+        case OP_LD_ST_VX:
+            soundTimer[lane] = vx;
+            PC += 2;
+            break;
+        case OP_ADD_I_VX:
+            vf = I[lane] + vx > 0xFFF;
+            I[lane] += vx;
+            PC += 2;
+            break;
+        case OP_LD_F_VX:
+            I[lane] = vx * 0x5;
+            PC += 2;
+            break;
+        case OP_LD_B_VX: {
+            uint8_t value = vx;
+            write(I[lane],     (value / 100) % 10);
+            write(I[lane] + 1, (value / 10) % 10);
+            write(I[lane] + 2, (value / 1) % 10);
+            PC += 2;
+            break;
+        }
+        case OP_LD_I_VX:
+            for (size_t i = 0; i <= in.x; i++) {
+                write(I[lane] + i, v(i));
+            }
+            PC += 2;
+            break;
+        case OP_LD_VX_I:
+            for (size_t i = 0; i <= in.x; i++) {
+                v(i) = m[(I[lane] + i) & 0xFFF];
+            }
+            PC += 2;
+            break;
+        default:
+            //* Invalid opcodes stall, like in Chip8
+            break;
+    }
+}
+
+#if LOCKSTEP_SIMD
+
+//* 32 lanes per vector: one byte per lane for V and the timers, two vectors of
+//* 16 words for pc and I
+
+__attribute__((target("avx2")))
+static inline __m256i maskFromBits(uint32_t bits)
+{
+    const __m256i spread = _mm256_setr_epi64x(
+        0x0000000000000000, 0x0101010101010101, 0x0202020202020202, 0x0303030303030303);
+    const __m256i select = _mm256_set1_epi64x((long long)0x8040201008040201ull);
+
+    __m256i v = _mm256_shuffle_epi8(_mm256_set1_epi32(bits), spread);
+    return _mm256_cmpeq_epi8(_mm256_and_si256(v, select), select);
+}
+
+//* Unsigned a > b per byte, 0xFF or 0
+__attribute__((target("avx2")))
+static inline __m256i greater(__m256i a, __m256i b)
+{
+    return _mm256_andnot_si256(_mm256_cmpeq_epi8(a, b), _mm256_cmpeq_epi8(_mm256_max_epu8(a, b), a));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i load8(const uint8_t *p)
+{
+    return _mm256_loadu_si256((const __m256i *)p);
+}
+
+__attribute__((target("avx2")))
+static inline void store8(uint8_t *p, __m256i value, __m256i mask)
+{
+    _mm256_storeu_si256((__m256i *)p, _mm256_blendv_epi8(load8(p), value, mask));
+}
+
+//* 0xFF where key Vx & 0xF is down: pick the low or high key byte on bit 3 of Vx,
+//* then test the bit the low three select
+__attribute__((target("avx2")))
+static inline __m256i keyDown(const uint8_t *low, const uint8_t *high, __m256i vx)
+{
+    const __m256i bits = _mm256_setr_epi8(
+        1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128,
+        1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+    const __m256i eight = _mm256_set1_epi8(8);
+
+    __m256i upper = _mm256_cmpeq_epi8(_mm256_and_si256(vx, eight), eight);
+    __m256i keys = _mm256_blendv_epi8(load8(low), load8(high), upper);
+    __m256i bit = _mm256_shuffle_epi8(bits, _mm256_and_si256(vx, _mm256_set1_epi8(7)));
+
+    return _mm256_cmpeq_epi8(_mm256_and_si256(keys, bit), bit);
+}
+
+//* 16-bit lane arrays (pc, I) as two halves
+struct Words {
+    __m256i lo, hi;
+};
+
+__attribute__((target("avx2")))
+static inline Words load16(const uint16_t *p)
+{
+    return { _mm256_loadu_si256((const __m256i *)p), _mm256_loadu_si256((const __m256i *)(p + 16)) };
+}
+
+__attribute__((target("avx2")))
+static inline void store16(uint16_t *p, Words value, Words mask)
+{
+    Words old = load16(p);
+    _mm256_storeu_si256((__m256i *)p, _mm256_blendv_epi8(old.lo, value.lo, mask.lo));
+    _mm256_storeu_si256((__m256i *)(p + 16), _mm256_blendv_epi8(old.hi, value.hi, mask.hi));
+}
+
+//* Bytes to words, zero or sign extended
+__attribute__((target("avx2")))
+static inline Words widen(__m256i bytes, bool sign)
+{
+    __m128i lo = _mm256_castsi256_si128(bytes);
+    __m128i hi = _mm256_extracti128_si256(bytes, 1);
+    if (sign) {
+        return { _mm256_cvtepi8_epi16(lo), _mm256_cvtepi8_epi16(hi) };
+    }
+    return { _mm256_cvtepu8_epi16(lo), _mm256_cvtepu8_epi16(hi) };
+}
+
+//* Words that are 0 or 0xFFFF back to bytes, lane order kept
+__attribute__((target("avx2")))
+static inline __m256i narrow(Words words)
+{
+    return _mm256_permute4x64_epi64(_mm256_packs_epi16(words.lo, words.hi), 0xD8);
+}
+
+__attribute__((target("avx2")))
+static inline Words add16(Words a, __m256i b)
+{
+    return { _mm256_add_epi16(a.lo, b), _mm256_add_epi16(a.hi, b) };
+}
+
+__attribute__((target("avx2")))
+void LockstepEngine::stepBlock(unsigned base)
+{
+    uint32_t pending = ~0u;
+    Words pcs = load16(&pc[base]);
+
+    while (pending) {
+        unsigned leader = base + __builtin_ctz(pending);
+        __m256i target = _mm256_set1_epi16(pc[leader]);
+        Words same = { _mm256_cmpeq_epi16(pcs.lo, target), _mm256_cmpeq_epi16(pcs.hi, target) };
+
+        uint32_t group = (uint32_t)_mm256_movemask_epi8(narrow(same)) & pending;
+        pending &= ~group;
+
+        uint16_t addr = pc[leader] & 0xFFF;
+        if (diverged[addr] || diverged[(addr + 1) & 0xFFF]) {
+            //* The lanes may hold different code here
+            for (uint32_t bits = group; bits; bits &= bits - 1) {
+                unsigned lane = base + __builtin_ctz(bits);
+                stepLane(lane, Chip8::decodeOpcode(fetch(lane)));
+            }
+            continue;
+        }
+
+        Instruction &in = decoded[addr];
+        if (in.op == OP_DECODE) {
+            in = Chip8::decodeOpcode(fetch(leader));
+        }
+
+        if (in.op == OP_DRW) {
+            for (uint32_t bits = group; bits; bits &= bits - 1) {
+                drawLane(base + __builtin_ctz(bits), in);
+            }
+        } else if (!stepGroup(base, group, in)) {
+            for (uint32_t bits = group; bits; bits &= bits - 1) {
+                stepLane(base + __builtin_ctz(bits), in);
+            }
+        }
+    }
+}
+
+//* Vector version of the register-only opcodes for the lanes in `group`.
+//* Every store is a blend, and stores happen in the same order as in the scalar
+//* handler so aliasing registers (x or y being VF) behave the same.
+//* Returns false for the opcodes that have to run lane by lane.
+__attribute__((target("avx2")))
+bool LockstepEngine::stepGroup(unsigned base, uint32_t group, const Instruction &in)
+{
+    const __m256i mask = maskFromBits(group);
+    const Words mask16 = widen(mask, true);
+    const __m256i one = _mm256_set1_epi8(1);
+    const __m256i two = _mm256_set1_epi16(2);
+
+    uint8_t *vx = reg(in.x) + base;
+    uint8_t *vy = reg(in.y) + base;
+    uint8_t *vf = reg(0xF) + base;
+    uint16_t *PC = &pc[base];
+    Words next = add16(load16(PC), two);
+    __m256i skip;
+
+    switch (in.op) {
+        case OP_SYS:
+            break;
+        case OP_JP:
+            next.lo = next.hi = _mm256_set1_epi16(in.nnn);
+            break;
+        case OP_SE_VX_KK:
+            skip = _mm256_cmpeq_epi8(load8(vx), _mm256_set1_epi8(in.kk));
+            goto conditional;
+        case OP_SNE_VX_KK:
+            skip = _mm256_xor_si256(_mm256_cmpeq_epi8(load8(vx), _mm256_set1_epi8(in.kk)), _mm256_set1_epi8(-1));
+            goto conditional;
+        case OP_SE_VX_VY:
+            skip = _mm256_cmpeq_epi8(load8(vx), load8(vy));
+            goto conditional;
+        case OP_SNE_VX_VY:
+            skip = _mm256_xor_si256(_mm256_cmpeq_epi8(load8(vx), load8(vy)), _mm256_set1_epi8(-1));
+            goto conditional;
+        case OP_SKP:
+            skip = keyDown(&keys[base], &keys[width + base], load8(vx));
+            goto conditional;
+        case OP_SKNP:
+            skip = _mm256_xor_si256(keyDown(&keys[base], &keys[width + base], load8(vx)), _mm256_set1_epi8(-1));
+        conditional: {
+            Words taken = widen(skip, true);
+            next.lo = _mm256_add_epi16(next.lo, _mm256_and_si256(taken.lo, two));
+            next.hi = _mm256_add_epi16(next.hi, _mm256_and_si256(taken.hi, two));
+            break;
+        }
+        case OP_LD_VX_KK:
+            store8(vx, _mm256_set1_epi8(in.kk), mask);
+            break;
+        case OP_ADD_VX_KK:
+            store8(vx, _mm256_add_epi8(load8(vx), _mm256_set1_epi8(in.kk)), mask);
+            break;
+        case OP_LD_VX_VY:
+            store8(vx, load8(vy), mask);
+            break;
+        case OP_OR:
+            store8(vx, _mm256_or_si256(load8(vx), load8(vy)), mask);
+            break;
+        case OP_AND:
+            store8(vx, _mm256_and_si256(load8(vx), load8(vy)), mask);
+            break;
+        case OP_XOR:
+            store8(vx, _mm256_xor_si256(load8(vx), load8(vy)), mask);
+            break;
+        case OP_ADD_VX_VY:
+            store8(vx, _mm256_add_epi8(load8(vx), load8(vy)), mask);
+            store8(vf, _mm256_and_si256(greater(load8(vy), _mm256_xor_si256(load8(vx), _mm256_set1_epi8(-1))), one), mask);
+            break;
+        case OP_SUB:
+            store8(vf, _mm256_and_si256(greater(load8(vx), load8(vy)), one), mask);
+            store8(vx, _mm256_sub_epi8(load8(vx), load8(vy)), mask);
+            break;
+        case OP_SHR:
+            store8(vf, _mm256_and_si256(load8(vx), one), mask);
+            store8(vx, _mm256_and_si256(_mm256_srli_epi16(load8(vx), 1), _mm256_set1_epi8(0x7F)), mask);
+            break;
+        case OP_SUBN:
+            store8(vf, _mm256_and_si256(greater(load8(vy), load8(vx)), one), mask);
+            store8(vx, _mm256_sub_epi8(load8(vy), load8(vx)), mask);
+            break;
+        case OP_SHL:
+            store8(vf, _mm256_and_si256(_mm256_srli_epi16(load8(vx), 7), one), mask);
+            store8(vx, _mm256_add_epi8(load8(vx), load8(vx)), mask);
+            break;
+        case OP_LD_I: {
+            __m256i value = _mm256_set1_epi16(in.nnn);
+            store16(&I[base], { value, value }, mask16);
+            break;
+        }
+        case OP_LD_VX_DT:
+            store8(vx, load8(&delayTimer[base]), mask);
+            break;
+        case OP_LD_DT_VX:
+            store8(&delayTimer[base], load8(vx), mask);
+            break;
+        case OP_LD_ST_VX:
+            store8(&soundTimer[base], load8(vx), mask);
+            break;
+        case OP_ADD_I_VX: {
+            //* VF = I + Vx > 0xFFF, written as I > 0xFFF - Vx to stay within 16 bits
+            Words index = load16(&I[base]);
+            Words limit = widen(load8(vx), false);
+            limit.lo = _mm256_sub_epi16(_mm256_set1_epi16(0xFFF), limit.lo);
+            limit.hi = _mm256_sub_epi16(_mm256_set1_epi16(0xFFF), limit.hi);
+            Words over = {
+                _mm256_andnot_si256(_mm256_cmpeq_epi16(index.lo, limit.lo),
+                    _mm256_cmpeq_epi16(_mm256_max_epu16(index.lo, limit.lo), index.lo)),
+                _mm256_andnot_si256(_mm256_cmpeq_epi16(index.hi, limit.hi),
+                    _mm256_cmpeq_epi16(_mm256_max_epu16(index.hi, limit.hi), index.hi)),
+            };
+            store8(vf, _mm256_and_si256(narrow(over), one), mask);
+
+            Words add = widen(load8(vx), false);
+            store16(&I[base], { _mm256_add_epi16(index.lo, add.lo), _mm256_add_epi16(index.hi, add.hi) }, mask16);
+            break;
+        }
+        case OP_LD_F_VX: {
+            Words digit = widen(load8(vx), false);
+            __m256i five = _mm256_set1_epi16(5);
+            store16(&I[base], { _mm256_mullo_epi16(digit.lo, five), _mm256_mullo_epi16(digit.hi, five) }, mask16);
+            break;
+        }
+        default:
+            return false;
+    }
+
+    store16(PC, next, mask16);
+    return true;
+}
+
+#else
+
+void LockstepEngine::stepBlock(unsigned base)
+{
+    for (unsigned lane = base; lane < base + BLOCK; lane++) {
+        stepLane(lane, Chip8::decodeOpcode(fetch(lane)));
+    }
+}
+
+bool LockstepEngine::stepGroup(unsigned, uint32_t, const Instruction &)
+{
+    return false;
+}
+
+#endif
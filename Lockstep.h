@@ -0,0 +1,91 @@
+#ifndef _LOCKSTEP_H
+#define _LOCKSTEP_H
+
+#include "Chip8.h"
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+struct SaveState;
+
+//* Many Chip8 machines running the same ROM, stored as struct-of-arrays and
+//* stepped together: every step executes one instruction on every lane.
+//*
+//* Lanes are processed in blocks of 32. Within a block, the lanes sitting on the
+//* same pc form a group; register and timer opcodes run once per group on AVX2
+//* vectors, masked to the group's lanes. Everything touching per-lane memory,
+//* the stack, the screen or the keys (DRW, CALL/RET, Fx33/55/65, ...) runs lane
+//* by lane with the same semantics as Chip8::emulateCycle.
+class LockstepEngine {
+private:
+    static const unsigned BLOCK = 32;
+    //* Each lane's RAM is padded past 4KB so the lanes don't all map to the same cache sets
+    static const size_t MEM_STRIDE = MEM_SIZE + 64;
+
+    unsigned lanes;
+    unsigned width;                 // lanes rounded up to BLOCK, the padding lanes run too
+
+    std::vector<uint8_t>  V;        // [16][width]
+    std::vector<uint16_t> I;
+    std::vector<uint16_t> pc;
+    std::vector<uint8_t>  sp;
+    std::vector<uint16_t> stack;    // [16][width]
+    std::vector<uint8_t>  delayTimer;
+    std::vector<uint8_t>  soundTimer;
+    std::vector<uint8_t>  keys;     // [2][width]: keys 0-7 then keys 8-15, one bit per key down
+    std::vector<uint8_t>  mem;      // [width][MEM_STRIDE]
+    std::vector<uint64_t> gfx;      // [width][SCREEN_HEIGHT]
+    std::vector<Random>   rng;      // Cxkk runs lane by lane, one generator per lane
+    std::vector<KeyWait>  keyWait;  // Fx0A too
+
+    //* Decodes of the code every lane shares
+    Instruction decoded[MEM_SIZE];
+    //* Addresses some lane has written: lanes may disagree on their bytes from now on,
+    //* instructions there are fetched and decoded per lane
+    uint8_t diverged[MEM_SIZE];
+
+    bool simd;
+
+    uint8_t *reg(unsigned r) { return &V[r * width]; }
+    uint8_t *ram(unsigned lane) { return &mem[lane * MEM_STRIDE]; }
+    const uint8_t *ram(unsigned lane) const { return &mem[lane * MEM_STRIDE]; }
+    uint16_t fetch(unsigned lane) const;
+
+    void step();
+    void stepBlock(unsigned base);
+    bool stepGroup(unsigned base, uint32_t group, const Instruction &in);
+    void stepLane(unsigned lane, const Instruction &in);
+    void drawLane(unsigned lane, const Instruction &in);
+
+public:
+    explicit LockstepEngine(unsigned lanes);
+
+    unsigned size() const { return lanes; }
+
+    //* Power-on state on every lane
+    void reset();
+    //* The same ROM on every lane
+    bool load(const uint8_t *rom, size_t size);
+
+    void setKeys(unsigned lane, const uint8_t key[16]);
+
+    //* Lane n draws from stream n of the seed, as Chip8::seedRandom(seed, n) would.
+    //* Kept across reset(), like on Chip8.
+    void seedRandom(uint64_t seed);
+    void setRandom(unsigned lane, const Random &random) { rng[lane] = random; }
+
+    //* `cycles` instructions on every lane, then one timer tick
+    void runFrame(unsigned cycles);
+
+    //* One lane's machine state, in the format Chip8::saveState produces
+    void saveState(unsigned lane, SaveState &state) const;
+
+    //* Instructions executed over all lanes (padding lanes excluded)
+    uint64_t instructionCount = 0;
+
+    //* False when stepping falls back to one lane at a time (no AVX2 on this host)
+    bool vectorized() const { return simd; }
+};
+
+#endif // _LOCKSTEP_H
@@ -0,0 +1,76 @@
+#include "Perf.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstring>
+
+static int openCounter(uint64_t config)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+PerfCounters::PerfCounters()
+{
+    fds[CACHE_MISSES] = openCounter(PERF_COUNT_HW_CACHE_MISSES);
+    fds[BRANCH_MISSES] = openCounter(PERF_COUNT_HW_BRANCH_MISSES);
+}
+
+PerfCounters::~PerfCounters()
+{
+    for (int fd : fds) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+}
+
+void PerfCounters::start()
+{
+    for (int fd : fds) {
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+void PerfCounters::stop()
+{
+    for (int i = 0; i < COUNTER_COUNT; i++) {
+        values[i] = 0;
+
+        if (fds[i] >= 0) {
+            ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+            if (read(fds[i], &values[i], sizeof(values[i])) != sizeof(values[i])) {
+                values[i] = 0;
+            }
+        }
+    }
+}
+
+#else
+
+PerfCounters::PerfCounters()
+{
+    for (int &fd : fds) {
+        fd = -1;
+    }
+}
+
+PerfCounters::~PerfCounters() = default;
+void PerfCounters::start() {}
+void PerfCounters::stop() {}
+
+#endif
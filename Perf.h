@@ -0,0 +1,38 @@
+#ifndef _PERF_H
+#define _PERF_H
+
+#include <cstdint>
+
+//* Hardware counters of the calling thread through perf_event_open (Linux only).
+//* Any counter the kernel refuses (no PMU, perf_event_paranoid, containers) simply
+//* reads as unavailable, the caller keeps measuring time.
+class PerfCounters {
+public:
+    enum Counter {
+        CACHE_MISSES,
+        BRANCH_MISSES,
+        COUNTER_COUNT
+    };
+
+private:
+    int fds[COUNTER_COUNT];
+    uint64_t values[COUNTER_COUNT] = {};
+
+public:
+    PerfCounters();
+    ~PerfCounters();
+
+    PerfCounters(const PerfCounters &) = delete;
+    PerfCounters &operator=(const PerfCounters &) = delete;
+
+    bool available(Counter counter) const { return fds[counter] >= 0; }
+
+    //* Zero and start every counter
+    void start();
+    //* Stop and latch the values read by value()
+    void stop();
+
+    uint64_t value(Counter counter) const { return values[counter]; }
+};
+
+#endif // _PERF_H
@@ -0,0 +1,252 @@
+#include "Profile.h"
+#include "Disasm.h"
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+
+//* Opcode class names, in OpKind order
+static const char *const opNames[OP_COUNT] = {
+    "(undecoded)",
+    "00E0 CLS", "00EE RET", "0nnn SYS", "1nnn JP", "2nnn CALL",
+    "3xkk SE Vx, kk", "4xkk SNE Vx, kk", "5xy0 SE Vx, Vy", "6xkk LD Vx, kk", "7xkk ADD Vx, kk",
+    "8xy0 LD Vx, Vy", "8xy1 OR", "8xy2 AND", "8xy3 XOR", "8xy4 ADD Vx, Vy",
+    "8xy5 SUB", "8xy6 SHR", "8xy7 SUBN", "8xyE SHL", "9xy0 SNE Vx, Vy",
+    "Annn LD I", "Bnnn JP V0", "Cxkk RND", "Dxyn DRW", "Ex9E SKP", "ExA1 SKNP",
+    "Fx07 LD Vx, DT", "Fx0A LD Vx, K", "Fx15 LD DT, Vx", "Fx18 LD ST, Vx", "Fx1E ADD I, Vx",
+    "Fx29 LD F, Vx", "Fx33 LD B, Vx", "Fx55 LD [I], Vx", "Fx65 LD Vx, [I]",
+    "invalid",
+};
+
+static double steadySeconds()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+Profiler::Profiler()
+{
+    Node root;
+    root.addr = 0;
+    root.parent = 0;
+    nodes.push_back(root);
+
+    clockStart = profileClock();
+    secondsStart = steadySeconds();
+}
+
+void Profiler::call(uint16_t from, uint16_t target, uint64_t instructionCount)
+{
+    transfer(from, target);
+    charge(instructionCount);
+
+    if (lost) {
+        lost++;
+        return;
+    }
+
+    uint32_t node = nodes[current].child;
+    while (node && nodes[node].addr != target) {
+        node = nodes[node].sibling;
+    }
+
+    if (!node) {
+        if (nodes.size() >= MAX_NODES) {
+            //* Keep charging the caller until the stack comes back up
+            lost = 1;
+            return;
+        }
+
+        Node child;
+        child.addr = target;
+        child.parent = current;
+        child.sibling = nodes[current].child;
+        node = nodes.size();
+        nodes[current].child = node;
+        nodes.push_back(child);
+    }
+
+    nodes[node].calls++;
+    current = node;
+}
+
+void Profiler::ret(uint16_t from, uint16_t to, uint64_t instructionCount)
+{
+    transfer(from, to);
+    charge(instructionCount);
+
+    if (lost) {
+        lost--;
+        return;
+    }
+
+    //* A RET with nothing called (the ROM started inside a routine) stays at the root
+    current = nodes[current].parent;
+}
+
+void Profiler::resume(uint16_t pc, uint64_t instructionCount)
+{
+    flow[pc & 0xFFF].arrivals++;
+    current = 0;
+    lost = 0;
+    mark = instructionCount;
+}
+
+void Profiler::suspend(uint16_t pc, uint64_t instructionCount)
+{
+    unfinished[pc & 0xFFF]++;
+    charge(instructionCount);
+}
+
+void Profiler::addressCounts(uint64_t counts[4096]) const
+{
+    //* Two chains, even and odd addresses: each address gets its arrivals plus
+    //* whatever ran at addr - 2 and didn't leave it another way
+    for (int addr = 0; addr < 4096; addr++) {
+        uint64_t fallthrough = addr >= 2 ? counts[addr - 2] - flow[addr - 2].departures : 0;
+        counts[addr] = flow[addr].arrivals + fallthrough - unfinished[addr];
+    }
+}
+
+double Profiler::secondsPerTick() const
+{
+    uint64_t ticks = profileClock() - clockStart;
+    double seconds = steadySeconds() - secondsStart;
+
+    return ticks ? seconds / ticks : 0;
+}
+
+void Profiler::writePath(FILE *file, uint32_t node, const char *root) const
+{
+    if (!node) {
+        fputs(root, file);
+        return;
+    }
+
+    writePath(file, nodes[node].parent, root);
+    fprintf(file, ";sub_%03X", nodes[node].addr);
+}
+
+void Profiler::writeFolded(FILE *file, const char *root) const
+{
+    for (uint32_t node = 0; node < nodes.size(); node++) {
+        if (nodes[node].self) {
+            writePath(file, node, root);
+            fprintf(file, " %llu\n", (unsigned long long)nodes[node].self);
+        }
+    }
+}
+
+void Profiler::writeListing(FILE *file, const uint8_t *mem) const
+{
+    uint64_t pcCount[4096];
+    uint64_t opCount[OP_COUNT] = {};
+    uint64_t total = 0;
+
+    addressCounts(pcCount);
+    for (int addr = 0; addr < 4096; addr++) {
+        if (pcCount[addr]) {
+            uint16_t opcode = mem[addr] << 8 | mem[(addr + 1) & 0xFFF];
+            opCount[Chip8::decodeOpcode(opcode).op] += pcCount[addr];
+            total += pcCount[addr];
+        }
+    }
+    double share = total ? 100.0 / total : 0;
+
+    fprintf(file, "Instructions : %llu\n\n", (unsigned long long)total);
+
+    //* Opcode classes, busiest first
+    std::vector<int> ops;
+    for (int op = 0; op < OP_COUNT; op++) {
+        if (opCount[op]) {
+            ops.push_back(op);
+        }
+    }
+    std::sort(ops.begin(), ops.end(), [&opCount](int a, int b) { return opCount[a] > opCount[b]; });
+
+    fprintf(file, "Opcode classes:\n");
+    for (int op : ops) {
+        fprintf(file, "  %-18s %12llu %6.2f%%\n", opNames[op], (unsigned long long)opCount[op], opCount[op] * share);
+    }
+
+    double drwEach = drwTimed ? drwTicks * secondsPerTick() / drwTimed : 0;
+    fprintf(file, "\nDRW          : %llu draws, %.3f ms host time, %.1f ns each (%llu timed)\n",
+        (unsigned long long)draws, drwEach * draws * 1e3, drwEach * 1e9, (unsigned long long)drwTimed);
+    fprintf(file, "Key waits    : %llu instructions (%.2f%%) spent in Fx0A with no key\n",
+        (unsigned long long)keyWaits, keyWaits * share);
+    fprintf(file, "Timer polls  : %llu Fx07 (%.2f%%) read a delay timer still running\n",
+        (unsigned long long)timerPolls, timerPolls * share);
+
+    //* Per subroutine: calls, own instructions, and inclusive ones counted once
+    //* even through recursion. Children always come after their parent.
+    std::vector<uint64_t> inclusive(nodes.size());
+    for (size_t node = nodes.size(); node-- > 0;) {
+        inclusive[node] += nodes[node].self;
+        if (node) {
+            inclusive[nodes[node].parent] += inclusive[node];
+        }
+    }
+
+    struct Routine {
+        uint64_t calls = 0;
+        uint64_t self = 0;
+        uint64_t inclusive = 0;
+    };
+    std::map<uint16_t, Routine> routines;
+    for (uint32_t node = 1; node < nodes.size(); node++) {
+        Routine &routine = routines[nodes[node].addr];
+        routine.calls += nodes[node].calls;
+        routine.self += nodes[node].self;
+
+        uint32_t up = nodes[node].parent;
+        while (up && nodes[up].addr != nodes[node].addr) {
+            up = nodes[up].parent;
+        }
+        if (!up) {
+            routine.inclusive += inclusive[node];
+        }
+    }
+
+    if (!routines.empty()) {
+        fprintf(file, "\nSubroutines:        calls         self    inclusive\n");
+        for (auto &routine : routines) {
+            fprintf(file, "  sub_%03X %16llu %12llu %12llu %6.2f%%\n", routine.first,
+                (unsigned long long)routine.second.calls,
+                (unsigned long long)routine.second.self,
+                (unsigned long long)routine.second.inclusive,
+                routine.second.inclusive * share);
+        }
+    }
+
+    //* Annotated disassembly of every address that ran
+    uint64_t hottest = *std::max_element(pcCount, pcCount + 4096);
+    char mnemonic[64];
+    int last = -2;
+
+    fprintf(file, "\nListing:\n");
+    for (int addr = 0; addr < 4096; addr++) {
+        if (!pcCount[addr]) {
+            continue;
+        }
+
+        if (last >= 0 && addr != last + 2) {
+            fprintf(file, "        ...\n");
+        }
+        last = addr;
+
+        if (routines.count(addr)) {
+            fprintf(file, "sub_%03X:\n", addr);
+        }
+
+        uint16_t opcode = mem[addr] << 8 | mem[(addr + 1) & 0xFFF];
+        disassemble(opcode, mnemonic, sizeof(mnemonic));
+        for (char *c = mnemonic; *c; c++) {
+            if (*c == '\t') {
+                *c = ' ';
+            }
+        }
+
+        int bar = hottest ? (int)(pcCount[addr] * 20 / hottest) : 0;
+        fprintf(file, "  %03X  %04X  %-24s %12llu %6.2f%%  %.*s\n", addr, opcode, mnemonic,
+            (unsigned long long)pcCount[addr], pcCount[addr] * share, bar, "####################");
+    }
+}
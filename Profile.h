@@ -0,0 +1,142 @@
+#ifndef _PROFILE_H
+#define _PROFILE_H
+
+#include "Chip8.h"
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+//* Profiling is a compile-time policy like tracing: built without -DCHIP8_PROFILE
+//* every profiler hook in the core is an `if constexpr` on a false constant and disappears.
+#ifdef CHIP8_PROFILE
+constexpr bool PROFILE_ENABLED = true;
+#else
+constexpr bool PROFILE_ENABLED = false;
+#endif
+
+//* Cheap host timestamp for the DRW timer: TSC ticks on x86, nanoseconds elsewhere.
+//* Profiler converts ticks to seconds against the steady clock.
+inline uint64_t profileClock()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+//* Both ends of the control transfers of one address, side by side
+struct ProfileFlow {
+    uint64_t arrivals;          // Control transferred to the address
+    uint64_t departures;        // The instruction there transferred control away
+};
+
+//* Where one Chip8 spends its cycles: executions per address and per opcode class,
+//* host time in DRW, instructions lost waiting, and the call graph of 2nnn/00EE.
+//* Straight-line code costs nothing: only control transfers (jumps, calls, returns,
+//* taken skips) are counted, at both ends, and the per-address counts are rebuilt
+//* from them like arc profiling does: an address runs as often as control arrived at
+//* it, plus the times its predecessor ran and fell through.
+class Profiler {
+private:
+    //* One node per distinct call path, self counts instructions run with that path on top
+    struct Node {
+        uint16_t addr;          // Subroutine entry, 0 for the root
+        uint32_t parent;
+        uint32_t child = 0;     // First child, 0 = none (the root is never a child)
+        uint32_t sibling = 0;
+        uint64_t self = 0;
+        uint64_t calls = 0;
+    };
+    static const size_t MAX_NODES = 1 << 16;
+
+    std::vector<Node> nodes;
+    uint32_t current = 0;
+    uint64_t mark = 0;          // Instruction count when `current` was entered or resumed
+    unsigned lost = 0;          // Calls deeper than the tree could hold, their RETs are skipped
+
+    ProfileFlow flow[4096] = {};
+    uint64_t unfinished[4096] = {};     // Arrived but never ran: the profile stopped there
+
+    uint64_t draws = 0;
+    uint64_t clockStart;
+    double secondsStart;
+
+    void charge(uint64_t instructionCount)
+    {
+        nodes[current].self += instructionCount - mark;
+        mark = instructionCount;
+    }
+
+    void writePath(FILE *file, uint32_t node, const char *root) const;
+
+public:
+    uint64_t drwTicks = 0;              // profileClock() ticks inside the timed DRWs
+    uint64_t drwTimed = 0;
+    uint64_t keyWaits = 0;              // Fx0A executions that found no key press yet
+    uint64_t timerPolls = 0;            // Fx07 reading a delay timer still running
+
+    Profiler();
+
+    //* Jumps, taken skips, and anything else that doesn't go on to from + 2.
+    //* The interpreter counts its jumps straight into flows().
+    void transfer(uint16_t from, uint16_t to)
+    {
+        flow[from & 0xFFF].departures++;
+        flow[to & 0xFFF].arrivals++;
+    }
+    ProfileFlow *flows() { return flow; }
+
+    //* 2nnn and 00EE, with the instruction count at that point
+    void call(uint16_t from, uint16_t target, uint64_t instructionCount);
+    void ret(uint16_t from, uint16_t to, uint64_t instructionCount);
+
+    //* Fx0A found nothing: the instruction runs again in place
+    void keyWait(uint16_t pc)
+    {
+        transfer(pc, pc);
+        keyWaits++;
+    }
+
+    //* Only one DRW in DRW_SAMPLE is timed: reading the clock costs as much as the
+    //* draw itself (more under virtualization), the total is extrapolated
+    static const uint64_t DRW_SAMPLE = 256;
+    bool timeDraw() { return (draws++ & (DRW_SAMPLE - 1)) == 0; }
+    void drawTimed(uint64_t ticks)
+    {
+        drwTicks += ticks;
+        drwTimed++;
+    }
+
+    //* Execution starts or goes on at pc with instructionCount done, back at the
+    //* root of the call graph (attach, reset, state load)
+    void resume(uint16_t pc, uint64_t instructionCount);
+    //* Execution stops before running pc (detach, reset, state load)
+    void suspend(uint16_t pc, uint64_t instructionCount);
+
+    //* Executions of every address, rebuilt from the transfers
+    void addressCounts(uint64_t counts[4096]) const;
+
+    //* Host seconds per profileClock() tick, measured since construction
+    double secondsPerTick() const;
+
+    //* Folded stacks, one `root;sub_2A4;sub_31C <instructions>` line per call path,
+    //* the input format of flamegraph.pl, inferno and speedscope
+    void writeFolded(FILE *file, const char *root) const;
+
+    //* Summary (opcode classes, DRW time, waits, subroutines) followed by the
+    //* disassembly of every executed address with its count and share. Opcode
+    //* classes are read from mem, the memory the profile ended with.
+    void writeListing(FILE *file, const uint8_t *mem) const;
+};
+
+#endif // _PROFILE_H
@@ -0,0 +1,147 @@
+#include "Quirks.h"
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+static const char *const profileNames[QUIRK_PROFILE_COUNT] = { "legacy", "chip8", "schip-quirks",
+    "xochip-quirks" };
+
+const char *quirkProfileName(QuirkProfile profile)
+{
+    return profile < QUIRK_PROFILE_COUNT ? profileNames[profile] : "unknown";
+}
+
+bool parseQuirkProfile(const char *name, QuirkProfile &profile)
+{
+    for (int i = 0; i < QUIRK_PROFILE_COUNT; i++) {
+        if (!strcmp(name, profileNames[i])) {
+            profile = (QuirkProfile)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+//* 00Cn/00Dn scroll, 00FB-00FF scroll, exit and resolution, 5xy2/5xy3 register ranges,
+//* F000 nnnn long I, Fn01 planes, F002 audio, Fx30 big font, Fx3A pitch, Fx75/Fx85 flags
+static bool variantOpcode(uint16_t opcode)
+{
+    switch (opcode >> 12) {
+        case 0x0:
+            return (opcode & 0xFFE0) == 0x00C0 || (opcode >= 0x00FB && opcode <= 0x00FF);
+        case 0x5:
+            return (opcode & 0xF) == 0x2 || (opcode & 0xF) == 0x3;
+        case 0xF:
+            switch (opcode & 0xFF) {
+                case 0x00: case 0x01: case 0x02: case 0x30: case 0x3A: case 0x75: case 0x85:
+                    return true;
+            }
+            return false;
+        default:
+            return false;
+    }
+}
+
+uint16_t findVariantOpcode(const uint8_t *rom, size_t size)
+{
+    const unsigned start = 0x200;
+    std::vector<bool> seen(size, false);
+    std::vector<unsigned> pending(1, start);
+
+    while (!pending.empty()) {
+        unsigned addr = pending.back();
+        pending.pop_back();
+
+        //* Off the ROM (or into RAM it never wrote), or already followed
+        if (addr < start || addr - start + 1 >= size || seen[addr - start]) {
+            continue;
+        }
+        seen[addr - start] = true;
+
+        uint16_t opcode = rom[addr - start] << 8 | rom[addr - start + 1];
+        uint16_t nnn = opcode & 0xFFF;
+        if (variantOpcode(opcode)) {
+            return addr;
+        }
+
+        switch (opcode >> 12) {
+            case 0x0:
+                if (opcode != 0x00EE) {
+                    pending.push_back(addr + 2);
+                }
+                break;
+            case 0x1:
+                pending.push_back(nnn);
+                break;
+            case 0x2:
+                pending.push_back(nnn);
+                pending.push_back(addr + 2);
+                break;
+            case 0x3: case 0x4: case 0x5: case 0x9:
+                pending.push_back(addr + 2);
+                pending.push_back(addr + 4);
+                break;
+            case 0xB:
+                //* Computed jump, the targets aren't known
+                break;
+            case 0xE:
+                pending.push_back(addr + 2);
+                pending.push_back(addr + 4);
+                break;
+            default:
+                pending.push_back(addr + 2);
+                break;
+        }
+    }
+    return 0;
+}
+
+bool QuirkDatabase::load(const char *path)
+{
+    FILE *file = fopen(path, "r");
+
+    if (!file) {
+        fprintf(stderr, "Fail to load the quirk database: %s\n", path);
+        return false;
+    }
+
+    char line[256];
+    int number = 0;
+    bool ok = true;
+
+    while (fgets(line, sizeof(line), file)) {
+        number++;
+
+        char *comment = strchr(line, '#');
+        if (comment) {
+            *comment = '\0';
+        }
+
+        char first;
+        if (sscanf(line, " %c", &first) != 1) {
+            continue;
+        }
+
+        uint64_t hash;
+        char name[32];
+        QuirkProfile profile;
+        if (sscanf(line, " %" SCNx64 " %31s", &hash, name) != 2 || !parseQuirkProfile(name, profile)) {
+            fprintf(stderr, "%s:%d: expected <ROM hash> <legacy|chip8|schip-quirks|xochip-quirks>\n", path, number);
+            ok = false;
+            continue;
+        }
+
+        profiles[hash] = profile;
+    }
+
+    fclose(file);
+    return ok;
+}
+
+QuirkProfile QuirkDatabase::lookup(uint64_t hash, QuirkProfile fallback) const
+{
+    auto found = profiles.find(hash);
+    return found != profiles.end() ? found->second : fallback;
+}
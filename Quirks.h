@@ -0,0 +1,64 @@
+#ifndef _QUIRKS_H
+#define _QUIRKS_H
+
+#include <cstdint>
+#include <cstddef>
+#include <unordered_map>
+
+//* Platforms disagree on a handful of opcodes, and ROMs rely on the one they were
+//* written for. Each profile is a compile-time constant: the interpreter is
+//* instantiated once per profile, so a quirk costs nothing at run time.
+enum QuirkProfile : uint8_t {
+    QUIRKS_LEGACY,      // This emulator's original behavior (Cowgod's reference), the JIT's and lockstep's
+    QUIRKS_CHIP8,       // COSMAC VIP CHIP-8
+    QUIRKS_SCHIP,       // SUPER-CHIP 1.1 quirks, "schip-quirks": not its hires mode or new opcodes
+    QUIRKS_XOCHIP,      // XO-CHIP quirks, "xochip-quirks": not its planes, opcodes or 64 KB
+    QUIRK_PROFILE_COUNT
+};
+
+struct Quirks {
+    bool shiftVy;       // 8xy6/8xyE shift Vy into Vx, VF written last. Off: shift Vx in place.
+    bool loadStoreI;    // Fx55/Fx65 leave I at I + x + 1. Off: I unchanged.
+    bool jumpVx;        // Bxnn jumps to xnn + Vx. Off: Bnnn jumps to nnn + V0.
+    bool vfReset;       // 8xy1/8xy2/8xy3 clear VF.
+    bool clipSprites;   // Sprites stop at the screen edges. Off: they wrap around.
+    bool flagsLast;     // 8xy4/8xy5/8xy7 write Vx, then VF: the carry or NOT borrow (>=) of the
+                        // operands. Off: VF compared after 8xy4's write, strictly before 8xy5/8xy7's.
+    bool indexFlag;     // Fx1E sets VF when I + Vx passes 0xFFF. Off: VF unchanged.
+};
+
+constexpr Quirks QUIRK_TABLE[QUIRK_PROFILE_COUNT] = {
+    //  shiftVy  loadStoreI  jumpVx  vfReset  clipSprites  flagsLast  indexFlag
+    {   false,   false,      false,  false,   false,       false,     true  },  // legacy
+    {   true,    true,       false,  true,    true,        true,      false },  // chip8
+    {   false,   false,      true,   false,   true,        true,      false },  // schip
+    {   true,    true,       false,  false,   false,       true,      false },  // xochip
+};
+
+//* "legacy", "chip8", "schip-quirks", "xochip-quirks"
+const char *quirkProfileName(QuirkProfile profile);
+bool parseQuirkProfile(const char *name, QuirkProfile &profile);
+
+//* The profiles are quirk sets on the CHIP-8 machine only: SUPER-CHIP's 128x64 mode,
+//* scrolling and 16x16 sprites, XO-CHIP's planes, long I loads and 64 KB are not
+//* emulated. Control flow is followed from 0x200 (jumps, calls, both sides of skips)
+//* so sprite data isn't taken for code. Returns the address of the first reachable
+//* opcode of those extensions, 0 if there is none.
+uint16_t findVariantOpcode(const uint8_t *rom, size_t size);
+
+//* Per-ROM profiles, keyed by the catalog's content hash. One entry per line:
+//* `<hash, 16 hex digits> <profile>`, # starts a comment.
+class QuirkDatabase {
+private:
+    std::unordered_map<uint64_t, QuirkProfile> profiles;
+
+public:
+    //* Prints the offending line and returns false on a malformed file
+    bool load(const char *path);
+
+    //* The profile listed for hash, or fallback
+    QuirkProfile lookup(uint64_t hash, QuirkProfile fallback) const;
+    size_t size() const { return profiles.size(); }
+};
+
+#endif // _QUIRKS_H
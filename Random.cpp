@@ -0,0 +1,48 @@
+#include "Random.h"
+
+void Random::seed(uint64_t seed)
+{
+    for (int i = 0; i < 4; i++) {
+        uint64_t z = (seed += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        s[i] = z ^ (z >> 31);
+    }
+}
+
+void Random::jump()
+{
+    static const uint64_t JUMP[4] = {
+        0x180EC6D33CFD0ABAull, 0xD5A61266F0C9392Cull, 0xA9582618E03FC9AAull, 0x39ABDC4529B1661Cull
+    };
+
+    uint64_t t[4] = { 0, 0, 0, 0 };
+
+    for (int i = 0; i < 4; i++) {
+        for (int b = 0; b < 64; b++) {
+            if (JUMP[i] & (1ull << b)) {
+                t[0] ^= s[0];
+                t[1] ^= s[1];
+                t[2] ^= s[2];
+                t[3] ^= s[3];
+            }
+            next();
+        }
+    }
+
+    setState(t);
+}
+
+void Random::getState(uint64_t state[4]) const
+{
+    for (int i = 0; i < 4; i++) {
+        state[i] = s[i];
+    }
+}
+
+void Random::setState(const uint64_t state[4])
+{
+    for (int i = 0; i < 4; i++) {
+        s[i] = state[i];
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef _XOSHIRO_RANDOM_H
+#define _XOSHIRO_RANDOM_H
+
+#include <cstdint>
+
+#define RANDOM_DEFAULT_SEED 0x43484950382D3031ull  // "CHIP8-01"
+
+//* xoshiro256** generator: 256 bits of state, no system calls, identical output on
+//* every host for the same seed. Each Chip8 owns one, so Cxkk is reproducible and
+//* threads never share generator state.
+class Random {
+private:
+    uint64_t s[4];
+
+    static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+public:
+    explicit Random(uint64_t seed = RANDOM_DEFAULT_SEED) { this->seed(seed); }
+
+    //* Expand a 64-bit seed into the full state with splitmix64
+    void seed(uint64_t seed);
+
+    //* Advance by 2^128 outputs. Jumping n times from one seed gives n streams that
+    //* never overlap, one per parallel instance.
+    void jump();
+
+    uint64_t next()
+    {
+        uint64_t result = rotl(s[1] * 5, 7) * 9;
+        uint64_t t = s[1] << 17;
+
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = rotl(s[3], 45);
+
+        return result;
+    }
+
+    //* Uniform over 0-255: the top byte, the best mixed bits of the output
+    uint8_t byte() { return next() >> 56; }
+
+    //* Raw state, for save states
+    void getState(uint64_t state[4]) const;
+    void setState(const uint64_t state[4]);
+
+    bool operator==(const Random &other) const
+    {
+        return s[0] == other.s[0] && s[1] == other.s[1] && s[2] == other.s[2] && s[3] == other.s[3];
+    }
+};
+
+#endif // _XOSHIRO_RANDOM_H
@@ -0,0 +1,326 @@
+#include "Recorder.h"
+
+#include <chrono>
+#include <cstring>
+
+//* First set bit at or after `from` in a 256-bit map, 256 if none
+static size_t findBit(const uint64_t words[4], size_t from)
+{
+    for (size_t w = from >> 6; w < 4; w++) {
+        uint64_t bits = words[w] & (w == from >> 6 ? ~0ULL << (from & 63) : ~0ULL);
+        if (bits) {
+            return w * 64 + __builtin_ctzll(bits);
+        }
+    }
+    return RECORD_FRAME_BYTES;
+}
+
+size_t recordEncode(const uint8_t delta[RECORD_FRAME_BYTES], uint8_t *out)
+{
+    //* One bit per nonzero byte, eight bytes at a time, so runs are found with
+    //* bit scans instead of byte compares
+    uint64_t nonzero[5] = {};
+    for (size_t w = 0; w < RECORD_FRAME_BYTES / 8; w++) {
+        uint64_t bytes;
+        memcpy(&bytes, &delta[w * 8], sizeof(bytes));
+        uint64_t high = (((bytes & 0x7F7F7F7F7F7F7F7FULL) + 0x7F7F7F7F7F7F7F7FULL) | bytes) & 0x8080808080808080ULL;
+        nonzero[w / 8] |= ((high >> 7) * 0x0102040810204080ULL >> 56) << (w % 8 * 8);
+    }
+
+    //* Where a literal run ends: the first of two zero bytes (or a zero last byte)
+    uint64_t zeroPair[4];
+    for (int w = 0; w < 4; w++) {
+        zeroPair[w] = ~nonzero[w] & ~(nonzero[w] >> 1 | nonzero[w + 1] << 63);
+    }
+
+    size_t size = 0;
+    size_t i = 0;
+
+    while (i < RECORD_FRAME_BYTES) {
+        if (!(nonzero[i >> 6] >> (i & 63) & 1)) {
+            size_t next = findBit(nonzero, i);
+            //* Trailing zeros are implied by the end of the payload
+            if (next == RECORD_FRAME_BYTES) {
+                break;
+            }
+            for (; next - i > 128; i += 128) {
+                out[size++] = 127;
+            }
+            out[size++] = next - i - 1;
+            i = next;
+            continue;
+        }
+
+        //* A single zero costs less inline than as a run of its own
+        size_t end = findBit(zeroPair, i);
+        if (end - i > 128) {
+            end = i + 128;
+        }
+
+        out[size++] = 0x7F + (end - i);
+        memcpy(&out[size], &delta[i], end - i);
+        size += end - i;
+        i = end;
+    }
+
+    return size;
+}
+
+bool recordDecode(const uint8_t *in, size_t size, uint8_t delta[RECORD_FRAME_BYTES])
+{
+    size_t i = 0;
+    size_t pos = 0;
+
+    while (pos < size) {
+        uint8_t token = in[pos++];
+
+        if (token < 0x80) {
+            size_t count = token + 1;
+            if (i + count > RECORD_FRAME_BYTES) {
+                return false;
+            }
+            memset(&delta[i], 0, count);
+            i += count;
+        } else {
+            size_t count = token - 0x7F;
+            if (i + count > RECORD_FRAME_BYTES || pos + count > size) {
+                return false;
+            }
+            memcpy(&delta[i], &in[pos], count);
+            i += count;
+            pos += count;
+        }
+    }
+
+    memset(&delta[i], 0, RECORD_FRAME_BYTES - i);
+    return true;
+}
+
+FrameRecorder::FrameRecorder(FILE *file, RecordOverflow overflow, size_t capacity, unsigned keyframeInterval)
+    : file(file), keyframeInterval(keyframeInterval ? keyframeInterval : 1), overflow(overflow)
+{
+    size_t size = 1;
+    while (size < capacity) {
+        size <<= 1;
+    }
+
+    slots.resize(size);
+    mask = size - 1;
+    out.resize(64 * 1024);
+
+    RecordFileHeader header = { RECORD_MAGIC, RECORD_VERSION, 64, 32, this->keyframeInterval };
+    fwrite(&header, sizeof(header), 1, file);
+    bytes.store(sizeof(header), std::memory_order_relaxed);
+
+    thread = std::thread(&FrameRecorder::loop, this);
+}
+
+FrameRecorder::~FrameRecorder()
+{
+    running.store(false, std::memory_order_release);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        wake.notify_one();
+    }
+    thread.join();
+    fflush(file);
+}
+
+bool FrameRecorder::waitForSlot(size_t h)
+{
+    if (overflow == RECORD_DROP) {
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        wake.notify_one();
+    }
+    while (h - tail.load(std::memory_order_acquire) >= slots.size()) {
+        std::this_thread::yield();
+    }
+    return true;
+}
+
+void FrameRecorder::flush()
+{
+    fwrite(out.data(), 1, used, file);
+    bytes.fetch_add(used, std::memory_order_relaxed);
+    used = 0;
+}
+
+void FrameRecorder::append(uint8_t type, uint16_t keys, const uint8_t *payload, size_t length)
+{
+    if (used + sizeof(RecordHeader) + length > out.size()) {
+        flush();
+    }
+
+    RecordHeader header = { type, 0, keys, (uint16_t)length };
+    memcpy(&out[used], &header, sizeof(header));
+    memcpy(&out[used + sizeof(header)], payload, length);
+    used += sizeof(header) + length;
+}
+
+void FrameRecorder::encode(const Slot &slot)
+{
+    bool keyframe = sinceKeyframe % keyframeInterval == 0;
+
+    if (slot.frame != expected) {
+        uint32_t lost = slot.frame - expected;
+        append(RECORD_GAP, 0, (const uint8_t *)&lost, sizeof(lost));
+        keyframe = true;
+    }
+    if (keyframe) {
+        sinceKeyframe = 0;
+    }
+
+    //* Whole rows first: most frames change a few rows or none
+    uint64_t rows[32];
+    uint64_t changed = 0;
+    for (int y = 0; y < 32; y++) {
+        rows[y] = keyframe ? slot.rows[y] : slot.rows[y] ^ previous[y];
+        changed |= rows[y];
+    }
+    sinceKeyframe++;
+
+    uint8_t encoded[RECORD_MAX_ENCODED];
+    size_t length = 0;
+    if (changed) {
+        uint8_t delta[RECORD_FRAME_BYTES];
+        for (int y = 0; y < 32; y++) {
+            for (int b = 0; b < 8; b++) {
+                delta[y * 8 + b] = rows[y] >> (56 - 8 * b);
+            }
+        }
+        length = recordEncode(delta, encoded);
+    }
+    append(keyframe ? RECORD_KEY : RECORD_DELTA, slot.keys, encoded, length);
+
+    memcpy(previous, slot.rows, sizeof(previous));
+    expected = slot.frame + 1;
+    written.fetch_add(1, std::memory_order_relaxed);
+}
+
+void FrameRecorder::loop()
+{
+    for (;;) {
+        //* Read the flag first: once it is down, everything captured is in the ring
+        bool more = running.load(std::memory_order_acquire);
+
+        size_t t = tail.load(std::memory_order_relaxed);
+        size_t h = head.load(std::memory_order_acquire);
+        for (size_t i = t; i != h; i++) {
+            encode(slots[i & mask]);
+            tail.store(i + 1, std::memory_order_release);
+        }
+
+        if (!more) {
+            break;
+        }
+
+        //* Sleep only once caught up. Streamed: what is on disk is at most a few
+        //* milliseconds behind.
+        if (t == h) {
+            if (used) {
+                flush();
+                fflush(file);
+            }
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait_for(lock, std::chrono::milliseconds(1), [this, h] {
+                return head.load(std::memory_order_acquire) - h >= slots.size() || !running.load(std::memory_order_acquire);
+            });
+        }
+    }
+
+    //* Frames dropped at the very end leave no later frame to carry their gap
+    uint64_t captured = frame;
+    if (captured != expected) {
+        uint32_t lost = captured - expected;
+        append(RECORD_GAP, 0, (const uint8_t *)&lost, sizeof(lost));
+    }
+    flush();
+}
+
+RecordingReader::~RecordingReader()
+{
+    if (file) {
+        fclose(file);
+    }
+}
+
+bool RecordingReader::open(const char *path)
+{
+    file = fopen(path, "rb");
+    if (!file) {
+        fprintf(stderr, "Fail to open the recording: %s\n", path);
+        return false;
+    }
+
+    if (fread(&header, sizeof(header), 1, file) != 1
+        || header.magic != RECORD_MAGIC
+        || header.version != RECORD_VERSION
+        || header.width != 64
+        || header.height != 32) {
+        fprintf(stderr, "Not a version %d recording: %s\n", RECORD_VERSION, path);
+        return false;
+    }
+
+    return true;
+}
+
+bool RecordingReader::next(RecordedFrame &frame)
+{
+    RecordHeader record;
+    uint8_t payload[65536];
+    uint64_t lostBefore = 0;
+
+    for (;;) {
+        if (!file || fread(&record, sizeof(record), 1, file) != 1) {
+            return false;
+        }
+        if (fread(payload, 1, record.length, file) != record.length) {
+            fprintf(stderr, "Recording truncated at frame %llu\n", (unsigned long long)index);
+            return false;
+        }
+
+        if (record.type != RECORD_GAP) {
+            break;
+        }
+
+        uint32_t count;
+        if (record.length != sizeof(count)) {
+            fprintf(stderr, "Bad gap record at frame %llu\n", (unsigned long long)index);
+            return false;
+        }
+        memcpy(&count, payload, sizeof(count));
+        lostBefore += count;
+        lost += count;
+        gaps++;
+        index += count;
+        synced = false;
+    }
+
+    uint8_t delta[RECORD_FRAME_BYTES];
+    bool keyframe = record.type == RECORD_KEY;
+    if ((record.type != RECORD_KEY && record.type != RECORD_DELTA) || !recordDecode(payload, record.length, delta)
+        || (!keyframe && !synced)) {
+        fprintf(stderr, "Bad frame record at frame %llu\n", (unsigned long long)index);
+        return false;
+    }
+
+    if (keyframe) {
+        memcpy(screen, delta, sizeof(screen));
+        synced = true;
+    } else {
+        for (int i = 0; i < RECORD_FRAME_BYTES; i++) {
+            screen[i] ^= delta[i];
+        }
+    }
+
+    frame.index = index++;
+    frame.lost = lostBefore;
+    frame.keys = record.keys;
+    frame.keyframe = keyframe;
+    memcpy(frame.rows, screen, sizeof(screen));
+    return true;
+}
@@ -0,0 +1,178 @@
+#ifndef _RECORDER_H
+#define _RECORDER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define RECORD_MAGIC    0x52433843  // "C8CR"
+#define RECORD_VERSION  1
+
+//* Screen rows as stored: 32 rows of 8 bytes, leftmost pixel in the top bit of the
+//* first byte (the 1-bit PNG layout)
+#define RECORD_FRAME_BYTES 256
+
+struct RecordFileHeader {
+    uint32_t    magic;
+    uint16_t    version;
+    uint8_t     width;
+    uint8_t     height;
+    uint32_t    keyframeInterval;   // Frames between two keyframes
+};
+
+enum RecordType : uint8_t {
+    RECORD_DELTA = 0,       // Frame XOR the previous one, run-length encoded
+    RECORD_KEY = 1,         // Frame XOR a blank screen: decodes on its own
+    RECORD_GAP = 2,         // Frames lost to a full ring, count in the 4-byte payload
+};
+
+//* Every record is this header followed by `length` payload bytes.
+//* keys is the keypad the frame ran with: the input log rides along with the video.
+struct RecordHeader {
+    uint8_t     type;
+    uint8_t     reserved;
+    uint16_t    keys;
+    uint16_t    length;
+};
+static_assert(sizeof(RecordHeader) == 6, "record headers are written to disk as is");
+
+//* Run-length coding of an XOR delta, where most bytes are zero. A token byte
+//* t < 0x80 stands for t + 1 zero bytes, t >= 0x80 is followed by t - 0x7F literal
+//* bytes. An unchanged frame encodes to nothing at all.
+//* Returns the encoded size, at most RECORD_MAX_ENCODED.
+#define RECORD_MAX_ENCODED (RECORD_FRAME_BYTES + RECORD_FRAME_BYTES / 128)
+size_t recordEncode(const uint8_t delta[RECORD_FRAME_BYTES], uint8_t *out);
+//* false if the payload is malformed or doesn't cover exactly one frame
+bool recordDecode(const uint8_t *in, size_t size, uint8_t delta[RECORD_FRAME_BYTES]);
+
+//* What capture() does when the writer is a whole ring behind
+enum RecordOverflow {
+    RECORD_DROP,            // Leave the frame out (gap record, next frame a keyframe): never stalls
+    RECORD_WAIT,            // Wait for a free slot: lossless, for headless runs faster than the disk
+};
+
+//* Records the screen at every vblank, with the keypad it ran with.
+//* capture() on the emulation thread only copies the 256-byte screen into a
+//* preallocated lock-free ring. A writer thread does the XOR, the run-length
+//* coding and the file writes, from buffers allocated up front.
+class FrameRecorder {
+private:
+    struct Slot {
+        uint64_t    rows[32];
+        uint64_t    frame;
+        uint16_t    keys;
+    };
+
+    std::vector<Slot> slots;
+    size_t mask;
+
+    alignas(64) std::atomic<size_t> head{0};    // Written by the emulation thread
+    uint64_t frame = 0;                         // Emulation side
+    std::atomic<uint64_t> dropped{0};
+    alignas(64) std::atomic<size_t> tail{0};    // Written by the writer thread
+
+    FILE *file;
+    unsigned keyframeInterval;
+    RecordOverflow overflow;
+    std::thread thread;
+    std::atomic<bool> running{true};
+    std::mutex mutex;
+    std::condition_variable wake;       // A waiting capture() doesn't sit out the writer's nap
+
+    //* Writer side
+    uint64_t previous[32] = {};
+    uint64_t expected = 0;                      // Next frame number
+    uint64_t sinceKeyframe = 0;
+    std::vector<uint8_t> out;
+    size_t used = 0;
+    std::atomic<uint64_t> written{0};
+    std::atomic<uint64_t> bytes{0};
+
+    void append(uint8_t type, uint16_t keys, const uint8_t *payload, size_t length);
+    void encode(const Slot &slot);
+    void flush();
+    void loop();
+    bool waitForSlot(size_t h);
+
+public:
+    //* Capacity (frames) is rounded up to a power of two. The caller owns the file
+    //* and closes it after the recorder is gone.
+    FrameRecorder(FILE *file, RecordOverflow overflow = RECORD_DROP, size_t capacity = 1024,
+        unsigned keyframeInterval = 600);
+    //* Writes out everything captured
+    ~FrameRecorder();
+
+    FrameRecorder(const FrameRecorder &) = delete;
+    FrameRecorder &operator=(const FrameRecorder &) = delete;
+
+    //* Emulation side, once per emulated frame after it ran
+    bool capture(const uint64_t rows[32], uint16_t keys)
+    {
+        size_t h = head.load(std::memory_order_relaxed);
+        uint64_t index = frame++;
+
+        if (h - tail.load(std::memory_order_acquire) >= slots.size() && !waitForSlot(h)) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        Slot &slot = slots[h & mask];
+        for (int y = 0; y < 32; y++) {
+            slot.rows[y] = rows[y];
+        }
+        slot.frame = index;
+        slot.keys = keys;
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    uint64_t framesCaptured() const { return frame; }
+    uint64_t framesDropped() const { return dropped.load(std::memory_order_relaxed); }
+    //* Writer side progress, final once the recorder is destroyed
+    uint64_t framesWritten() const { return written.load(std::memory_order_relaxed); }
+    uint64_t bytesWritten() const { return bytes.load(std::memory_order_relaxed); }
+};
+
+//* One decoded frame of a recording
+struct RecordedFrame {
+    uint64_t    index;          // Emulated frame number
+    uint64_t    lost;           // Frames missing just before this one
+    uint16_t    keys;
+    bool        keyframe;
+    uint8_t     rows[RECORD_FRAME_BYTES];
+
+    bool pixel(unsigned x, unsigned y) const { return rows[y * 8 + x / 8] >> (7 - x % 8) & 1; }
+};
+
+//* Sequential decoder of a recording
+class RecordingReader {
+private:
+    FILE *file = nullptr;
+    RecordFileHeader header = {};
+    uint8_t screen[RECORD_FRAME_BYTES] = {};
+    uint64_t index = 0;
+    bool synced = false;            // A keyframe came after the last gap
+    uint64_t lost = 0;
+    uint64_t gaps = 0;
+
+public:
+    ~RecordingReader();
+
+    //* Prints what went wrong and returns false if the file isn't a recording
+    bool open(const char *path);
+
+    //* false at the end of the file, or on a damaged record (with a message)
+    bool next(RecordedFrame &frame);
+
+    unsigned keyframeInterval() const { return header.keyframeInterval; }
+    //* Read so far, gaps at the very end of the file included
+    uint64_t framesLost() const { return lost; }
+    uint64_t gapCount() const { return gaps; }
+};
+
+#endif // _RECORDER_H
@@ -0,0 +1,200 @@
+#include "Rewind.h"
+
+#include <cstring>
+
+//* Delta encoding, against the keyframe of the group:
+//*   <skip> <count> <count bytes>   repeated
+//* skip is a run of bytes equal to the keyframe, count a run of replacement bytes,
+//* both as LEB128 varints. Gaps of one or two equal bytes are folded into the
+//* literal run, that is cheaper than a new pair of lengths.
+
+static const size_t MERGE_GAP = 2;
+
+static void putLength(std::vector<uint8_t> &out, size_t value)
+{
+    while (value >= 0x80) {
+        out.push_back((uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((uint8_t)value);
+}
+
+static size_t getLength(const uint8_t *&in)
+{
+    size_t value = 0;
+    int shift = 0;
+
+    while (*in & 0x80) {
+        value |= (size_t)(*in++ & 0x7F) << shift;
+        shift += 7;
+    }
+    return value | (size_t)*in++ << shift;
+}
+
+//* First index >= i where the two states differ, a word at a time
+static size_t nextDifference(const uint8_t *a, const uint8_t *b, size_t i, size_t size)
+{
+    while (i + 8 <= size) {
+        uint64_t x, y;
+        memcpy(&x, a + i, 8);
+        memcpy(&y, b + i, 8);
+        if (x != y) {
+            break;
+        }
+        i += 8;
+    }
+    while (i < size && a[i] == b[i]) {
+        i++;
+    }
+    return i;
+}
+
+void encodeStateDelta(const SaveState &base, const SaveState &state, std::vector<uint8_t> &out)
+{
+    const uint8_t *current = (const uint8_t *)&state;
+    const uint8_t *previous = (const uint8_t *)&base;
+    const size_t size = sizeof(SaveState);
+
+    size_t i = nextDifference(current, previous, 0, size);
+    size_t last = 0;
+
+    while (i < size) {
+        //* Extend the literal run over differences and short equal gaps
+        size_t end = i + 1;
+        for (;;) {
+            size_t gap = nextDifference(current, previous, end, size);
+            if (gap == size || gap - end > MERGE_GAP) {
+                break;
+            }
+            end = gap + 1;
+        }
+
+        putLength(out, i - last);
+        putLength(out, end - i);
+        out.insert(out.end(), current + i, current + end);
+
+        last = end;
+        i = nextDifference(current, previous, end, size);
+    }
+}
+
+void applyStateDelta(const uint8_t *in, const uint8_t *end, SaveState &state)
+{
+    uint8_t *out = (uint8_t *)&state;
+
+    while (in < end) {
+        out += getLength(in);
+        size_t count = getLength(in);
+        memcpy(out, in, count);
+        out += count;
+        in += count;
+    }
+}
+
+RewindBuffer::RewindBuffer(unsigned capacity, unsigned keyInterval)
+    : capacity(capacity ? capacity : 1), keyInterval(keyInterval ? keyInterval : 1)
+{
+    //* Frames held can span one partial group at each end
+    groups.resize(this->capacity / this->keyInterval + 2);
+}
+
+void RewindBuffer::push(const SaveState &state)
+{
+    uint64_t frame = next++;
+    Group &group = groupOf(frame);
+
+    if (next - oldest > capacity) {
+        oldest = next - capacity;
+    }
+
+    if (frame % keyInterval == 0) {
+        //* Reusing the slot keeps the vectors' capacity, no allocation once warmed up
+        group.keyframe = state;
+        group.bytes.clear();
+        group.offsets.clear();
+        group.offsets.push_back(0);
+        return;
+    }
+
+    group.offsets.push_back((uint32_t)group.bytes.size());
+    encodeStateDelta(group.keyframe, state, group.bytes);
+}
+
+bool RewindBuffer::peek(unsigned framesBack, SaveState &state) const
+{
+    if (framesBack >= size()) {
+        return false;
+    }
+
+    uint64_t frame = next - 1 - framesBack;
+    const Group &group = groupOf(frame);
+    size_t index = frame % keyInterval;
+    size_t begin = group.offsets[index];
+    size_t end = index + 1 < group.offsets.size() ? group.offsets[index + 1] : group.bytes.size();
+
+    memcpy(&state, &group.keyframe, sizeof(SaveState));
+    applyStateDelta(group.bytes.data() + begin, group.bytes.data() + end, state);
+
+    return true;
+}
+
+bool RewindBuffer::rewind(unsigned framesBack, SaveState &state)
+{
+    if (!peek(framesBack, state)) {
+        return false;
+    }
+
+    next -= framesBack;
+
+    //* Drop the deltas recorded after the restored frame in its own group. Later
+    //* groups are reset when the next keyframe lands in them.
+    uint64_t frame = next - 1;
+    Group &group = groupOf(frame);
+    size_t index = frame % keyInterval;
+
+    if (index + 1 < group.offsets.size()) {
+        group.bytes.resize(group.offsets[index + 1]);
+        group.offsets.resize(index + 1);
+    }
+
+    return true;
+}
+
+void RewindBuffer::clear()
+{
+    next = 0;
+    oldest = 0;
+}
+
+size_t RewindBuffer::memoryBytes() const
+{
+    size_t bytes = groups.size() * sizeof(Group);
+
+    for (auto &group : groups) {
+        bytes += group.bytes.capacity() + group.offsets.capacity() * sizeof(uint32_t);
+    }
+
+    return bytes;
+}
+
+double RewindBuffer::bytesPerMinute(unsigned framesPerSecond) const
+{
+    if (!size()) {
+        return 0;
+    }
+
+    //* Only what the frames held now take, not the spare capacity
+    size_t bytes = 0;
+    for (uint64_t frame = oldest; frame < next; frame++) {
+        const Group &group = groupOf(frame);
+        size_t index = frame % keyInterval;
+        size_t end = index + 1 < group.offsets.size() ? group.offsets[index + 1] : group.bytes.size();
+
+        bytes += end - group.offsets[index] + sizeof(uint32_t);
+        if (index == 0) {
+            bytes += sizeof(SaveState);
+        }
+    }
+
+    return (double)bytes / size() * framesPerSecond * 60;
+}
@@ -0,0 +1,61 @@
+#ifndef _REWIND_H
+#define _REWIND_H
+
+#include "SaveState.h"
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+//* Append the byte runs where state differs from base to out
+void encodeStateDelta(const SaveState &base, const SaveState &state, std::vector<uint8_t> &out);
+//* Apply a delta of encodeStateDelta(), [in, end), to a copy of its base
+void applyStateDelta(const uint8_t *in, const uint8_t *end, SaveState &state);
+
+//* In-memory history of save states, one per frame.
+//* Every `keyInterval`-th frame is kept whole (a keyframe). The frames after it store
+//* only the byte runs where they differ from that keyframe, so a frame costs tens of
+//* bytes instead of 4KB. Restoring any frame is one keyframe copy plus one delta,
+//* never a chain of deltas.
+class RewindBuffer {
+private:
+    //* A keyframe and the deltas of the frames that follow it, packed back to back
+    struct Group {
+        SaveState keyframe;
+        std::vector<uint8_t> bytes;
+        std::vector<uint32_t> offsets;  // Where each frame's delta starts in bytes
+    };
+
+    unsigned capacity;              // Frames of history
+    unsigned keyInterval;
+    uint64_t next = 0;              // Absolute index of the next pushed frame
+    uint64_t oldest = 0;            // Absolute index of the oldest frame still held
+
+    std::vector<Group> groups;      // By frame index / keyInterval, as a ring
+
+    Group &groupOf(uint64_t frame) { return groups[(frame / keyInterval) % groups.size()]; }
+    const Group &groupOf(uint64_t frame) const { return groups[(frame / keyInterval) % groups.size()]; }
+
+public:
+    explicit RewindBuffer(unsigned capacity = 60 * 60, unsigned keyInterval = 240);
+
+    //* Record the state of the frame that just ended, dropping the oldest when full
+    void push(const SaveState &state);
+
+    //* Frames that can be restored
+    unsigned size() const { return (unsigned)(next - oldest); }
+
+    //* The state `framesBack` frames ago, 0 being the last push
+    bool peek(unsigned framesBack, SaveState &state) const;
+    //* Same as peek(), and forget every frame newer than the one restored
+    bool rewind(unsigned framesBack, SaveState &state);
+
+    void clear();
+
+    //* Heap held by the history, keyframes and spare capacity included
+    size_t memoryBytes() const;
+    //* Bytes one minute of history costs at this rate, averaged over what is held now
+    double bytesPerMinute(unsigned framesPerSecond = 60) const;
+};
+
+#endif // _REWIND_H
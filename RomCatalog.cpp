@@ -0,0 +1,130 @@
+#include "RomCatalog.h"
+#include "Chip8.h"
+
+#include <algorithm>
+#include <cstdio>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+uint64_t romHash(const uint8_t *data, size_t size)
+{
+    uint64_t hash = 0xCBF29CE484222325ull;
+
+    for (size_t i = 0; i < size; i++) {
+        hash ^= data[i];
+        hash *= 0x100000001B3ull;
+    }
+    return hash;
+}
+
+RomCatalog::~RomCatalog()
+{
+    for (auto &mapping : mappings) {
+        munmap(mapping.first, mapping.second);
+    }
+}
+
+bool RomCatalog::map(const std::string &path, const std::string &name)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Fail to load the file: %s\n", path.c_str());
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) < 0 || !S_ISREG(info.st_mode)) {
+        close(fd);
+        return false;
+    }
+
+    if (info.st_size == 0 || info.st_size > MAX_ROM_SIZE) {
+        fprintf(stderr, "ROM does not fit in memory: %s (%lld bytes)\n", path.c_str(), (long long)info.st_size);
+        close(fd);
+        return false;
+    }
+
+    void *data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        fprintf(stderr, "Fail to map the file: %s\n", path.c_str());
+        return false;
+    }
+
+    mappings.push_back({ data, (size_t)info.st_size });
+
+    uint16_t variant = findVariantOpcode(static_cast<const uint8_t *>(data), info.st_size);
+    if (variant) {
+        fprintf(stderr, "ROM needs SUPER-CHIP or XO-CHIP, not emulated: %s (opcode at %03X)\n", path.c_str(),
+            variant);
+        return false;
+    }
+
+    RomEntry entry;
+    entry.name = name;
+    entry.path = path;
+    entry.data = static_cast<const uint8_t *>(data);
+    entry.size = info.st_size;
+    entry.hash = romHash(entry.data, entry.size);
+    roms.push_back(entry);
+
+    return true;
+}
+
+bool RomCatalog::open(const std::string &path)
+{
+    struct stat info;
+    if (stat(path.c_str(), &info) < 0) {
+        fprintf(stderr, "Fail to load the file: %s\n", path.c_str());
+        return false;
+    }
+
+    if (S_ISDIR(info.st_mode)) {
+        DIR *dir = opendir(path.c_str());
+        if (!dir) {
+            fprintf(stderr, "Fail to open the directory: %s\n", path.c_str());
+            return false;
+        }
+
+        std::string prefix = path.back() == '/' ? path : path + "/";
+        while (struct dirent *file = readdir(dir)) {
+            if (file->d_name[0] != '.') {
+                map(prefix + file->d_name, file->d_name);
+            }
+        }
+        closedir(dir);
+    } else {
+        size_t slash = path.rfind('/');
+        map(path, slash == std::string::npos ? path : path.substr(slash + 1));
+    }
+
+    std::sort(roms.begin(), roms.end(), [](const RomEntry &a, const RomEntry &b) { return a.name < b.name; });
+
+    for (size_t i = 0; i < roms.size(); i++) {
+        byName.emplace(roms[i].name, i);
+        byName.emplace(roms[i].path, i);
+        byHash.emplace(roms[i].hash, i);
+    }
+
+    if (roms.empty()) {
+        fprintf(stderr, "No ROM found in %s\n", path.c_str());
+        return false;
+    }
+    return true;
+}
+
+const RomEntry *RomCatalog::find(const std::string &name) const
+{
+    auto found = byName.find(name);
+    return found == byName.end() ? nullptr : &roms[found->second];
+}
+
+const RomEntry *RomCatalog::findHash(uint64_t hash) const
+{
+    auto found = byHash.find(hash);
+    return found == byHash.end() ? nullptr : &roms[found->second];
+}
@@ -0,0 +1,57 @@
+#ifndef _ROM_CATALOG_H
+#define _ROM_CATALOG_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+//* One ROM of the catalog. `data` points into a read-only mapping of the file.
+struct RomEntry {
+    std::string name;           // File name without the directory
+    std::string path;
+    const uint8_t *data;
+    size_t size;
+    uint64_t hash;              // romHash() of the contents
+};
+
+//* 64-bit FNV-1a of a ROM image, its identity whatever the file is called
+uint64_t romHash(const uint8_t *data, size_t size);
+
+//* Every ROM of a directory, memory-mapped once and indexed by name and content
+//* hash. After open() nothing changes: the catalog can be shared read-only by every
+//* instance and thread of the process, and loading a ROM from it is a bounded
+//* memcpy (Chip8::load(entry.data, entry.size)) without any system call.
+class RomCatalog {
+private:
+    std::vector<RomEntry> roms;                         // Sorted by name
+    std::unordered_map<std::string, size_t> byName;
+    std::unordered_map<uint64_t, size_t> byHash;        // First ROM with those contents
+    std::vector<std::pair<void *, size_t>> mappings;
+
+    bool map(const std::string &path, const std::string &name);
+
+public:
+    RomCatalog() = default;
+    ~RomCatalog();
+    RomCatalog(const RomCatalog &) = delete;
+    RomCatalog &operator=(const RomCatalog &) = delete;
+
+    //* A directory (every regular file in it that fits above START_LOCATION) or a
+    //* single ROM file. Files that are empty, too large or that run SUPER-CHIP/XO-CHIP
+    //* opcodes (findVariantOpcode) are reported and skipped.
+    //* False if nothing could be mapped.
+    bool open(const std::string &path);
+
+    size_t size() const { return roms.size(); }
+    const RomEntry &operator[](size_t index) const { return roms[index]; }
+
+    //* By file name or by the path given to open(), nullptr if unknown
+    const RomEntry *find(const std::string &name) const;
+    const RomEntry *findHash(uint64_t hash) const;
+    //* Position of an entry, for stepping through the catalog
+    size_t indexOf(const RomEntry &entry) const { return &entry - roms.data(); }
+};
+
+#endif // _ROM_CATALOG_H
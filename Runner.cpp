@@ -0,0 +1,898 @@
+#include "Runner.h"
+#include "Chip8.h"
+#include "Audio.h"
+#include "ThreadPool.h"
+#include "Trace.h"
+#include "Profile.h"
+#include "Recorder.h"
+#include "Rewind.h"
+#include "RomCatalog.h"
+#include "Lockstep.h"
+#include "SaveState.h"
+#include "EmulationThread.h"
+#include "Input.h"
+#include "Scheduler.h"
+#include "TripleBuffer.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <time.h>
+
+bool readRom(const char *path, std::vector<uint8_t> &rom)
+{
+    FILE *file = fopen(path, "rb");
+
+    if (!file) {
+        fprintf(stderr, "Fail to load the file: %s\n", path);
+        return false;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    rewind(file);
+
+    if (size < 0 || size > MAX_ROM_SIZE) {
+        fprintf(stderr, "ROM does not fit in memory: %s (%ld bytes)\n", path, size);
+        fclose(file);
+        return false;
+    }
+
+    rom.resize(size);
+    size_t read = fread(rom.data(), sizeof(uint8_t), rom.size(), file);
+    fclose(file);
+
+    uint16_t variant = read == rom.size() ? findVariantOpcode(rom.data(), rom.size()) : 0;
+    if (variant) {
+        fprintf(stderr, "ROM needs SUPER-CHIP or XO-CHIP, not emulated: %s (opcode at %03X)\n", path, variant);
+        return false;
+    }
+    return read == rom.size();
+}
+
+bool runBatch(const RunnerConfig &config, RunnerReport &report)
+{
+    //* Mapped once, then every session start or restart is a memcpy out of it
+    RomCatalog catalog;
+
+    if (!catalog.open(config.romPath)) {
+        return false;
+    }
+
+    if (config.jit && !Chip8::jitAvailable()) {
+        fprintf(stderr, "JIT backend is not available on this host\n");
+        return false;
+    }
+
+    QuirkDatabase quirksDb;
+    if (!config.quirksDbPath.empty() && !quirksDb.load(config.quirksDbPath.c_str())) {
+        return false;
+    }
+
+    //* Only the first session is traced, drained by a background writer
+    FILE *traceFile = NULL;
+    std::unique_ptr<TraceRing> traceRing;
+    std::unique_ptr<TraceWriter> traceWriter;
+
+    if (!config.tracePath.empty()) {
+        if (!TRACE_ENABLED) {
+            fprintf(stderr, "Tracing needs a CHIP8_TRACE build (make TRACE=1)\n");
+            return false;
+        }
+
+        traceFile = fopen(config.tracePath.c_str(), "wb");
+        if (!traceFile) {
+            fprintf(stderr, "Fail to create the trace: %s\n", config.tracePath.c_str());
+            return false;
+        }
+
+        traceRing.reset(new TraceRing());
+        traceWriter.reset(new TraceWriter(*traceRing, traceFile));
+    }
+
+    //* Likewise only the first session is profiled, written out once the batch is done
+    std::unique_ptr<Profiler> profiler;
+    std::unique_ptr<Chip8> profiled;
+
+    if (!config.profilePath.empty()) {
+        if (!PROFILE_ENABLED) {
+            fprintf(stderr, "Profiling needs a CHIP8_PROFILE build (make PROFILE=1)\n");
+            return false;
+        }
+        profiler.reset(new Profiler());
+    }
+
+    //* The first session is also the recorded one: screen and keys at every frame
+    FILE *recordFile = NULL;
+    std::unique_ptr<FrameRecorder> recorder;
+    double recordSeconds = 0;
+    double recordSessionSeconds = 0;
+    std::vector<uint64_t> recordedRows;     // Every frame fed to the recorder, to check the file
+
+    if (!config.recordPath.empty()) {
+        recordFile = fopen(config.recordPath.c_str(), "wb");
+        if (!recordFile) {
+            fprintf(stderr, "Fail to create the recording: %s\n", config.recordPath.c_str());
+            return false;
+        }
+        //* Headless sessions outrun any disk: wait rather than leave frames out
+        recorder.reset(new FrameRecorder(recordFile, RECORD_WAIT));
+        recordedRows.reserve((size_t)config.frames * 32);
+    }
+
+    ThreadPool pool(config.threads);
+
+    report = RunnerReport();
+    report.threads = pool.size();
+    report.workers.resize(pool.size());
+    report.roms = catalog.size();
+
+    auto start = std::chrono::steady_clock::now();
+
+    //* One jump per session here rather than n jumps inside session n
+    Random stream(config.seed);
+
+    for (unsigned i = 0; i < config.instances; i++) {
+        TraceRing *ring = i == 0 ? traceRing.get() : nullptr;
+        Profiler *sessionProfiler = i == 0 ? profiler.get() : nullptr;
+        FrameRecorder *sessionRecorder = i == 0 ? recorder.get() : nullptr;
+        Random random = stream;
+        stream.jump();
+        const RomEntry *rom = &catalog[i % catalog.size()];
+        QuirkProfile quirks = quirksDb.lookup(rom->hash, config.quirks);
+        report.quirkSessions[quirks]++;
+
+        pool.submit([&config, &report, &profiled, &recordSeconds, &recordSessionSeconds, &recordedRows,
+                ring, sessionProfiler, sessionRecorder, random, rom, quirks] {
+            auto begin = std::chrono::steady_clock::now();
+            uint64_t restarts = 0;
+            double restartSeconds = 0;
+            uint64_t instructions = 0;      // Of the runs before the last restart
+
+            //* Heap allocated so every session gets its own cache lines
+            std::unique_ptr<Chip8> chip8(new Chip8());
+            chip8->load(rom->data, rom->size);
+            chip8->setRandom(random);
+            chip8->setQuirks(quirks);
+            if (config.jit) {
+                chip8->setBackend(BACKEND_JIT);
+            }
+            chip8->attachTrace(ring);
+            chip8->attachProfiler(sessionProfiler);
+
+            std::unique_ptr<RewindBuffer> rewind;
+            SaveState state;
+            if (config.rewindFrames) {
+                rewind.reset(new RewindBuffer(config.rewindFrames));
+            }
+
+            std::unique_ptr<NullAudioSink> audio;
+            uint64_t expectedOn = 0;
+            if (config.audio) {
+                audio.reset(new NullAudioSink());
+            }
+
+            for (unsigned frame = 0; frame < config.frames; frame++) {
+                if (config.restartFrames && frame && frame % config.restartFrames == 0) {
+                    //* Same ROM and stream again: a restart replays the session from power-on
+                    instructions += chip8->instructionCount;
+                    auto restartBegin = std::chrono::steady_clock::now();
+                    chip8->reset();
+                    chip8->load(rom->data, rom->size);
+                    chip8->setRandom(random);
+                    std::chrono::duration<double> restart = std::chrono::steady_clock::now() - restartBegin;
+                    restartSeconds += restart.count();
+                    restarts++;
+                }
+
+                chip8->runFrame(config.cyclesPerFrame);
+
+                if (sessionRecorder) {
+                    auto captureBegin = std::chrono::steady_clock::now();
+                    sessionRecorder->capture(chip8->frameRows(), chip8->keyMask());
+                    std::chrono::duration<double> capture = std::chrono::steady_clock::now() - captureBegin;
+                    recordSeconds += capture.count();
+                    recordedRows.insert(recordedRows.end(), chip8->frameRows(), chip8->frameRows() + 32);
+                }
+                if (rewind) {
+                    chip8->saveState(state);
+                    rewind->push(state);
+                }
+                if (audio) {
+                    audio->frameDone(chip8->soundOn());
+                    if (chip8->soundOn()) {
+                        expectedOn += audio->output().frameSamples(frame);
+                    }
+                }
+            }
+
+            std::chrono::duration<double> busy = std::chrono::steady_clock::now() - begin;
+            if (sessionRecorder) {
+                recordSessionSeconds = busy.count();
+            }
+
+            //* Only this worker ever touches its own slot
+            WorkerStats &stats = report.workers[ThreadPool::workerIndex()];
+            stats.instances++;
+            stats.instructions += instructions + chip8->instructionCount;
+            stats.frames += config.frames;
+            stats.busySeconds += busy.count();
+            stats.restarts += restarts;
+            stats.restartSeconds += restartSeconds;
+
+            if (audio) {
+                //* Frame n owns exactly its samples, whatever speed it ran at
+                const Buzzer &buzzer = audio->output();
+                uint64_t expected = (uint64_t)config.frames * buzzer.sampleRate() / 60;
+
+                stats.audioSamples += buzzer.samplesRendered();
+                stats.audioSamplesOn += buzzer.samplesOn();
+                stats.audioUnderruns += buzzer.underrunCount();
+                if (buzzer.samplesRendered() != expected || buzzer.samplesOn() != expectedOn) {
+                    stats.audioMismatches++;
+                }
+            }
+
+            if (rewind && rewind->size()) {
+                //* The oldest frame carries the largest delta against its keyframe
+                SaveState restored;
+                auto restoreBegin = std::chrono::steady_clock::now();
+                rewind->peek(rewind->size() - 1, restored);
+                std::chrono::duration<double> restore = std::chrono::steady_clock::now() - restoreBegin;
+
+                rewind->peek(0, restored);
+                if (memcmp(&restored, &state, sizeof(state))) {
+                    stats.rewindMismatches++;
+                }
+
+                stats.rewindBytes += rewind->memoryBytes();
+                stats.rewindBytesPerMinute += rewind->bytesPerMinute();
+                if (restore.count() > stats.rewindRestoreMax) {
+                    stats.rewindRestoreMax = restore.count();
+                }
+            }
+
+            if (sessionProfiler) {
+                //* The listing disassembles the memory the session ended with
+                chip8->attachProfiler(nullptr);
+                profiled = std::move(chip8);
+            }
+        });
+    }
+
+    pool.wait();
+
+    std::chrono::duration<double> wall = std::chrono::steady_clock::now() - start;
+    report.wallSeconds = wall.count();
+    report.steals = pool.stealCount();
+
+    if (traceWriter) {
+        traceWriter.reset();
+        fclose(traceFile);
+
+        if (traceRing->droppedCount()) {
+            fprintf(stderr, "Trace: %llu records dropped, ring full\n", (unsigned long long)traceRing->droppedCount());
+        }
+    }
+
+    if (recorder) {
+        report.recordDropped = recorder->framesDropped();
+        recorder.reset();
+        report.recordBytes = ftell(recordFile);
+        fclose(recordFile);
+
+        //* Every frame that made it into the file has to decode to what was captured
+        RecordingReader reader;
+        RecordedFrame frame;
+        bool matches = reader.open(config.recordPath.c_str());
+        uint64_t frames = 0;
+
+        while (matches && reader.next(frame)) {
+            const uint64_t *rows = &recordedRows[frame.index * 32];
+            for (unsigned y = 0; y < 32; y++) {
+                for (unsigned b = 0; b < 8; b++) {
+                    matches = matches && frame.rows[y * 8 + b] == (uint8_t)(rows[y] >> (56 - 8 * b));
+                }
+            }
+            frames++;
+        }
+
+        report.recordFrames = frames;
+        report.recordMatches = matches && frames + reader.framesLost() == config.frames
+            && reader.framesLost() == report.recordDropped;
+        report.recordSeconds = recordSeconds;
+        report.recordSessionSeconds = recordSessionSeconds;
+    }
+
+    if (profiler) {
+        std::string folded = config.profilePath + ".folded";
+        std::string listing = config.profilePath + ".txt";
+        FILE *foldedFile = fopen(folded.c_str(), "w");
+        FILE *listingFile = fopen(listing.c_str(), "w");
+
+        if (!foldedFile || !listingFile) {
+            fprintf(stderr, "Fail to create the profile: %s\n", config.profilePath.c_str());
+        } else {
+            profiler->writeFolded(foldedFile, catalog[0].name.c_str());
+            fprintf(listingFile, "ROM          : %s\n", catalog[0].path.c_str());
+            profiler->writeListing(listingFile, profiled->memory());
+        }
+
+        if (foldedFile) {
+            fclose(foldedFile);
+        }
+        if (listingFile) {
+            fclose(listingFile);
+        }
+    }
+
+    for (auto &stats : report.workers) {
+        report.instances += stats.instances;
+        report.instructions += stats.instructions;
+        report.frames += stats.frames;
+        report.rewindBytes += stats.rewindBytes;
+        report.rewindBytesPerMinute += stats.rewindBytesPerMinute;
+        report.rewindMismatches += stats.rewindMismatches;
+        report.audioSamples += stats.audioSamples;
+        report.audioSamplesOn += stats.audioSamplesOn;
+        report.audioUnderruns += stats.audioUnderruns;
+        report.audioMismatches += stats.audioMismatches;
+        report.restarts += stats.restarts;
+        report.restartSeconds += stats.restartSeconds;
+        if (stats.rewindRestoreMax > report.rewindRestoreMax) {
+            report.rewindRestoreMax = stats.rewindRestoreMax;
+        }
+    }
+
+    return true;
+}
+
+void printReport(const RunnerConfig &config, const RunnerReport &report, bool json)
+{
+    double ips = report.instructionsPerSecond();
+    double fps = report.framesPerSecond();
+
+    //* Uncapped, one session runs this many times faster than the 60Hz it emulates
+    double busy = 0;
+    for (auto &stats : report.workers) {
+        busy += stats.busySeconds;
+    }
+    double speedup = busy > 0 ? report.frames / busy / 60 : 0;
+
+    if (json) {
+        printf("{\n");
+        printf("  \"rom\": \"%s\",\n", config.romPath.c_str());
+        printf("  \"roms\": %zu,\n", report.roms);
+        printf("  \"instances\": %u,\n", config.instances);
+        printf("  \"frames\": %u,\n", config.frames);
+        printf("  \"cycles_per_frame\": %u,\n", config.cyclesPerFrame);
+        printf("  \"threads\": %u,\n", report.threads);
+        printf("  \"wall_seconds\": %.6f,\n", report.wallSeconds);
+        printf("  \"instructions\": %llu,\n", (unsigned long long)report.instructions);
+        printf("  \"instructions_per_second\": %.0f,\n", ips);
+        printf("  \"instructions_per_second_per_core\": %.0f,\n", ips / report.threads);
+        printf("  \"frames_per_second\": %.0f,\n", fps);
+        printf("  \"frames_per_second_per_core\": %.0f,\n", fps / report.threads);
+        printf("  \"speedup_per_session\": %.1f,\n", speedup);
+        printf("  \"steals\": %llu,\n", (unsigned long long)report.steals);
+        printf("  \"quirks\": {");
+        for (int q = 0; q < QUIRK_PROFILE_COUNT; q++) {
+            printf("\"%s\": %llu%s", quirkProfileName((QuirkProfile)q), (unsigned long long)report.quirkSessions[q],
+                q + 1 < QUIRK_PROFILE_COUNT ? ", " : "},\n");
+        }
+        if (config.rewindFrames) {
+            printf("  \"rewind_frames\": %u,\n", config.rewindFrames);
+            printf("  \"rewind_bytes_per_instance\": %.0f,\n", (double)report.rewindBytes / report.instances);
+            printf("  \"rewind_bytes_per_minute_per_instance\": %.0f,\n", report.rewindBytesPerMinute / report.instances);
+            printf("  \"rewind_restore_max_seconds\": %.9f,\n", report.rewindRestoreMax);
+            printf("  \"rewind_mismatches\": %llu,\n", (unsigned long long)report.rewindMismatches);
+        }
+        if (config.audio) {
+            printf("  \"audio_samples\": %llu,\n", (unsigned long long)report.audioSamples);
+            printf("  \"audio_samples_on\": %llu,\n", (unsigned long long)report.audioSamplesOn);
+            printf("  \"audio_underruns\": %llu,\n", (unsigned long long)report.audioUnderruns);
+            printf("  \"audio_mismatches\": %llu,\n", (unsigned long long)report.audioMismatches);
+        }
+        if (!config.recordPath.empty()) {
+            printf("  \"record_frames\": %llu,\n", (unsigned long long)report.recordFrames);
+            printf("  \"record_dropped\": %llu,\n", (unsigned long long)report.recordDropped);
+            printf("  \"record_bytes\": %llu,\n", (unsigned long long)report.recordBytes);
+            printf("  \"record_capture_seconds\": %.9f,\n", report.recordSeconds);
+            printf("  \"record_session_seconds\": %.9f,\n", report.recordSessionSeconds);
+            printf("  \"record_matches\": %s,\n", report.recordMatches ? "true" : "false");
+        }
+        if (config.restartFrames) {
+            printf("  \"restarts\": %llu,\n", (unsigned long long)report.restarts);
+            printf("  \"restart_seconds_mean\": %.9f,\n", report.restarts ? report.restartSeconds / report.restarts : 0);
+        }
+        printf("  \"workers\": [\n");
+        for (size_t i = 0; i < report.workers.size(); i++) {
+            const WorkerStats &stats = report.workers[i];
+            printf("    {\"instances\": %llu, \"instructions\": %llu, \"busy_seconds\": %.6f}%s\n",
+                (unsigned long long)stats.instances,
+                (unsigned long long)stats.instructions,
+                stats.busySeconds,
+                i + 1 < report.workers.size() ? "," : "");
+        }
+        printf("  ]\n");
+        printf("}\n");
+        return;
+    }
+
+    if (report.roms > 1) {
+        printf("ROM          : %s (%zu ROMs, taken in turn)\n", config.romPath.c_str(), report.roms);
+    } else {
+        printf("ROM          : %s\n", config.romPath.c_str());
+    }
+    printf("Instances    : %u x %u frames (%u cycles/frame)\n", config.instances, config.frames, config.cyclesPerFrame);
+    printf("Threads      : %u (%llu steals)\n", report.threads, (unsigned long long)report.steals);
+    printf("Quirks       :");
+    for (int q = 0; q < QUIRK_PROFILE_COUNT; q++) {
+        if (report.quirkSessions[q]) {
+            printf(" %s x%llu", quirkProfileName((QuirkProfile)q), (unsigned long long)report.quirkSessions[q]);
+        }
+    }
+    printf("\n");
+    printf("Wall time    : %.3f s\n", report.wallSeconds);
+    printf("Instructions : %.2f M/s (%.2f M/s per core)\n", ips / 1e6, ips / 1e6 / report.threads);
+    printf("Frames       : %.0f /s (%.0f /s per core)\n", fps, fps / report.threads);
+    printf("Speed-up     : x%.0f realtime per session\n", speedup);
+    if (config.rewindFrames) {
+        printf("Rewind       : %.1f KB per instance held, %.1f KB per minute of history, restore <= %.1f us%s\n",
+            (double)report.rewindBytes / report.instances / 1024,
+            report.rewindBytesPerMinute / report.instances / 1024,
+            report.rewindRestoreMax * 1e6,
+            report.rewindMismatches ? ", MISMATCH" : "");
+    }
+    if (config.audio) {
+        printf("Audio        : %.1f s of samples per instance, buzzer on %.1f%%, %llu underruns%s\n",
+            (double)report.audioSamples / report.instances / AUDIO_RATE,
+            report.audioSamples ? (double)report.audioSamplesOn / report.audioSamples * 100 : 0,
+            (unsigned long long)report.audioUnderruns,
+            report.audioMismatches ? ", MISMATCH" : "");
+    }
+    if (!config.recordPath.empty()) {
+        printf("Recording    : %llu frames, %llu dropped, %llu bytes (%.1f bytes/frame), %s\n",
+            (unsigned long long)report.recordFrames, (unsigned long long)report.recordDropped,
+            (unsigned long long)report.recordBytes,
+            report.recordFrames ? (double)report.recordBytes / report.recordFrames : 0,
+            report.recordMatches ? "decodes back" : "MISMATCH");
+        printf("Capture      : %.1f ns/frame on the emulation thread, %.2f%% of the recorded session\n",
+            report.recordFrames + report.recordDropped ? report.recordSeconds / (report.recordFrames + report.recordDropped) * 1e9 : 0,
+            report.recordSessionSeconds > 0 ? report.recordSeconds / report.recordSessionSeconds * 100 : 0);
+    }
+    if (config.restartFrames) {
+        printf("Restarts     : %llu, %.2f us each (reset + load from the catalog)\n",
+            (unsigned long long)report.restarts,
+            report.restarts ? report.restartSeconds / report.restarts * 1e6 : 0);
+    }
+}
+
+void scriptedKeys(unsigned frame, uint8_t key[16])
+{
+    for (int i = 0; i < 16; i++) {
+        key[i] = (frame / 8) % 2 == 0 && i == (int)(frame / 16) % 16;
+    }
+}
+
+long checkConformance(const std::vector<uint8_t> &rom, unsigned frames, unsigned cyclesPerFrame)
+{
+    std::unique_ptr<Chip8> interpreter(new Chip8());
+    std::unique_ptr<Chip8> jit(new Chip8());
+
+    interpreter->load(rom.data(), rom.size());
+    jit->load(rom.data(), rom.size());
+    jit->setBackend(BACKEND_JIT);
+
+    for (unsigned frame = 0; frame < frames; frame++) {
+        scriptedKeys(frame, interpreter->key);
+        scriptedKeys(frame, jit->key);
+
+        interpreter->runFrame(cyclesPerFrame);
+        jit->runFrame(cyclesPerFrame);
+
+        if (!interpreter->stateEquals(*jit)) {
+            return frame;
+        }
+    }
+
+    return -1;
+}
+
+//* One program per QUIRK_TABLE column, with the registers it ends with when the
+//* quirk is on and when it is off
+struct QuirkProbe {
+    const char *column;
+    bool expected[QUIRK_PROFILE_COUNT];     // The column as each profile should have it
+    std::vector<uint16_t> program;
+    unsigned cycles;
+    std::vector<std::pair<uint8_t, uint8_t>> on;
+    std::vector<std::pair<uint8_t, uint8_t>> off;
+};
+
+static const QuirkProbe QUIRK_PROBES[] = {
+    //                 legacy chip8  schip  xochip
+    //* V0 = 8, V1 = 5, 8016: on shifts V1 (2, VF = 1), off shifts V0 (4, VF = 0)
+    {"shiftVy",     {false, true,  false, true },
+        {0x6008, 0x6105, 0x8016}, 3, {{0x0, 2}, {0xF, 1}}, {{0x0, 4}, {0xF, 0}}},
+    //* Store V0 = 7 at 300, load it back: on, I moved past it and 301 reads 0
+    {"loadStoreI",  {false, true,  false, true },
+        {0xA300, 0x6007, 0xF055, 0xF065}, 4, {{0x0, 0}}, {{0x0, 7}}},
+    //* V2 = 4, B208: on lands on 20C (VA = 2), off on 208 (VA = 1)
+    {"jumpVx",      {false, false, true,  false},
+        {0x6204, 0xB208, 0x0000, 0x0000, 0x6A01, 0x120A, 0x6A02, 0x120E}, 3, {{0xA, 2}}, {{0xA, 1}}},
+    {"vfReset",     {false, true,  false, false},
+        {0x6F05, 0x6001, 0x6102, 0x8011}, 4, {{0xF, 0}}, {{0xF, 5}}},
+    //* The top row of "0" at x = 62: wrapped, its last two pixels land at x = 0 and 1,
+    //* where the second draw collides with them
+    {"clipSprites", {false, true,  true,  false},
+        {0x603E, 0x6100, 0x6200, 0xF229, 0xD011, 0x6000, 0xD011}, 7, {{0xF, 0}}, {{0xF, 1}}},
+    //* 5 - 5: on, no borrow (VF = 1), off, strict > (VF = 0)
+    {"flagsLast",   {false, true,  true,  true },
+        {0x6005, 0x6105, 0x8015}, 3, {{0xF, 1}}, {{0xF, 0}}},
+    {"indexFlag",   {true,  false, false, false},
+        {0xAFFF, 0x6001, 0x6F05, 0xF01E}, 4, {{0xF, 1}}, {{0xF, 5}}},
+};
+
+static std::vector<ConformanceCase> buildConformanceCases()
+{
+    std::vector<ConformanceCase> all = {
+        //* 7001 2200: recurse forever, 300 calls wrap the 16-entry stack and sp
+        {"stack-overflow", QUIRKS_LEGACY, {0x7001, 0x2200}, 600, 0x200, 300 & 0xFF, {{0x0, 300 & 0xFF}}},
+        //* 16 nested calls fill the stack, then RET at 206 forever: 16 returns empty
+        //* it, 34 more wrap sp below zero and keep reading the same addresses
+        {"stack-underflow", QUIRKS_LEGACY, {0x7001, 0x3011, 0x2200, 0x00EE}, 100, 0x206, (16 - 50) & 0xFF,
+            {{0x0, 17}}},
+
+        //* ALU flags at the carry and borrow edges. Non-legacy profiles write VF last, from
+        //* the operands, with NOT borrow = Vx >= Vy; legacy keeps its original results.
+        {"add-carry", QUIRKS_CHIP8, {0x60FF, 0x6101, 0x8014}, 3, -1, -1, {{0x0, 0x00}, {0xF, 1}}},
+        {"add-carry-legacy", QUIRKS_LEGACY, {0x60FF, 0x6101, 0x8014}, 3, -1, -1, {{0x0, 0x00}, {0xF, 0}}},
+        {"add-carry-vf", QUIRKS_SCHIP, {0x6FFF, 0x6101, 0x8F14}, 3, -1, -1, {{0xF, 1}}},
+        {"add-carry-vf-legacy", QUIRKS_LEGACY, {0x6FFF, 0x6101, 0x8F14}, 3, -1, -1, {{0xF, 0}}},
+        {"sub-equal", QUIRKS_CHIP8, {0x6005, 0x6105, 0x8015}, 3, -1, -1, {{0x0, 0x00}, {0xF, 1}}},
+        {"sub-equal-legacy", QUIRKS_LEGACY, {0x6005, 0x6105, 0x8015}, 3, -1, -1, {{0x0, 0x00}, {0xF, 0}}},
+        {"sub-borrow", QUIRKS_XOCHIP, {0x6004, 0x6105, 0x8015}, 3, -1, -1, {{0x0, 0xFF}, {0xF, 0}}},
+        {"sub-vf", QUIRKS_CHIP8, {0x6F07, 0x6102, 0x8F15}, 3, -1, -1, {{0xF, 1}}},
+        {"sub-vf-legacy", QUIRKS_LEGACY, {0x6F07, 0x6102, 0x8F15}, 3, -1, -1, {{0xF, 0xFF}}},
+        {"subn-equal", QUIRKS_CHIP8, {0x6005, 0x6105, 0x8017}, 3, -1, -1, {{0x0, 0x00}, {0xF, 1}}},
+        {"subn-equal-legacy", QUIRKS_LEGACY, {0x6005, 0x6105, 0x8017}, 3, -1, -1, {{0x0, 0x00}, {0xF, 0}}},
+        {"subn-borrow", QUIRKS_SCHIP, {0x6005, 0x6104, 0x8017}, 3, -1, -1, {{0x0, 0xFF}, {0xF, 0}}},
+        {"add-i-overflow", QUIRKS_CHIP8, {0xAFFF, 0x6001, 0x6F05, 0xF01E}, 4, -1, -1, {{0xF, 5}}},
+        {"add-i-overflow-legacy", QUIRKS_LEGACY, {0xAFFF, 0x6001, 0x6F05, 0xF01E}, 4, -1, -1, {{0xF, 1}}},
+    };
+
+    //* Every column of the quirk table, on every profile
+    for (auto &probe : QUIRK_PROBES) {
+        for (int profile = 0; profile < QUIRK_PROFILE_COUNT; profile++) {
+            bool on = probe.expected[profile];
+            all.push_back({std::string(probe.column) + "-" + quirkProfileName((QuirkProfile)profile),
+                (QuirkProfile)profile, probe.program, probe.cycles, -1, -1, on ? probe.on : probe.off});
+        }
+    }
+    return all;
+}
+
+const std::vector<ConformanceCase> &conformanceCases()
+{
+    static const std::vector<ConformanceCase> cases = buildConformanceCases();
+    return cases;
+}
+
+static std::string describeRegisters(const char *engine, const Registers &registers, const ConformanceCase &test)
+{
+    char text[160];
+
+    if (test.pc >= 0 && registers.pc != test.pc) {
+        snprintf(text, sizeof(text), "%s: pc %03X, expected %03X", engine, registers.pc, test.pc);
+        return text;
+    }
+    if (test.sp >= 0 && registers.sp != test.sp) {
+        snprintf(text, sizeof(text), "%s: sp %u, expected %d", engine, registers.sp, test.sp);
+        return text;
+    }
+    for (auto &expected : test.registers) {
+        if (registers.V[expected.first] != expected.second) {
+            snprintf(text, sizeof(text), "%s: V%X %02X, expected %02X", engine, expected.first,
+                registers.V[expected.first], expected.second);
+            return text;
+        }
+    }
+    return "";
+}
+
+std::string checkConformanceCase(const ConformanceCase &test, std::string &skipped)
+{
+    skipped.clear();
+
+    std::vector<uint8_t> rom;
+    for (uint16_t opcode : test.program) {
+        rom.push_back(opcode >> 8);
+        rom.push_back(opcode & 0xFF);
+    }
+
+    std::unique_ptr<Chip8> interpreter(new Chip8());
+    interpreter->setQuirks(test.quirks);
+    interpreter->load(rom.data(), rom.size());
+    interpreter->runFrame(test.cycles);
+
+    Registers registers;
+    interpreter->getRegisters(registers);
+    std::string failure = describeRegisters("interpreter", registers, test);
+    if (!failure.empty()) {
+        return failure;
+    }
+
+    //* Whatever state a program reaches, its snapshot restores
+    std::unique_ptr<SaveState> state(new SaveState());
+    std::unique_ptr<Chip8> restored(new Chip8());
+    interpreter->saveState(*state);
+    if (!restored->loadState(*state) || !restored->stateEquals(*interpreter)) {
+        return "snapshot does not restore";
+    }
+
+    //* The JIT only translates legacy programs, any other profile would just run the
+    //* interpreter twice
+    if (test.quirks != QUIRKS_LEGACY) {
+        skipped = "JIT skipped, legacy quirks only";
+        return failure;
+    }
+
+    std::unique_ptr<Chip8> jit(new Chip8());
+    jit->setQuirks(test.quirks);
+    jit->load(rom.data(), rom.size());
+    if (!jit->setBackend(BACKEND_JIT)) {
+        skipped = "JIT skipped, not available";
+        return failure;
+    }
+    jit->runFrame(test.cycles);
+
+    jit->getRegisters(registers);
+    failure = describeRegisters("JIT", registers, test);
+    if (failure.empty() && !interpreter->stateEquals(*jit)) {
+        failure = "interpreter and JIT states differ";
+    }
+    return failure;
+}
+
+static double threadCpuSeconds()
+{
+    timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+//* Thread CPU time of the whole run
+static double timeFrames(const std::vector<uint8_t> &rom, unsigned frames, unsigned cyclesPerFrame,
+    QuirkProfile quirks, bool idleSkip)
+{
+    std::unique_ptr<Chip8> chip8(new Chip8());
+
+    chip8->load(rom.data(), rom.size());
+    chip8->setQuirks(quirks);
+    chip8->setIdleSkip(idleSkip);
+
+    double begin = threadCpuSeconds();
+    for (unsigned frame = 0; frame < frames; frame++) {
+        scriptedKeys(frame, chip8->key);
+        chip8->runFrame(cyclesPerFrame);
+    }
+    return threadCpuSeconds() - begin;
+}
+
+long checkIdle(const std::vector<uint8_t> &rom, unsigned frames, unsigned cyclesPerFrame, QuirkProfile quirks,
+    IdleReport &report)
+{
+    std::unique_ptr<Chip8> skipping(new Chip8());
+    std::unique_ptr<Chip8> stepping(new Chip8());
+
+    skipping->load(rom.data(), rom.size());
+    stepping->load(rom.data(), rom.size());
+    skipping->setQuirks(quirks);
+    stepping->setQuirks(quirks);
+    stepping->setIdleSkip(false);
+
+    for (unsigned frame = 0; frame < frames; frame++) {
+        scriptedKeys(frame, skipping->key);
+        scriptedKeys(frame, stepping->key);
+
+        skipping->runFrame(cyclesPerFrame);
+        stepping->runFrame(cyclesPerFrame);
+
+        if (!skipping->stateEquals(*stepping) || skipping->instructionCount != stepping->instructionCount) {
+            return frame;
+        }
+    }
+
+    report.instructions = skipping->instructionCount;
+    report.skipped = skipping->idleSkipped;
+    report.cpuOff = timeFrames(rom, frames, cyclesPerFrame, quirks, false);
+    report.cpuOn = timeFrames(rom, frames, cyclesPerFrame, quirks, true);
+    return -1;
+}
+
+void laneKeys(unsigned lane, unsigned frame, uint8_t key[16])
+{
+    scriptedKeys(frame + lane * 3, key);
+}
+
+//* Separate machines drawing from the same streams as engine->seedRandom(seed)
+static void loadMachines(const std::vector<uint8_t> &rom, unsigned lanes, uint64_t seed,
+    std::vector<std::unique_ptr<Chip8>> &machines)
+{
+    Random stream(seed);
+
+    for (unsigned lane = 0; lane < lanes; lane++) {
+        machines.emplace_back(new Chip8());
+        machines.back()->load(rom.data(), rom.size());
+        machines.back()->setRandom(stream);
+        stream.jump();
+    }
+}
+
+long checkLockstep(const std::vector<uint8_t> &rom, unsigned lanes, unsigned frames, unsigned cyclesPerFrame,
+    uint64_t seed)
+{
+    std::unique_ptr<LockstepEngine> engine(new LockstepEngine(lanes));
+    std::vector<std::unique_ptr<Chip8>> machines;
+
+    engine->load(rom.data(), rom.size());
+    engine->seedRandom(seed);
+    loadMachines(rom, lanes, seed, machines);
+
+    SaveState expected, actual;
+
+    for (unsigned frame = 0; frame < frames; frame++) {
+        for (unsigned lane = 0; lane < lanes; lane++) {
+            laneKeys(lane, frame, machines[lane]->key);
+            engine->setKeys(lane, machines[lane]->key);
+            machines[lane]->runFrame(cyclesPerFrame);
+        }
+        engine->runFrame(cyclesPerFrame);
+
+        for (unsigned lane = 0; lane < lanes; lane++) {
+            machines[lane]->saveState(expected);
+            engine->saveState(lane, actual);
+            if (memcmp(&expected, &actual, sizeof(SaveState))) {
+                return frame;
+            }
+        }
+    }
+
+    return -1;
+}
+
+bool benchLockstep(const RunnerConfig &config, LockstepReport &report)
+{
+    std::vector<uint8_t> rom;
+
+    if (!readRom(config.romPath.c_str(), rom)) {
+        return false;
+    }
+
+    unsigned lanes = config.instances;
+    std::vector<uint8_t> key(16);
+
+    report = LockstepReport();
+    report.lanes = lanes;
+
+    //* Input is set up the same way for both, so it costs the same on both sides
+    {
+        std::unique_ptr<LockstepEngine> engine(new LockstepEngine(lanes));
+        engine->load(rom.data(), rom.size());
+        engine->seedRandom(config.seed);
+        report.vectorized = engine->vectorized();
+
+        auto begin = std::chrono::steady_clock::now();
+        for (unsigned frame = 0; frame < config.frames; frame++) {
+            for (unsigned lane = 0; lane < lanes; lane++) {
+                laneKeys(lane, frame, key.data());
+                engine->setKeys(lane, key.data());
+            }
+            engine->runFrame(config.cyclesPerFrame);
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+
+        report.engineSeconds = elapsed.count();
+        report.steps = engine->instructionCount;
+    }
+
+    {
+        std::vector<std::unique_ptr<Chip8>> machines;
+        loadMachines(rom, lanes, config.seed, machines);
+
+        auto begin = std::chrono::steady_clock::now();
+        for (unsigned frame = 0; frame < config.frames; frame++) {
+            for (unsigned lane = 0; lane < lanes; lane++) {
+                laneKeys(lane, frame, machines[lane]->key);
+                machines[lane]->runFrame(config.cyclesPerFrame);
+            }
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+
+        report.objectSeconds = elapsed.count();
+    }
+
+    return true;
+}
+
+bool measureInputLatency(const RunnerConfig &config, LatencyReport &report)
+{
+    std::vector<uint8_t> rom;
+
+    if (!readRom(config.romPath.c_str(), rom)) {
+        return false;
+    }
+
+    std::unique_ptr<Chip8> chip8(new Chip8());
+    chip8->load(rom.data(), rom.size());
+    chip8->seedRandom(config.seed);
+
+    FrameScheduler scheduler(config.cyclesPerFrame);
+    TripleBuffer frames;
+    KeyInput input;
+    EmulationThread emulation(*chip8, scheduler, frames, input);
+    emulation.setEarlyInput(!config.fixedCadence);
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool done = false;
+    LatencyHistogram latency;
+
+    emulation.onPublish([&] {
+        std::lock_guard<std::mutex> lock(mutex);
+        wake.notify_one();
+    });
+
+    std::thread consumer([&] {
+        std::unique_lock<std::mutex> lock(mutex);
+
+        while (!done) {
+            wake.wait_for(lock, std::chrono::milliseconds(100), [&] { return done || frames.fresh(); });
+
+            const Frame *frame = frames.fresh() ? frames.acquire() : nullptr;
+            if (frame && frame->inputTime) {
+                latency.add((inputClock() - frame->inputTime) / 1e9);
+            }
+        }
+    });
+
+    emulation.start();
+
+    //* Taps and holds of random keys, 5 to 50 ms apart so several land in most frames' gaps
+    Random random(config.seed);
+    auto end = std::chrono::steady_clock::now()
+        + std::chrono::microseconds((uint64_t)config.frames * 1000000 / scheduler.frameRate());
+    uint16_t held = 0;
+
+    while (std::chrono::steady_clock::now() < end) {
+        std::this_thread::sleep_for(std::chrono::microseconds(5000 + random.next() % 45000));
+
+        uint8_t key = random.next() & 0xF;
+        bool down = !((held >> key) & 1);
+        held ^= 1 << key;
+        input.post({ inputClock(), key, down });
+    }
+
+    emulation.stop();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        done = true;
+        wake.notify_one();
+    }
+    consumer.join();
+
+    report = LatencyReport();
+    report.events = latency.samples();
+    report.p50 = latency.percentile(0.5);
+    report.p99 = latency.percentile(0.99);
+    report.max = latency.maximum();
+    report.framePeriod = 1.0 / scheduler.frameRate();
+    report.framesPublished = frames.framesPublished();
+    report.framesDropped = frames.framesDropped();
+    return true;
+}
@@ -0,0 +1,171 @@
+#ifndef _RUNNER_H
+#define _RUNNER_H
+
+#include "Quirks.h"
+#include "Random.h"
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+//* Headless batch runner: many independent Chip8 instances spread over a work-stealing pool
+struct RunnerConfig {
+    std::string romPath;            // ROM file, or a directory whose ROMs the sessions take in turn
+    unsigned instances = 64;        // Independent Chip8 sessions
+    unsigned frames = 600;          // Frames run by every session (10 s of game time)
+    unsigned cyclesPerFrame = 10;   // Instructions per 60Hz frame
+    unsigned threads = 0;           // 0 = one worker per hardware thread
+    bool jit = false;               // Run the sessions on the JIT backend
+    QuirkProfile quirks = QUIRKS_LEGACY;    // Profile of the ROMs the database doesn't list
+    std::string quirksDbPath;       // Per-ROM profiles by content hash, empty = none
+    std::string tracePath;          // Binary trace of the first session (CHIP8_TRACE builds)
+    std::string profilePath;        // Profile of the first session to <path>.folded and <path>.txt (CHIP8_PROFILE builds)
+    std::string recordPath;         // Screen and keypad recording of the first session
+    unsigned rewindFrames = 0;      // Per-session rewind history in frames, 0 = off
+    uint64_t seed = RANDOM_DEFAULT_SEED;    // Session n draws Cxkk from stream n of this seed
+    bool fixedCadence = false;      // Latency runs: input waits for the frame deadline, no early frames
+    bool audio = false;             // Render every session's buzzer into a null sink
+    unsigned restartFrames = 0;     // Restart every session from the catalog that often, 0 = never
+};
+
+struct WorkerStats {
+    uint64_t instances = 0;
+    uint64_t instructions = 0;
+    uint64_t frames = 0;
+    double busySeconds = 0;
+    uint64_t rewindBytes = 0;           // Summed over the sessions
+    double rewindBytesPerMinute = 0;    // Summed over the sessions
+    double rewindRestoreMax = 0;        // Slowest restore, in seconds
+    uint64_t rewindMismatches = 0;      // Restored state differed from the live one
+    uint64_t audioSamples = 0;
+    uint64_t audioSamplesOn = 0;        // Buzzer sounding
+    uint64_t audioUnderruns = 0;
+    uint64_t audioMismatches = 0;       // Sessions whose samples didn't line up with their frames
+    uint64_t restarts = 0;
+    double restartSeconds = 0;          // Spent in reset() + load()
+};
+
+struct RunnerReport {
+    unsigned threads = 0;
+    uint64_t instructions = 0;
+    uint64_t frames = 0;
+    uint64_t steals = 0;
+    double wallSeconds = 0;
+    uint64_t instances = 0;
+    uint64_t rewindBytes = 0;
+    double rewindBytesPerMinute = 0;
+    double rewindRestoreMax = 0;
+    uint64_t rewindMismatches = 0;
+    uint64_t audioSamples = 0;
+    uint64_t audioSamplesOn = 0;
+    uint64_t audioUnderruns = 0;
+    uint64_t audioMismatches = 0;
+    uint64_t restarts = 0;
+    double restartSeconds = 0;
+    size_t roms = 0;                    // In the catalog
+    uint64_t quirkSessions[QUIRK_PROFILE_COUNT] = {};   // Sessions run with each profile
+    uint64_t recordFrames = 0;          // Written to the recording
+    uint64_t recordDropped = 0;         // Ring full, left out of it
+    uint64_t recordBytes = 0;
+    double recordSeconds = 0;           // Spent in capture() on the recorded session's thread
+    double recordSessionSeconds = 0;    // The recorded session's whole run
+    bool recordMatches = false;         // Decoding it gives back the frames it was fed
+    std::vector<WorkerStats> workers;
+
+    double instructionsPerSecond() const { return wallSeconds > 0 ? instructions / wallSeconds : 0; }
+    double framesPerSecond() const { return wallSeconds > 0 ? frames / wallSeconds : 0; }
+};
+
+//* Read a whole ROM file, false if it can't be read or doesn't fit above START_LOCATION
+bool readRom(const char *path, std::vector<uint8_t> &rom);
+
+bool runBatch(const RunnerConfig &config, RunnerReport &report);
+
+void printReport(const RunnerConfig &config, const RunnerReport &report, bool json);
+
+//* Deterministic input for headless runs: hold one key for 8 frames, release it
+//* for 8, and walk through the keypad that way
+void scriptedKeys(unsigned frame, uint8_t key[16]);
+
+//* Run the ROM on the interpreter and the JIT in lockstep with the same scripted
+//* input and compare the whole machine state after every frame.
+//* Returns the first diverging frame, or -1 when both stay identical.
+long checkConformance(const std::vector<uint8_t> &rom, unsigned frames, unsigned cyclesPerFrame);
+
+//* Hand-written program for a corner the ROMs don't reach, with what the machine
+//* must hold after running it. -1 leaves pc or sp unchecked.
+struct ConformanceCase {
+    std::string name;
+    QuirkProfile quirks;
+    std::vector<uint16_t> program;  // Opcodes from START_LOCATION
+    unsigned cycles;
+    int pc;
+    int sp;
+    std::vector<std::pair<uint8_t, uint8_t>> registers;    // Vx and its value
+};
+
+const std::vector<ConformanceCase> &conformanceCases();
+
+//* Run the case on the interpreter and on the JIT, check both against its
+//* expectations and against each other, and round-trip the end state through a
+//* snapshot. Empty when they pass, otherwise what went wrong. The JIT leg only runs
+//* for legacy cases on a host with a JIT, `skipped` says why when it did not.
+std::string checkConformanceCase(const ConformanceCase &test, std::string &skipped);
+
+//* Idle-loop skipping on one ROM: instructions fast-forwarded, and the host CPU time
+//* of the same frames run with skipping off and on
+struct IdleReport {
+    uint64_t instructions = 0;
+    uint64_t skipped = 0;
+    double cpuOff = 0;              // Thread CPU seconds
+    double cpuOn = 0;
+};
+
+//* Run the ROM with idle skipping on and off side by side with the same scripted
+//* input, comparing the machine state and instruction count after every frame,
+//* then time both separately. Returns the first diverging frame, or -1.
+long checkIdle(const std::vector<uint8_t> &rom, unsigned frames, unsigned cyclesPerFrame, QuirkProfile quirks,
+    IdleReport &report);
+
+//* Lockstep engine against separate Chip8 objects, both single-threaded
+struct LockstepReport {
+    unsigned lanes = 0;
+    uint64_t steps = 0;             // Machine-steps: instructions summed over the lanes
+    double engineSeconds = 0;
+    double objectSeconds = 0;
+    bool vectorized = false;
+
+    double engineStepsPerSecond() const { return engineSeconds > 0 ? steps / engineSeconds : 0; }
+    double objectStepsPerSecond() const { return objectSeconds > 0 ? steps / objectSeconds : 0; }
+};
+
+//* Lane n gets the scripted input shifted by 3n frames, so the lanes diverge
+void laneKeys(unsigned lane, unsigned frame, uint8_t key[16]);
+
+//* Run `lanes` copies of the ROM on the lockstep engine and as separate Chip8
+//* objects, each lane with its own input and random stream, and compare every lane after every frame.
+//* Returns the first diverging frame, or -1 when all lanes stay identical.
+long checkLockstep(const std::vector<uint8_t> &rom, unsigned lanes, unsigned frames, unsigned cyclesPerFrame,
+    uint64_t seed);
+
+//* Time config.instances lanes for config.frames frames both ways
+bool benchLockstep(const RunnerConfig &config, LockstepReport &report);
+
+//* Key event to frame handed over, measured over the frontend's threads without SDL
+struct LatencyReport {
+    uint64_t events = 0;
+    double p50 = 0;
+    double p99 = 0;
+    double max = 0;
+    double framePeriod = 0;
+    uint64_t framesPublished = 0;
+    uint64_t framesDropped = 0;
+};
+
+//* Run the ROM at real speed on an EmulationThread for config.frames frames while
+//* this thread posts key events at random moments and a consumer thread, woken by
+//* every publish like the SDL thread, takes the frames that show them
+bool measureInputLatency(const RunnerConfig &config, LatencyReport &report);
+
+#endif // _RUNNER_H
@@ -0,0 +1,48 @@
+#include "SaveState.h"
+#include "Chip8.h"
+
+#include <cstdio>
+
+bool saveStateValid(const SaveState &state)
+{
+    return state.magic == SAVE_STATE_MAGIC
+        && state.version == SAVE_STATE_VERSION
+        && state.size == sizeof(SaveState)
+        //* Snapshots also come from other processes and files: range-check the Fx0A wait.
+        //* Any sp is fine, every stack access is masked and deep programs take it past 16.
+        && state.keyWaitState <= KEY_WAIT_RELEASE
+        && state.keyWaitKey <= 0xF;
+}
+
+bool writeSaveState(const char *path, const SaveState &state)
+{
+    FILE *file = fopen(path, "wb");
+
+    if (!file) {
+        fprintf(stderr, "Fail to create the save state: %s\n", path);
+        return false;
+    }
+
+    bool written = fwrite(&state, sizeof(state), 1, file) == 1;
+    return fclose(file) == 0 && written;
+}
+
+bool readSaveState(const char *path, SaveState &state)
+{
+    FILE *file = fopen(path, "rb");
+
+    if (!file) {
+        fprintf(stderr, "Fail to load the save state: %s\n", path);
+        return false;
+    }
+
+    bool read = fread(&state, sizeof(state), 1, file) == 1;
+    fclose(file);
+
+    if (!read || !saveStateValid(state)) {
+        fprintf(stderr, "Not a save state of this version: %s\n", path);
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,43 @@
+#ifndef _SAVE_STATE_H
+#define _SAVE_STATE_H
+
+#include <cstdint>
+#include <cstddef>
+
+#define SAVE_STATE_MAGIC    0x53533843  // "C8SS"
+#define SAVE_STATE_VERSION  3
+
+//* Complete machine state, written to disk as is (little endian, no padding).
+//* Fields are ordered by size so the layout is the same on every compiler, and the
+//* total is a multiple of 8 so the rewind buffer can diff it a word at a time.
+struct SaveState {
+    uint32_t    magic;
+    uint16_t    version;
+    uint16_t    size;               // sizeof(SaveState), catches layout changes within a version
+
+    uint64_t    gfx[32];
+    uint64_t    rng[4];             // Cxkk generator, so a restored run draws the same numbers (since version 2)
+    uint16_t    stack[16];
+    uint16_t    I;
+    uint16_t    pc;
+    uint16_t    keyWaitHeld;        // Fx0A wait, see KeyWait (since version 3)
+    uint8_t     mem[4096];
+    uint8_t     V[16];
+    uint8_t     key[16];
+    uint8_t     sp;
+    uint8_t     delayTimer;
+    uint8_t     soundTimer;
+    uint8_t     keyWaitState;
+    uint8_t     keyWaitKey;
+    uint8_t     reserved[5];
+};
+static_assert(sizeof(SaveState) % 8 == 0, "save states are diffed in 64-bit words");
+
+//* True if the header matches this build's format and the Fx0A wait is in range
+bool saveStateValid(const SaveState &state);
+
+bool writeSaveState(const char *path, const SaveState &state);
+//* Fails on a missing file, a short read or a header from another format version
+bool readSaveState(const char *path, SaveState &state);
+
+#endif // _SAVE_STATE_H
@@ -0,0 +1,122 @@
+#include "Scheduler.h"
+#include "Chip8.h"
+
+#include <thread>
+
+constexpr std::chrono::microseconds FrameScheduler::SPIN_MARGIN;
+constexpr unsigned FrameScheduler::MAX_LAG_FRAMES;
+constexpr std::chrono::microseconds FrameScheduler::WAKE_POLL;
+
+FrameScheduler::FrameScheduler(unsigned cyclesPerFrame, unsigned hz)
+    : cycles(cyclesPerFrame), hz(hz)
+{
+    origin = Clock::now();
+    statsStart = origin;
+    current.frameRate = hz;
+}
+
+void FrameScheduler::setTurbo(bool enabled)
+{
+    if (fastForward && !enabled) {
+        origin = Clock::now();
+        frameIndex = 0;
+    }
+    fastForward = enabled;
+}
+
+FrameScheduler::Clock::time_point FrameScheduler::deadline(uint64_t frame) const
+{
+    //* Whole nanoseconds from the origin: 60Hz doesn't divide a second evenly
+    return origin + std::chrono::nanoseconds(frame * 1000000000ull / hz);
+}
+
+void FrameScheduler::emulate(Chip8 &chip8)
+{
+    auto begin = Clock::now();
+    uint64_t before = chip8.instructionCount;
+
+    chip8.runFrame(cycles);
+
+    std::chrono::duration<double> busy = Clock::now() - begin;
+    current.emulateSeconds += busy.count();
+    current.instructions += chip8.instructionCount - before;
+    current.frames++;
+}
+
+void FrameScheduler::waitNextFrame(const std::function<bool()> &wakeEarly)
+{
+    if (fastForward) {
+        return;
+    }
+
+    frameIndex++;
+    Clock::time_point target = deadline(frameIndex);
+    Clock::time_point earliest = deadline(frameIndex - 1);
+    Clock::time_point now = Clock::now();
+
+    if (now > deadline(frameIndex + MAX_LAG_FRAMES)) {
+        //* Stalled (debugger, window drag, suspended): drop the missed frames instead of racing
+        origin = now;
+        frameIndex = 0;
+        current.resyncs++;
+        return;
+    }
+
+    auto early = [&] {
+        if (wakeEarly && now >= earliest && wakeEarly()) {
+            current.earlyFrames++;
+            return true;
+        }
+        return false;
+    };
+
+    Clock::time_point sleepStart = now;
+    while (target - now > SPIN_MARGIN) {
+        if (early()) {
+            current.sleepSeconds += std::chrono::duration<double>(now - sleepStart).count();
+            return;
+        }
+
+        auto sleep = target - now - SPIN_MARGIN;
+        if (wakeEarly && sleep > WAKE_POLL) {
+            sleep = WAKE_POLL;
+        }
+        std::this_thread::sleep_for(sleep);
+        now = Clock::now();
+    }
+    current.sleepSeconds += std::chrono::duration<double>(now - sleepStart).count();
+
+    //* The OS wakes us up with a millisecond of slack, the rest is spent spinning
+    Clock::time_point spinStart = now;
+    while (now < target) {
+        if (early()) {
+            break;
+        }
+        now = Clock::now();
+    }
+    current.spinSeconds += std::chrono::duration<double>(now - spinStart).count();
+
+    if (now < target) {
+        return;
+    }
+
+    std::chrono::duration<double> late = now - target;
+    current.jitterSum += late.count();
+    if (late.count() > current.jitterMax) {
+        current.jitterMax = late.count();
+    }
+}
+
+SchedulerStats FrameScheduler::stats() const
+{
+    SchedulerStats stats = current;
+    stats.wallSeconds = std::chrono::duration<double>(Clock::now() - statsStart).count();
+    return stats;
+}
+
+void FrameScheduler::resetStats()
+{
+    current = SchedulerStats();
+    current.frameRate = hz;
+    statsStart = Clock::now();
+}
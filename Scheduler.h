@@ -0,0 +1,78 @@
+#ifndef _SCHEDULER_H
+#define _SCHEDULER_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+
+class Chip8;
+
+struct SchedulerStats {
+    uint64_t frames = 0;
+    uint64_t instructions = 0;
+    double wallSeconds = 0;
+    double emulateSeconds = 0;     // Inside runFrame
+    double sleepSeconds = 0;       // Blocked in the OS
+    double spinSeconds = 0;        // Busy-waiting the last stretch before a deadline
+    double jitterSum = 0;          // How late every frame started, summed
+    double jitterMax = 0;
+    uint64_t resyncs = 0;          // Fell too far behind and dropped the missed frames
+    uint64_t earlyFrames = 0;      // Started ahead of their deadline to show new input sooner
+    unsigned frameRate = 60;
+
+    double instructionsPerSecond() const { return wallSeconds > 0 ? instructions / wallSeconds : 0; }
+    //* Emulated time over wall time: 1 when paced, far above in turbo
+    double speedMultiplier() const { return wallSeconds > 0 ? frames / (wallSeconds * frameRate) : 0; }
+    double meanJitter() const { return frames ? jitterSum / frames : 0; }
+};
+
+//* Paces emulation at a fixed frame rate: a budget of instructions and one timer
+//* tick per frame, and all the waiting at frame boundaries.
+//* Deadlines are computed from the start of the run, not from the previous wakeup,
+//* so oversleeping one frame doesn't push every later frame back.
+class FrameScheduler {
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    unsigned cycles;
+    unsigned hz;
+    Clock::time_point origin;
+    uint64_t frameIndex = 0;
+    bool fastForward = false;
+    Clock::time_point statsStart;
+    SchedulerStats current;
+
+    Clock::time_point deadline(uint64_t frame) const;
+
+public:
+    //* Sleeps until this much before a deadline, then spins
+    static constexpr std::chrono::microseconds SPIN_MARGIN{1000};
+    //* Further behind than this many frames, the schedule starts over from now
+    static constexpr unsigned MAX_LAG_FRAMES = 4;
+    //* How often a wait with a wake condition checks it
+    static constexpr std::chrono::microseconds WAKE_POLL{250};
+
+    explicit FrameScheduler(unsigned cyclesPerFrame = 10, unsigned hz = 60);
+
+    unsigned cyclesPerFrame() const { return cycles; }
+    void setCyclesPerFrame(unsigned cyclesPerFrame) { cycles = cyclesPerFrame; }
+    unsigned frameRate() const { return hz; }
+
+    //* Turbo: frames run back to back, the timers still tick once per emulated frame.
+    //* Leaving turbo starts a fresh schedule instead of sleeping off the time gained.
+    void setTurbo(bool enabled);
+    bool turbo() const { return fastForward; }
+
+    //* Run this frame's instruction budget and tick the timers
+    void emulate(Chip8 &chip8);
+    //* Block until the next frame boundary. If `wakeEarly` turns true first, return
+    //* at once so the next frame shows it sooner (new input). A frame never starts
+    //* before the previous frame's boundary, emulated time stays at most a frame ahead.
+    void waitNextFrame(const std::function<bool()> &wakeEarly = nullptr);
+
+    //* Counters since construction or the last resetStats()
+    SchedulerStats stats() const;
+    void resetStats();
+};
+
+#endif // _SCHEDULER_H
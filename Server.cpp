@@ -0,0 +1,413 @@
+#include "Server.h"
+#include "RomCatalog.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+//* Instructions a request has to step, at least, before it is spread over the pool
+#define SERVER_PARALLEL_WORK 100000
+
+EmulatorServer::EmulatorServer(const RomCatalog &catalog, unsigned threads, unsigned maxSessions)
+    : catalog(catalog), pool(new ThreadPool(threads))
+{
+    if (maxSessions > 0xFFFF) {
+        maxSessions = 0xFFFF;
+    }
+
+    sessions.resize(maxSessions);
+    //* Lowest slots first
+    for (uint32_t slot = maxSessions; slot > 0; slot--) {
+        freeSlots.push_back(slot - 1);
+    }
+}
+
+EmulatorServer::~EmulatorServer()
+{
+    for (int fd : clients) {
+        close(fd);
+    }
+    for (auto &session : sessions) {
+        if (session.live) {
+            destroy(session);
+        }
+    }
+    if (listenFd >= 0) {
+        close(listenFd);
+        unlink(path.c_str());
+    }
+}
+
+bool EmulatorServer::listen(const char *socketPath)
+{
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+
+    if (strlen(socketPath) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", socketPath);
+        return false;
+    }
+    strcpy(address.sun_path, socketPath);
+
+    //* Message boundaries are kept: one request is one recv, whatever its size
+    listenFd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (listenFd < 0) {
+        fprintf(stderr, "Fail to create the socket: %s\n", strerror(errno));
+        return false;
+    }
+
+    //* Only a stale socket is replaced, never a file that happens to be at that path
+    struct stat info;
+    if (lstat(socketPath, &info) == 0) {
+        if (!S_ISSOCK(info.st_mode)) {
+            fprintf(stderr, "Not a socket, left alone: %s\n", socketPath);
+            close(listenFd);
+            listenFd = -1;
+            return false;
+        }
+        unlink(socketPath);
+    }
+    if (bind(listenFd, (sockaddr *)&address, sizeof(address)) < 0 || ::listen(listenFd, 64) < 0) {
+        fprintf(stderr, "Fail to listen at %s: %s\n", socketPath, strerror(errno));
+        close(listenFd);
+        listenFd = -1;
+        return false;
+    }
+
+    path = socketPath;
+    return true;
+}
+
+EmulatorServer::Session *EmulatorServer::find(uint32_t id)
+{
+    uint32_t slot = id & 0xFFFF;
+
+    if (slot >= sessions.size() || !sessions[slot].live || sessions[slot].generation != id >> 16) {
+        return nullptr;
+    }
+    return &sessions[slot];
+}
+
+void EmulatorServer::publish(Session &session)
+{
+    SessionView *view = session.view;
+    uint32_t sequence = view->sequence.load(std::memory_order_relaxed);
+
+    view->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    view->frames = session.frames;
+    view->instructions = session.chip8->instructionCount;
+    memcpy(view->gfx, session.chip8->frameRows(), sizeof(view->gfx));
+    session.chip8->getRegisters(view->registers);
+
+    view->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+ServerReply EmulatorServer::create(const ServerCommand &command, std::vector<int> &fds)
+{
+    ServerReply reply = { SERVER_FULL, 0, 0 };
+
+    if (freeSlots.empty() || command.quirks >= QUIRK_PROFILE_COUNT || command.count > SERVER_MAX_CYCLES) {
+        reply.status = freeSlots.empty() ? SERVER_FULL : SERVER_BAD_OP;
+        return reply;
+    }
+
+    //* Sealed at its size: a client can't shrink it under the server's mapping
+    int memfd = memfd_create("chip8-session", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (memfd < 0) {
+        return reply;
+    }
+
+    void *memory = MAP_FAILED;
+    if (ftruncate(memfd, sizeof(SessionView)) == 0
+        && fcntl(memfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) == 0) {
+        memory = mmap(nullptr, sizeof(SessionView), PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+    }
+    if (memory == MAP_FAILED) {
+        close(memfd);
+        return reply;
+    }
+
+    uint32_t slot = freeSlots.back();
+    freeSlots.pop_back();
+
+    Session &session = sessions[slot];
+    session.memfd = memfd;
+    session.view = new (memory) SessionView();
+    session.view->magic = SERVER_MAGIC;
+    session.view->version = SERVER_VERSION;
+    session.cycles = command.count ? command.count : 10;
+    session.frames = 0;
+    session.view->cyclesPerFrame = session.cycles;
+    session.chip8.reset(new Chip8());
+    session.chip8->seedRandom(command.hash ? command.hash : RANDOM_DEFAULT_SEED);
+    session.chip8->setQuirks((QuirkProfile)command.quirks);
+    session.live = true;
+    liveSessions++;
+    publish(session);
+
+    reply.status = SERVER_OK;
+    reply.session = slot | (uint32_t)session.generation << 16;
+    reply.value = fds.size();
+    fds.push_back(memfd);
+    return reply;
+}
+
+void EmulatorServer::destroy(Session &session)
+{
+    //* Clients that still map the region keep it until they unmap it
+    munmap(session.view, sizeof(SessionView));
+    close(session.memfd);
+    session.view = nullptr;
+    session.memfd = -1;
+    session.chip8.reset();
+    session.live = false;
+    session.generation++;
+    freeSlots.push_back(&session - sessions.data());
+    liveSessions--;
+}
+
+ServerReply EmulatorServer::apply(const ServerCommand &command)
+{
+    ServerReply reply = { SERVER_OK, command.session, 0 };
+    Session *session = find(command.session);
+
+    if (!session) {
+        reply.status = SERVER_BAD_SESSION;
+        return reply;
+    }
+
+    Chip8 &chip8 = *session->chip8;
+    SessionView *view = session->view;
+
+    switch (command.op) {
+        case SERVER_LOAD: {
+            const uint8_t *data = view->rom;
+            size_t size = command.count;
+            if (command.hash) {
+                const RomEntry *rom = catalog.findHash(command.hash);
+                if (!rom) {
+                    reply.status = SERVER_NO_ROM;
+                    break;
+                }
+                data = rom->data;
+                size = rom->size;
+            }
+            if (size > MAX_ROM_SIZE || findVariantOpcode(data, size)) {
+                reply.status = SERVER_NO_ROM;
+                break;
+            }
+            chip8.reset();
+            chip8.load(data, size);
+            session->frames = 0;
+            publish(*session);
+            break;
+        }
+        case SERVER_STEP: {
+            if (command.count > SERVER_MAX_FRAMES) {
+                reply.status = SERVER_BAD_OP;
+                break;
+            }
+            uint64_t before = chip8.instructionCount;
+            for (uint32_t frame = 0; frame < command.count; frame++) {
+                chip8.runFrame(session->cycles);
+            }
+            session->frames += command.count;
+            publish(*session);
+            reply.value = chip8.instructionCount - before;
+            break;
+        }
+        case SERVER_SET_KEYS:
+            chip8.setKeys(command.keys);
+            break;
+        case SERVER_SNAPSHOT:
+            chip8.saveState(view->snapshot);
+            break;
+        case SERVER_RESTORE: {
+            //* A private copy: the client may be writing the next one already
+            SaveState state = view->snapshot;
+            if (!chip8.loadState(state)) {
+                reply.status = SERVER_BAD_STATE;
+                break;
+            }
+            publish(*session);
+            break;
+        }
+        case SERVER_DESTROY:
+            destroy(*session);
+            break;
+        default:
+            reply.status = SERVER_BAD_OP;
+            break;
+    }
+
+    return reply;
+}
+
+bool EmulatorServer::handle(int fd)
+{
+    alignas(8) uint8_t request[SERVER_REQUEST_SIZE];
+    alignas(8) uint8_t response[SERVER_REPLY_SIZE];
+
+    iovec in = { request, sizeof(request) };
+    msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &in;
+    message.msg_iovlen = 1;
+
+    ssize_t size = recvmsg(fd, &message, 0);
+    if (size <= 0) {
+        return false;
+    }
+
+    ServerMessage header;
+    memcpy(&header, request, sizeof(header));
+    if ((size_t)size < sizeof(header) || (message.msg_flags & MSG_TRUNC)
+        || header.magic != SERVER_MAGIC || header.version != SERVER_VERSION
+        || header.count > SERVER_MAX_BATCH
+        || (size_t)size != sizeof(header) + header.count * sizeof(ServerCommand)) {
+        fprintf(stderr, "Server: malformed request, connection closed\n");
+        return false;
+    }
+
+    const ServerCommand *commands = (const ServerCommand *)(request + sizeof(header));
+    ServerReply *replies = (ServerReply *)(response + sizeof(header));
+    std::vector<int> fds;
+
+    //* The whole request's steps, before anything runs. A session that isn't live yet
+    //* (created earlier in the request, or unknown) counts at the most cycles per frame.
+    uint64_t requestWork = 0;
+    for (unsigned i = 0; i < header.count; i++) {
+        if (commands[i].op == SERVER_STEP) {
+            Session *session = find(commands[i].session);
+            uint32_t frames = std::min<uint32_t>(commands[i].count, SERVER_MAX_FRAMES);
+            requestWork += (uint64_t)frames * (session ? session->cycles : SERVER_MAX_CYCLES);
+        }
+    }
+    bool overBudget = requestWork > SERVER_MAX_REQUEST_WORK;
+    for (unsigned i = 0; i < header.count && overBudget; i++) {
+        replies[i] = { SERVER_OVER_BUDGET, commands[i].session, 0 };
+    }
+
+    for (unsigned i = overBudget ? header.count : 0; i < header.count;) {
+        //* CREATE and DESTROY change the slot lists, they run on their own
+        if (commands[i].op == SERVER_CREATE || commands[i].op == SERVER_DESTROY) {
+            replies[i] = commands[i].op == SERVER_CREATE ? create(commands[i], fds) : apply(commands[i]);
+            i++;
+            continue;
+        }
+
+        //* Up to the next one, commands only touch their own session: each session's
+        //* commands run in order on one worker, the sessions in parallel
+        unsigned end = i;
+        uint64_t work = 0;
+        while (end < header.count && commands[end].op != SERVER_CREATE && commands[end].op != SERVER_DESTROY) {
+            Session *session = find(commands[end].session);
+            if (session && commands[end].op == SERVER_STEP) {
+                work += (uint64_t)commands[end].count * session->cycles;
+            }
+            end++;
+        }
+
+        //* Handing a session to a worker costs microseconds: short steps stay on this thread
+        if (pool->size() > 1 && work >= SERVER_PARALLEL_WORK) {
+            uint32_t groups[SERVER_MAX_BATCH];      // Session of each group
+            uint8_t group[SERVER_MAX_BATCH];        // Group of each command
+            unsigned groupCount = 0;
+
+            for (unsigned j = i; j < end; j++) {
+                unsigned g = 0;
+                while (g < groupCount && groups[g] != commands[j].session) {
+                    g++;
+                }
+                if (g == groupCount) {
+                    groups[groupCount++] = commands[j].session;
+                }
+                group[j] = g;
+            }
+
+            for (unsigned g = 0; g < groupCount; g++) {
+                pool->submit([this, commands, replies, &group, i, end, g] {
+                    for (unsigned j = i; j < end; j++) {
+                        if (group[j] == g) {
+                            replies[j] = apply(commands[j]);
+                        }
+                    }
+                });
+            }
+            pool->wait();
+        } else {
+            for (unsigned j = i; j < end; j++) {
+                replies[j] = apply(commands[j]);
+            }
+        }
+        i = end;
+    }
+
+    requests++;
+    this->commands += header.count;
+
+    memcpy(response, &header, sizeof(header));
+    iovec out = { response, sizeof(header) + header.count * sizeof(ServerReply) };
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * SERVER_MAX_BATCH)];
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &out;
+    message.msg_iovlen = 1;
+
+    //* The memfds of the sessions created, in command order
+    if (!fds.empty()) {
+        message.msg_control = control;
+        message.msg_controllen = CMSG_SPACE(sizeof(int) * fds.size());
+        cmsghdr *rights = CMSG_FIRSTHDR(&message);
+        rights->cmsg_level = SOL_SOCKET;
+        rights->cmsg_type = SCM_RIGHTS;
+        rights->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+        memcpy(CMSG_DATA(rights), fds.data(), sizeof(int) * fds.size());
+    }
+
+    return sendmsg(fd, &message, MSG_NOSIGNAL) == (ssize_t)out.iov_len;
+}
+
+void EmulatorServer::serve(const std::atomic<bool> &stop)
+{
+    std::vector<pollfd> polled;
+
+    while (!stop.load(std::memory_order_relaxed)) {
+        polled.clear();
+        polled.push_back({ listenFd, POLLIN, 0 });
+        for (int fd : clients) {
+            polled.push_back({ fd, POLLIN, 0 });
+        }
+
+        int ready = poll(polled.data(), polled.size(), 100);
+        if (ready <= 0) {
+            continue;
+        }
+
+        for (size_t i = 1; i < polled.size(); i++) {
+            if (polled[i].revents && !handle(polled[i].fd)) {
+                close(polled[i].fd);
+                clients.erase(std::find(clients.begin(), clients.end(), polled[i].fd));
+            }
+        }
+
+        if (polled[0].revents & POLLIN) {
+            int fd = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd >= 0) {
+                clients.push_back(fd);
+            }
+        }
+    }
+}
@@ -0,0 +1,191 @@
+#ifndef _SERVER_H
+#define _SERVER_H
+
+#include "Chip8.h"
+#include "SaveState.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+//* Protocol of chip8-server. Clients only need this header: requests and replies
+//* are plain structs over a SOCK_SEQPACKET Unix socket, and every session's screen
+//* and registers live in a memfd the client maps.
+
+#define SERVER_MAGIC        0x53483843  // "C8HS"
+#define SERVER_VERSION      1
+#define SERVER_SOCKET       "/tmp/chip8-server.sock"
+//* Commands per request message
+#define SERVER_MAX_BATCH    64
+//* Most instructions per frame (SERVER_CREATE) and frames per SERVER_STEP: a command
+//* runs 6M instructions at most, a few tens of milliseconds. Larger counts get SERVER_BAD_OP.
+#define SERVER_MAX_CYCLES   10000
+#define SERVER_MAX_FRAMES   600
+//* Most instructions the steps of one request may add up to, about 100 ms of one core.
+//* Over it, nothing of the request runs and every command gets SERVER_OVER_BUDGET.
+#define SERVER_MAX_REQUEST_WORK 16000000
+
+enum ServerOp : uint8_t {
+    SERVER_CREATE,      // New session: quirks, count = cycles per frame (0 = 10, at most SERVER_MAX_CYCLES),
+                        // hash = Cxkk seed (0 = RANDOM_DEFAULT_SEED). Its memfd comes with the reply.
+    SERVER_LOAD,        // Reset and load: hash = ROM of the server's catalog, or 0 = count bytes of view->rom
+    SERVER_STEP,        // Run count frames (at most SERVER_MAX_FRAMES), then publish the screen and registers
+    SERVER_SET_KEYS,    // keys = keypad mask, bit n = key n down
+    SERVER_SNAPSHOT,    // Whole machine into view->snapshot
+    SERVER_RESTORE,     // Whole machine from view->snapshot, then publish
+    SERVER_DESTROY,
+    SERVER_OP_COUNT
+};
+
+enum ServerStatus : int32_t {
+    SERVER_OK = 0,
+    SERVER_BAD_OP = -1,         // Unknown op, or a count or profile out of range
+    SERVER_BAD_SESSION = -2,    // Unknown or destroyed
+    SERVER_NO_ROM = -3,         // Not in the catalog, too large, or SUPER-CHIP/XO-CHIP code
+    SERVER_BAD_STATE = -4,      // view->snapshot isn't a valid save state of this version (saveStateValid)
+    SERVER_FULL = -5,           // No session slot, or no memory for one
+    SERVER_OVER_BUDGET = -6,    // The request's steps exceed SERVER_MAX_REQUEST_WORK, none ran
+};
+
+struct ServerCommand {
+    uint8_t     op;             // ServerOp
+    uint8_t     quirks;         // QuirkProfile, SERVER_CREATE
+    uint16_t    keys;
+    uint32_t    session;
+    uint32_t    count;
+    uint32_t    reserved;
+    uint64_t    hash;
+};
+
+struct ServerReply {
+    int32_t     status;         // ServerStatus
+    uint32_t    session;
+    //* SERVER_CREATE: index of the session's memfd among the reply's SCM_RIGHTS.
+    //* SERVER_STEP: instructions run by the step.
+    uint64_t    value;
+};
+
+//* Both directions: a header, then `count` commands or replies. Replies come in
+//* the order of the commands.
+struct ServerMessage {
+    uint32_t    magic;
+    uint16_t    version;
+    uint16_t    count;
+};
+
+#define SERVER_REQUEST_SIZE (sizeof(ServerMessage) + SERVER_MAX_BATCH * sizeof(ServerCommand))
+#define SERVER_REPLY_SIZE   (sizeof(ServerMessage) + SERVER_MAX_BATCH * sizeof(ServerReply))
+
+//* A session's shared region. The server rewrites frames to registers after every
+//* step under the sequence counter, odd while it writes. snapshot and rom are
+//* only touched by the commands that name them.
+struct SessionView {
+    uint32_t    magic;          // SERVER_MAGIC
+    uint16_t    version;        // SERVER_VERSION
+    uint16_t    reserved;
+    std::atomic<uint32_t> sequence;
+    uint32_t    cyclesPerFrame;
+    uint64_t    frames;         // Stepped since the last load
+    uint64_t    instructions;
+    uint64_t    gfx[SCREEN_HEIGHT];     // Chip8::frameRows()
+    Registers   registers;
+
+    alignas(64) SaveState snapshot;
+    alignas(64) uint8_t rom[MAX_ROM_SIZE];     // Written by the client for SERVER_LOAD
+};
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "the sequence is shared between processes");
+
+//* Screen and registers as of one step
+struct SessionFrame {
+    uint64_t    frames;
+    uint64_t    instructions;
+    uint64_t    gfx[SCREEN_HEIGHT];
+    Registers   registers;
+};
+
+//* Client side: copy a consistent frame out of the view, retrying while the
+//* server is in the middle of publishing one
+inline void readSessionView(const SessionView *view, SessionFrame &frame)
+{
+    for (;;) {
+        uint32_t before = view->sequence.load(std::memory_order_acquire);
+        if (before & 1) {
+            continue;
+        }
+
+        frame.frames = view->frames;
+        frame.instructions = view->instructions;
+        memcpy(frame.gfx, view->gfx, sizeof(frame.gfx));
+        frame.registers = view->registers;
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (view->sequence.load(std::memory_order_relaxed) == before) {
+            return;
+        }
+    }
+}
+
+class RomCatalog;
+class ThreadPool;
+
+//* Hosts a pool of Chip8 sessions for local processes. One thread polls the
+//* listening socket and every connection. Within a request, the commands of
+//* different sessions run in parallel on a ThreadPool, each session's in order.
+//* Sessions aren't tied to a connection: any client can drive any id it knows.
+class EmulatorServer {
+private:
+    struct Session {
+        std::unique_ptr<Chip8> chip8;
+        SessionView *view = nullptr;
+        int memfd = -1;
+        unsigned cycles = 10;
+        uint64_t frames = 0;
+        uint16_t generation = 0;
+        bool live = false;
+    };
+
+    const RomCatalog &catalog;
+    std::unique_ptr<ThreadPool> pool;
+    std::vector<Session> sessions;
+    std::vector<uint32_t> freeSlots;
+    int listenFd = -1;
+    std::string path;
+    std::vector<int> clients;
+
+    uint64_t requests = 0;
+    uint64_t commands = 0;
+    uint64_t liveSessions = 0;
+
+    //* The session of an id, nullptr if it isn't live. Ids are slot | generation << 16.
+    Session *find(uint32_t id);
+    void publish(Session &session);
+    ServerReply create(const ServerCommand &command, std::vector<int> &fds);
+    ServerReply apply(const ServerCommand &command);
+    void destroy(Session &session);
+    //* Run a request, true if the connection is still good
+    bool handle(int fd);
+
+public:
+    //* threads = 0: one worker per hardware thread. At most 65535 sessions.
+    EmulatorServer(const RomCatalog &catalog, unsigned threads = 0, unsigned maxSessions = 1024);
+    ~EmulatorServer();
+
+    EmulatorServer(const EmulatorServer &) = delete;
+    EmulatorServer &operator=(const EmulatorServer &) = delete;
+
+    //* Bind and listen at path (a stale socket is replaced, any other file refused), false with a message
+    bool listen(const char *path);
+
+    //* Serve until stop goes up (may be set from a signal handler), checked every 100 ms
+    void serve(const std::atomic<bool> &stop);
+
+    uint64_t requestCount() const { return requests; }
+    uint64_t commandCount() const { return commands; }
+    uint64_t sessionCount() const { return liveSessions; }
+};
+
+#endif // _SERVER_H
@@ -0,0 +1,31 @@
+#ifndef _STATE_HASH_H
+#define _STATE_HASH_H
+
+#include <cstdint>
+
+//* Keys of the Zobrist-style state hash (Chip8::stateHash). Every (location, value)
+//* pair of RAM and the screen has a pseudo-random 64-bit key, and RAM and screen hash
+//* to the XOR of the keys of their contents, so a write moves the hash by two XORs:
+//* the key of the old value out, the key of the new one in. The keys are computed
+//* rather than looked up, a 4096 x 256 table wouldn't stay in cache. Zero bytes and
+//* blank rows have key 0, a rehash only visits what is set.
+
+//* splitmix64 finalizer
+inline uint64_t hashMix(uint64_t z)
+{
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+inline uint64_t memoryKey(uint16_t addr, uint8_t value)
+{
+    return value ? hashMix(0x5A0B000000000000ull | (uint64_t)(addr & 0xFFF) << 8 | value) : 0;
+}
+
+inline uint64_t rowKey(unsigned row, uint64_t bits)
+{
+    return bits ? hashMix(bits + hashMix(0x6F7700 + row)) : 0;
+}
+
+#endif // _STATE_HASH_H
@@ -0,0 +1,117 @@
+#include "ThreadPool.h"
+
+static thread_local int currentWorker = -1;
+
+ThreadPool::ThreadPool(size_t threadCount) :
+    workers(threadCount ? threadCount : (std::thread::hardware_concurrency() ? std::thread::hardware_concurrency() : 1))
+{
+    for (size_t i = 0; i < workers.size(); i++) {
+        threads.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> guard(idleLock);
+        stopping = true;
+    }
+    wakeUp.notify_all();
+
+    for (auto &thread : threads) {
+        thread.join();
+    }
+}
+
+int ThreadPool::workerIndex()
+{
+    return currentWorker;
+}
+
+void ThreadPool::submit(std::function<void()> task)
+{
+    size_t queue = nextQueue.fetch_add(1, std::memory_order_relaxed) % workers.size();
+
+    pending.fetch_add(1, std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> guard(workers[queue].lock);
+        workers[queue].tasks.push_back(std::move(task));
+    }
+
+    //* Take the idle lock so a worker between "found nothing" and "sleep" can't miss the wake up
+    {
+        std::lock_guard<std::mutex> guard(idleLock);
+    }
+    wakeUp.notify_one();
+}
+
+void ThreadPool::wait()
+{
+    std::unique_lock<std::mutex> guard(idleLock);
+    allDone.wait(guard, [this] { return pending.load() == 0; });
+}
+
+bool ThreadPool::popTask(size_t self, std::function<void()> &task)
+{
+    //* Own deque first, newest task (still warm in cache)
+    {
+        std::lock_guard<std::mutex> guard(workers[self].lock);
+        if (!workers[self].tasks.empty()) {
+            task = std::move(workers[self].tasks.back());
+            workers[self].tasks.pop_back();
+            return true;
+        }
+    }
+
+    //* Steal the oldest task of another worker
+    for (size_t i = 1; i < workers.size(); i++) {
+        Worker &victim = workers[(self + i) % workers.size()];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            steals.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void ThreadPool::workerLoop(size_t self)
+{
+    currentWorker = (int)self;
+
+    while (true) {
+        std::function<void()> task;
+
+        if (popTask(self, task)) {
+            task();
+
+            if (pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                std::lock_guard<std::mutex> guard(idleLock);
+                allDone.notify_all();
+            }
+            continue;
+        }
+
+        std::unique_lock<std::mutex> guard(idleLock);
+        if (stopping) {
+            return;
+        }
+
+        //* Re-check under the lock: a task may have been queued since the steal attempt
+        bool queued = false;
+        for (auto &worker : workers) {
+            std::lock_guard<std::mutex> queueGuard(worker.lock);
+            if (!worker.tasks.empty()) {
+                queued = true;
+                break;
+            }
+        }
+
+        if (!queued) {
+            wakeUp.wait(guard);
+        }
+    }
+}
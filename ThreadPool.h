@@ -0,0 +1,57 @@
+#ifndef _THREAD_POOL_H
+#define _THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//* Work-stealing thread pool.
+//* Every worker owns a deque: it pops its own work from the back and, once that
+//* runs dry, steals from the front of the other workers' deques.
+class ThreadPool {
+private:
+    struct Worker {
+        std::mutex lock;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<Worker> workers;
+    std::vector<std::thread> threads;
+
+    std::mutex idleLock;
+    std::condition_variable wakeUp;     // Signalled when new work is submitted
+    std::condition_variable allDone;    // Signalled when the pending count drops to zero
+
+    std::atomic<size_t> pending{0};
+    std::atomic<size_t> nextQueue{0};
+    std::atomic<size_t> steals{0};
+    bool stopping = false;
+
+    bool popTask(size_t self, std::function<void()> &task);
+    void workerLoop(size_t self);
+
+public:
+    explicit ThreadPool(size_t threadCount = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    //* Queue a task, distributed round-robin over the worker deques
+    void submit(std::function<void()> task);
+    //* Block until every submitted task has finished
+    void wait();
+
+    size_t size() const { return threads.size(); }
+    size_t stealCount() const { return steals.load(std::memory_order_relaxed); }
+
+    //* Index of the calling worker thread, or -1 when called from outside the pool
+    static int workerIndex();
+};
+
+#endif // _THREAD_POOL_H
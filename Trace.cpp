@@ -0,0 +1,66 @@
+#include "Trace.h"
+
+#include <chrono>
+
+TraceRing::TraceRing(size_t capacity)
+{
+    size_t size = 1;
+    while (size < capacity) {
+        size <<= 1;
+    }
+
+    records.resize(size);
+    mask = size - 1;
+}
+
+size_t TraceRing::drain(TraceRecord *out, size_t max)
+{
+    size_t t = tail.load(std::memory_order_relaxed);
+    size_t available = head.load(std::memory_order_acquire) - t;
+    size_t count = available < max ? available : max;
+
+    for (size_t i = 0; i < count; i++) {
+        out[i] = records[(t + i) & mask];
+    }
+
+    tail.store(t + count, std::memory_order_release);
+    return count;
+}
+
+TraceWriter::TraceWriter(TraceRing &ring, FILE *file) : ring(ring), file(file)
+{
+    TraceFileHeader header = { TRACE_MAGIC, TRACE_VERSION, sizeof(TraceRecord) };
+    fwrite(&header, sizeof(header), 1, file);
+
+    thread = std::thread(&TraceWriter::loop, this);
+}
+
+TraceWriter::~TraceWriter()
+{
+    running.store(false, std::memory_order_release);
+    thread.join();
+    fflush(file);
+}
+
+void TraceWriter::writeAvailable(std::vector<TraceRecord> &buffer)
+{
+    size_t count;
+
+    while ((count = ring.drain(buffer.data(), buffer.size())) > 0) {
+        fwrite(buffer.data(), sizeof(TraceRecord), count, file);
+        written += count;
+    }
+}
+
+void TraceWriter::loop()
+{
+    std::vector<TraceRecord> buffer(4096);
+
+    while (running.load(std::memory_order_acquire)) {
+        writeAvailable(buffer);
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    //* The producer is done by now, pick up the tail end
+    writeAvailable(buffer);
+}
@@ -0,0 +1,113 @@
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+//* Execution tracing is a compile-time policy: built without -DCHIP8_TRACE every
+//* trace hook in the core is an `if constexpr` on a false constant and disappears.
+#ifdef CHIP8_TRACE
+constexpr bool TRACE_ENABLED = true;
+#else
+constexpr bool TRACE_ENABLED = false;
+#endif
+
+#define TRACE_MAGIC     0x52543843  // "C8TR"
+#define TRACE_VERSION   1
+
+enum TraceRecordType : uint8_t {
+    TRACE_STEP = 0,     // One executed instruction, registers after execution
+    TRACE_STACK = 1,    // Stack snapshot: 8 entries starting at index pc, packed in V
+};
+
+//* One fixed-size binary record, 24 bytes
+struct TraceRecord {
+    uint16_t    pc;
+    uint16_t    opcode;
+    uint16_t    I;
+    uint8_t     sp;
+    uint8_t     type;
+    uint8_t     V[16];
+};
+static_assert(sizeof(TraceRecord) == 24, "trace records are written to disk as is");
+
+struct TraceFileHeader {
+    uint32_t    magic;
+    uint16_t    version;
+    uint16_t    recordSize;
+};
+
+//* Lock-free single-producer single-consumer ring of trace records.
+//* The emulation thread pushes, a writer thread drains. A full ring drops the
+//* record instead of blocking the emulator.
+class TraceRing {
+private:
+    std::vector<TraceRecord> records;
+    size_t mask;
+
+    alignas(64) std::atomic<size_t> head{0};    // Written by the producer
+    alignas(64) std::atomic<size_t> tail{0};    // Written by the consumer
+    alignas(64) uint64_t dropped = 0;           // Producer side only
+    bool resync = true;                         // Producer side: stack snapshot needed
+
+public:
+    //* Capacity is rounded up to a power of two
+    explicit TraceRing(size_t capacity = 1 << 16);
+
+    bool push(const TraceRecord &record)
+    {
+        size_t h = head.load(std::memory_order_relaxed);
+
+        if (h - tail.load(std::memory_order_acquire) >= records.size()) {
+            dropped++;
+            resync = true;
+            return false;
+        }
+
+        records[h & mask] = record;
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    //* Copy up to `max` records out, returns how many
+    size_t drain(TraceRecord *out, size_t max);
+
+    //* True once after attach or after a drop: the decoder needs a stack snapshot
+    bool needsResync()
+    {
+        bool value = resync;
+        resync = false;
+        return value;
+    }
+
+    uint64_t droppedCount() const { return dropped; }
+};
+
+//* Background thread draining one ring into a trace file
+class TraceWriter {
+private:
+    TraceRing &ring;
+    FILE *file;
+    std::thread thread;
+    std::atomic<bool> running{true};
+    uint64_t written = 0;
+
+    void writeAvailable(std::vector<TraceRecord> &buffer);
+    void loop();
+
+public:
+    TraceWriter(TraceRing &ring, FILE *file);
+    //* Drains whatever is left and closes nothing: the caller owns the file
+    ~TraceWriter();
+
+    TraceWriter(const TraceWriter &) = delete;
+    TraceWriter &operator=(const TraceWriter &) = delete;
+
+    uint64_t recordsWritten() const { return written; }
+};
+
+#endif // _TRACE_H
@@ -0,0 +1,53 @@
+#include "TripleBuffer.h"
+
+#include <cstring>
+
+TripleBuffer::TripleBuffer()
+{
+    for (Frame &frame : slots) {
+        memset(frame.rows, 0, sizeof(frame.rows));
+        frame.dirty = 0;
+        frame.index = 0;
+        frame.inputTime = 0;
+        frame.turbo = false;
+    }
+}
+
+void TripleBuffer::publish()
+{
+    Frame &frame = slots[back];
+
+    //* The pending frame is about to be replaced before the reader saw it: its rows
+    //* must still reach the screen, and its input is only shown by this frame. If the
+    //* reader takes it in the meantime this only uploads a few rows more than needed,
+    //* and the latency is measured from the older event.
+    if (middle.load(std::memory_order_relaxed) & FRESH) {
+        frame.dirty |= lastDirty;
+        if (lastInputTime) {
+            frame.inputTime = lastInputTime;
+        }
+    }
+    lastDirty = frame.dirty;
+    lastInputTime = frame.inputTime;
+
+    uint32_t previous = middle.exchange(back | FRESH, std::memory_order_acq_rel);
+    if (previous & FRESH) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+    back = previous & ~FRESH;
+    published.fetch_add(1, std::memory_order_relaxed);
+}
+
+const Frame *TripleBuffer::acquire()
+{
+    if (!(middle.load(std::memory_order_relaxed) & FRESH)) {
+        duplicated.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    //* Only the producer sets FRESH, so it is still there
+    uint32_t previous = middle.exchange(front, std::memory_order_acq_rel);
+    front = previous & ~FRESH;
+    taken.fetch_add(1, std::memory_order_relaxed);
+    return &slots[front];
+}
@@ -0,0 +1,63 @@
+#ifndef _TRIPLE_BUFFER_H
+#define _TRIPLE_BUFFER_H
+
+#include "Chip8.h"
+#include "Scheduler.h"
+
+#include <atomic>
+#include <cstdint>
+
+//* One emulated frame as the renderer sees it
+struct Frame {
+    uint64_t rows[SCREEN_HEIGHT];   // Chip8::frameRows() at the end of the frame
+    uint32_t dirty;                 // Rows changed since the last frame the reader took
+    uint64_t index;                 // Emulated frame number
+    uint64_t inputTime;             // Oldest key event this frame is the first to show (inputClock), 0 = none
+    bool turbo;
+    SchedulerStats timing;          // Last complete second of the emulation thread
+};
+
+//* Lock-free single-producer single-consumer triple buffer. The emulation thread
+//* fills the back slot and publishes it, the render thread takes the newest
+//* published slot. Neither side ever waits: a frame the reader didn't take in time
+//* is overwritten (dropped), a reader finding nothing new shows the old one again
+//* (duplicated). Dirty rows and input times of dropped frames carry over to the next
+//* published one.
+class TripleBuffer {
+private:
+    static const uint32_t FRESH = 4;    // Set in `middle` while the reader hasn't taken it
+
+    alignas(64) Frame slots[3];
+
+    alignas(64) std::atomic<uint32_t> middle{2};    // Slot index | FRESH
+    alignas(64) unsigned back = 0;                  // Producer side only
+    uint32_t lastDirty = 0;
+    uint64_t lastInputTime = 0;
+    std::atomic<uint64_t> published{0};
+    std::atomic<uint64_t> dropped{0};
+    alignas(64) unsigned front = 1;                 // Consumer side only
+    std::atomic<uint64_t> taken{0};
+    std::atomic<uint64_t> duplicated{0};
+
+public:
+    TripleBuffer();
+
+    //* Producer: the slot to fill, then publish() it
+    Frame &writeFrame() { return slots[back]; }
+    void publish();
+
+    //* Consumer: the newest frame if one was published since the last call, nullptr
+    //* (counted as a duplicate) if not
+    const Frame *acquire();
+    //* The frame the reader holds, valid until the next acquire()
+    const Frame &readFrame() const { return slots[front]; }
+    //* Consumer: true if acquire() would return a new frame
+    bool fresh() const { return middle.load(std::memory_order_relaxed) & FRESH; }
+
+    uint64_t framesPublished() const { return published.load(std::memory_order_relaxed); }
+    uint64_t framesDropped() const { return dropped.load(std::memory_order_relaxed); }
+    uint64_t framesTaken() const { return taken.load(std::memory_order_relaxed); }
+    uint64_t framesDuplicated() const { return duplicated.load(std::memory_order_relaxed); }
+};
+
+#endif // _TRIPLE_BUFFER_H
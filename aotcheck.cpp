@@ -0,0 +1,190 @@
+#include "Aot.h"
+#include "Chip8.h"
+#include "SaveState.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+//* Driver linked with the translation units chip8c emitted (make aot). For every
+//* program: a lockstep differential run against the interpreter, frame by frame,
+//* then the speed of the translated code against Chip8::emulateCycle, the
+//* interpreter's runFrame and the JIT.
+
+struct AotCheckConfig {
+    unsigned frames = 20000;        // Lockstep
+    unsigned benchFrames = 20000;
+    unsigned cycles = 10;
+    uint64_t seed = RANDOM_DEFAULT_SEED;
+};
+
+//* Scripted input, the same for every engine: a new key combination every 8 frames,
+//* released every third frame so Fx0A waits end
+static uint16_t scriptedKeys(uint64_t seed, unsigned frame)
+{
+    uint64_t z = seed + (frame / 8) * 0x9E3779B97F4A7C15ull;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return frame % 3 == 0 ? 0 : (z ^ (z >> 31)) & 0xFFFF;
+}
+
+static void boot(Chip8 &chip8, const AotProgram &program, uint64_t seed)
+{
+    chip8.seedRandom(seed);
+    chip8.setQuirks(program.quirks);
+    chip8.reset();
+    chip8.load(program.rom, program.romSize);
+}
+
+//* Both machines from power-on, budgets between 1 and 2 * cycles so frames end inside
+//* blocks too. A save state is restored into the translated machine half way.
+static bool lockstep(const AotProgram &program, const AotCheckConfig &config)
+{
+    Chip8 reference;
+    Chip8 translated;
+    boot(reference, program, config.seed);
+    boot(translated, program, config.seed);
+    translated.attachProgram(&program);
+
+    uint64_t budgetState = config.seed;
+    for (unsigned frame = 0; frame < config.frames; frame++) {
+        budgetState = budgetState * 6364136223846793005ull + 1442695040888963407ull;
+        unsigned cycles = 1 + (budgetState >> 33) % (2 * config.cycles);
+        uint16_t keys = scriptedKeys(config.seed, frame);
+
+        reference.setKeys(keys);
+        translated.setKeys(keys);
+        reference.runFrame(cycles);
+        translated.runFrame(cycles);
+
+        if (!reference.stateEquals(translated) || reference.instructionCount != translated.instructionCount) {
+            Registers expected;
+            Registers actual;
+            reference.getRegisters(expected);
+            translated.getRegisters(actual);
+            fprintf(stderr, "%s: diverged at frame %u (pc %03X, translated pc %03X, %llu/%llu instructions)\n",
+                program.name, frame, expected.pc, actual.pc, (unsigned long long)reference.instructionCount,
+                (unsigned long long)translated.instructionCount);
+            return false;
+        }
+
+        if (frame == config.frames / 2) {
+            SaveState state;
+            translated.saveState(state);
+            if (!translated.loadState(state)) {
+                fprintf(stderr, "%s: the snapshot of frame %u does not restore\n", program.name, frame);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+enum AotCheckEngine {
+    ENGINE_CYCLE,           // emulateCycle() per instruction, tickTimers() per frame
+    ENGINE_INTERPRETER,
+    ENGINE_JIT,
+    ENGINE_AOT,
+    ENGINE_COUNT
+};
+
+//* ns per instruction, 0 when the engine can't run this program. active: the translated
+//* code was still in use at the end
+static double measure(const AotProgram &program, const AotCheckConfig &config, AotCheckEngine engine,
+    bool &active)
+{
+    Chip8 chip8;
+    boot(chip8, program, config.seed);
+    //* Translated code runs idle loops like any other, compare instructions actually run
+    chip8.setIdleSkip(false);
+
+    if (engine == ENGINE_JIT && (program.quirks != QUIRKS_LEGACY || !chip8.setBackend(BACKEND_JIT))) {
+        return 0;
+    }
+    if (engine == ENGINE_AOT) {
+        chip8.attachProgram(&program);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned frame = 0; frame < config.benchFrames; frame++) {
+        chip8.setKeys(scriptedKeys(config.seed, frame));
+        if (engine == ENGINE_CYCLE) {
+            for (unsigned i = 0; i < config.cycles; i++) {
+                chip8.emulateCycle();
+            }
+            chip8.tickTimers();
+        } else {
+            chip8.runFrame(config.cycles);
+        }
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    active = chip8.programActive();
+    return elapsed.count() * 1e9 / chip8.instructionCount;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [-f lockstep frames] [-b bench frames] [-c cycles] [--seed n]\n", name);
+}
+
+int main(int argc, char **argv)
+{
+    AotCheckConfig config;
+
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+
+        if (!strcmp(argv[i], "-f") && hasValue) {
+            config.frames = strtoul(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "-b") && hasValue) {
+            config.benchFrames = strtoul(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "-c") && hasValue) {
+            config.cycles = strtoul(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "--seed") && hasValue) {
+            config.seed = strtoull(argv[++i], NULL, 0);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (config.cycles == 0 || Aot::count() == 0) {
+        if (Aot::count() == 0) {
+            fprintf(stderr, "No translated ROM linked in\n");
+        }
+        usage(argv[0]);
+        return 1;
+    }
+
+    bool ok = true;
+    printf("%-10s %-8s %7s %12s %12s %12s %12s %9s %9s\n", "rom", "lockstep", "blocks", "emulateCycle",
+        "interpreter", "jit", "aot", "vs cycle", "vs interp");
+
+    for (size_t p = 0; p < Aot::count(); p++) {
+        const AotProgram &program = *Aot::program(p);
+        bool same = lockstep(program, config);
+        ok = ok && same;
+
+        double ns[ENGINE_COUNT];
+        bool active = false;
+        for (int engine = 0; engine < ENGINE_COUNT; engine++) {
+            ns[engine] = measure(program, config, (AotCheckEngine)engine, active);
+        }
+
+        printf("%-10s %-8s %7u", program.name, same ? "ok" : "DIVERGED", program.blocks);
+        for (int engine = 0; engine < ENGINE_COUNT; engine++) {
+            if (ns[engine] > 0) {
+                printf(" %10.2fns", ns[engine]);
+            } else {
+                printf(" %12s", "-");
+            }
+        }
+        printf(" %8.1fx %8.1fx%s\n", ns[ENGINE_CYCLE] / ns[ENGINE_AOT], ns[ENGINE_INTERPRETER] / ns[ENGINE_AOT],
+            active ? "" : "  (dropped: code was overwritten)");
+    }
+
+    printf("ns per instruction at %u instructions per frame, idle loops not skipped\n", config.cycles);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,315 @@
+#include "Runner.h"
+#include "Chip8.h"
+#include "RomCatalog.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+static void usage(const char *program)
+{
+    fprintf(stderr,
+        "Usage: %s [options] <rom or directory>\n"
+        "  -n <instances>   Number of independent sessions (default 64)\n"
+        "  -f <frames>      Frames run by every session (default 600)\n"
+        "  -c <cycles>      Instructions per frame (default 10)\n"
+        "  -t <threads>     Worker threads, 0 = all cores (default 0)\n"
+        "  --jit            Run on the JIT backend instead of the interpreter\n"
+        "  --quirks <profile> Opcode behavior: legacy (default), chip8, schip-quirks or xochip-quirks\n"
+        "  --quirks-db <file> Per-ROM profiles, lines of `<ROM hash> <profile>`, others get --quirks\n"
+        "  --trace <file>   Binary trace of the first session, decode with chip8-trace\n"
+        "  --profile <path> Profile the first session: folded stacks to <path>.folded,\n"
+        "                   counts and annotated disassembly to <path>.txt\n"
+        "  --record <file>  Record the screen and keypad of the first session, decode with chip8-rec\n"
+        "  --rewind <frames> Keep a rewind history of that many frames per session\n"
+        "  --seed <n>       Seed of the Cxkk generator, session i takes its stream i\n"
+        "  --audio          Render every session's buzzer into a null audio sink\n"
+        "  --restart <frames> Restart every session from the ROM catalog that often\n"
+        "  --json           Machine-readable output\n"
+        "\n"
+        "       %s --conformance [-f <frames>] [-c <cycles>] [<rom>...]\n"
+        "  Run the built-in edge-case programs (stack wrap-around, ALU flags, every quirk of\n"
+        "  every profile), then every ROM, on the interpreter and the JIT in lockstep and\n"
+        "  compare the machine state\n"
+        "\n"
+        "       %s --idle [-f <frames>] [-c <cycles>] [--quirks <profile>] [--quirks-db <file>] <rom>...\n"
+        "  Run every ROM with idle-loop skipping on and off, check both end up identical and\n"
+        "  report the instructions skipped and the host CPU per emulated second\n"
+        "\n"
+        "       %s --lockstep [-n <lanes>] [-f <frames>] [-c <cycles>] <rom>\n"
+        "  Step the lanes together on the SIMD lockstep engine, check them against separate\n"
+        "  Chip8 objects and compare machine-steps/sec (single thread)\n"
+        "\n"
+        "       %s --latency [-f <frames>] [-c <cycles>] [--fixed-cadence] <rom>\n"
+        "  Run the ROM at real speed on the frontend's threads, post random key events and\n"
+        "  measure how long until a published frame shows them\n",
+        program,
+        program,
+        program,
+        program,
+        program);
+}
+
+static int lockstep(const RunnerConfig &config, bool json)
+{
+    std::vector<uint8_t> rom;
+
+    if (!readRom(config.romPath.c_str(), rom)) {
+        return 1;
+    }
+
+    //* Correctness first, on a shorter run
+    long frame = checkLockstep(rom, config.instances, config.frames < 600 ? config.frames : 600, config.cyclesPerFrame,
+        config.seed);
+    if (frame >= 0) {
+        printf("FAIL  %-24s lane state diverged at frame %ld\n", config.romPath.c_str(), frame);
+        return 1;
+    }
+
+    LockstepReport report;
+    if (!benchLockstep(config, report)) {
+        return 1;
+    }
+
+    double speedup = report.engineSeconds > 0 ? report.objectSeconds / report.engineSeconds : 0;
+
+    if (json) {
+        printf("{\n");
+        printf("  \"rom\": \"%s\",\n", config.romPath.c_str());
+        printf("  \"lanes\": %u,\n", report.lanes);
+        printf("  \"frames\": %u,\n", config.frames);
+        printf("  \"cycles_per_frame\": %u,\n", config.cyclesPerFrame);
+        printf("  \"vectorized\": %s,\n", report.vectorized ? "true" : "false");
+        printf("  \"machine_steps\": %llu,\n", (unsigned long long)report.steps);
+        printf("  \"lockstep_steps_per_second\": %.0f,\n", report.engineStepsPerSecond());
+        printf("  \"objects_steps_per_second\": %.0f,\n", report.objectStepsPerSecond());
+        printf("  \"speedup\": %.2f\n", speedup);
+        printf("}\n");
+        return 0;
+    }
+
+    printf("ROM          : %s\n", config.romPath.c_str());
+    printf("Lanes        : %u x %u frames (%u cycles/frame), %s\n", report.lanes, config.frames, config.cyclesPerFrame,
+        report.vectorized ? "AVX2" : "scalar fallback");
+    printf("Check        : PASS, every lane matches Chip8\n");
+    printf("Lockstep     : %.2f M machine-steps/s\n", report.engineStepsPerSecond() / 1e6);
+    printf("Chip8 objects: %.2f M machine-steps/s\n", report.objectStepsPerSecond() / 1e6);
+    printf("Speed-up     : x%.2f\n", speedup);
+    return 0;
+}
+
+static int latency(const RunnerConfig &config, bool json)
+{
+    LatencyReport report;
+
+    if (!measureInputLatency(config, report)) {
+        return 1;
+    }
+
+    bool withinFrame = report.events && report.p99 < report.framePeriod;
+
+    if (json) {
+        printf("{\n");
+        printf("  \"rom\": \"%s\",\n", config.romPath.c_str());
+        printf("  \"events\": %llu,\n", (unsigned long long)report.events);
+        printf("  \"p50_ms\": %.2f,\n", report.p50 * 1000);
+        printf("  \"p99_ms\": %.2f,\n", report.p99 * 1000);
+        printf("  \"max_ms\": %.2f,\n", report.max * 1000);
+        printf("  \"frame_ms\": %.2f,\n", report.framePeriod * 1000);
+        printf("  \"frames_published\": %llu,\n", (unsigned long long)report.framesPublished);
+        printf("  \"frames_dropped\": %llu,\n", (unsigned long long)report.framesDropped);
+        printf("  \"p99_within_frame\": %s\n", withinFrame ? "true" : "false");
+        printf("}\n");
+        return 0;
+    }
+
+    printf("ROM          : %s\n", config.romPath.c_str());
+    printf("Key events   : %llu shown\n", (unsigned long long)report.events);
+    printf("Latency      : p50 %.2f ms, p99 %.2f ms, max %.2f ms (frame %.2f ms)\n",
+        report.p50 * 1000, report.p99 * 1000, report.max * 1000, report.framePeriod * 1000);
+    printf("Frames       : %llu published, %llu dropped\n",
+        (unsigned long long)report.framesPublished, (unsigned long long)report.framesDropped);
+    printf("p99 < frame  : %s\n", withinFrame ? "yes" : "no");
+    return 0;
+}
+
+static int conformance(const RunnerConfig &config, const std::vector<std::string> &roms)
+{
+    int failures = 0;
+
+    for (auto &test : conformanceCases()) {
+        std::string skipped;
+        std::string failure = checkConformanceCase(test, skipped);
+        if (failure.empty() && !skipped.empty()) {
+            printf("PASS  %-24s %u cycles (%s)\n", test.name.c_str(), test.cycles, skipped.c_str());
+        } else if (failure.empty()) {
+            printf("PASS  %-24s %u cycles\n", test.name.c_str(), test.cycles);
+        } else {
+            printf("FAIL  %-24s %s\n", test.name.c_str(), failure.c_str());
+            failures++;
+        }
+    }
+
+    for (auto &path : roms) {
+        std::vector<uint8_t> rom;
+
+        if (!readRom(path.c_str(), rom)) {
+            failures++;
+            continue;
+        }
+
+        long frame = checkConformance(rom, config.frames, config.cyclesPerFrame);
+        if (frame < 0) {
+            printf("PASS  %-24s %u frames\n", path.c_str(), config.frames);
+        } else {
+            printf("FAIL  %-24s state diverged at frame %ld\n", path.c_str(), frame);
+            failures++;
+        }
+    }
+
+    return failures ? 1 : 0;
+}
+
+static int idle(const RunnerConfig &config, const std::vector<std::string> &roms)
+{
+    int failures = 0;
+    double emulated = config.frames / 60.0;
+    double totalOff = 0, totalOn = 0;
+
+    QuirkDatabase quirksDb;
+    if (!config.quirksDbPath.empty() && !quirksDb.load(config.quirksDbPath.c_str())) {
+        return 1;
+    }
+
+    printf("%-24s %8s %12s %12s\n", "", "skipped", "CPU off", "CPU on");
+    for (auto &path : roms) {
+        std::vector<uint8_t> rom;
+        IdleReport report;
+
+        if (!readRom(path.c_str(), rom)) {
+            failures++;
+            continue;
+        }
+
+        QuirkProfile quirks = quirksDb.lookup(romHash(rom.data(), rom.size()), config.quirks);
+        long frame = checkIdle(rom, config.frames, config.cyclesPerFrame, quirks, report);
+        if (frame >= 0) {
+            printf("FAIL  %-18s state diverged at frame %ld\n", path.c_str(), frame);
+            failures++;
+            continue;
+        }
+
+        //* CPU usage as a share of one core while emulating in real time
+        printf("PASS  %-18s %7.2f%% %11.4f%% %11.4f%%\n", path.c_str(),
+            report.instructions ? (double)report.skipped / report.instructions * 100 : 0,
+            report.cpuOff / emulated * 100, report.cpuOn / emulated * 100);
+        totalOff += report.cpuOff;
+        totalOn += report.cpuOn;
+    }
+
+    printf("%-24s %8s %11.4f%% %11.4f%%  (%u frames at %u cycles/frame, x%.2f)\n", "Total", "",
+        totalOff / emulated * 100, totalOn / emulated * 100, config.frames, config.cyclesPerFrame,
+        totalOn > 0 ? totalOff / totalOn : 0);
+    return failures ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+    RunnerConfig config;
+    std::vector<std::string> roms;
+    bool json = false;
+    bool checkJit = false;
+    bool runLockstep = false;
+    bool runLatency = false;
+    bool checkIdleSkip = false;
+
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+
+        if (!strcmp(argv[i], "-n") && hasValue) {
+            config.instances = strtoul(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "-f") && hasValue) {
+            config.frames = strtoul(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "-c") && hasValue) {
+            config.cyclesPerFrame = strtoul(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "-t") && hasValue) {
+            config.threads = strtoul(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "--jit")) {
+            config.jit = true;
+        } else if (!strcmp(argv[i], "--quirks") && hasValue) {
+            if (!parseQuirkProfile(argv[++i], config.quirks)) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "--quirks-db") && hasValue) {
+            config.quirksDbPath = argv[++i];
+        } else if (!strcmp(argv[i], "--lockstep")) {
+            runLockstep = true;
+        } else if (!strcmp(argv[i], "--latency")) {
+            runLatency = true;
+        } else if (!strcmp(argv[i], "--fixed-cadence")) {
+            config.fixedCadence = true;
+        } else if (!strcmp(argv[i], "--idle")) {
+            checkIdleSkip = true;
+        } else if (!strcmp(argv[i], "--conformance")) {
+            checkJit = true;
+        } else if (!strcmp(argv[i], "--trace") && hasValue) {
+            config.tracePath = argv[++i];
+        } else if (!strcmp(argv[i], "--profile") && hasValue) {
+            config.profilePath = argv[++i];
+        } else if (!strcmp(argv[i], "--record") && hasValue) {
+            config.recordPath = argv[++i];
+        } else if (!strcmp(argv[i], "--rewind") && hasValue) {
+            config.rewindFrames = strtoul(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "--seed") && hasValue) {
+            config.seed = strtoull(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "--restart") && hasValue) {
+            config.restartFrames = strtoul(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "--audio")) {
+            config.audio = true;
+        } else if (!strcmp(argv[i], "--json")) {
+            json = true;
+        } else if (argv[i][0] == '-') {
+            usage(argv[0]);
+            return 1;
+        } else {
+            roms.push_back(argv[i]);
+        }
+    }
+
+    if (checkJit) {
+        if (!Chip8::jitAvailable()) {
+            fprintf(stderr, "JIT backend is not available on this host\n");
+            return 1;
+        }
+        return conformance(config, roms);
+    }
+
+    if (checkIdleSkip && !roms.empty()) {
+        return idle(config, roms);
+    }
+
+    if (roms.size() != 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    config.romPath = roms[0];
+
+    if (runLockstep) {
+        return lockstep(config, json);
+    }
+
+    if (runLatency) {
+        return latency(config, json);
+    }
+
+    RunnerReport report;
+    if (!runBatch(config, report)) {
+        return 1;
+    }
+
+    printReport(config, report, json);
+
+    return 0;
+}
@@ -0,0 +1,245 @@
+#include "Runner.h"
+#include "Chip8.h"
+#include "Perf.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+//* Headless benchmark: every ROM given on the command line plus synthetic ROMs
+//* that hammer one opcode class each, on every available backend, and on the
+//* interpreter once per quirk profile. Prints JSON, one result per line, so two
+//* builds can be compared with a plain diff.
+
+struct BenchCase {
+    std::string name;
+    std::vector<uint8_t> rom;
+    bool scriptedInput;
+};
+
+//* What a case runs on: the JIT only implements the legacy profile
+struct BenchTarget {
+    Backend backend;
+    QuirkProfile quirks;
+};
+
+struct BenchResult {
+    uint64_t instructions = 0;
+    double seconds = 0;
+    uint64_t cacheMisses = 0;
+    uint64_t branchMisses = 0;
+};
+
+static std::vector<uint8_t> assemble(const std::vector<uint16_t> &opcodes)
+{
+    std::vector<uint8_t> rom;
+
+    for (uint16_t opcode : opcodes) {
+        rom.push_back(opcode >> 8);
+        rom.push_back(opcode & 0xFF);
+    }
+    return rom;
+}
+
+//* Endless loops where nearly every instruction belongs to the class under test
+static std::vector<BenchCase> microbenchmarks()
+{
+    std::vector<BenchCase> cases;
+
+    //* 8xy_: every ALU operation over a few register pairs, one JP per 36
+    std::vector<uint16_t> alu = { 0x6001, 0x6103, 0x6207, 0x630F, 0x6455, 0x65AA };
+    const uint16_t loop = START_LOCATION + 2 * 6;
+    for (int pair = 0; pair < 4; pair++) {
+        uint16_t xy = (pair << 8) | ((pair + 1) << 4);
+        for (uint16_t n : { 0x0, 0x1, 0x2, 0x3, 0x4, 0x5, 0x6, 0x7, 0xE }) {
+            alu.push_back(0x8000 | xy | n);
+        }
+    }
+    alu.push_back(0x1000 | loop);
+    cases.push_back({ "micro/alu", assemble(alu), false });
+
+    //* Dxyn: font and 15-line sprites at moving, wrapping positions
+    cases.push_back({ "micro/drw", assemble({
+        0xA000, 0x6000, 0x6100,
+        0xD015, 0xD015, 0xD01F, 0x7009, 0xD01F, 0x7103,
+        0x1206,
+    }), false });
+
+    //* Fx55/Fx65: register block copies to and from a data area past the code
+    cases.push_back({ "micro/fx55_fx65", assemble({
+        0xA300,
+        0xFF55, 0xFF65, 0xF755, 0xF365, 0xFF65, 0xFF55,
+        0x1202,
+    }), false });
+
+    //* 1nnn/2nnn/00EE: nested calls, returns and jumps, nothing else
+    cases.push_back({ "micro/jump_call", assemble({
+        0x2206,     // 200: CALL 206
+        0x1204,     // 202: JP 204
+        0x1200,     // 204: JP 200
+        0x220A,     // 206: CALL 20A
+        0x00EE,     // 208: RET
+        0x00EE,     // 20A: RET
+    }), false });
+
+    //* Cxkk: random bytes under different masks
+    cases.push_back({ "micro/rnd", assemble({
+        0xC0FF, 0xC10F, 0xC2F0, 0xC3FF, 0xC47F, 0xC5FF, 0xC601, 0xC7FF,
+        0x1200,
+    }), false });
+
+    return cases;
+}
+
+static BenchResult measure(const BenchCase &bench, BenchTarget target, unsigned frames, unsigned cycles, PerfCounters &perf)
+{
+    std::unique_ptr<Chip8> chip8(new Chip8());
+    chip8->load(bench.rom.data(), bench.rom.size());
+    chip8->setBackend(target.backend);
+    chip8->setQuirks(target.quirks);
+    //* Measure every instruction executed, not fast-forwarded
+    chip8->setIdleSkip(false);
+
+    BenchResult result;
+    auto begin = std::chrono::steady_clock::now();
+    perf.start();
+
+    for (unsigned frame = 0; frame < frames; frame++) {
+        if (bench.scriptedInput) {
+            scriptedKeys(frame, chip8->key);
+        }
+        chip8->runFrame(cycles);
+    }
+
+    perf.stop();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+
+    result.instructions = chip8->instructionCount;
+    result.seconds = elapsed.count();
+    result.cacheMisses = perf.value(PerfCounters::CACHE_MISSES);
+    result.branchMisses = perf.value(PerfCounters::BRANCH_MISSES);
+    return result;
+}
+
+static void printCounter(PerfCounters &perf, PerfCounters::Counter counter, const char *name, uint64_t value)
+{
+    if (perf.available(counter)) {
+        printf(", \"%s\": %llu", name, (unsigned long long)value);
+    } else {
+        printf(", \"%s\": null", name);
+    }
+}
+
+static void usage(const char *program)
+{
+    fprintf(stderr,
+        "Usage: %s [options] [rom...]\n"
+        "  -f <frames>      Frames per run (default 20000)\n"
+        "  -c <cycles>      Instructions per frame (default 100)\n"
+        "  -r <repeats>     Runs per benchmark, the fastest is reported (default 3)\n"
+        "  --no-micro       Skip the per-opcode-class microbenchmarks\n",
+        program);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned frames = 20000;
+    unsigned cycles = 100;
+    unsigned repeats = 3;
+    bool micro = true;
+    std::vector<BenchCase> cases;
+
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+
+        if (!strcmp(argv[i], "-f") && hasValue) {
+            frames = strtoul(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "-c") && hasValue) {
+            cycles = strtoul(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "-r") && hasValue) {
+            repeats = strtoul(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "--no-micro")) {
+            micro = false;
+        } else if (argv[i][0] == '-') {
+            usage(argv[0]);
+            return 1;
+        } else {
+            BenchCase bench = { std::string("rom/") + argv[i], {}, true };
+            if (!readRom(argv[i], bench.rom)) {
+                return 1;
+            }
+
+            //* Just the file name, results stay comparable across checkouts
+            const char *slash = strrchr(argv[i], '/');
+            bench.name = std::string("rom/") + (slash ? slash + 1 : argv[i]);
+            cases.push_back(bench);
+        }
+    }
+
+    if (micro) {
+        std::vector<BenchCase> synthetic = microbenchmarks();
+        cases.insert(cases.begin(), synthetic.begin(), synthetic.end());
+    }
+
+    if (cases.empty() || repeats == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    std::vector<BenchTarget> targets;
+    for (int q = 0; q < QUIRK_PROFILE_COUNT; q++) {
+        targets.push_back({ BACKEND_INTERPRETER, (QuirkProfile)q });
+    }
+    if (Chip8::jitAvailable()) {
+        targets.push_back({ BACKEND_JIT, QUIRKS_LEGACY });
+    }
+
+    PerfCounters perf;
+
+    printf("{\n");
+    printf("  \"frames\": %u,\n", frames);
+    printf("  \"cycles_per_frame\": %u,\n", cycles);
+    printf("  \"repeats\": %u,\n", repeats);
+    printf("  \"perf_counters\": %s,\n",
+        perf.available(PerfCounters::CACHE_MISSES) || perf.available(PerfCounters::BRANCH_MISSES) ? "true" : "false");
+    printf("  \"results\": [\n");
+
+    for (size_t i = 0; i < cases.size(); i++) {
+        for (size_t b = 0; b < targets.size(); b++) {
+            BenchResult best;
+
+            for (unsigned run = 0; run < repeats; run++) {
+                BenchResult result = measure(cases[i], targets[b], frames, cycles, perf);
+                if (run == 0 || result.seconds < best.seconds) {
+                    best = result;
+                }
+            }
+
+            double ips = best.seconds > 0 ? best.instructions / best.seconds : 0;
+            double ns = best.instructions ? best.seconds * 1e9 / best.instructions : 0;
+            bool last = i + 1 == cases.size() && b + 1 == targets.size();
+
+            printf("    {\"name\": \"%s\", \"backend\": \"%s\", \"quirks\": \"%s\", \"instructions\": %llu, "
+                "\"seconds\": %.6f, \"ns_per_instruction\": %.3f, \"instructions_per_second\": %.0f",
+                cases[i].name.c_str(),
+                targets[b].backend == BACKEND_JIT ? "jit" : "interpreter",
+                quirkProfileName(targets[b].quirks),
+                (unsigned long long)best.instructions,
+                best.seconds,
+                ns,
+                ips);
+            printCounter(perf, PerfCounters::CACHE_MISSES, "cache_misses", best.cacheMisses);
+            printCounter(perf, PerfCounters::BRANCH_MISSES, "branch_misses", best.branchMisses);
+            printf("}%s\n", last ? "" : ",");
+        }
+    }
+
+    printf("  ]\n");
+    printf("}\n");
+
+    return 0;
+}
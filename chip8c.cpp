@@ -0,0 +1,570 @@
+#include "Chip8.h"
+#include "Disasm.h"
+#include "Quirks.h"
+
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+//* Ahead-of-time recompiler: translates the code of one ROM into a C++ translation
+//* unit for Aot.h. The code is found by following control flow from START_LOCATION:
+//* jumps, calls and the return sites after them, both ways out of every skip. Only
+//* the ROM's own bytes are translated. What can't be followed statically (Bnnn,
+//* 00EE into a site no call made) lands on the dispatcher, which hands anything it
+//* has no code for back to the interpreter.
+
+enum Reach : uint8_t {
+    REACH_NONE = 0,
+    REACH_CODE,             // Translated
+    REACH_INTERPRETED       // Reached, but left to the interpreter (Fx0A, invalid opcodes)
+};
+
+struct Analysis {
+    std::vector<uint8_t> rom;
+    QuirkProfile quirks = QUIRKS_LEGACY;
+    Reach reach[MEM_SIZE] = {};
+    bool leader[MEM_SIZE] = {};     // Starts a basic block
+    unsigned instructions = 0;
+    unsigned interpreted = 0;
+    unsigned indirect = 0;          // Bnnn, targets unknown
+
+    bool inRom(unsigned addr) const
+    {
+        return addr >= START_LOCATION && addr + 1 < START_LOCATION + rom.size();
+    }
+    uint16_t opcode(unsigned addr) const
+    {
+        return rom[addr - START_LOCATION] << 8 | rom[addr + 1 - START_LOCATION];
+    }
+};
+
+//* Ends a basic block: control goes somewhere else, or a store may have rewritten the code after it
+static bool endsBlock(uint8_t op)
+{
+    switch (op) {
+        case OP_RET: case OP_JP: case OP_CALL: case OP_JP_V0:
+        case OP_SE_VX_KK: case OP_SNE_VX_KK: case OP_SE_VX_VY: case OP_SNE_VX_VY:
+        case OP_SKP: case OP_SKNP:
+        case OP_LD_B_VX: case OP_LD_I_VX:
+            return true;
+        default:
+            return false;
+    }
+}
+
+//* Where control may go after the instruction at addr, as far as it is known statically
+//* and translated
+static std::vector<unsigned> successors(const Analysis &analysis, unsigned addr)
+{
+    Instruction in = Chip8::decodeOpcode(analysis.opcode(addr));
+    std::vector<unsigned> next;
+
+    switch (in.op) {
+        case OP_JP: case OP_CALL:
+            next = {in.nnn};
+            break;
+        case OP_RET: case OP_JP_V0:
+            break;
+        case OP_SE_VX_KK: case OP_SNE_VX_KK: case OP_SE_VX_VY: case OP_SNE_VX_VY:
+        case OP_SKP: case OP_SKNP:
+            next = {addr + 2, addr + 4};
+            break;
+        default:
+            next = {addr + 2};
+            break;
+    }
+
+    std::vector<unsigned> translated;
+    for (unsigned target : next) {
+        if (target < MEM_SIZE && analysis.reach[target] == REACH_CODE) {
+            translated.push_back(target);
+        }
+    }
+    return translated;
+}
+
+static void analyze(Analysis &analysis)
+{
+    std::vector<uint16_t> work = {START_LOCATION};
+    analysis.leader[START_LOCATION] = true;
+
+    auto branch = [&](unsigned target) {
+        target &= 0xFFFF;
+        if (target < MEM_SIZE) {
+            analysis.leader[target] = true;
+            work.push_back(target);
+        }
+    };
+
+    while (!work.empty()) {
+        unsigned addr = work.back();
+        work.pop_back();
+
+        if (!analysis.inRom(addr) || analysis.reach[addr] != REACH_NONE) {
+            continue;
+        }
+
+        Instruction in = Chip8::decodeOpcode(analysis.opcode(addr));
+        if (in.op == OP_LD_VX_K || in.op == OP_INVALID) {
+            analysis.reach[addr] = REACH_INTERPRETED;
+            analysis.interpreted++;
+            //* Once the interpreter is done waiting, translated code takes over again
+            if (in.op == OP_LD_VX_K) {
+                branch(addr + 2);
+            }
+            continue;
+        }
+
+        analysis.reach[addr] = REACH_CODE;
+        analysis.instructions++;
+
+        switch (in.op) {
+            case OP_JP:
+                branch(in.nnn);
+                break;
+            case OP_CALL:
+                branch(in.nnn);
+                branch(addr + 2);
+                break;
+            case OP_RET:
+                break;
+            case OP_JP_V0:
+                analysis.indirect++;
+                break;
+            case OP_SE_VX_KK: case OP_SNE_VX_KK: case OP_SE_VX_VY: case OP_SNE_VX_VY:
+            case OP_SKP: case OP_SKNP:
+                branch(addr + 2);
+                branch(addr + 4);
+                break;
+            default:
+                if (endsBlock(in.op)) {
+                    branch(addr + 2);
+                } else {
+                    work.push_back(addr + 2);
+                }
+                break;
+        }
+    }
+
+    //* Targets outside the ROM, or on an instruction the interpreter runs, start nothing
+    for (unsigned addr = 0; addr < MEM_SIZE; addr++) {
+        if (analysis.reach[addr] != REACH_CODE) {
+            analysis.leader[addr] = false;
+        }
+    }
+}
+
+static void emitBitmap(FILE *out, const char *name, const uint64_t bits[MEM_SIZE / 64])
+{
+    fprintf(out, "const uint64_t %s[MEM_SIZE / 64] = {\n", name);
+    for (unsigned word = 0; word < MEM_SIZE / 64; word++) {
+        fprintf(out, "%s0x%016llXull,%s", word % 4 ? " " : "    ", (unsigned long long)bits[word],
+            word % 4 == 3 ? "\n" : "");
+    }
+    fprintf(out, "};\n\n");
+}
+
+//* Body of one instruction, every operand and quirk resolved. Instructions that end a
+//* block return the next pc, the others fall through to `return next`.
+static void emitInstruction(FILE *out, const Analysis &analysis, unsigned addr)
+{
+    const Quirks &quirks = QUIRK_TABLE[analysis.quirks];
+    uint16_t opcode = analysis.opcode(addr);
+    Instruction in = Chip8::decodeOpcode(opcode);
+    unsigned x = in.x;
+    unsigned y = in.y;
+    unsigned next = addr + 2;
+    unsigned skip = addr + 4;
+    char text[64];
+
+    disassemble(opcode, text, sizeof(text));
+    for (char *c = text; *c; c++) {
+        if (*c == '\t') {
+            *c = ' ';
+        }
+    }
+
+    fprintf(out, "//* %03X: %04X  %s\n", addr, opcode, text);
+    fprintf(out, "AOT_INLINE uint16_t op_%03X(AotCpu &s)\n{\n", addr);
+
+    switch (in.op) {
+        case OP_CLS:
+            fprintf(out, "    Aot::clear(s);\n");
+            break;
+        case OP_RET:
+            fprintf(out, "    return s.stack[--s.sp & 0xF] + 2;\n}\n\n");
+            return;
+        case OP_SYS:
+            break;
+        case OP_JP:
+            next = in.nnn;
+            break;
+        case OP_CALL:
+            fprintf(out, "    s.stack[s.sp++ & 0xF] = 0x%03X;\n", addr);
+            next = in.nnn;
+            break;
+        case OP_SE_VX_KK:
+            fprintf(out, "    return s.V[0x%X] == 0x%02X ? 0x%03X : 0x%03X;\n}\n\n", x, in.kk, skip, next);
+            return;
+        case OP_SNE_VX_KK:
+            fprintf(out, "    return s.V[0x%X] != 0x%02X ? 0x%03X : 0x%03X;\n}\n\n", x, in.kk, skip, next);
+            return;
+        case OP_SE_VX_VY:
+            fprintf(out, "    return s.V[0x%X] == s.V[0x%X] ? 0x%03X : 0x%03X;\n}\n\n", x, y, skip, next);
+            return;
+        case OP_SNE_VX_VY:
+            fprintf(out, "    return s.V[0x%X] != s.V[0x%X] ? 0x%03X : 0x%03X;\n}\n\n", x, y, skip, next);
+            return;
+        case OP_LD_VX_KK:
+            fprintf(out, "    s.V[0x%X] = 0x%02X;\n", x, in.kk);
+            break;
+        case OP_ADD_VX_KK:
+            fprintf(out, "    s.V[0x%X] += 0x%02X;\n", x, in.kk);
+            break;
+        case OP_LD_VX_VY:
+            fprintf(out, "    s.V[0x%X] = s.V[0x%X];\n", x, y);
+            break;
+        case OP_OR:
+        case OP_AND:
+        case OP_XOR:
+            fprintf(out, "    s.V[0x%X] %s= s.V[0x%X];\n", x, in.op == OP_OR ? "|" : in.op == OP_AND ? "&" : "^", y);
+            if (quirks.vfReset) {
+                fprintf(out, "    s.V[0xF] = 0;\n");
+            }
+            break;
+        case OP_ADD_VX_VY:
+            if (quirks.flagsLast) {
+                fprintf(out, "    uint8_t flag = s.V[0x%X] > (0xFF - s.V[0x%X]);\n", y, x);
+                fprintf(out, "    s.V[0x%X] += s.V[0x%X];\n", x, y);
+                fprintf(out, "    s.V[0xF] = flag;\n");
+            } else {
+                fprintf(out, "    s.V[0x%X] += s.V[0x%X];\n", x, y);
+                fprintf(out, "    s.V[0xF] = s.V[0x%X] > (0xFF - s.V[0x%X]);\n", y, x);
+            }
+            break;
+        case OP_SUB:
+            if (quirks.flagsLast) {
+                fprintf(out, "    uint8_t flag = s.V[0x%X] >= s.V[0x%X];\n", x, y);
+                fprintf(out, "    s.V[0x%X] -= s.V[0x%X];\n", x, y);
+                fprintf(out, "    s.V[0xF] = flag;\n");
+            } else {
+                fprintf(out, "    s.V[0xF] = s.V[0x%X] > s.V[0x%X];\n", x, y);
+                fprintf(out, "    s.V[0x%X] -= s.V[0x%X];\n", x, y);
+            }
+            break;
+        case OP_SHR:
+            if (quirks.shiftVy) {
+                fprintf(out, "    uint8_t flag = s.V[0x%X] & 0x01;\n", y);
+                fprintf(out, "    s.V[0x%X] = s.V[0x%X] >> 1;\n", x, y);
+                fprintf(out, "    s.V[0xF] = flag;\n");
+            } else {
+                fprintf(out, "    s.V[0xF] = s.V[0x%X] & 0x01;\n", x);
+                fprintf(out, "    s.V[0x%X] >>= 1;\n", x);
+            }
+            break;
+        case OP_SUBN:
+            if (quirks.flagsLast) {
+                fprintf(out, "    uint8_t flag = s.V[0x%X] >= s.V[0x%X];\n", y, x);
+                fprintf(out, "    s.V[0x%X] = s.V[0x%X] - s.V[0x%X];\n", x, y, x);
+                fprintf(out, "    s.V[0xF] = flag;\n");
+            } else {
+                fprintf(out, "    s.V[0xF] = s.V[0x%X] > s.V[0x%X];\n", y, x);
+                fprintf(out, "    s.V[0x%X] = s.V[0x%X] - s.V[0x%X];\n", x, y, x);
+            }
+            break;
+        case OP_SHL:
+            if (quirks.shiftVy) {
+                fprintf(out, "    uint8_t flag = s.V[0x%X] >> 7;\n", y);
+                fprintf(out, "    s.V[0x%X] = s.V[0x%X] << 1;\n", x, y);
+                fprintf(out, "    s.V[0xF] = flag;\n");
+            } else {
+                fprintf(out, "    s.V[0xF] = s.V[0x%X] >> 7;\n", x);
+                fprintf(out, "    s.V[0x%X] <<= 1;\n", x);
+            }
+            break;
+        case OP_LD_I:
+            fprintf(out, "    s.I = 0x%03X;\n", in.nnn);
+            break;
+        case OP_JP_V0:
+            fprintf(out, "    return 0x%03X + s.V[0x%X];\n}\n\n", in.nnn, quirks.jumpVx ? x : 0);
+            return;
+        case OP_RND:
+            fprintf(out, "    s.V[0x%X] = Aot::random(s.chip8) & 0x%02X;\n", x, in.kk);
+            break;
+        case OP_DRW:
+            fprintf(out, "    Aot::draw<%s>(s, s.V[0x%X], s.V[0x%X], %u);\n", quirks.clipSprites ? "true" : "false",
+                x, y, in.n);
+            break;
+        case OP_SKP:
+            fprintf(out, "    return s.key[s.V[0x%X] & 0xF] ? 0x%03X : 0x%03X;\n}\n\n", x, skip, next);
+            return;
+        case OP_SKNP:
+            fprintf(out, "    return !s.key[s.V[0x%X] & 0xF] ? 0x%03X : 0x%03X;\n}\n\n", x, skip, next);
+            return;
+        case OP_LD_VX_DT:
+            fprintf(out, "    s.V[0x%X] = s.delayTimer;\n", x);
+            break;
+        case OP_LD_DT_VX:
+            fprintf(out, "    s.delayTimer = s.V[0x%X];\n", x);
+            break;
+        case OP_LD_ST_VX:
+            fprintf(out, "    s.soundTimer = s.V[0x%X];\n", x);
+            break;
+        case OP_ADD_I_VX:
+            if (quirks.indexFlag) {
+                fprintf(out, "    s.V[0xF] = s.I + s.V[0x%X] > 0xFFF;\n", x);
+            }
+            fprintf(out, "    s.I += s.V[0x%X];\n", x);
+            break;
+        case OP_LD_F_VX:
+            fprintf(out, "    s.I = s.V[0x%X] * 0x5;\n", x);
+            break;
+        case OP_LD_B_VX:
+            fprintf(out, "    uint8_t value = s.V[0x%X];\n", x);
+            fprintf(out, "    s.modified |= Aot::store(s.chip8, s.I, (value / 100) %% 10);\n");
+            fprintf(out, "    s.modified |= Aot::store(s.chip8, s.I + 1, (value / 10) %% 10);\n");
+            fprintf(out, "    s.modified |= Aot::store(s.chip8, s.I + 2, value %% 10);\n");
+            break;
+        case OP_LD_I_VX:
+            for (unsigned i = 0; i <= x; i++) {
+                fprintf(out, "    s.modified |= Aot::store(s.chip8, s.I + %u, s.V[0x%X]);\n", i, i);
+            }
+            if (quirks.loadStoreI) {
+                fprintf(out, "    s.I += %u;\n", x + 1);
+            }
+            break;
+        case OP_LD_VX_I:
+            for (unsigned i = 0; i <= x; i++) {
+                fprintf(out, "    s.V[0x%X] = s.mem[(s.I + %u) & 0xFFF];\n", i, i);
+            }
+            if (quirks.loadStoreI) {
+                fprintf(out, "    s.I += %u;\n", x + 1);
+            }
+            break;
+    }
+
+    fprintf(out, "    return 0x%03X;\n}\n\n", next);
+}
+
+static bool emit(FILE *out, const Analysis &analysis, const std::string &name, const char *romPath)
+{
+    uint64_t covered[MEM_SIZE / 64] = {};
+    uint64_t entries[MEM_SIZE / 64] = {};
+
+    for (unsigned addr = 0; addr < MEM_SIZE; addr++) {
+        if (analysis.reach[addr] == REACH_CODE) {
+            entries[addr / 64] |= 1ull << (addr % 64);
+            for (unsigned byte = addr; byte < addr + 2; byte++) {
+                covered[byte / 64] |= 1ull << (byte % 64);
+            }
+        }
+    }
+
+    fprintf(out, "// Generated by chip8c from %s, profile %s. Do not edit.\n", romPath,
+        quirkProfileName(analysis.quirks));
+    fprintf(out, "#include \"Aot.h\"\n\n");
+    fprintf(out, "#define AOT_INLINE static inline __attribute__((always_inline))\n\n");
+    fprintf(out, "namespace {\n\n");
+
+    fprintf(out, "const uint8_t rom[%zu] = {\n", analysis.rom.size());
+    for (size_t i = 0; i < analysis.rom.size(); i++) {
+        fprintf(out, "%s0x%02X,%s", i % 16 ? " " : "    ", analysis.rom[i],
+            i % 16 == 15 || i + 1 == analysis.rom.size() ? "\n" : "");
+    }
+    fprintf(out, "};\n\n");
+    emitBitmap(out, "covered", covered);
+    emitBitmap(out, "entries", entries);
+
+    for (unsigned addr = 0; addr < MEM_SIZE; addr++) {
+        if (analysis.reach[addr] == REACH_CODE) {
+            emitInstruction(out, analysis, addr);
+        }
+    }
+
+    //* Basic blocks: from a leader up to the first instruction that ends one, or up to
+    //* the next leader
+    unsigned blocks = 0;
+    unsigned blockEnd[MEM_SIZE] = {};      // Last instruction of the block starting there
+    for (unsigned start = 0; start < MEM_SIZE; start++) {
+        if (!analysis.leader[start]) {
+            continue;
+        }
+
+        unsigned addr = start;
+        std::vector<unsigned> body;
+        for (;;) {
+            body.push_back(addr);
+            uint8_t op = Chip8::decodeOpcode(analysis.opcode(addr)).op;
+            unsigned next = addr + 2;
+            if (endsBlock(op) || next >= MEM_SIZE || analysis.reach[next] != REACH_CODE || analysis.leader[next]) {
+                break;
+            }
+            addr = next;
+        }
+
+        //* The budget may run out inside the block: every instruction after the first
+        //* checks it, and leaves with pc on itself
+        fprintf(out, "//* %03X-%03X, %zu instructions\n", start, addr, body.size());
+        fprintf(out, "AOT_INLINE uint16_t block_%03X(AotCpu &s, unsigned &cycles)\n{\n", start);
+        for (size_t i = 0; i < body.size(); i++) {
+            if (i > 0) {
+                fprintf(out, "    if (cycles == 0) {\n        return 0x%03X;\n    }\n", body[i]);
+            }
+            fprintf(out, "    cycles--;\n");
+            fprintf(out, i + 1 < body.size() ? "    op_%03X(s);\n" : "    return op_%03X(s);\n", body[i]);
+        }
+        fprintf(out, "}\n\n");
+        blockEnd[start] = addr;
+        blocks++;
+    }
+
+    //* One switch over pc: a whole block where one starts, otherwise one instruction
+    //* (the block was left in the middle when the previous budget ran out). Where the
+    //* next pc is one of the exits known statically, control goes straight to its case.
+    std::vector<std::vector<unsigned>> exits(MEM_SIZE);
+    bool target[MEM_SIZE] = {};
+    for (unsigned addr = 0; addr < MEM_SIZE; addr++) {
+        if (analysis.reach[addr] == REACH_CODE) {
+            for (unsigned exit : successors(analysis, analysis.leader[addr] ? blockEnd[addr] : addr)) {
+                exits[addr].push_back(exit);
+                target[exit] = true;
+            }
+        }
+    }
+
+    fprintf(out, "unsigned run(AotCpu &s, unsigned cycles)\n{\n");
+    fprintf(out, "    uint16_t pc = s.pc;\n\n");
+    fprintf(out, "    while (cycles > 0 && !s.modified) {\n");
+    fprintf(out, "        switch (pc) {\n");
+    for (unsigned addr = 0; addr < MEM_SIZE; addr++) {
+        if (analysis.reach[addr] != REACH_CODE) {
+            continue;
+        }
+        fprintf(out, "            case 0x%03X:\n", addr);
+        if (target[addr]) {
+            fprintf(out, "            at_%03X:\n", addr);
+        }
+        if (analysis.leader[addr]) {
+            fprintf(out, "                pc = block_%03X(s, cycles);\n", addr);
+        } else {
+            fprintf(out, "                cycles--;\n");
+            fprintf(out, "                pc = op_%03X(s);\n", addr);
+        }
+        if (!exits[addr].empty()) {
+            fprintf(out, "                if (cycles > 0 && !s.modified) {\n");
+            for (unsigned exit : exits[addr]) {
+                fprintf(out, "                    if (pc == 0x%03X) {\n", exit);
+                fprintf(out, "                        goto at_%03X;\n", exit);
+                fprintf(out, "                    }\n");
+            }
+            fprintf(out, "                }\n");
+        }
+        fprintf(out, "                break;\n");
+    }
+    fprintf(out, "            default:\n");
+    fprintf(out, "                s.pc = pc;\n");
+    fprintf(out, "                return cycles;\n");
+    fprintf(out, "        }\n");
+    fprintf(out, "    }\n\n");
+    fprintf(out, "    s.pc = pc;\n");
+    fprintf(out, "    return cycles;\n}\n\n");
+
+    fprintf(out, "const AotProgram program = {\n");
+    fprintf(out, "    \"%s\", (QuirkProfile)%d, rom, sizeof(rom), covered, entries, %u, run\n", name.c_str(),
+        analysis.quirks, blocks);
+    fprintf(out, "};\n\n");
+    fprintf(out, "const bool registered = Aot::add(&program);\n\n");
+    fprintf(out, "} // namespace\n");
+
+    return !ferror(out);
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [--quirks profile] [--name name] [-o output.cpp] rom\n", name);
+}
+
+int main(int argc, char **argv)
+{
+    Analysis analysis;
+    const char *romPath = nullptr;
+    const char *outPath = nullptr;
+    std::string name;
+
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+
+        if (!strcmp(argv[i], "--quirks") && hasValue) {
+            if (!parseQuirkProfile(argv[++i], analysis.quirks)) {
+                fprintf(stderr, "Unknown quirk profile: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "--name") && hasValue) {
+            name = argv[++i];
+        } else if (!strcmp(argv[i], "-o") && hasValue) {
+            outPath = argv[++i];
+        } else if (argv[i][0] == '-' || romPath) {
+            usage(argv[0]);
+            return 1;
+        } else {
+            romPath = argv[i];
+        }
+    }
+
+    if (!romPath) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    FILE *file = fopen(romPath, "rb");
+    if (!file) {
+        fprintf(stderr, "Fail to open %s\n", romPath);
+        return 1;
+    }
+    uint8_t buffer[MAX_ROM_SIZE + 1];
+    size_t size = fread(buffer, 1, sizeof(buffer), file);
+    fclose(file);
+    if (size > MAX_ROM_SIZE) {
+        fprintf(stderr, "ROM does not fit in memory: %s\n", romPath);
+        return 1;
+    }
+    uint16_t variant = findVariantOpcode(buffer, size);
+    if (variant) {
+        fprintf(stderr, "ROM needs SUPER-CHIP or XO-CHIP, not emulated: %s (opcode at %03X)\n", romPath, variant);
+        return 1;
+    }
+    analysis.rom.assign(buffer, buffer + size);
+
+    if (name.empty()) {
+        const char *base = strrchr(romPath, '/');
+        name = base ? base + 1 : romPath;
+    }
+    for (char &c : name) {
+        if (!isprint((unsigned char)c) || c == '"' || c == '\\') {
+            c = '_';
+        }
+    }
+
+    analyze(analysis);
+
+    FILE *out = outPath ? fopen(outPath, "w") : stdout;
+    if (!out) {
+        fprintf(stderr, "Fail to create %s\n", outPath);
+        return 1;
+    }
+    bool written = emit(out, analysis, name, romPath);
+    if (outPath) {
+        written = fclose(out) == 0 && written;
+    }
+    if (!written) {
+        fprintf(stderr, "Fail to write %s\n", outPath ? outPath : "the output");
+        return 1;
+    }
+
+    fprintf(stderr, "%s: %u instructions translated, %u left to the interpreter, %u indirect jumps\n",
+        name.c_str(), analysis.instructions, analysis.interpreted, analysis.indirect);
+    return 0;
+}
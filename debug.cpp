@@ -0,0 +1,454 @@
+#include "Chip8.h"
+#include "Debugger.h"
+#include "Disasm.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+//* Terminal debugger. Reads one command per line from stdin, an empty line repeats
+//* the last one, so a script can be piped in too:
+//*
+//*   s [n]         step n instructions            n             step over a call
+//*   c [frames]    run until a stop (600 frames)  f <frame>     run to the start of a frame
+//*   b <addr>      toggle a breakpoint            w <addr>      toggle a memory watchpoint
+//*   r <register>  toggle a register watchpoint (V0-VF, I, DT, ST)
+//*   i             list breakpoints and watchpoints
+//*   x <addr> [n]  dump memory                    l [addr] [n]  disassemble
+//*   k <mask>      hold keys (hex bitmask)        p             print the screen
+//*   q             quit
+//*
+//* --bench times the core with the debugger detached, attached with nothing armed,
+//* and armed with a breakpoint and a watchpoint nothing reaches. --check runs each
+//* ROM stopping at every breakpoint and watchpoint hit against a plain runFrame.
+
+struct DebugConfig {
+    unsigned cycles = 10;
+    QuirkProfile quirks = QUIRKS_LEGACY;
+    uint64_t seed = RANDOM_DEFAULT_SEED;
+    bool bench = false;
+    bool check = false;
+    unsigned benchFrames = 100000;
+    unsigned benchRuns = 5;
+};
+
+static const char *const REGISTER_NAMES[DEBUG_REG_COUNT] = {
+    "V0", "V1", "V2", "V3", "V4", "V5", "V6", "V7",
+    "V8", "V9", "VA", "VB", "VC", "VD", "VE", "VF",
+    "I", "DT", "ST"
+};
+
+static bool parseRegister(const char *text, DebugRegister &reg)
+{
+    for (int r = 0; r < DEBUG_REG_COUNT; r++) {
+        if (!strcasecmp(text, REGISTER_NAMES[r])) {
+            reg = (DebugRegister)r;
+            return true;
+        }
+    }
+    return false;
+}
+
+static uint16_t opcodeAt(const Chip8 &chip8, uint16_t addr)
+{
+    const uint8_t *mem = chip8.memory();
+    return mem[addr & 0xFFF] << 8 | mem[(addr + 1) & 0xFFF];
+}
+
+static void printInstruction(const Chip8 &chip8, const Debugger &debugger, uint16_t addr, bool current)
+{
+    char mnemonic[64];
+    uint16_t opcode = opcodeAt(chip8, addr);
+
+    disassemble(opcode, mnemonic, sizeof(mnemonic));
+    printf("%c%c %03X  %04X  %s\n", current ? '>' : ' ', debugger.breakpoint(addr) ? '*' : ' ',
+        addr & 0xFFF, opcode, mnemonic);
+}
+
+static void printRegisters(const Chip8 &chip8, const Debugger &debugger)
+{
+    Registers regs;
+    chip8.getRegisters(regs);
+
+    for (int i = 0; i < 16; i++) {
+        printf("V%X=%02X%c", i, regs.V[i], i == 7 || i == 15 ? '\n' : ' ');
+    }
+    printf("I=%03X DT=%02X ST=%02X SP=%X keys=%04X  frame %llu +%u, %llu instructions\n", regs.I,
+        regs.delayTimer, regs.soundTimer, regs.sp, regs.keys, (unsigned long long)debugger.frame,
+        debugger.frameCycles, (unsigned long long)chip8.instructionCount);
+    if (regs.sp) {
+        printf("stack:");
+        for (int i = 0; i < (regs.sp & 0xF); i++) {
+            printf(" %03X", regs.stack[i]);
+        }
+        putchar('\n');
+    }
+    printInstruction(chip8, debugger, regs.pc, true);
+}
+
+static void printStop(const Chip8 &chip8, const Debugger &debugger, const DebugStop &stop)
+{
+    switch (stop.reason) {
+        case DEBUG_BREAKPOINT:
+            printf("Breakpoint at %03X\n", stop.pc);
+            break;
+        case DEBUG_WATCH_MEMORY:
+            printf("Watchpoint: %03X wrote [%03X] %02X -> %02X\n", stop.at, stop.addr, stop.before, stop.after);
+            break;
+        case DEBUG_WATCH_REGISTER:
+            printf("Watchpoint: %03X wrote %s = %X\n", stop.at, REGISTER_NAMES[stop.addr], stop.after);
+            break;
+        default:
+            break;
+    }
+    printRegisters(chip8, debugger);
+}
+
+static void printScreen(const Chip8 &chip8)
+{
+    const uint64_t *rows = chip8.frameRows();
+    std::string line;
+
+    for (unsigned y = 0; y < SCREEN_HEIGHT; y++) {
+        line.clear();
+        for (unsigned x = 0; x < SCREEN_WIDTH; x++) {
+            line += (rows[y] >> (63 - x)) & 1 ? '#' : '.';
+        }
+        printf("%s\n", line.c_str());
+    }
+}
+
+static void printWatches(const Debugger &debugger)
+{
+    printf("breakpoints:");
+    for (unsigned addr = 0; addr < MEM_SIZE; addr++) {
+        if (debugger.breakpoint(addr)) {
+            printf(" %03X", addr);
+        }
+    }
+    printf("\nwatchpoints:");
+    for (unsigned addr = 0; addr < MEM_SIZE; addr++) {
+        if (debugger.watching(addr)) {
+            printf(" [%03X]", addr);
+        }
+    }
+    for (int r = 0; r < DEBUG_REG_COUNT; r++) {
+        if (debugger.watchingRegister((DebugRegister)r)) {
+            printf(" %s", REGISTER_NAMES[r]);
+        }
+    }
+    putchar('\n');
+}
+
+//* One command line, false on quit or end of input
+static bool command(Chip8 &chip8, Debugger &debugger, const char *line)
+{
+    char name[16] = "";
+    char first[32] = "";
+    char second[32] = "";
+    int args = sscanf(line, "%15s %31s %31s", name, first, second);
+
+    if (args <= 0) {
+        return true;
+    }
+    unsigned long value = args > 1 ? strtoul(first, NULL, 16) : 0;
+    unsigned long count = args > 2 ? strtoul(second, NULL, 0) : 0;
+
+    if (!strcmp(name, "q")) {
+        return false;
+    } else if (!strcmp(name, "s")) {
+        printStop(chip8, debugger, debugger.step(chip8, args > 1 ? strtoul(first, NULL, 0) : 1));
+    } else if (!strcmp(name, "n")) {
+        printStop(chip8, debugger, debugger.stepOver(chip8, 600));
+    } else if (!strcmp(name, "c")) {
+        uint64_t frames = args > 1 ? strtoull(first, NULL, 0) : 600;
+        printStop(chip8, debugger, debugger.runToFrame(chip8, debugger.frame + frames));
+    } else if (!strcmp(name, "f") && args > 1) {
+        printStop(chip8, debugger, debugger.runToFrame(chip8, strtoull(first, NULL, 0)));
+    } else if (!strcmp(name, "b") && args > 1) {
+        debugger.setBreakpoint(value, !debugger.breakpoint(value));
+        printWatches(debugger);
+    } else if (!strcmp(name, "w") && args > 1) {
+        debugger.setWatch(value, !debugger.watching(value));
+        printWatches(debugger);
+    } else if (!strcmp(name, "r") && args > 1) {
+        DebugRegister reg;
+        if (!parseRegister(first, reg)) {
+            printf("Unknown register: %s\n", first);
+        } else {
+            debugger.watchRegister(reg, !debugger.watchingRegister(reg));
+            printWatches(debugger);
+        }
+    } else if (!strcmp(name, "i")) {
+        printWatches(debugger);
+    } else if (!strcmp(name, "x") && args > 1) {
+        const uint8_t *mem = chip8.memory();
+        for (unsigned long i = 0; i < (count ? count : 16); i++) {
+            if (i % 16 == 0) {
+                printf("%s%03lX:", i ? "\n" : "", (value + i) & 0xFFF);
+            }
+            printf(" %02X", mem[(value + i) & 0xFFF]);
+        }
+        putchar('\n');
+    } else if (!strcmp(name, "l")) {
+        Registers regs;
+        chip8.getRegisters(regs);
+        uint16_t addr = args > 1 ? value : regs.pc;
+        for (unsigned long i = 0; i < (count ? count : 8); i++) {
+            printInstruction(chip8, debugger, addr + 2 * i, ((addr + 2 * i) & 0xFFF) == regs.pc);
+        }
+    } else if (!strcmp(name, "k") && args > 1) {
+        chip8.setKeys(value);
+    } else if (!strcmp(name, "p")) {
+        printScreen(chip8);
+    } else {
+        printf("Unknown command: %s", line);
+    }
+    return true;
+}
+
+static bool readRom(const char *path, std::vector<uint8_t> &rom)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        fprintf(stderr, "Fail to load the file: %s\n", path);
+        return false;
+    }
+    rom.resize(MAX_ROM_SIZE);
+    rom.resize(fread(rom.data(), 1, rom.size(), file));
+    fclose(file);
+
+    uint16_t variant = findVariantOpcode(rom.data(), rom.size());
+    if (variant) {
+        fprintf(stderr, "ROM needs SUPER-CHIP or XO-CHIP, not emulated: %s (opcode at %03X)\n", path, variant);
+        return false;
+    }
+    return true;
+}
+
+static void boot(Chip8 &chip8, const DebugConfig &config, const std::vector<uint8_t> &rom)
+{
+    chip8.seedRandom(config.seed);
+    chip8.setQuirks(config.quirks);
+    chip8.reset();
+    chip8.load(rom.data(), rom.size());
+}
+
+//* All through runFrame: what the core pays, not the command loop
+enum DebugBenchMode {
+    BENCH_DETACHED,
+    BENCH_ATTACHED,         // Nothing armed
+    BENCH_BREAKPOINT,       // A breakpoint nothing reaches
+    BENCH_WATCH,            // A memory watchpoint nothing stores to
+    BENCH_MODE_COUNT
+};
+
+//* ns per instruction, idle loops not skipped
+static double measure(const DebugConfig &config, const std::vector<uint8_t> &rom, DebugBenchMode mode)
+{
+    Chip8 chip8;
+    Debugger debugger(config.cycles);
+    boot(chip8, config, rom);
+    chip8.setIdleSkip(false);
+
+    if (mode != BENCH_DETACHED) {
+        chip8.attachDebugger(&debugger);
+    }
+    if (mode == BENCH_BREAKPOINT) {
+        debugger.setBreakpoint(0xFFE, true);
+    } else if (mode == BENCH_WATCH) {
+        debugger.setWatch(0xFFE, true);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned frame = 0; frame < config.benchFrames; frame++) {
+        chip8.setKeys(frame % 16 < 8 ? 1u << (frame / 16 % 16) : 0);
+        chip8.runFrame(config.cycles);
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    return elapsed.count() * 1e9 / chip8.instructionCount;
+}
+
+static void bench(const DebugConfig &config, int count, char **paths)
+{
+    printf("%-24s %12s %12s %12s %12s\n", "rom", "detached", "attached", "breakpoint", "watchpoint");
+    for (int p = 0; p < count; p++) {
+        std::vector<uint8_t> rom;
+        if (!readRom(paths[p], rom)) {
+            continue;
+        }
+
+        //* Best of the runs, the modes interleaved so they see the same host noise
+        double best[BENCH_MODE_COUNT] = {};
+        for (unsigned run = 0; run < config.benchRuns; run++) {
+            for (int mode = 0; mode < BENCH_MODE_COUNT; mode++) {
+                double ns = measure(config, rom, (DebugBenchMode)mode);
+                best[mode] = run == 0 || ns < best[mode] ? ns : best[mode];
+            }
+        }
+
+        const char *name = strrchr(paths[p], '/');
+        printf("%-24s", name ? name + 1 : paths[p]);
+        for (int mode = 0; mode < BENCH_MODE_COUNT; mode++) {
+            printf(" %10.2fns", best[mode]);
+        }
+        putchar('\n');
+    }
+    printf("ns per instruction at %u instructions per frame, best of %u, idle loops not skipped%s\n",
+        config.cycles, config.benchRuns, DEBUG_ENABLED ? "" : " (not a CHIP8_DEBUG build: nothing is checked)");
+}
+
+//* Stopping and resuming must not change anything: a machine run through the debugger
+//* with stops all over the main loop against one that never stops
+static bool check(const DebugConfig &config, int count, char **paths)
+{
+    bool ok = true;
+
+    for (int p = 0; p < count; p++) {
+        std::vector<uint8_t> rom;
+        if (!readRom(paths[p], rom)) {
+            ok = false;
+            continue;
+        }
+
+        Chip8 reference;
+        Chip8 stopped;
+        Debugger debugger(config.cycles);
+        boot(reference, config, rom);
+        boot(stopped, config, rom);
+        reference.setIdleSkip(false);
+        stopped.attachDebugger(&debugger);
+        for (uint16_t addr = START_LOCATION; addr < START_LOCATION + rom.size(); addr += 6) {
+            debugger.setBreakpoint(addr, true);
+        }
+        debugger.setWatch(0x300, true);
+        debugger.watchRegister(DEBUG_REG_VF, true);
+
+        uint64_t stops = 0;
+        unsigned frame = 0;
+        for (; frame < config.benchFrames / 10; frame++) {
+            uint16_t keys = frame % 16 < 8 ? 1u << (frame / 16 % 16) : 0;
+            reference.setKeys(keys);
+            stopped.setKeys(keys);
+            reference.runFrame(config.cycles);
+            while (debugger.runToFrame(stopped, frame + 1).reason != DEBUG_FRAME) {
+                stops++;
+            }
+            if (!reference.stateEquals(stopped) || reference.instructionCount != stopped.instructionCount) {
+                break;
+            }
+        }
+
+        bool same = frame == config.benchFrames / 10;
+        ok = ok && same;
+        printf("%s  %-24s %u frames, %llu stops\n", same ? "PASS" : "FAIL", paths[p], frame,
+            (unsigned long long)stops);
+    }
+    if (!DEBUG_ENABLED) {
+        printf("Not a CHIP8_DEBUG build: nothing stopped\n");
+    }
+    return ok;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [-c cycles] [--quirks profile] [--seed n] [-b addr]... rom\n"
+        "       %s --bench|--check [-f frames] [-c cycles] [--quirks profile] rom...\n", name, name);
+}
+
+int main(int argc, char **argv)
+{
+    DebugConfig config;
+    Debugger breaks;
+    int firstRom = argc;
+
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+
+        if (!strcmp(argv[i], "-c") && hasValue) {
+            config.cycles = strtoul(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "-f") && hasValue) {
+            config.benchFrames = strtoul(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "--quirks") && hasValue) {
+            if (!parseQuirkProfile(argv[++i], config.quirks)) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "--seed") && hasValue) {
+            config.seed = strtoull(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "-b") && hasValue) {
+            breaks.setBreakpoint(strtoul(argv[++i], NULL, 16), true);
+        } else if (!strcmp(argv[i], "--bench")) {
+            config.bench = true;
+        } else if (!strcmp(argv[i], "--check")) {
+            config.check = true;
+        } else if (argv[i][0] == '-') {
+            usage(argv[0]);
+            return 1;
+        } else {
+            firstRom = i;
+            break;
+        }
+    }
+
+    bool batch = config.bench || config.check;
+    if (config.cycles == 0 || firstRom == argc || (!batch && firstRom != argc - 1)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (config.check) {
+        return check(config, argc - firstRom, &argv[firstRom]) ? 0 : 1;
+    }
+    if (config.bench) {
+        bench(config, argc - firstRom, &argv[firstRom]);
+        return 0;
+    }
+
+    if (!DEBUG_ENABLED) {
+        fprintf(stderr, "Not a CHIP8_DEBUG build: breakpoints and watchpoints never stop\n");
+    }
+
+    Chip8 chip8;
+    Debugger debugger(config.cycles);
+    std::vector<uint8_t> rom;
+    if (!readRom(argv[firstRom], rom)) {
+        return 1;
+    }
+    boot(chip8, config, rom);
+    for (unsigned addr = 0; addr < MEM_SIZE; addr++) {
+        debugger.setBreakpoint(addr, breaks.breakpoint(addr));
+    }
+    chip8.attachDebugger(&debugger);
+    printRegisters(chip8, debugger);
+
+    bool interactive = isatty(STDIN_FILENO);
+    char line[256];
+    std::string last;
+
+    for (;;) {
+        if (interactive) {
+            printf("(chip8) ");
+            fflush(stdout);
+        }
+        if (!fgets(line, sizeof(line), stdin)) {
+            break;
+        }
+        if (line[strspn(line, " \t\r\n")] == '\0') {
+            if (last.empty()) {
+                continue;
+            }
+        } else {
+            last = line;
+        }
+        if (!command(chip8, debugger, last.c_str())) {
+            break;
+        }
+    }
+    return 0;
+}
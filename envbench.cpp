@@ -0,0 +1,166 @@
+#include "Chip8Env.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+//* Env-steps per second through libchip8.so, the way a training loop drives it:
+//* one chip8_env_step per batch with fresh actions, observations and flags read
+//* back. Only the C ABI is used, like any other caller of the library.
+
+struct EnvBenchResult {
+    uint32_t count;
+    uint32_t format;
+    uint64_t calls = 0;
+    uint64_t envSteps = 0;      // Environments times calls
+    uint64_t resets = 0;
+    uint64_t instructions = 0;
+    double seconds = 0;
+};
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [-m count[,count...]] [-f frames] [-c cycles] [-e episode-frames] [-t threads]\n"
+        "          [-d seconds] [--json] rom\n", name);
+}
+
+static bool readFile(const char *path, std::vector<uint8_t> &data)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        fprintf(stderr, "Fail to open %s\n", path);
+        return false;
+    }
+    uint8_t buffer[4096];
+    size_t size;
+    while ((size = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        data.insert(data.end(), buffer, buffer + size);
+    }
+    fclose(file);
+    return true;
+}
+
+static bool runPoint(const std::vector<uint8_t> &rom, const Chip8EnvConfig &config, uint32_t frames, double seconds,
+    EnvBenchResult &result)
+{
+    Chip8Env *env = chip8_env_create(rom.data(), rom.size(), result.count, &config);
+    if (!env) {
+        fprintf(stderr, "Fail to create %u environments\n", result.count);
+        return false;
+    }
+
+    std::vector<uint16_t> actions(result.count);
+    std::vector<uint8_t> observations(result.count * chip8_env_observation_size(result.format));
+    std::vector<uint8_t> flags(result.count);
+    uint32_t state = 0x2545F491;
+
+    chip8_env_reset(env, -1, observations.data(), result.format);
+    auto start = std::chrono::steady_clock::now();
+    std::chrono::duration<double> elapsed(0);
+
+    //* Batches of calls between clock reads, so M = 1 measures the call and not the clock
+    while (elapsed.count() < seconds) {
+        for (unsigned repeat = 0; repeat < 16; repeat++) {
+            for (auto &action : actions) {
+                state = state * 1664525 + 1013904223;
+                action = 1 << (state >> 28);
+            }
+            chip8_env_step(env, actions.data(), frames, observations.data(), result.format, flags.data());
+            for (uint8_t flag : flags) {
+                result.resets += (flag & CHIP8_ENV_RESET) != 0;
+            }
+            result.calls++;
+        }
+        elapsed = std::chrono::steady_clock::now() - start;
+    }
+
+    result.seconds = elapsed.count();
+    result.envSteps = result.calls * result.count;
+    result.instructions = chip8_env_instructions(env);
+    chip8_env_destroy(env);
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    Chip8EnvConfig config;
+    chip8_env_default_config(&config);
+    std::vector<uint32_t> counts = {1, 64, 1024};
+    const char *romPath = nullptr;
+    uint32_t frames = 1;
+    double seconds = 1;
+    bool json = false;
+
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+
+        if (!strcmp(argv[i], "-m") && hasValue) {
+            counts.clear();
+            for (char *next = argv[++i]; *next; next += *next == ',') {
+                counts.push_back(strtoul(next, &next, 10));
+            }
+        } else if (!strcmp(argv[i], "-f") && hasValue) {
+            frames = strtoul(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "-c") && hasValue) {
+            config.cyclesPerFrame = strtoul(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "-e") && hasValue) {
+            config.episodeFrames = strtoul(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "-t") && hasValue) {
+            config.threads = strtoul(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "-d") && hasValue) {
+            seconds = strtod(argv[++i], NULL);
+        } else if (!strcmp(argv[i], "--json")) {
+            json = true;
+        } else if (argv[i][0] == '-' || romPath) {
+            usage(argv[0]);
+            return 1;
+        } else {
+            romPath = argv[i];
+        }
+    }
+
+    std::vector<uint8_t> rom;
+    if (!romPath || counts.empty() || !readFile(romPath, rom)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    std::vector<EnvBenchResult> results;
+    for (uint32_t count : counts) {
+        for (uint32_t format : {CHIP8_OBS_NONE, CHIP8_OBS_BITS, CHIP8_OBS_BYTES}) {
+            EnvBenchResult result;
+            result.count = count;
+            result.format = format;
+            if (!runPoint(rom, config, frames, seconds, result)) {
+                return 1;
+            }
+            results.push_back(result);
+        }
+    }
+
+    static const char *formatNames[] = {"none", "bytes", "bits"};
+    if (json) {
+        printf("{\n  \"abi_version\": %u,\n  \"frames_per_step\": %u,\n  \"cycles_per_frame\": %u,\n",
+            chip8_env_abi_version(), frames, config.cyclesPerFrame);
+        printf("  \"threads\": %u,\n  \"results\": [\n", config.threads);
+        for (size_t r = 0; r < results.size(); r++) {
+            const EnvBenchResult &result = results[r];
+            printf("    {\"envs\": %u, \"observation\": \"%s\", \"calls_per_second\": %.0f, "
+                "\"env_steps_per_second\": %.0f, \"instructions_per_second\": %.0f, \"resets\": %llu}%s\n",
+                result.count, formatNames[result.format], result.calls / result.seconds,
+                result.envSteps / result.seconds, result.instructions / result.seconds,
+                (unsigned long long)result.resets, r + 1 < results.size() ? "," : "");
+        }
+        printf("  ]\n}\n");
+    } else {
+        printf("%6s %-6s %14s %16s %12s %10s\n", "envs", "obs", "calls/s", "env-steps/s", "ns/env-step", "resets");
+        for (const EnvBenchResult &result : results) {
+            printf("%6u %-6s %14.0f %16.0f %12.1f %10llu\n", result.count, formatNames[result.format],
+                result.calls / result.seconds, result.envSteps / result.seconds,
+                result.seconds * 1e9 / result.envSteps, (unsigned long long)result.resets);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,124 @@
+#include "Chip8.h"
+#include "Explorer.h"
+#include "RomCatalog.h"
+#include "ThreadPool.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+//* Breadth-first input search over every ROM of a directory (or one ROM file):
+//* states/sec, how many children were states seen before, memory per state kept,
+//* and the addresses executed along the way
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [-d depth] [-n max states] [-c cycles] [-t threads] [--quirks profile] "
+        "[--seed n] [--coverage] <rom or directory>\n", name);
+}
+
+//* Executed addresses as ranges, for --coverage
+static void printCoverage(const uint64_t coverage[64])
+{
+    unsigned addr = 0;
+
+    while (addr < MEM_SIZE) {
+        if (!((coverage[addr >> 6] >> (addr & 63)) & 1)) {
+            addr++;
+            continue;
+        }
+        unsigned end = addr;
+        while (end + 1 < MEM_SIZE && ((coverage[(end + 1) >> 6] >> ((end + 1) & 63)) & 1)) {
+            end++;
+        }
+        printf(end > addr ? " %03X-%03X" : " %03X", addr, end);
+        addr = end + 1;
+    }
+    putchar('\n');
+}
+
+int main(int argc, char **argv)
+{
+    ExploreConfig config;
+    unsigned threads = 0;
+    bool listCoverage = false;
+    const char *path = nullptr;
+
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+
+        if (!strcmp(argv[i], "-d") && hasValue) {
+            config.depth = strtoul(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "-n") && hasValue) {
+            config.maxStates = strtoull(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "-c") && hasValue) {
+            config.cyclesPerFrame = strtoul(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "-t") && hasValue) {
+            threads = strtoul(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "--quirks") && hasValue) {
+            if (!parseQuirkProfile(argv[++i], config.quirks)) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "--seed") && hasValue) {
+            config.seed = strtoull(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "--coverage")) {
+            listCoverage = true;
+        } else if (argv[i][0] != '-' && !path) {
+            path = argv[i];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    RomCatalog catalog;
+    if (!path || config.cyclesPerFrame == 0 || config.maxStates == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (!catalog.open(path)) {
+        fprintf(stderr, "No ROM to explore in %s\n", path);
+        return 1;
+    }
+
+    ThreadPool pool(threads);
+    printf("%-10s %5s %11s %10s %7s %12s %8s %9s %6s %6s\n", "rom", "depth", "generated", "distinct", "dup",
+        "states/s", "B/state", "peak", "pcs", "rom");
+
+    for (size_t r = 0; r < catalog.size(); r++) {
+        const RomEntry &rom = catalog[r];
+        ExploreReport report;
+        if (!explore(rom.data, rom.size, config, pool, report)) {
+            if (report.failedRestores) {
+                fprintf(stderr, "Fail to explore %s: %llu states did not restore by depth %u\n", rom.path.c_str(),
+                    (unsigned long long)report.failedRestores, report.depth);
+            } else {
+                fprintf(stderr, "Fail to explore %s\n", rom.path.c_str());
+            }
+            continue;
+        }
+
+        //* ROM bytes under an executed opcode
+        unsigned codeBytes = 0;
+        for (unsigned addr = START_LOCATION; addr < START_LOCATION + rom.size; addr++) {
+            bool first = (report.coverage[addr >> 6] >> (addr & 63)) & 1;
+            bool second = (report.coverage[(addr - 1) >> 6] >> ((addr - 1) & 63)) & 1;
+            codeBytes += first || second;
+        }
+
+        printf("%-10s %4u%s %11llu %10llu %6.1f%% %12.0f %8.1f %7.1fMB %6u %5.1f%%\n", rom.name.c_str(),
+            report.depth, report.truncated ? "+" : " ", (unsigned long long)report.generated,
+            (unsigned long long)report.distinct, report.duplicateRatio() * 100, report.statesPerSecond(),
+            report.bytesPerState(), (report.tableBytes + report.peakFrontierBytes) / 1e6, report.covered,
+            100.0 * codeBytes / rom.size);
+        if (listCoverage) {
+            printCoverage(report.coverage);
+        }
+    }
+
+    printf("%u inputs per state (none or one key), %u instructions per frame, %zu threads; "
+        "+ = stopped at %zu states; peak = table and largest level\n", 17, config.cyclesPerFrame, pool.size(),
+        config.maxStates);
+    return 0;
+}
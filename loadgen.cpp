@@ -0,0 +1,564 @@
+#include "Server.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+//* Load generator for chip8-server. It only uses the protocol in Server.h, like any
+//* other client: no emulator code is linked in.
+
+struct LoadConfig {
+    std::string socketPath = SERVER_SOCKET;
+    std::vector<uint8_t> rom;       // Uploaded through each session's view
+    uint64_t hash = 0;              // Or loaded from the server's catalog
+    unsigned sessions = 64;
+    unsigned batch = 16;            // Sessions per request, each a SET_KEYS and a STEP
+    unsigned frames = 1;            // Per STEP
+    unsigned cycles = 10;
+    unsigned connections = 1;
+    double seconds = 5;
+};
+
+struct LoadStats {
+    uint64_t requests = 0;          // Step requests
+    uint64_t commands = 0;
+    uint64_t frames = 0;
+    uint64_t instructions = 0;
+    uint64_t viewMismatches = 0;    // The view didn't show the step just replied to
+    uint64_t errors = 0;
+    std::vector<double> latencies;  // Step request round trips, seconds
+};
+
+static int connectServer(const std::string &path)
+{
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, (sockaddr *)&address, sizeof(address)) < 0) {
+        fprintf(stderr, "Fail to connect to %s: %s\n", path.c_str(), strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    return fd;
+}
+
+//* One request and its reply, with the memfds the reply carries
+static bool call(int fd, const std::vector<ServerCommand> &commands, std::vector<ServerReply> &replies,
+    std::vector<int> *fds = nullptr)
+{
+    alignas(8) uint8_t buffer[SERVER_REQUEST_SIZE > SERVER_REPLY_SIZE ? SERVER_REQUEST_SIZE : SERVER_REPLY_SIZE];
+    ServerMessage header = { SERVER_MAGIC, SERVER_VERSION, (uint16_t)commands.size() };
+
+    memcpy(buffer, &header, sizeof(header));
+    memcpy(buffer + sizeof(header), commands.data(), commands.size() * sizeof(ServerCommand));
+    size_t size = sizeof(header) + commands.size() * sizeof(ServerCommand);
+    if (send(fd, buffer, size, MSG_NOSIGNAL) != (ssize_t)size) {
+        return false;
+    }
+
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * SERVER_MAX_BATCH)];
+    iovec in = { buffer, sizeof(buffer) };
+    msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &in;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    ssize_t received = recvmsg(fd, &message, MSG_CMSG_CLOEXEC);
+    if (received != (ssize_t)(sizeof(header) + commands.size() * sizeof(ServerReply))) {
+        return false;
+    }
+
+    replies.resize(commands.size());
+    memcpy(replies.data(), buffer + sizeof(header), replies.size() * sizeof(ServerReply));
+
+    for (cmsghdr *rights = CMSG_FIRSTHDR(&message); rights && fds; rights = CMSG_NXTHDR(&message, rights)) {
+        if (rights->cmsg_level == SOL_SOCKET && rights->cmsg_type == SCM_RIGHTS) {
+            size_t count = (rights->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            size_t first = fds->size();
+            fds->resize(first + count);
+            memcpy(&(*fds)[first], CMSG_DATA(rights), count * sizeof(int));
+        }
+    }
+    return true;
+}
+
+//* Hold one key for 8 frames, release it for 8, walking through the keypad
+static uint16_t scriptedMask(uint64_t frame)
+{
+    return (frame / 8) % 2 == 0 ? 1 << (frame / 16) % 16 : 0;
+}
+
+static void runConnection(const LoadConfig &config, unsigned sessionCount, LoadStats &stats)
+{
+    int fd = connectServer(config.socketPath);
+    if (fd < 0) {
+        stats.errors++;
+        return;
+    }
+
+    std::vector<uint32_t> ids;
+    std::vector<SessionView *> views;
+    std::vector<ServerCommand> commands;
+    std::vector<ServerReply> replies;
+
+    //* Create and map, then load: uploaded ROMs go straight into the shared view
+    for (unsigned first = 0; first < sessionCount; first += SERVER_MAX_BATCH) {
+        unsigned count = std::min<unsigned>(SERVER_MAX_BATCH, sessionCount - first);
+        std::vector<int> fds;
+
+        commands.assign(count, ServerCommand());
+        for (auto &command : commands) {
+            command.op = SERVER_CREATE;
+            command.count = config.cycles;
+        }
+        if (!call(fd, commands, replies, &fds)) {
+            stats.errors++;
+            break;
+        }
+
+        for (auto &reply : replies) {
+            if (reply.status != SERVER_OK || reply.value >= fds.size()) {
+                stats.errors++;
+                continue;
+            }
+            void *memory = mmap(nullptr, sizeof(SessionView), PROT_READ | PROT_WRITE, MAP_SHARED,
+                fds[reply.value], 0);
+            if (memory == MAP_FAILED) {
+                stats.errors++;
+                continue;
+            }
+            ids.push_back(reply.session);
+            views.push_back((SessionView *)memory);
+        }
+        for (int memfd : fds) {
+            close(memfd);
+        }
+    }
+
+    for (size_t first = 0; first < ids.size(); first += SERVER_MAX_BATCH) {
+        size_t count = std::min<size_t>(SERVER_MAX_BATCH, ids.size() - first);
+        commands.assign(count, ServerCommand());
+        for (size_t i = 0; i < count; i++) {
+            commands[i].op = SERVER_LOAD;
+            commands[i].session = ids[first + i];
+            commands[i].hash = config.hash;
+            if (!config.hash) {
+                memcpy(views[first + i]->rom, config.rom.data(), config.rom.size());
+                commands[i].count = config.rom.size();
+            }
+        }
+        if (!call(fd, commands, replies)) {
+            stats.errors++;
+            break;
+        }
+        for (auto &reply : replies) {
+            stats.errors += reply.status != SERVER_OK;
+        }
+    }
+
+    std::vector<uint64_t> frames(ids.size(), 0);
+    SessionFrame frame;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(config.seconds);
+
+    while (!ids.empty() && std::chrono::steady_clock::now() < deadline) {
+        for (size_t first = 0; first < ids.size(); first += config.batch) {
+            size_t count = std::min<size_t>(config.batch, ids.size() - first);
+
+            commands.assign(count * 2, ServerCommand());
+            for (size_t i = 0; i < count; i++) {
+                commands[2 * i].op = SERVER_SET_KEYS;
+                commands[2 * i].session = ids[first + i];
+                commands[2 * i].keys = scriptedMask(frames[first + i]);
+                commands[2 * i + 1].op = SERVER_STEP;
+                commands[2 * i + 1].session = ids[first + i];
+                commands[2 * i + 1].count = config.frames;
+            }
+
+            auto begin = std::chrono::steady_clock::now();
+            if (!call(fd, commands, replies)) {
+                stats.errors++;
+                ids.clear();
+                break;
+            }
+            std::chrono::duration<double> latency = std::chrono::steady_clock::now() - begin;
+            stats.latencies.push_back(latency.count());
+            stats.requests++;
+            stats.commands += commands.size();
+
+            //* Zero-copy: the screen and registers of the step are already in the view
+            for (size_t i = 0; i < count; i++) {
+                const ServerReply &reply = replies[2 * i + 1];
+                if (reply.status != SERVER_OK) {
+                    stats.errors++;
+                    continue;
+                }
+                frames[first + i] += config.frames;
+                stats.frames += config.frames;
+                stats.instructions += reply.value;
+
+                readSessionView(views[first + i], frame);
+                stats.viewMismatches += frame.frames != frames[first + i];
+            }
+        }
+    }
+
+    commands.clear();
+    for (uint32_t id : ids) {
+        ServerCommand command = {};
+        command.op = SERVER_DESTROY;
+        command.session = id;
+        commands.push_back(command);
+        if (commands.size() == SERVER_MAX_BATCH) {
+            call(fd, commands, replies);
+            commands.clear();
+        }
+    }
+    if (!commands.empty()) {
+        call(fd, commands, replies);
+    }
+
+    for (SessionView *view : views) {
+        munmap(view, sizeof(SessionView));
+    }
+    close(fd);
+}
+
+//* One command on its own, SERVER_BAD_OP standing for a lost connection
+static ServerReply callOne(int fd, const ServerCommand &command, std::vector<int> *fds = nullptr)
+{
+    std::vector<ServerCommand> commands(1, command);
+    std::vector<ServerReply> replies;
+
+    if (!call(fd, commands, replies, fds)) {
+        return { SERVER_BAD_OP, command.session, 0 };
+    }
+    return replies[0];
+}
+
+static bool expect(const char *name, const ServerReply &reply, int32_t status)
+{
+    bool pass = reply.status == status;
+    printf("%s  %-28s status %d, expected %d\n", pass ? "PASS" : "FAIL", name, reply.status, status);
+    return pass;
+}
+
+//* --check: what a client may send that the server must refuse or survive. Runs
+//* against a live server like any other client.
+static int check(const LoadConfig &config)
+{
+    int fd = connectServer(config.socketPath);
+    if (fd < 0) {
+        return 1;
+    }
+
+    bool pass = true;
+    ServerCommand command = {};
+    std::vector<int> fds;
+
+    command.op = SERVER_CREATE;
+    command.count = SERVER_MAX_CYCLES + 1;
+    pass &= expect("create-too-many-cycles", callOne(fd, command, &fds), SERVER_BAD_OP);
+
+    command.count = 10;
+    ServerReply created = callOne(fd, command, &fds);
+    SessionView *view = nullptr;
+    if (created.status == SERVER_OK && created.value < fds.size()) {
+        void *memory = mmap(nullptr, sizeof(SessionView), PROT_READ | PROT_WRITE, MAP_SHARED, fds[created.value], 0);
+        view = memory == MAP_FAILED ? nullptr : (SessionView *)memory;
+    }
+    for (int memfd : fds) {
+        close(memfd);
+    }
+    if (!view) {
+        printf("FAIL  %-28s no session\n", "create");
+        close(fd);
+        return 1;
+    }
+
+    //* 2F8: ADD V0, 1; SE V0, 255; CALL 2F8; JP 000: 255 levels deep, then off
+    //* into the font with 255 return addresses on a 16-entry stack
+    static const uint8_t overflow[] = { 0x12, 0xF8 };
+    static const uint8_t body[] = { 0x70, 0x01, 0x30, 0xFF, 0x22, 0xF8, 0x10, 0x00 };
+    memset(view->rom, 0, 0x100);
+    memcpy(view->rom, overflow, sizeof(overflow));
+    memcpy(view->rom + 0xF8, body, sizeof(body));
+
+    command = {};
+    command.session = created.session;
+    command.op = SERVER_LOAD;
+    command.count = 0x100;
+    pass &= expect("load", callOne(fd, command), SERVER_OK);
+
+    //* Fresh from the load, valid; then one field out of range at a time
+    command.count = 0;
+    command.op = SERVER_SNAPSHOT;
+    pass &= expect("snapshot", callOne(fd, command), SERVER_OK);
+    SaveState good = view->snapshot;
+
+    command.op = SERVER_RESTORE;
+    view->snapshot.keyWaitState = KEY_WAIT_RELEASE + 1;
+    pass &= expect("restore-bad-key-wait", callOne(fd, command), SERVER_BAD_STATE);
+    view->snapshot = good;
+    view->snapshot.keyWaitKey = 0x10;
+    pass &= expect("restore-bad-key", callOne(fd, command), SERVER_BAD_STATE);
+    view->snapshot = good;
+    view->snapshot.version++;
+    pass &= expect("restore-bad-version", callOne(fd, command), SERVER_BAD_STATE);
+    view->snapshot = good;
+    pass &= expect("restore", callOne(fd, command), SERVER_OK);
+
+    command.op = SERVER_STEP;
+    command.count = SERVER_MAX_FRAMES + 1;
+    pass &= expect("step-too-many-frames", callOne(fd, command), SERVER_BAD_OP);
+    command.count = SERVER_MAX_FRAMES;
+    pass &= expect("step-stack-overflow", callOne(fd, command), SERVER_OK);
+    command.count = 1;
+    pass &= expect("step-after-overflow", callOne(fd, command), SERVER_OK);
+
+    //* sp is past 16 now: the session's own snapshot must still restore, to the same machine
+    command.op = SERVER_SNAPSHOT;
+    pass &= expect("snapshot-after-overflow", callOne(fd, command), SERVER_OK);
+    SaveState deep = view->snapshot;
+    command.op = SERVER_STEP;
+    pass &= expect("step-away", callOne(fd, command), SERVER_OK);
+    command.op = SERVER_RESTORE;
+    pass &= expect("restore-after-overflow", callOne(fd, command), SERVER_OK);
+
+    SessionFrame frame;
+    readSessionView(view, frame);
+    bool same = deep.sp > 16 && frame.registers.sp == deep.sp && frame.registers.pc == deep.pc
+        && !memcmp(frame.registers.stack, deep.stack, sizeof(deep.stack));
+    printf("%s  %-28s sp %u, pc %03X\n", same ? "PASS" : "FAIL", "round-trip-after-overflow",
+        frame.registers.sp, frame.registers.pc);
+    pass &= same;
+
+    command.op = SERVER_DESTROY;
+    pass &= expect("destroy", callOne(fd, command), SERVER_OK);
+
+    //* Three full steps at the most cycles per frame: each is allowed, the request isn't
+    command = {};
+    command.op = SERVER_CREATE;
+    command.count = SERVER_MAX_CYCLES;
+    fds.clear();
+    ServerReply busy = callOne(fd, command, &fds);
+    for (int memfd : fds) {
+        close(memfd);
+    }
+    pass &= expect("create-most-cycles", busy, SERVER_OK);
+
+    std::vector<ServerCommand> steps(3, ServerCommand());
+    std::vector<ServerReply> replies;
+    for (auto &step : steps) {
+        step.op = SERVER_STEP;
+        step.session = busy.session;
+        step.count = SERVER_MAX_FRAMES;
+    }
+    bool refused = call(fd, steps, replies);
+    for (auto &reply : replies) {
+        refused = refused && reply.status == SERVER_OVER_BUDGET && reply.value == 0;
+    }
+    printf("%s  %-28s %u x %u instructions\n", refused ? "PASS" : "FAIL", "request-over-budget",
+        (unsigned)steps.size(), SERVER_MAX_FRAMES * SERVER_MAX_CYCLES);
+    pass &= refused;
+
+    steps.pop_back();
+    bool allowed = call(fd, steps, replies);
+    for (auto &reply : replies) {
+        allowed = allowed && reply.status == SERVER_OK;
+    }
+    printf("%s  %-28s %u x %u instructions\n", allowed ? "PASS" : "FAIL", "request-within-budget",
+        (unsigned)steps.size(), SERVER_MAX_FRAMES * SERVER_MAX_CYCLES);
+    pass &= allowed;
+
+    command.op = SERVER_DESTROY;
+    command.session = busy.session;
+    command.count = 0;
+    pass &= expect("destroy-busy", callOne(fd, command), SERVER_OK);
+
+    munmap(view, sizeof(SessionView));
+    close(fd);
+    return pass ? 0 : 1;
+}
+
+static double percentile(std::vector<double> &values, double p)
+{
+    if (values.empty()) {
+        return 0;
+    }
+    size_t index = std::min(values.size() - 1, (size_t)(p * values.size()));
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+static bool readFile(const char *path, std::vector<uint8_t> &data)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        fprintf(stderr, "Fail to load the file: %s\n", path);
+        return false;
+    }
+
+    uint8_t buffer[MAX_ROM_SIZE + 1];
+    size_t size = fread(buffer, 1, sizeof(buffer), file);
+    fclose(file);
+
+    if (size > MAX_ROM_SIZE) {
+        fprintf(stderr, "ROM does not fit in memory: %s\n", path);
+        return false;
+    }
+    data.assign(buffer, buffer + size);
+    return true;
+}
+
+static void usage(const char *program)
+{
+    fprintf(stderr,
+        "Usage: %s [options] <rom file> | --hash <ROM hash>\n"
+        "       %s --check [--socket <path>]\n"
+        "  Protocol checks: out-of-range counts and save states are refused, a ROM overflowing\n"
+        "  its stack leaves the server running\n"
+        "  --socket <path>  Server socket (default " SERVER_SOCKET ")\n"
+        "  --hash <hex>     Load a ROM of the server's catalog instead of uploading one\n"
+        "  -n <sessions>    Sessions, spread over the connections (default 64)\n"
+        "  -b <batch>       Sessions per request, each a SET_KEYS and a STEP (default 16, at most %d)\n"
+        "  -f <frames>      Frames per STEP (default 1, at most %d)\n"
+        "  -c <cycles>      Instructions per frame (default 10, at most %d)\n"
+        "                   batch x frames x cycles is at most %d, the server's budget per request\n"
+        "  -j <connections> Client connections, one thread each (default 1)\n"
+        "  -d <seconds>     Duration (default 5)\n"
+        "  --json           Machine-readable output\n",
+        program, program, SERVER_MAX_BATCH / 2, SERVER_MAX_FRAMES, SERVER_MAX_CYCLES,
+        SERVER_MAX_REQUEST_WORK);
+}
+
+int main(int argc, char **argv)
+{
+    LoadConfig config;
+    const char *romPath = nullptr;
+    bool json = false;
+    bool runCheck = false;
+
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+
+        if (!strcmp(argv[i], "--socket") && hasValue) {
+            config.socketPath = argv[++i];
+        } else if (!strcmp(argv[i], "--hash") && hasValue) {
+            config.hash = strtoull(argv[++i], NULL, 16);
+        } else if (!strcmp(argv[i], "-n") && hasValue) {
+            config.sessions = strtoul(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "-b") && hasValue) {
+            config.batch = strtoul(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "-f") && hasValue) {
+            config.frames = strtoul(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "-c") && hasValue) {
+            config.cycles = strtoul(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "-j") && hasValue) {
+            config.connections = strtoul(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "-d") && hasValue) {
+            config.seconds = strtod(argv[++i], NULL);
+        } else if (!strcmp(argv[i], "--json")) {
+            json = true;
+        } else if (!strcmp(argv[i], "--check")) {
+            runCheck = true;
+        } else if (argv[i][0] == '-' || romPath) {
+            usage(argv[0]);
+            return 1;
+        } else {
+            romPath = argv[i];
+        }
+    }
+
+    if (runCheck) {
+        return check(config);
+    }
+    if ((!romPath == !config.hash) || config.batch == 0 || config.batch > SERVER_MAX_BATCH / 2
+        || config.connections == 0 || config.sessions < config.connections
+        || config.frames > SERVER_MAX_FRAMES || config.cycles > SERVER_MAX_CYCLES
+        || (uint64_t)config.batch * config.frames * config.cycles > SERVER_MAX_REQUEST_WORK) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (romPath && !readFile(romPath, config.rom)) {
+        return 1;
+    }
+
+    std::vector<LoadStats> perConnection(config.connections);
+    std::vector<std::thread> threads;
+    auto start = std::chrono::steady_clock::now();
+
+    for (unsigned c = 0; c < config.connections; c++) {
+        unsigned count = config.sessions / config.connections + (c < config.sessions % config.connections);
+        threads.emplace_back(runConnection, std::cref(config), count, std::ref(perConnection[c]));
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    std::chrono::duration<double> wall = std::chrono::steady_clock::now() - start;
+    LoadStats total;
+    for (auto &stats : perConnection) {
+        total.requests += stats.requests;
+        total.commands += stats.commands;
+        total.frames += stats.frames;
+        total.instructions += stats.instructions;
+        total.viewMismatches += stats.viewMismatches;
+        total.errors += stats.errors;
+        total.latencies.insert(total.latencies.end(), stats.latencies.begin(), stats.latencies.end());
+    }
+
+    double seconds = wall.count();
+    double p50 = percentile(total.latencies, 0.50);
+    double p99 = percentile(total.latencies, 0.99);
+    double max = total.latencies.empty() ? 0 : *std::max_element(total.latencies.begin(), total.latencies.end());
+
+    if (json) {
+        printf("{\n");
+        printf("  \"sessions\": %u,\n", config.sessions);
+        printf("  \"batch\": %u,\n", config.batch);
+        printf("  \"frames_per_step\": %u,\n", config.frames);
+        printf("  \"cycles_per_frame\": %u,\n", config.cycles);
+        printf("  \"connections\": %u,\n", config.connections);
+        printf("  \"wall_seconds\": %.6f,\n", seconds);
+        printf("  \"requests_per_second\": %.0f,\n", total.requests / seconds);
+        printf("  \"commands_per_second\": %.0f,\n", total.commands / seconds);
+        printf("  \"frames_per_second\": %.0f,\n", total.frames / seconds);
+        printf("  \"instructions_per_second\": %.0f,\n", total.instructions / seconds);
+        printf("  \"step_latency_p50_seconds\": %.9f,\n", p50);
+        printf("  \"step_latency_p99_seconds\": %.9f,\n", p99);
+        printf("  \"step_latency_max_seconds\": %.9f,\n", max);
+        printf("  \"view_mismatches\": %llu,\n", (unsigned long long)total.viewMismatches);
+        printf("  \"errors\": %llu\n", (unsigned long long)total.errors);
+        printf("}\n");
+    } else {
+        printf("Sessions     : %u over %u connection%s, %u per request, %u frame%s per step (%u cycles/frame)\n",
+            config.sessions, config.connections, config.connections > 1 ? "s" : "", config.batch,
+            config.frames, config.frames > 1 ? "s" : "", config.cycles);
+        printf("Requests     : %.0f /s (%.0f commands/s)\n", total.requests / seconds, total.commands / seconds);
+        printf("Frames       : %.0f /s (%.2f M instructions/s)\n", total.frames / seconds,
+            total.instructions / seconds / 1e6);
+        printf("Step latency : p50 %.1f us, p99 %.1f us, max %.1f us\n", p50 * 1e6, p99 * 1e6, max * 1e6);
+        printf("Views        : %s, %llu errors\n",
+            total.viewMismatches ? "MISMATCH" : "every step visible on reply",
+            (unsigned long long)total.errors);
+    }
+
+    return total.errors || total.viewMismatches ? 1 : 0;
+}
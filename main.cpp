@@ -1,36 +1,177 @@
+#include "Audio.h"
 #include "Chip8.h"
-#include <unistd.h>
+#include "Display.h"
+#include "EmulationThread.h"
+#include "Input.h"
+#include "Recorder.h"
+#include "RomCatalog.h"
+#include "Scheduler.h"
+#include "TripleBuffer.h"
 #include "SDL2/SDL.h"
-#include <chrono>   // sleep in microseconds
-#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cinttypes>
+#include <memory>
+#include <random>
+#include <string>
+#include <sys/stat.h>
 
-#define SCREEN_SIZE 2048 // (64 * 32)
+//* Expand the dirty rows straight into the streaming texture, one lock per run of
+//* consecutive rows. Returns the bytes written.
+static size_t uploadRows(SDL_Texture *texture, const uint64_t *rows, uint32_t dirty)
+{
+    size_t bytes = 0;
+    int y = 0;
+
+    while (y < SCREEN_HEIGHT) {
+        if (!(dirty >> y & 1)) {
+            y++;
+            continue;
+        }
+
+        int first = y;
+        while (y < SCREEN_HEIGHT && (dirty >> y & 1)) {
+            y++;
+        }
+
+        SDL_Rect rect = { 0, first, SCREEN_WIDTH, y - first };
+        void *pixels;
+        int pitch;
+
+        if (SDL_LockTexture(texture, &rect, &pixels, &pitch) == 0) {
+            expandRows(rows + first, y - first, pixels, pitch);
+            SDL_UnlockTexture(texture);
+            bytes += rect.h * SCREEN_WIDTH * sizeof(Uint32);
+        }
+    }
+
+    return bytes;
+}
+
+//* SDL audio thread: no locks, no allocations, only the buzzer's own state
+static void audioCallback(void *userdata, Uint8 *stream, int len)
+{
+    static_cast<Buzzer *>(userdata)->render(reinterpret_cast<int16_t *>(stream), len / sizeof(int16_t));
+}
+
+static int32_t keyFromName(const char *name)
+{
+    return SDL_GetKeyFromName(name);
+}
+
+//* The catalog the frontend switches through: the directory given, or the one the
+//* ROM given is in. `start` is the ROM to begin with, empty for the first one.
+static bool openCatalog(RomCatalog &catalog, const std::string &path, std::string &start)
+{
+    struct stat info;
+
+    if (stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode)) {
+        return catalog.open(path);
+    }
+
+    size_t slash = path.rfind('/');
+    start = slash == std::string::npos ? path : path.substr(slash + 1);
+    return catalog.open(slash == std::string::npos ? "." : path.substr(0, slash));
+}
 
-int main()
+int main(int argc, char **argv)
 {
     Chip8 chip8 = Chip8();
+    std::string romPath = "roms/TETRIS";
+    unsigned cyclesPerFrame = 10;
+    bool turbo = false;
+    unsigned frameSkip = 16;
+    //* A fresh seed per session unless one is given, printed so the session can be replayed
+    uint64_t seed = ((uint64_t)std::random_device()() << 32) | std::random_device()();
+    bool vsync = false;
+    bool fixedCadence = false;
+    bool mute = false;
+    std::string recordPath;
+    KeyMap keymap;
+    QuirkProfile defaultQuirks = QUIRKS_LEGACY;
+    QuirkDatabase quirksDb;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-c") && i + 1 < argc) {
+            cyclesPerFrame = strtoul(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "--turbo")) {
+            turbo = true;
+        } else if (!strcmp(argv[i], "--skip") && i + 1 < argc) {
+            frameSkip = strtoul(argv[++i], NULL, 10);
+            if (frameSkip == 0) {
+                frameSkip = 1;
+            }
+        } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+            seed = strtoull(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "--vsync")) {
+            vsync = true;
+        } else if (!strcmp(argv[i], "--fixed-cadence")) {
+            fixedCadence = true;
+        } else if (!strcmp(argv[i], "--mute")) {
+            mute = true;
+        } else if (!strcmp(argv[i], "--record") && i + 1 < argc) {
+            recordPath = argv[++i];
+        } else if (!strcmp(argv[i], "--keymap") && i + 1 < argc) {
+            if (!keymap.load(argv[++i], keyFromName)) {
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "--quirks-db") && i + 1 < argc) {
+            if (!quirksDb.load(argv[++i])) {
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "--quirks") && i + 1 < argc) {
+            if (!parseQuirkProfile(argv[++i], defaultQuirks)) {
+                fprintf(stderr, "Unknown quirk profile: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr,
+                "Usage: %s [-c <instructions per frame>] [--turbo] [--skip <frames>] [--seed <n>] [--vsync]\n"
+                "          [--fixed-cadence] [--mute] [--record <file>] [--keymap <file>] [--quirks <profile>]\n"
+                "          [--quirks-db <file>] [rom or directory]\n"
+                "  Every ROM next to the one given (or in the directory given) is mapped at start,\n"
+                "  Page Down / Page Up switch to the next / previous one\n"
+                "  --turbo          Start uncapped (Tab toggles it at runtime)\n"
+                "  --skip <frames>  In turbo, render once every that many frames (default 16)\n"
+                "  --seed <n>       Seed of the Cxkk generator, the same seed and input replay the same game\n"
+                "  --vsync          Present at every display refresh: no tearing, up to a refresh more input latency\n"
+                "  --fixed-cadence  Keep every frame on its deadline, a key press no longer starts the next one early\n"
+                "  --mute           No sound device, the buzzer stays silent\n"
+                "  --record <file>  Record every frame and the keypad, decode with chip8-rec\n"
+                "  --keymap <file>  Lines of `<chip8 key 0-F> <SDL key name>`, e.g. `5 W` or `0 Space`\n"
+                "  --quirks <profile> Opcode behavior: legacy (default), chip8, schip-quirks or xochip-quirks\n"
+                "  --quirks-db <file> Per-ROM profiles, lines of `<ROM hash> <profile>`, others get --quirks\n",
+                argv[0]);
+            return 1;
+        } else {
+            romPath = argv[i];
+        }
+    }
 
-    // Keypad keymap
-    uint8_t keymap[16] = {
-        SDLK_x,
-        SDLK_1,
-        SDLK_2,
-        SDLK_3,
-        SDLK_q,
-        SDLK_w,
-        SDLK_e,
-        SDLK_a,
-        SDLK_s,
-        SDLK_d,
-        SDLK_z,
-        SDLK_c,
-        SDLK_4,
-        SDLK_r,
-        SDLK_f,
-        SDLK_v,
-    };
-
-    if (chip8.load("roms/TETRIS")) {
+    chip8.seedRandom(seed);
+    printf("Seed: 0x%016" PRIx64 "\n", seed);
+
+    RomCatalog catalog;
+    std::string startName;
+    if (!openCatalog(catalog, romPath, startName)) {
+        return 1;
+    }
+
+    const RomEntry *rom = startName.empty() ? &catalog[0] : catalog.find(startName);
+    if (!rom) {
+        fprintf(stderr, "Fail to load the file: %s\n", romPath.c_str());
+        return 1;
+    }
+
+    printf("Catalog: %zu ROMs\n", catalog.size());
+    chip8.setQuirks(quirksDb.lookup(rom->hash, defaultQuirks));
+    printf("Load: %s (%zu bytes, hash %016" PRIx64 ", quirks %s)\n", rom->path.c_str(), rom->size, rom->hash,
+        quirkProfileName(chip8.getQuirks()));
+
+    if (chip8.load(rom->data, rom->size)) {
 
         int width = 1024;
         int height = 512;
@@ -57,8 +198,9 @@ int main()
             fprintf(stderr, "Could not create window: SDL_Error: %s\n", SDL_GetError());
         }
 
-        // Create renderer
-        SDL_Renderer *renderer = SDL_CreateRenderer(window, -1, 0);
+        // Create renderer. Without vsync a new frame is presented as soon as it is
+        // published, with it presents wait for the refresh (on this thread only).
+        SDL_Renderer *renderer = SDL_CreateRenderer(window, -1, vsync ? SDL_RENDERER_PRESENTVSYNC : 0);
         SDL_RenderSetLogicalSize(renderer, width, height);
 
         // Create texture that stores frame buffer
@@ -69,64 +211,208 @@ int main()
             64, 32
         );
 
-        //* Temporary pixels buffer
-        uint32_t pixels[SCREEN_SIZE];
-
-        while (true) {
-            chip8.emulateCycle();
-
-            if (chip8.updateScreen) {
-                chip8.updateScreen = false;
-
-                // Process SDL events
-                SDL_Event e;
-                while (SDL_PollEvent(&e)) {
-                    switch (e.type) {
-                        case SDL_QUIT:
-                            exit(0);
-                            break;
-                        case SDL_KEYDOWN: {
-                            if (e.key.keysym.sym == SDLK_ESCAPE) {
-                                exit(0);
-                            }
-
-                            //* Check if user pressed a key that in the keymap 
-                            for (int i = 0; i < 16; i++) {
-                                if (e.key.keysym.sym == keymap[i]) {
-                                    chip8.key[i] = 1;
-                                }
-                            }
-                            break;
+        FrameScheduler scheduler(cyclesPerFrame);
+        scheduler.setTurbo(turbo);
+        TripleBuffer frames;
+        KeyInput input;
+        EmulationThread emulation(chip8, scheduler, frames, input, frameSkip);
+        emulation.setEarlyInput(!fixedCadence);
+
+        //* Captured on the emulation thread, encoded and written on the recorder's own
+        FILE *recordFile = NULL;
+        std::unique_ptr<FrameRecorder> recorder;
+        if (!recordPath.empty()) {
+            recordFile = fopen(recordPath.c_str(), "wb");
+            if (recordFile) {
+                recorder.reset(new FrameRecorder(recordFile));
+                emulation.setRecorder(recorder.get());
+            } else {
+                fprintf(stderr, "Fail to create the recording: %s\n", recordPath.c_str());
+            }
+        }
+
+        //* The emulation thread pushes one buzzer gate per emulated frame, the
+        //* callback turns each into exactly that frame's samples
+        AudioGate audioGate;
+        Buzzer buzzer(audioGate);
+        SDL_AudioDeviceID audioDevice = 0;
+        if (!mute) {
+            SDL_AudioSpec want;
+            memset(&want, 0, sizeof(want));
+            want.freq = AUDIO_RATE;
+            want.format = AUDIO_S16SYS;
+            want.channels = 1;
+            want.samples = 512;
+            want.callback = audioCallback;
+            want.userdata = &buzzer;
+
+            audioDevice = SDL_OpenAudioDevice(NULL, 0, &want, NULL, 0);
+            if (audioDevice) {
+                emulation.setAudio(&audioGate);
+                SDL_PauseAudioDevice(audioDevice, 0);
+            } else {
+                fprintf(stderr, "No sound, SDL Error: %s\n", SDL_GetError());
+            }
+        }
+
+        //* A published frame wakes this thread out of SDL_WaitEventTimeout, one
+        //* wake-up event in the queue at a time
+        Uint32 frameEvent = SDL_RegisterEvents(1);
+        std::atomic<bool> wakePending{false};
+        emulation.onPublish([&] {
+            if (!wakePending.exchange(true, std::memory_order_relaxed)) {
+                SDL_Event wake;
+                memset(&wake, 0, sizeof(wake));
+                wake.type = frameEvent;
+                SDL_PushEvent(&wake);
+            }
+        });
+        emulation.start();
+
+        //* The ROM is already in memory: a switch is a reset and a memcpy between two frames
+        auto switchRom = [&](size_t index) {
+            rom = &catalog[index % catalog.size()];
+            emulation.stop();
+            chip8.reset();
+            chip8.load(rom->data, rom->size);
+            chip8.setQuirks(quirksDb.lookup(rom->hash, defaultQuirks));
+            emulation.start();
+            printf("Load: %s (%zu bytes, hash %016" PRIx64 ", quirks %s)\n", rom->path.c_str(), rom->size, rom->hash,
+                quirkProfileName(chip8.getQuirks()));
+        };
+
+        DisplayStats stats;
+        LatencyHistogram latency;
+        uint64_t droppedBefore = 0;
+        uint64_t duplicatedBefore = 0;
+        auto statsStart = std::chrono::steady_clock::now();
+        bool running = true;
+
+        while (running) {
+            //* Input is read on its own cadence: this thread sleeps until an event
+            //* arrives, never inside a present it doesn't need
+            SDL_Event e;
+            bool event = vsync ? SDL_PollEvent(&e) : SDL_WaitEventTimeout(&e, 100);
+
+            while (event) {
+                switch (e.type) {
+                    case SDL_QUIT:
+                        running = false;
+                        break;
+                    case SDL_KEYDOWN:
+                    case SDL_KEYUP: {
+                        bool down = e.type == SDL_KEYDOWN;
+
+                        if (down && e.key.keysym.sym == SDLK_ESCAPE) {
+                            running = false;
+                        }
+                        if (down && e.key.keysym.sym == SDLK_TAB && !e.key.repeat) {
+                            emulation.setTurbo(!emulation.turbo());
+                        }
+                        if (down && e.key.keysym.sym == SDLK_PAGEDOWN) {
+                            switchRom(catalog.indexOf(*rom) + 1);
+                        }
+                        if (down && e.key.keysym.sym == SDLK_PAGEUP) {
+                            switchRom(catalog.indexOf(*rom) + catalog.size() - 1);
                         }
 
-                        case SDL_KEYUP: {
-                            for (int i = 0; i < 16; i++) {
-                                if (e.key.keysym.sym == keymap[i]) {
-                                    chip8.key[i] = 0;
-                                }
-                            }
-                            break;
+                        int key = keymap.lookup(e.key.keysym.sym);
+                        if (key >= 0 && !e.key.repeat) {
+                            input.post({ inputClock(), (uint8_t)key, down });
                         }
+                        break;
                     }
+                    default:
+                        if (e.type == frameEvent) {
+                            wakePending.store(false, std::memory_order_relaxed);
+                        }
+                        break;
                 }
+                event = SDL_PollEvent(&e);
+            }
 
-                // Store pixels in temporary buffer
-                for (int i = 0; i < SCREEN_SIZE; ++i) {
-                    uint8_t pixel = chip8.gfx[i];
-                    pixels[i] = (0x00FFFFFF * (pixel)) | 0xFF000000;
-                }
+            //* With vsync every refresh presents, a refresh without a new frame shows the last one again
+            if (!vsync && !frames.fresh()) {
+                continue;
+            }
+
+            const Frame *frame = frames.acquire();
+            if (frame && frame->dirty) {
+                // Update SDL texture, only the rows that changed
+                stats.bytesUploaded += uploadRows(sdlTexture, frame->rows, frame->dirty);
+            }
+
+            SDL_RenderClear(renderer);
+            SDL_RenderCopy(renderer, sdlTexture, NULL, NULL);
+            SDL_RenderPresent(renderer);
+            stats.presents++;
+
+            if (frame && frame->inputTime) {
+                latency.add((inputClock() - frame->inputTime) / 1e9);
+            }
+            if (!frame) {
+                //* In case the driver ignores vsync, don't spin on presents that return at once
+                SDL_Delay(1);
+            }
 
-                // Update SDL texture
-                SDL_UpdateTexture(sdlTexture, NULL, pixels, 64 * sizeof(Uint32));
-                // Clear screen and render
-                SDL_RenderClear(renderer);
-                SDL_RenderCopy(renderer, sdlTexture, NULL, NULL);
-                SDL_RenderPresent(renderer);
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - statsStart;
+            if (elapsed.count() >= 1.0) {
+                const Frame &shown = frames.readFrame();
+                const SchedulerStats &timing = shown.timing;
+                uint64_t dropped = frames.framesDropped();
+                uint64_t duplicated = frames.framesDuplicated();
+                double seconds = elapsed.count();
+
+                char title[384];
+                snprintf(title, sizeof(title),
+                    "Chip-8 Emulator - %s%s - x%.1f speed, %.0f IPS, jitter %.2f/%.2f ms, %.0f%% emulating, %.0f%% sleeping, "
+                    "%.0f presents/s, %.1f KB/s, %.0f dropped/s, %.0f duplicated/s, input p50/p99 %.1f/%.1f ms, "
+                    "%llu audio underruns",
+                    rom->name.c_str(),
+                    shown.turbo ? " [turbo]" : "",
+                    timing.speedMultiplier(),
+                    timing.instructionsPerSecond(),
+                    timing.meanJitter() * 1000, timing.jitterMax * 1000,
+                    timing.wallSeconds > 0 ? timing.emulateSeconds / timing.wallSeconds * 100 : 0,
+                    timing.wallSeconds > 0 ? timing.sleepSeconds / timing.wallSeconds * 100 : 0,
+                    stats.presents / seconds,
+                    stats.bytesUploaded / seconds / 1024,
+                    (dropped - droppedBefore) / seconds,
+                    (duplicated - duplicatedBefore) / seconds,
+                    latency.percentile(0.5) * 1000, latency.percentile(0.99) * 1000,
+                    (unsigned long long)buzzer.underrunCount());
+                SDL_SetWindowTitle(window, title);
+
+                stats = DisplayStats();
+                droppedBefore = dropped;
+                duplicatedBefore = duplicated;
+                statsStart = std::chrono::steady_clock::now();
             }
+        }
+
+        emulation.stop();
+        if (audioDevice) {
+            SDL_CloseAudioDevice(audioDevice);
+        }
+
+        if (recorder) {
+            uint64_t captured = recorder->framesCaptured();
+            uint64_t dropped = recorder->framesDropped();
+            recorder.reset();
+            printf("Recording: %llu frames (%llu dropped), %ld bytes in %s\n", (unsigned long long)captured,
+                (unsigned long long)dropped, ftell(recordFile), recordPath.c_str());
+            fclose(recordFile);
+        }
 
-            // Sleep to slow down emulation speed
-            // sleep(1);
-            std::this_thread::sleep_for(std::chrono::microseconds(10000));
+        if (latency.samples()) {
+            printf("Input to screen: p50 %.1f ms, p99 %.1f ms, max %.1f ms over %llu key events\n",
+                latency.percentile(0.5) * 1000, latency.percentile(0.99) * 1000, latency.maximum() * 1000,
+                (unsigned long long)latency.samples());
         }
+
+        SDL_DestroyTexture(sdlTexture);
+        SDL_DestroyRenderer(renderer);
+        SDL_DestroyWindow(window);
+        SDL_Quit();
     }
 }
\ No newline at end of file
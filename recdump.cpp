@@ -0,0 +1,253 @@
+#include "Recorder.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+//* Offline decoder for recordings (chip8-batch --record, chip8 --record):
+//* prints the input log, or exports the frames as PNG files or raw video
+
+static uint32_t crcTable[256];
+
+static void makeCrcTable()
+{
+    for (uint32_t n = 0; n < 256; n++) {
+        uint32_t c = n;
+        for (int k = 0; k < 8; k++) {
+            c = c & 1 ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+        }
+        crcTable[n] = c;
+    }
+}
+
+static uint32_t crc32(uint32_t crc, const uint8_t *data, size_t size)
+{
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++) {
+        crc = crcTable[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+static void put32(std::vector<uint8_t> &out, uint32_t value)
+{
+    out.push_back(value >> 24);
+    out.push_back(value >> 16);
+    out.push_back(value >> 8);
+    out.push_back(value);
+}
+
+static void writeChunk(FILE *file, const char *type, const std::vector<uint8_t> &data)
+{
+    std::vector<uint8_t> chunk;
+    put32(chunk, data.size());
+    chunk.insert(chunk.end(), type, type + 4);
+    chunk.insert(chunk.end(), data.begin(), data.end());
+    put32(chunk, crc32(0, &chunk[4], chunk.size() - 4));
+    fwrite(chunk.data(), 1, chunk.size(), file);
+}
+
+//* 1-bit grayscale PNG, the image data in stored (uncompressed) deflate blocks:
+//* no zlib needed, and a 64x32 frame is under 400 bytes anyway
+static bool writePng(const char *path, const uint8_t *pixels, unsigned width, unsigned height)
+{
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        fprintf(stderr, "Fail to create the file: %s\n", path);
+        return false;
+    }
+
+    static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    fwrite(signature, 1, sizeof(signature), file);
+
+    std::vector<uint8_t> ihdr;
+    put32(ihdr, width);
+    put32(ihdr, height);
+    ihdr.push_back(1);      // Bit depth
+    ihdr.push_back(0);      // Grayscale
+    ihdr.push_back(0);
+    ihdr.push_back(0);
+    ihdr.push_back(0);
+    writeChunk(file, "IHDR", ihdr);
+
+    //* Every row starts with filter type 0, white pixels are set bits
+    unsigned stride = (width + 7) / 8;
+    std::vector<uint8_t> raw;
+    for (unsigned y = 0; y < height; y++) {
+        raw.push_back(0);
+        for (unsigned b = 0; b < stride; b++) {
+            uint8_t byte = 0;
+            for (unsigned bit = 0; bit < 8 && b * 8 + bit < width; bit++) {
+                byte |= pixels[y * width + b * 8 + bit] << (7 - bit);
+            }
+            raw.push_back(byte);
+        }
+    }
+
+    std::vector<uint8_t> idat = { 0x78, 0x01 };
+    for (size_t pos = 0; pos < raw.size(); pos += 65535) {
+        size_t size = raw.size() - pos < 65535 ? raw.size() - pos : 65535;
+        idat.push_back(pos + size == raw.size());
+        idat.push_back(size);
+        idat.push_back(size >> 8);
+        idat.push_back(~size);
+        idat.push_back(~size >> 8);
+        idat.insert(idat.end(), raw.begin() + pos, raw.begin() + pos + size);
+    }
+    uint32_t a = 1, b = 0;
+    for (uint8_t byte : raw) {
+        a = (a + byte) % 65521;
+        b = (b + a) % 65521;
+    }
+    put32(idat, b << 16 | a);
+    writeChunk(file, "IDAT", idat);
+    writeChunk(file, "IEND", std::vector<uint8_t>());
+
+    bool ok = !ferror(file);
+    fclose(file);
+    return ok;
+}
+
+static void usage(const char *program)
+{
+    fprintf(stderr,
+        "Usage: %s [options] <recording>\n"
+        "  (no option)      Summary and the input log, one line per keypad change\n"
+        "  --png <prefix>   One PNG per frame, <prefix>000000.png, <prefix>000001.png, ...\n"
+        "  --raw <file>     Raw 8-bit gray video, for ffmpeg -f rawvideo -pix_fmt gray\n"
+        "                   -s <64*scale>x<32*scale> -r 60 -i <file>\n"
+        "  --scale <n>      Pixel size of the exports (default 1)\n",
+        program);
+}
+
+int main(int argc, char **argv)
+{
+    const char *pngPrefix = nullptr;
+    const char *rawPath = nullptr;
+    const char *path = nullptr;
+    unsigned scale = 1;
+
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+
+        if (!strcmp(argv[i], "--png") && hasValue) {
+            pngPrefix = argv[++i];
+        } else if (!strcmp(argv[i], "--raw") && hasValue) {
+            rawPath = argv[++i];
+        } else if (!strcmp(argv[i], "--scale") && hasValue) {
+            scale = strtoul(argv[++i], NULL, 10);
+        } else if (argv[i][0] == '-' || path) {
+            usage(argv[0]);
+            return 1;
+        } else {
+            path = argv[i];
+        }
+    }
+
+    if (!path || scale < 1 || scale > 64) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    RecordingReader reader;
+    if (!reader.open(path)) {
+        return 1;
+    }
+
+    FILE *raw = nullptr;
+    if (rawPath && !(raw = fopen(rawPath, "wb"))) {
+        fprintf(stderr, "Fail to create the file: %s\n", rawPath);
+        return 1;
+    }
+    makeCrcTable();
+
+    unsigned width = 64 * scale;
+    unsigned height = 32 * scale;
+    std::vector<uint8_t> held(width * height);     // Last frame, one byte per pixel
+    std::vector<uint8_t> gray(width * height);
+    bool logInput = !pngPrefix && !rawPath;
+    uint64_t exported = 0;
+
+    auto exportFrame = [&](const std::vector<uint8_t> &pixels) {
+        if (raw) {
+            for (size_t i = 0; i < pixels.size(); i++) {
+                gray[i] = pixels[i] ? 0xFF : 0;
+            }
+            if (fwrite(gray.data(), 1, gray.size(), raw) != gray.size()) {
+                fprintf(stderr, "Fail to write the file: %s\n", rawPath);
+                return false;
+            }
+        }
+        if (pngPrefix) {
+            char number[32];
+            snprintf(number, sizeof(number), "%06llu.png", (unsigned long long)exported);
+            if (!writePng((std::string(pngPrefix) + number).c_str(), pixels.data(), width, height)) {
+                return false;
+            }
+        }
+        exported++;
+        return true;
+    };
+
+    RecordedFrame frame;
+    uint64_t frames = 0, keyframes = 0;
+    uint64_t filled = 0;
+    int lastKeys = -1;
+    bool ok = true;
+
+    while (ok && reader.next(frame)) {
+        frames++;
+        keyframes += frame.keyframe;
+
+        if (logInput && frame.keys != lastKeys) {
+            printf("%8llu  keys", (unsigned long long)frame.index);
+            for (int k = 0; k < 16; k++) {
+                if (frame.keys >> k & 1) {
+                    printf(" %X", k);
+                }
+            }
+            printf("%s\n", frame.keys ? "" : " -");
+            lastKeys = frame.keys;
+        }
+
+        if (logInput) {
+            continue;
+        }
+
+        //* Lost frames are filled with the last frame seen, so exports keep 60 frames a second
+        if (exported) {
+            for (uint64_t i = 0; i < frame.lost && ok; i++) {
+                ok = exportFrame(held);
+            }
+        }
+        filled += frame.lost;
+
+        for (unsigned y = 0; y < height; y++) {
+            for (unsigned x = 0; x < width; x++) {
+                held[y * width + x] = frame.pixel(x / scale, y / scale);
+            }
+        }
+        ok = ok && exportFrame(held);
+    }
+
+    //* Frames lost at the very end
+    for (uint64_t i = filled; i < reader.framesLost() && exported && ok; i++) {
+        ok = exportFrame(held);
+    }
+
+    if (raw) {
+        fclose(raw);
+    }
+
+    fprintf(logInput ? stdout : stderr, "%llu frames (%llu keyframes, every %u), %llu lost in %llu gaps",
+        (unsigned long long)frames, (unsigned long long)keyframes, reader.keyframeInterval(),
+        (unsigned long long)reader.framesLost(), (unsigned long long)reader.gapCount());
+    if (!logInput) {
+        fprintf(stderr, ", %llu exported at %ux%u", (unsigned long long)exported, width, height);
+    }
+    fprintf(logInput ? stdout : stderr, "\n");
+
+    return ok ? 0 : 1;
+}
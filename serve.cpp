@@ -0,0 +1,86 @@
+#include "Server.h"
+#include "RomCatalog.h"
+
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+//* Headless emulator server: a pool of Chip8 sessions driven over a Unix socket
+//* (protocol in Server.h, load generator in loadgen.cpp)
+
+static std::atomic<bool> stopping{false};
+
+static void onSignal(int)
+{
+    stopping.store(true, std::memory_order_relaxed);
+}
+
+static void usage(const char *program)
+{
+    fprintf(stderr,
+        "Usage: %s [options] <rom or directory>\n"
+        "  The catalog SERVER_LOAD picks ROMs from by hash; clients can also upload their own\n"
+        "  --socket <path>  Listening socket (default " SERVER_SOCKET ")\n"
+        "  -t <threads>     Workers for the steps of one request, 0 = all cores (default 0)\n"
+        "  --sessions <n>   Most sessions alive at once (default 1024, at most 65535)\n",
+        program);
+}
+
+int main(int argc, char **argv)
+{
+    const char *socketPath = SERVER_SOCKET;
+    const char *romPath = nullptr;
+    unsigned threads = 0;
+    unsigned maxSessions = 1024;
+
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+
+        if (!strcmp(argv[i], "--socket") && hasValue) {
+            socketPath = argv[++i];
+        } else if (!strcmp(argv[i], "-t") && hasValue) {
+            threads = strtoul(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "--sessions") && hasValue) {
+            maxSessions = strtoul(argv[++i], NULL, 10);
+        } else if (argv[i][0] == '-' || romPath) {
+            usage(argv[0]);
+            return 1;
+        } else {
+            romPath = argv[i];
+        }
+    }
+
+    if (!romPath || maxSessions == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    RomCatalog catalog;
+    if (!catalog.open(romPath)) {
+        return 1;
+    }
+
+    EmulatorServer server(catalog, threads, maxSessions);
+    if (!server.listen(socketPath)) {
+        return 1;
+    }
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = onSignal;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+
+    printf("Serving %zu ROMs at %s\n", catalog.size(), socketPath);
+    for (size_t i = 0; i < catalog.size(); i++) {
+        printf("  %016llx  %s\n", (unsigned long long)catalog[i].hash, catalog[i].name.c_str());
+    }
+    fflush(stdout);
+
+    server.serve(stopping);
+
+    printf("%llu requests, %llu commands, %llu sessions left\n", (unsigned long long)server.requestCount(),
+        (unsigned long long)server.commandCount(), (unsigned long long)server.sessionCount());
+    return 0;
+}
@@ -0,0 +1,69 @@
+#include "Chip8.h"
+#include "Disasm.h"
+#include "Trace.h"
+
+#include <cstdio>
+#include <cstring>
+
+//* Offline decoder for the binary trace written by a CHIP8_TRACE build:
+//* prints the same disassembly the interpreter used to print on every cycle
+int main(int argc, char **argv)
+{
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s <trace file>\n", argv[0]);
+        return 1;
+    }
+
+    FILE *file = fopen(argv[1], "rb");
+    if (!file) {
+        fprintf(stderr, "Fail to open the trace: %s\n", argv[1]);
+        return 1;
+    }
+
+    TraceFileHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1
+        || header.magic != TRACE_MAGIC
+        || header.version != TRACE_VERSION
+        || header.recordSize != sizeof(TraceRecord)) {
+        fprintf(stderr, "Not a version %d trace file: %s\n", TRACE_VERSION, argv[1]);
+        fclose(file);
+        return 1;
+    }
+
+    uint16_t stack[16] = {0};
+    TraceRecord record;
+    char mnemonic[64];
+
+    while (fread(&record, sizeof(record), 1, file) == 1) {
+        if (record.type == TRACE_STACK) {
+            memcpy(&stack[record.pc & 8], record.V, sizeof(record.V));
+            continue;
+        }
+
+        //* The stack isn't in the record, replay the pushes
+        if (Chip8::decodeOpcode(record.opcode).op == OP_CALL) {
+            stack[(record.sp - 1) & 0xF] = record.pc;
+        }
+
+        disassemble(record.opcode, mnemonic, sizeof(mnemonic));
+        printf("%s\n", mnemonic);
+
+        printf("Opcode: 0x%.4X\n", record.opcode);
+        printf("Stack : ");
+        for (auto addr : stack) {
+            printf("0x%.4X ", addr);
+        }
+        putchar('\n');
+
+        printf("V : ");
+        for (auto v : record.V) {
+            printf("%d ", v);
+        }
+        putchar('\n');
+        printf("I : 0x%.4X\n", record.I);
+        putchar('\n');
+    }
+
+    fclose(file);
+    return 0;
+}